@@ -3,6 +3,7 @@
  */
 
 #include "shastina.h"
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -28,9 +29,16 @@
 #define ASCII_EQUALS    (0x3d)  /* = */
 #define ASCII_QUESTION  (0x3f)  /* ? */
 #define ASCII_ATSIGN    (0x40)  /* @ */
+#define ASCII_UPPER_A   (0x41)  /* A */
+#define ASCII_UPPER_F   (0x46)  /* F */
 #define ASCII_LSQR      (0x5b)  /* [ */
 #define ASCII_BACKSLASH (0x5c)  /* \ */
 #define ASCII_RSQR      (0x5d)  /* ] */
+#define ASCII_LOWER_A   (0x61)  /* a */
+#define ASCII_LOWER_F   (0x66)  /* f */
+#define ASCII_LOWER_N   (0x6e)  /* n */
+#define ASCII_LOWER_T   (0x74)  /* t */
+#define ASCII_LOWER_U   (0x75)  /* u */
 #define ASCII_LCURL     (0x7b)  /* { */
 #define ASCII_BAR       (0x7c)  /* | */
 #define ASCII_RCURL     (0x7d)  /* } */
@@ -125,6 +133,240 @@
 #define SNREADER_AGSTACK_INIT (8)
 #define SNREADER_AGSTACK_MAX (1024)
 
+/*
+ * The initial and maximum allocations of the reader's metacommand
+ * arena, in bytes, and of its metacommand argument stack, in longs.
+ * 
+ * These are only used for metacommands that have a registered handler.
+ * The arena holds the data of all the arguments, each followed by one
+ * byte for its terminating nul, and the stack holds two longs for each
+ * argument.
+ */
+#define SNREADER_META_INIT (64)
+#define SNREADER_META_MAX  (65535)
+#define SNREADER_METARG_INIT (16)
+#define SNREADER_METARG_MAX  (1024)
+
+/*
+ * The initial and maximum allocations of the reader's error list, in
+ * records.
+ * 
+ * The error list is only used in recovery mode.  Errors beyond
+ * SNREADER_ERRS_MAX are still counted, but their records are not kept.
+ */
+#define SNREADER_ERRS_INIT (16)
+#define SNREADER_ERRS_MAX  (1024)
+
+/*
+ * The ways the reader can resynchronize after an error in recovery
+ * mode.
+ * 
+ * FATAL errors can not be recovered from.  TOKEN errors skip input up
+ * to the next whitespace.  LINE errors skip input up to the next line
+ * feed.  DROP errors discard the token that caused them.  NONE errors
+ * need nothing further, because schema validation has already dropped
+ * the offending entity where necessary.
+ */
+#define SNREADER_SYNC_FATAL (0)
+#define SNREADER_SYNC_TOKEN (1)
+#define SNREADER_SYNC_LINE  (2)
+#define SNREADER_SYNC_DROP  (3)
+#define SNREADER_SYNC_NONE  (4)
+
+/*
+ * The kinds of structures on the open stack of a reader in recovery
+ * mode, and the initial and maximum allocations of that stack, in
+ * longs.
+ * 
+ * Each open structure takes three longs on the stack, so this limits
+ * how deeply groups and arrays can be nested in recovery mode.  Room
+ * for one more structure is kept beyond the limit, so that opening a
+ * metacommand never fails because of it.
+ */
+#define SNREADER_OPEN_GROUP (1)
+#define SNREADER_OPEN_ARRAY (2)
+#define SNREADER_OPEN_META  (3)
+
+#define SNREADER_OPEN_INIT (48)
+#define SNREADER_OPEN_MAX  (49152)
+
+/*
+ * The maximum number of string prefix decoders that can be registered
+ * with a reader.
+ */
+#define SNREADER_MAXDECODERS (16)
+
+/*
+ * The maximum number of metacommand handlers that can be registered
+ * with a reader.
+ */
+#define SNREADER_MAXMETAS (16)
+
+/*
+ * The ways the reader can handle the metacommand it is in.
+ * 
+ * PASS metacommands are returned as entities.  NAME is used after the
+ * % token of a metacommand when handlers are registered, until the
+ * name of the metacommand is known.  COLLECT metacommands have a
+ * registered handler and their arguments are being collected, while
+ * SKIP metacommands have no handler and are dropped.
+ */
+#define SNREADER_META_PASS    (0)
+#define SNREADER_META_NAME    (1)
+#define SNREADER_META_COLLECT (2)
+#define SNREADER_META_SKIP    (3)
+
+/*
+ * The name of the include metacommand, and the maximum depth of nested
+ * included files in a reader.
+ * 
+ * The depth limit also stops files that include themselves.
+ */
+#define SNREADER_INCLUDE "include"
+#define SNREADER_MAXINCLUDE (16)
+
+/*
+ * The status of the records in a fragment that stand for nested
+ * include metacommands.
+ * 
+ * This is distinct from all the SNENTITY_ constants.
+ */
+#define SNFRAG_INCLUDE (-1)
+
+/*
+ * The initial capacities of the records and the string arena of a
+ * fragment, and of the buffer that included files are read into.
+ * 
+ * Capacities double as needed.
+ */
+#define SNFRAG_INIT       (64)
+#define SNFRAG_ARENA_INIT (1024)
+#define SNFRAG_READ_INIT  (4096)
+
+/*
+ * The number of bytes of string data that are collected before they
+ * are passed to a string prefix decoder.
+ * 
+ * The value buffer never holds more than this many bytes of a string
+ * that is being decoded, so decoded strings are not limited by the
+ * maximum size of the value buffer.
+ */
+#define SNSTR_DECODE_CHUNK (4096)
+
+/*
+ * Lexical states of a document scanner.
+ * 
+ * SNSCAN_GAP is between tokens.  SNSCAN_BAR has just read a | that
+ * begins a token, which is the |; terminator if a semicolon follows.
+ * SNSCAN_TOKEN is inside any other token.  SNSCAN_COMMENT is inside a
+ * comment.  SNSCAN_QUOTED and SNSCAN_CURLY are inside the data of a
+ * quoted or curlied string.
+ */
+#define SNSCAN_GAP     (0)
+#define SNSCAN_BAR     (1)
+#define SNSCAN_TOKEN   (2)
+#define SNSCAN_COMMENT (3)
+#define SNSCAN_QUOTED  (4)
+#define SNSCAN_CURLY   (5)
+
+/*
+ * Special values in the binary-to-text decoding tables.
+ * 
+ * SNBLOB_BAD is for bytes that may not appear in the encoding,
+ * SNBLOB_SPACE is for whitespace that is skipped, and SNBLOB_PAD is for
+ * the base64 padding character.
+ */
+#define SNBLOB_BAD   (-1)
+#define SNBLOB_SPACE (-2)
+#define SNBLOB_PAD   (-3)
+
+/*
+ * The initial capacities of the columns and the string arena of a
+ * batch.
+ * 
+ * Capacities double as needed, and are kept when the batch is reused.
+ */
+#define SNBATCH_INIT       (64)
+#define SNBATCH_ARENA_INIT (1024)
+
+/*
+ * The initial number of slots in the hash table of a schema name set,
+ * and the initial capacities of the schema string arena and of the
+ * name lists.
+ * 
+ * Hash tables double whenever they become half full, and the other
+ * allocations double as needed.
+ */
+#define SNNAMES_SLOTS_INIT  (16)
+#define SNNAMES_INIT        (16)
+#define SNSCHEMA_ARENA_INIT (256)
+
+/*
+ * The numeric shapes a schema can allow, as bit flags.
+ */
+#define SNSHAPE_INTEGER  (1)
+#define SNSHAPE_DECIMAL  (2)
+#define SNSHAPE_EXPONENT (4)
+#define SNSHAPE_HEX      (8)
+
+/*
+ * The metacommands of a schema that are being compiled.
+ * 
+ * SNSCHEMA_DIR_NAME means a metacommand has just begun, so the next
+ * token names it.
+ */
+#define SNSCHEMA_DIR_NAME      (0)
+#define SNSCHEMA_DIR_SIGNATURE (1)
+#define SNSCHEMA_DIR_OPERATORS (2)
+#define SNSCHEMA_DIR_PREFIXES  (3)
+#define SNSCHEMA_DIR_NUMERIC   (4)
+
+/*
+ * Special values of the signature state of a reader.
+ * 
+ * SNSIG_START means no entity of the document has been validated yet,
+ * and SNSIG_DONE means the signature has been checked.  Values from
+ * one upwards mean the reader is in the first metacommand of the
+ * document and has matched one less than that many signature tokens.
+ */
+#define SNSIG_START (0)
+#define SNSIG_DONE  (-1)
+
+/*
+ * The dimensions of the numeric shape automaton, and its dead state.
+ * 
+ * See snnum_dfa.
+ */
+#define SNNUM_CLASSES (8)
+#define SNNUM_STATES  (12)
+#define SNNUM_DEAD    (11)
+
+/*
+ * The initial capacities of the arrays of a stack effect analyzer.
+ * 
+ * All arrays double as needed.
+ */
+#define SNANALYZER_FRAMES_INIT (16)
+#define SNANALYZER_GROUPS_INIT (256)
+#define SNANALYZER_ERRS_INIT   (16)
+
+/*
+ * The number of codepoints the input filter reads between each poll of
+ * the cancellation flag and the deadline callback.
+ * 
+ * Polling is cheap for the flag but may involve a system call for the
+ * deadline callback, so this should be large enough that the callback
+ * cost disappears in the per-codepoint cost of parsing, and small
+ * enough that a cancelled parse stops promptly.
+ */
+#define SNFILTER_POLL_INTERVAL (4096)
+
+/*
+ * The initial allocation, in longs, of the line-start index that
+ * sources with a memory view build on demand.
+ */
+#define SNSOURCE_LINES_INIT (64)
+
 /*
  * Structure for storing an input source.
  * 
@@ -251,6 +493,59 @@ struct SNSOURCE_TAG {
    * custom data is a FILE * correpsonding to stdin).
    */
   void *pCustom;
+  
+  /*
+   * Pointer to a memory view of the source data, or NULL if the source
+   * data is not directly accessible in memory.
+   * 
+   * If present, then the byte at offset N from this pointer is the
+   * (N + 1)th byte read through the source.  Only bytes that have
+   * already been read through the source are ever accessed through the
+   * view.
+   */
+  const unsigned char *pView;
+  
+  /*
+   * The line-start index, or NULL if it has not been allocated yet.
+   * 
+   * This is only used when pView is present.  Each element is the byte
+   * offset of the first byte following an LF character in the view,
+   * in ascending order.  The index is built lazily, only as far as the
+   * offsets that have been looked up.
+   */
+  long *pLines;
+  
+  /*
+   * The number of elements in the line-start index.
+   */
+  long lines_count;
+  
+  /*
+   * The allocated capacity of the line-start index in longs.
+   */
+  long lines_cap;
+  
+  /*
+   * The number of bytes at the start of the view that have already
+   * been scanned into the line-start index.
+   */
+  long lines_scanned;
+  
+  /*
+   * Non-zero if a parser counting lines lazily has read from the
+   * source.
+   * 
+   * Only then does snsource_scan() extend the line-start index ahead
+   * of lookups.
+   */
+  int lines_lazy;
+  
+  /*
+   * The next source in the free list of a pool, or NULL.
+   * 
+   * This is only used while the source is being kept by a pool.
+   */
+  SNSOURCE *pPoolNext;
 };
 
 /*
@@ -277,6 +572,107 @@ typedef struct {
   
 } SNSTRSRC;
 
+/*
+ * Structure used for memory reader source.
+ */
+typedef struct {
+  
+  /*
+   * The pointer to the start of the data.
+   */
+  const unsigned char *pData;
+  
+  /*
+   * The length of the data in bytes.
+   */
+  long len;
+  
+  /*
+   * The offset of the next byte to read.
+   */
+  long pos;
+  
+} SNMEMSRC;
+
+/*
+ * Structure used for concatenated sources.
+ */
+typedef struct {
+  
+  /*
+   * The array of part sources, which is a copy of the array given by
+   * the client.  The part sources themselves are owned by the client.
+   */
+  SNSOURCE **ppParts;
+  
+  /*
+   * The number of parts.
+   */
+  long count;
+  
+  /*
+   * The index of the part currently being read, which is equal to count
+   * once all parts have been read.
+   */
+  long cur;
+  
+  /*
+   * The number of bytes read through the concatenation.
+   */
+  long pos;
+  
+  /*
+   * The byte offset within the concatenation at which each part starts.
+   * 
+   * The array has (count + 1) elements, of which the first (cur + 1)
+   * are valid.  The element at index count is the total length, once
+   * all parts have been read.
+   */
+  long *pStart;
+  
+} SNCATSRC;
+
+/*
+ * Structure for accounting the memory used by a parser.
+ * 
+ * Use the snmem_ functions to manipulate this structure.
+ * 
+ * A single accounting structure is shared by all the buffers and
+ * stacks of a parser, so that the budget applies to the parser as a
+ * whole.
+ */
+typedef struct {
+  
+  /*
+   * The memory budget in bytes, or zero if there is no budget.
+   * 
+   * Growth that would take the current total above a non-zero budget
+   * is refused.
+   */
+  long budget;
+  
+  /*
+   * The number of bytes currently charged.
+   */
+  long current;
+  
+  /*
+   * The highest value that current has ever had.
+   */
+  long peak;
+  
+  /*
+   * The over-budget flag.
+   * 
+   * This is set to non-zero when growth was refused because of the
+   * budget.  It allows the capacity failures that result to be reported
+   * as SNERR_BUDGET rather than as a limit on the specific buffer or
+   * stack that failed to grow.
+   */
+  int over;
+  
+} SNMEMACCT;
+
 /*
  * Structure for storing state of Shastina numeric stacks.
  * 
@@ -320,6 +716,12 @@ typedef struct {
    */
   long maxcap;
   
+  /*
+   * The memory accounting structure that allocations are charged to,
+   * or NULL if allocations are not accounted.
+   */
+  SNMEMACCT *pAcct;
+  
 } SNSTACK;
 
 /*
@@ -380,6 +782,12 @@ typedef struct {
    */
   long maxcap;
   
+  /*
+   * The memory accounting structure that allocations are charged to,
+   * or NULL if allocations are not accounted.
+   */
+  SNMEMACCT *pAcct;
+  
 } SNBUFFER;
 
 /*
@@ -415,6 +823,40 @@ typedef struct {
    */
   long c;
   
+  /*
+   * The byte offset within the source of the first byte of the
+   * codepoint most recently read without error.
+   * 
+   * This field is only valid if line_count is greater than zero.
+   * 
+   * For codepoints that were formed from several encoded codepoints in
+   * input (CR+LF pairs and surrogate pairs), this is the offset of the
+   * first byte of the first encoded codepoint.
+   */
+  long offset;
+  
+  /*
+   * The byte offset within the source of the first byte of the line
+   * that the codepoint most recently read is on.
+   * 
+   * This field is only maintained when line counting is not lazy.
+   */
+  long line_start;
+  
+  /*
+   * The lazy line counting flag.
+   * 
+   * If zero, line_count is maintained as each codepoint is read.
+   * 
+   * If non-zero, line_count is only ever zero or one, indicating
+   * whether anything has been read yet.  Line numbers are instead
+   * computed on demand from byte offsets using the line-start index of
+   * the source.  This is only possible for sources that have a memory
+   * view, so the flag is cleared when the first codepoint is read from
+   * a source that has no memory view.
+   */
+  int lazy;
+  
   /*
    * The pushback flag.
    * 
@@ -428,98 +870,357 @@ typedef struct {
    */
   int pushback;
   
-} SNFILTER;
-
-/*
- * Structure for a token read from a Shastina source file.
- * 
- * This covers everything that can be found in a Shastina source file.
- */
-typedef struct {
-  
   /*
-   * The status of a token structure.
+   * The number of codepoints remaining to be read before the next poll
+   * of the cancellation flag and deadline callback.
    * 
-   * This is either one of the SNTOKEN_ constants, or it is negative,
-   * indicating an SNERR_ error.
+   * This starts out at zero so that the very first read polls.  Each
+   * poll resets it to SNFILTER_POLL_INTERVAL.
    */
-  int status;
+  long poll;
   
   /*
-   * The string type flag.
+   * The cancellation flag.
    * 
-   * For STRING token types, this will be set to one of the SNSTRING_
-   * constants to indicate the string type.  Otherwise, it should be
-   * ignored.
+   * This is normally zero.  It is set to non-zero by snparser_cancel(),
+   * which may be invoked asynchronously, hence the volatile type.
    */
-  int str_type;
+  volatile sig_atomic_t cancel;
   
   /*
-   * Pointer to the key buffer.
-   * 
-   * This will always be reset on read operations.  For SIMPLE and FINAL
-   * token types, this buffer will contain the full token on return.
-   * For STRING token types, this buffer will contain the prefix
-   * (excluding the opening quote or bracket) on return.
-   * 
-   * The state of the buffer is undefined on error status returns.
+   * The deadline callback, or NULL if there is none.
    * 
-   * The key and value buffer may not point to the same object.
-   * 
-   * Note that this pointer will be to a buffer within the SNREADER
-   * structure.  The buffer is not owned by this structure.
+   * See snparser_deadline() in the header for the specification.
    */
-  SNBUFFER *pKey;
+  int (*pfExpired)(void *);
   
   /*
-   * Pointer to the value buffer.
-   * 
-   * This will always be reset on read operations.  For STRING token
-   * types, this buffer will contain the string data on return.  For
-   * other token types, this buffer will be empty on return.
-   * 
-   * The state of the buffer is undefined on error status returns.
-   * 
-   * The key and value buffer may not point to the same object.
-   * 
-   * Note that this pointer will be to a buffer within the SNREADER
-   * structure.  The buffer is not owned by this structure.
+   * The custom data passed through to the deadline callback.
    */
-  SNBUFFER *pValue;
+  void *pExpiredCustom;
   
-} SNTOKEN;
+} SNFILTER;
 
 /*
- * Structure for storing state of the Shastina source file reader.
- * 
- * Use the snreader_ functions to manipulate this structure.
+ * Structure for a registered string prefix decoder.
  */
 typedef struct {
   
   /*
-   * The status of the reader.
+   * The prefix that selects the decoder.
    * 
-   * This is normally zero.  If negative, it is one of the SNERR_
-   * constants, indicating that an error has occurred.
+   * This points to a nul-terminated string owned by the client.
    */
-  int status;
+  const char *pPrefix;
   
   /*
-   * The queue of entities.
-   * 
-   * The queue_count field determines how many entities are queued.
-   * 
-   * CAUTION:  Do not queue more than one entity that makes use of the
-   * string buffers, or there will be dangling pointers!
+   * The decoder callbacks.
    */
-  SNENTITY queue[SNREADER_MAXQUEUE];
+  const SNDECODER *pDecoder;
   
   /*
-   * The number of queued entities.
-   * 
-   * This has range zero up to SNREADER_MAXQUEUE.
+   * The custom data passed through to the callbacks.
    */
-  int queue_count;
+  void *pCustom;
+  
+} SNDECENTRY;
+
+/*
+ * Structure for a registry of string prefix decoders.
+ */
+typedef struct {
+  
+  /*
+   * The registered decoders.
+   * 
+   * Only the first count entries are valid.
+   */
+  SNDECENTRY entries[SNREADER_MAXDECODERS];
+  
+  /*
+   * The number of registered decoders.
+   */
+  int count;
+  
+} SNDECREG;
+
+/*
+ * Structure for a registered metacommand handler.
+ */
+typedef struct {
+  
+  /*
+   * The metacommand name that selects the handler.
+   * 
+   * This points to a nul-terminated string owned by the client.
+   */
+  const char *pName;
+  
+  /*
+   * The handler callback.
+   */
+  int (*pfMeta)(void *pCustom, const SNMETA *pMeta);
+  
+  /*
+   * The custom data passed through to the handler.
+   */
+  void *pCustom;
+  
+} SNMETAENTRY;
+
+/*
+ * Structure for a registry of metacommand handlers.
+ */
+typedef struct {
+  
+  /*
+   * The registered handlers.
+   * 
+   * Only the first count entries are valid.
+   */
+  SNMETAENTRY entries[SNREADER_MAXMETAS];
+  
+  /*
+   * The number of registered handlers.
+   */
+  int count;
+  
+} SNMETAREG;
+
+/*
+ * Structure for an entity stored in a fragment.
+ * 
+ * The fields have the same meaning as in SNENTITY, except that keys and
+ * values are offsets into the string arena of the fragment, or -1 if
+ * the entity has no key or value, and line is the line number of the
+ * entity in the included file.
+ * 
+ * Records for nested include metacommands have a status of
+ * SNFRAG_INCLUDE and the path as their key.
+ */
+typedef struct {
+  
+  int status;
+  int str_type;
+  long count;
+  long key;
+  long key_len;
+  long value;
+  long value_len;
+  long line;
+  long start;
+  long end;
+  long col;
+  
+} SNFRAGENT;
+
+/*
+ * Structure for a fragment, which is an included file that has been
+ * read into entities.
+ * 
+ * Fragments are shared by all the readers that include the same file
+ * through the same cache, so they are never changed once they have been
+ * read.  They are reference counted, and freed when the last reference
+ * is released.
+ */
+typedef struct SNFRAG_TAG SNFRAG;
+struct SNFRAG_TAG {
+  
+  /*
+   * The path of the included file, which is a nul-terminated string
+   * owned by the fragment.
+   */
+  char *pPath;
+  
+  /*
+   * The escape dialect the file was read with, and the length and hash
+   * of the file data.
+   * 
+   * The cache reuses the fragment when the same path is included with
+   * the same dialect, and the file data still has the same length and
+   * hash.
+   */
+  int dialect;
+  long src_len;
+  unsigned long hash;
+  
+  /*
+   * The entity records, not including the EOF entity.
+   * 
+   * count is the number of records and cap is the capacity.
+   */
+  SNFRAGENT *pEnts;
+  long count;
+  long cap;
+  
+  /*
+   * The string arena that keys and values are stored in, with each
+   * string nul-terminated.
+   */
+  char *pArena;
+  long arena_len;
+  long arena_cap;
+  
+  /*
+   * The error the file stopped with and its line number, or zero if it
+   * was read up to its |; token.
+   */
+  int err;
+  long err_line;
+  
+  /*
+   * The number of references to the fragment.
+   * 
+   * The cache holds one reference while the fragment is in it, and
+   * each reader holds one while the fragment is on its include stack.
+   */
+  long refs;
+  
+  /*
+   * The next fragment in the cache, or NULL.
+   */
+  SNFRAG *pNext;
+};
+
+/*
+ * Structure for a level of the include stack of a reader.
+ * 
+ * pFrag is the fragment being spliced in, with a reference held by the
+ * reader, and pos is the index of its next record.
+ */
+typedef struct {
+  
+  SNFRAG *pFrag;
+  long pos;
+  
+} SNINCLEVEL;
+
+/*
+ * Structure for a token read from a Shastina source file.
+ * 
+ * This covers everything that can be found in a Shastina source file.
+ */
+typedef struct {
+  
+  /*
+   * The status of a token structure.
+   * 
+   * This is either one of the SNTOKEN_ constants, or it is negative,
+   * indicating an SNERR_ error.
+   */
+  int status;
+  
+  /*
+   * The string type flag.
+   * 
+   * For STRING token types, this will be set to one of the SNSTRING_
+   * constants to indicate the string type.  Otherwise, it should be
+   * ignored.
+   */
+  int str_type;
+  
+  /*
+   * Pointer to the key buffer.
+   * 
+   * This will always be reset on read operations.  For SIMPLE and FINAL
+   * token types, this buffer will contain the full token on return.
+   * For STRING token types, this buffer will contain the prefix
+   * (excluding the opening quote or bracket) on return.
+   * 
+   * The state of the buffer is undefined on error status returns.
+   * 
+   * The key and value buffer may not point to the same object.
+   * 
+   * Note that this pointer will be to a buffer within the SNREADER
+   * structure.  The buffer is not owned by this structure.
+   */
+  SNBUFFER *pKey;
+  
+  /*
+   * The span recording flag.
+   * 
+   * This must be filled in upon entry.  If non-zero, the start, end,
+   * and col fields will be filled in on successful return.  If zero,
+   * those fields are set to zero.
+   */
+  int spans;
+  
+  /*
+   * The byte offset within the source of the first byte of the token.
+   */
+  long start;
+  
+  /*
+   * The byte offset within the source of the first byte following the
+   * token.  For string tokens, this is the byte following the closing
+   * quote or curly bracket.
+   */
+  long end;
+  
+  /*
+   * The byte column of the first byte of the token.
+   */
+  long col;
+  
+  /*
+   * The string prefix decoder registry, or NULL if string data should
+   * never be decoded.
+   * 
+   * This must be filled in upon entry.  If the prefix of a STRING token
+   * matches a registered decoder, the string data is passed to the
+   * decoder as it is read, and the value buffer is empty on return.
+   */
+  const SNDECREG *pDecoders;
+  
+  /*
+   * Pointer to the value buffer.
+   * 
+   * This will always be reset on read operations.  For STRING token
+   * types, this buffer will contain the string data on return.  For
+   * other token types, this buffer will be empty on return.
+   * 
+   * The state of the buffer is undefined on error status returns.
+   * 
+   * The key and value buffer may not point to the same object.
+   * 
+   * Note that this pointer will be to a buffer within the SNREADER
+   * structure.  The buffer is not owned by this structure.
+   */
+  SNBUFFER *pValue;
+  
+} SNTOKEN;
+
+/*
+ * Structure for storing state of the Shastina source file reader.
+ * 
+ * Use the snreader_ functions to manipulate this structure.
+ */
+typedef struct {
+  
+  /*
+   * The status of the reader.
+   * 
+   * This is normally zero.  If negative, it is one of the SNERR_
+   * constants, indicating that an error has occurred.
+   */
+  int status;
+  
+  /*
+   * The queue of entities.
+   * 
+   * The queue_count field determines how many entities are queued.
+   * 
+   * CAUTION:  Do not queue more than one entity that makes use of the
+   * string buffers, or there will be dangling pointers!
+   */
+  SNENTITY queue[SNREADER_MAXQUEUE];
+  
+  /*
+   * The number of queued entities.
+   * 
+   * This has range zero up to SNREADER_MAXQUEUE.
+   */
+  int queue_count;
 
   /*
    * The number of queued entities that have been read.
@@ -586,1851 +1287,8709 @@ typedef struct {
    */
   int array_flag;
   
-} SNREADER;
-
-/*
- * Structure for storing state of the Shastina metalanguage parser.
- * 
- * Use the snparser_ functions to manipulate this structure.
- * 
- * The prototype of this structure (SNPARSER) is defined in the header.
- */
-struct SNPARSER_TAG {
+  /*
+   * The span recording flag.
+   * 
+   * This is non-zero if source spans should be recorded in entities,
+   * zero otherwise.  It is not changed by resets.
+   */
+  int spans;
   
   /*
-   * The reader object.
+   * The memory accounting structure.
    * 
-   * This must be initialized with snreader_init().
+   * The buffers and stacks of this reader charge their allocations
+   * here.  The parser also charges its own structure here.
+   */
+  SNMEMACCT mem;
+  
+  /*
+   * The recovery mode flag.
    * 
-   * It must be fully reset with snreader_reset() before the structure
-   * is released.
+   * This is non-zero if errors that can be recovered from should be
+   * recorded in the error list rather than stopping the reader, zero
+   * otherwise.  It is not changed by resets.
    */
-  SNREADER reader;
+  int recover;
   
   /*
-   * The input filter object.
+   * The error list, or NULL if nothing has been allocated yet.
    * 
-   * This must be initialized with snfilter_reset().
+   * errs_cap is the number of records allocated, errs_stored is the
+   * number of records filled in, and errs_total is the total number of
+   * errors that have been recovered from, which may be greater than
+   * errs_stored if SNREADER_ERRS_MAX was exceeded.  The list is charged
+   * to the memory accounting structure.
    */
-  SNFILTER filter;
-};
-
-/* Function prototypes */
-static long snutf_pair(long hi, long lo);
-static int snutf_count(int c);
-static long snutf_decode(const unsigned char *pc);
-static void snutf_encode(long cpv, unsigned char *pb);
-
-static int snsource_file_read(void *pCustom);
-static void snsource_file_free(void *pCustom);
-static int snsource_file_rewind(void *pCustom);
-
-static int snsource_str_read(void *pCustom);
-static void snsource_str_free(void *pCustom);
-static int snsource_str_rewind(void *pCustom);
-
-static int snsource_read(SNSOURCE *pIn);
-static long snsource_readCPV(SNSOURCE *pIn);
-
-static void snstack_init(SNSTACK *pStack, long icap, long maxcap);
-static void snstack_reset(SNSTACK *pStack, int full);
-static int snstack_push(SNSTACK *pStack, long v);
-static long snstack_pop(SNSTACK *pStack);
-static long snstack_peek(SNSTACK *pStack);
-static int snstack_inc(SNSTACK *pStack);
-static int snstack_dec(SNSTACK *pStack);
-static long snstack_count(SNSTACK *pStack);
-
-static void snbuffer_init(SNBUFFER *pBuffer, long icap, long maxcap);
-static void snbuffer_reset(SNBUFFER *pBuffer, int full);
-static int snbuffer_appendByte(SNBUFFER *pBuffer, int c);
-static int snbuffer_append(SNBUFFER *pBuffer, long cpv);
-static char *snbuffer_get(SNBUFFER *pBuffer);
-static long snbuffer_last(SNBUFFER *pBuffer);
-static int snbuffer_less(SNBUFFER *pBuffer);
-
-static void snfilter_reset(SNFILTER *pFilter);
-static long snfilter_read(SNFILTER *pFilter, SNSOURCE *pIn);
-static long snfilter_count(SNFILTER *pFilter);
-static int snfilter_pushback(SNFILTER *pFilter);
-
-static int snchar_islegal(long c);
-static int snchar_isatomic(long c);
-static int snchar_isinclusive(long c);
-static int snchar_isexclusive(long c);
-static int snchar_strequals(int c, const char *pStr);
-static int snchar_strequals2(int c1, int c2, const char *pStr);
-
-static int snstr_readQuoted(
-    SNBUFFER * pBuffer,
-    SNSOURCE * pIn,
-    SNFILTER * pFilter);
-
-static int snstr_readCurlied(
-    SNBUFFER * pBuffer,
-    SNSOURCE * pIn,
-    SNFILTER * pFilter);
-
-static void sntk_skip(SNSOURCE *pIn, SNFILTER *pFilter);
-static int sntk_readToken(
-    SNBUFFER * pBuffer,
-    SNSOURCE * pIn,
-    SNFILTER * pFilter);
-
-static void sntoken_read(
-    SNTOKEN  * pToken,
-    SNSOURCE * pIn,
-    SNFILTER * pFil);
+  SNERRINFO *pErrs;
+  long errs_cap;
+  long errs_stored;
+  long errs_total;
+  
+  /*
+   * The open stack.
+   * 
+   * This needs to be properly initialized.  It also needs to be fully
+   * reset before the structure is released.
+   * 
+   * The stack is only used in recovery mode.  It holds three longs for
+   * each metacommand, array, and group that is open, with the innermost
+   * on top:  one of the SNREADER_OPEN_ constants, followed by the line
+   * number and byte offset just after the token that opened it.
+   */
+  SNSTACK stack_open;
+  
+  /*
+   * The closing flag.
+   * 
+   * This is non-zero once the |; token has been read in recovery mode
+   * with structures still open, zero otherwise.  While it is set, each
+   * fill closes the innermost open structure instead of reading a
+   * token, until the EOF entity is added.  close_start, close_end, and
+   * close_col hold the span of the |; token for the entities that are
+   * added this way.
+   */
+  int closing;
+  long close_start;
+  long close_end;
+  long close_col;
+  
+  /*
+   * The escape dialect for decoding string data in place.
+   * 
+   * This is a combination of SNESC_ flags, or zero if string data
+   * should be left as it is.  It is not changed by resets.
+   */
+  int unescape;
+  
+  /*
+   * The string prefix decoder registry.
+   *
+   * Decoders only apply to STRING entities, not META_STRING entities.
+   * It is not changed by resets.
+   */
+  SNDECREG decoders;
+  
+  /*
+   * The metacommand handler registry.
+   * 
+   * It is not changed by resets.
+   */
+  SNMETAREG metas;
+  
+  /*
+   * How the current metacommand is handled, which is one of the
+   * SNREADER_META_ constants.
+   * 
+   * Only meaningful while meta_flag is set.
+   */
+  int meta_mode;
+  
+  /*
+   * A copy of the registry entry of the metacommand whose arguments are
+   * being collected.
+   * 
+   * This is a copy so that the handler may change the registry.
+   */
+  SNMETAENTRY meta_entry;
+  
+  /*
+   * The metacommand arena and argument stack.
+   * 
+   * These need to be properly initialized.  They also need to be fully
+   * reset before the structure is released.
+   * 
+   * The arena holds the data of each collected argument followed by a
+   * placeholder byte that becomes its terminating nul when the handler
+   * is called.  The stack holds the arena offset and the entity type of
+   * each argument.
+   */
+  SNBUFFER buf_meta;
+  SNSTACK stack_meta;
+  
+  /*
+   * The argument arrays that are passed to metacommand handlers, or
+   * NULL if nothing has been allocated yet.
+   * 
+   * Each array has args_cap elements.  The arrays are charged to the
+   * memory accounting structure.
+   */
+  const char **ppArgv;
+  long *pArgl;
+  int *pArgt;
+  long args_cap;
+  
+  /*
+   * The include cache, or NULL if includes are not enabled.
+   * 
+   * It is not changed by resets.
+   */
+  SNINCCACHE *pIncCache;
 
-static void snreader_init(SNREADER *pReader);
-static void snreader_reset(SNREADER *pReader, int full);
-static void snreader_read(
-    SNREADER * pReader,
-    SNENTITY * pEntity,
-    SNSOURCE * pIn,
-    SNFILTER * pFilter);
+  /*
+   * The fragment being read, or NULL.
+   * 
+   * This is only set for the readers that read included files into
+   * fragments.  Include metacommands are then recorded in the fragment
+   * instead of being followed, and frag_line is set to the line number
+   * of each one.  It is not changed by resets.
+   */
+  SNFRAG *pIncFrag;
+  long frag_line;
 
-static void snreader_addEntityZ(SNREADER *pReader, int entity);
-static void snreader_addEntityS(
-    SNREADER * pReader,
-    int        entity,
-    char     * s);
-static void snreader_addEntityL(
-    SNREADER * pReader,
-    int        entity,
-    long       l);
-static void snreader_addEntityT(
-    SNREADER * pReader,
-    int        entity,
-    char     * pPrefix,
-    int        str_type,
-    char     * pData);
+  /*
+   * The include stack.
+   * 
+   * While inc_depth is greater than zero, entities are taken from the
+   * fragment on top of the stack instead of being read from the source,
+   * and inc_line is the line number of the most recent one.
+   */
+  SNINCLEVEL incs[SNREADER_MAXINCLUDE];
+  int inc_depth;
+  long inc_line;
 
-static void snreader_arrayPrefix(SNREADER *pReader);
-static void snreader_fill(
-    SNREADER * pReader,
-    SNSOURCE * pIn,
-    SNFILTER * pFilter);
+  /*
+   * The schema to validate against, or NULL.
+   * 
+   * The schema is shared and never changed by the reader.  It is not
+   * changed by resets.
+   */
+  const SNSCHEMA *pSchema;
+  
+  /*
+   * The signature state, which is SNSIG_START, SNSIG_DONE, or the
+   * progress through the signature metacommand.
+   * 
+   * Only used when the schema has a signature.
+   */
+  long sig_state;
+  
+} SNREADER;
 
 /*
- * Given a high surrogate and a low surrogate, return the supplemental
- * codepoint that the pair selects.
- * 
- * A fault occurs if hi is not in high surrogate range or lo is not in
- * low surrogate range.
- * 
- * Parameters:
+ * Structure for storing state of the Shastina metalanguage parser.
  * 
- *   hi - the high surrogate
+ * Use the snparser_ functions to manipulate this structure.
  * 
- *   lo - the low surrogate
+ * The prototype of this structure (SNPARSER) is defined in the header.
+ */
+struct SNPARSER_TAG {
+  
+  /*
+   * The reader object.
+   * 
+   * This must be initialized with snreader_init().
+   * 
+   * It must be fully reset with snreader_reset() before the structure
+   * is released.
+   */
+  SNREADER reader;
+  
+  /*
+   * The input filter object.
+   * 
+   * This must be initialized with snfilter_reset().
+   */
+  SNFILTER filter;
+  
+  /*
+   * The source most recently passed to snparser_read(), or NULL if
+   * nothing has been read yet.
+   * 
+   * This is needed to compute line counts on demand when the filter is
+   * counting lines lazily.
+   */
+  SNSOURCE *pSrc;
+  
+  /*
+   * The next parser in the free list of a pool, or NULL.
+   * 
+   * This is only used while the parser is being kept by a pool.
+   */
+  SNPARSER *pPoolNext;
+};
+
+/*
+ * Structure for a pool of reusable parsers and string sources.
  * 
- * Return:
+ * Use the snpool_ functions to manipulate this structure.
  * 
- *   the supplemental codepoint
+ * The prototype of this structure (SNPOOL) is defined in the header.
  */
-static long snutf_pair(long hi, long lo) {
-  
-  long result = 0;
+struct SNPOOL_TAG {
   
-  /* Check parameters */
-  if ((hi < UNICODE_MIN_HI_SUR) || (hi > UNICODE_MAX_HI_SUR) ||
-      (lo < UNICODE_MIN_LO_SUR) || (lo > UNICODE_MAX_LO_SUR)) {
-    abort();
-  }
+  /*
+   * The free list of parsers, linked through their pPoolNext fields, or
+   * NULL if empty.
+   */
+  SNPARSER *pParsers;
   
-  /* Convert hi and lo into offsets within their surrogate ranges */
-  hi = hi - UNICODE_MIN_HI_SUR;
-  lo = lo - UNICODE_MIN_LO_SUR;
+  /*
+   * The free list of string sources, linked through their pPoolNext
+   * fields, or NULL if empty.
+   */
+  SNSOURCE *pSources;
   
-  /* Combine hi and lo with bit shifting */
-  result = (hi << 10) | lo;
+  /*
+   * The number of parsers in the parser free list.
+   */
+  int parser_count;
   
-  /* Use as offset into surrogate range */
-  result = result + UNICODE_MIN_SUPPLEMENTAL;
+  /*
+   * The number of sources in the source free list.
+   */
+  int source_count;
   
-  /* Return result */
-  return result;
-}
+  /*
+   * The maximum number of objects of each kind to keep.
+   */
+  int max;
+};
 
 /*
- * Check a byte within a UTF-8 encoding to determine how many bytes long
- * the encoding is.
- * 
- * c is the unsigned byte value to check.  It must be in range [0, 255].
- * 
- * The return value is one if the most significant bit of the byte is
- * clear (indicating an ASCII character), two to four if the given byte
- * is a UTF-8 lead byte, zero if the byte is a UTF-8 continuation byte,
- * and -1 if the byte is not a valid UTF-8 byte.
- * 
- * If a value greater than zero is returned, then the whole encoded
- * codepoint (including the leading byte) has that many bytes in it,
- * where any bytes after the first are continuation bytes.
+ * Structure for a cache of included files.
  * 
- * Parameters:
+ * Use the sninccache_ functions to manipulate this structure.
  * 
- *   c - the byte value to check
+ * The prototype of this structure (SNINCCACHE) is defined in the
+ * header.
+ */
+struct SNINCCACHE_TAG {
+
+  /*
+   * The cached fragments, linked through their pNext fields, or NULL if
+   * empty.
+   * 
+   * The cache holds a reference to each of them.
+   */
+  SNFRAG *pFrags;
+};
+
+/*
+ * A set of names in a schema.
  * 
- * Return:
+ * Names are given IDs from one in the order they are added.  The names
+ * themselves are stored in the string arena of the schema, and pOff and
+ * pLen give the arena offset and length of the name with ID (i + 1) at
+ * index i.  count is the number of names and cap is the capacity of
+ * pOff and pLen.
  * 
- *   the number of bytes in the encoded codepoint, or zero if the given
- *   byte is a continuation byte, or -1 if the byte is not valid UTF-8
+ * pSlots is an open addressing hash table of slot_cap IDs, where zero
+ * marks an empty slot.  slot_cap is always a power of two.  Sets that
+ * allow duplicate names do not use the hash table, and pSlots is NULL.
  */
-static int snutf_count(int c) {
-  
-  int result = 0;
-  
-  /* Check parameter */
-  if ((c < 0) || (c > 255)) {
-    abort();
-  }
+typedef struct {
   
-  /* Determine result */
-  if (c <= 127) {
-    /* Everything in [0, 127] has one byte */
-    result = 1;
+  long *pSlots;
+  long slot_cap;
   
-  } else if ((c & 0xC0) == 0x80) {
-    /* 10?????? bytes are continuation bytes */
-    result = 0;
-    
-  } else if ((c & 0xE0) == 0xC0) {
-    /* 110????? bytes are lead bytes for two-byte encodings */
-    result = 2;
-    
-  } else if ((c & 0xF0) == 0xE0) {
-    /* 1110???? bytes are lead bytes for three-byte encodings */
-    result = 3;
-    
-  } else if ((c & 0xF8) == 0xF0) {
-    /* 11110??? bytes are lead bytes for four-byte encodings */
-    result = 4;
-    
-  } else {
-    /* Everything else is invalid UTF-8 */
-    result = -1;
-  }
+  long *pOff;
+  long *pLen;
+  long count;
+  long cap;
   
-  /* Return result */
-  return result;
-}
+} SNNAMES;
 
 /*
- * Decode a UTF-8 codepoint.
+ * Structure for storing a compiled schema.
  * 
- * pc points to the start of an encoded UTF-8 codepoint.  Encoded UTF-8
- * codepoints may have from one to four bytes for a codepoint.  This
- * function will stop immediately and return an error if it encounters
- * a faulty encoding, and it is guaranteed safe to use on nul-terminated
- * strings, even if the strings have bad UTF-8 encodings.  (It will
- * never read beyond the terminating nul, even if the terminating nul
- * comes unexpectedly in the middle of an encoded UTF-8 codepoint.)
+ * Use the snschema_ functions to manipulate this structure.
  * 
- * The leading byte pointed to by pc determines how many bytes are in
- * the encoding.  You can use snutf_count() to get this information
+ * The prototype of this structure (SNSCHEMA) is defined in the header.
+ */
+struct SNSCHEMA_TAG {
+  
+  /*
+   * The string arena holding all the names of the schema, each
+   * nul-terminated.
+   * 
+   * arena_len is the number of bytes used and arena_cap is the
+   * allocated capacity.
+   */
+  char *pArena;
+  long arena_len;
+  long arena_cap;
+  
+  /*
+   * The signature tokens, in order.
+   * 
+   * This set allows duplicates, so it has no hash table.
+   */
+  SNNAMES sig;
+  
+  /*
+   * The operator set and the prefix set.
+   */
+  SNNAMES ops;
+  SNNAMES prefixes;
+  
+  /*
+   * Flags that are non-zero if the schema has a signature, restricts
+   * operations, restricts string prefixes, and restricts numerics.
+   */
+  int has_sig;
+  int has_ops;
+  int has_prefixes;
+  int has_numeric;
+  
+  /*
+   * The allowed numeric shapes, as a combination of SNSHAPE_ flags.
+   */
+  int shapes;
+};
+
+/*
+ * The state of one group, or of the top level of the document, during
+ * stack effect analysis.
+ */
+typedef struct {
+  
+  /*
+   * The number of values pushed since the frame began, less the number
+   * popped.
+   * 
+   * Only meaningful if known is non-zero.
+   */
+  long depth;
+  
+  /*
+   * Non-zero if depth is known statically.
+   * 
+   * This is always zero for the top level, where nothing is checked.
+   */
+  int known;
+  
+  /*
+   * Non-zero if an error has been found in this group.
+   */
+  int bad;
+  
+  /*
+   * The number of the group, or -1 for the top level.
+   */
+  long group;
+  
+} SNFRAME;
+
+/*
+ * Structure for a stack effect analyzer.
+ * 
+ * Use the snanalyzer_ functions to manipulate this structure.
+ * 
+ * The prototype of this structure (SNANALYZER) is defined in the
+ * header.
+ */
+struct SNANALYZER_TAG {
+  
+  /*
+   * The declared operation names.
+   * 
+   * Only the string arena and the operator set of this schema are used.
+   * The effects of the operation with ID (i + 1) are at index i of
+   * pPops and pPushes, which have capacity effect_cap.
+   */
+  SNSCHEMA names;
+  int *pPops;
+  int *pPushes;
+  long effect_cap;
+  
+  /*
+   * The stack of frames, with the top level at the bottom.
+   */
+  SNFRAME *pFrames;
+  long frame_count;
+  long frame_cap;
+  
+  /*
+   * The SNGROUP_ marker of each group.
+   */
+  unsigned char *pGroups;
+  long group_count;
+  long group_cap;
+  
+  /*
+   * The errors found.
+   */
+  SNERRINFO *pErrs;
+  long err_count;
+  long err_cap;
+};
+
+/*
+ * Decoding table for base64.
+ * 
+ * Each byte value maps to its six-bit value in the standard base64
+ * alphabet, or to one of the SNBLOB_ special values.
+ */
+static const signed char snblob_b64table[256] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -2, -2, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+  52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -3, -1, -1,
+  -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+  15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+  -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+  41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+/*
+ * Decoding table for base16.
+ * 
+ * Each byte value maps to its four-bit value as a hexadecimal digit of
+ * either case, or to one of the SNBLOB_ special values.
+ */
+static const signed char snblob_hextable[256] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -2, -2, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+  -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+/*
+ * Transition table of the numeric shape automaton.
+ * 
+ * Rows are states and columns are the character classes returned by
+ * snnum_class().  State zero is the start state, and SNNUM_DEAD is a
+ * dead state that rejects.  Note that "e" is both the exponent mark and
+ * a hexadecimal digit.
+ */
+static const signed char snnum_dfa[SNNUM_STATES][SNNUM_CLASSES] = {
+  /* other sign zero digit point e    x    hex */
+  {  11,   1,   3,   2,   11,  11,  11,  11  },  /* 0: start */
+  {  11,  11,   3,   2,   11,  11,  11,  11  },  /* 1: sign */
+  {  11,  11,   2,   2,    4,   6,  11,  11  },  /* 2: integer */
+  {  11,  11,   2,   2,    4,   6,   9,  11  },  /* 3: leading zero */
+  {  11,  11,   5,   5,   11,  11,  11,  11  },  /* 4: point */
+  {  11,  11,   5,   5,   11,   6,  11,  11  },  /* 5: fraction */
+  {  11,   7,   8,   8,   11,  11,  11,  11  },  /* 6: exponent mark */
+  {  11,  11,   8,   8,   11,  11,  11,  11  },  /* 7: exponent sign */
+  {  11,  11,   8,   8,   11,  11,  11,  11  },  /* 8: exponent */
+  {  11,  11,  10,  10,   11,  10,  11,  10  },  /* 9: hex mark */
+  {  11,  11,  10,  10,   11,  10,  11,  10  },  /* 10: hex digits */
+  {  11,  11,  11,  11,   11,  11,  11,  11  }   /* 11: dead */
+};
+
+/*
+ * The shape that each state of the numeric shape automaton accepts, as
+ * an SNSHAPE_ flag, or zero if the state does not accept.
+ */
+static const unsigned char snnum_accept[SNNUM_STATES] = {
+  0, 0, SNSHAPE_INTEGER, SNSHAPE_INTEGER, 0, SNSHAPE_DECIMAL,
+  0, 0, SNSHAPE_EXPONENT, 0, SNSHAPE_HEX, 0
+};
+
+/* Function prototypes */
+static long snutf_pair(long hi, long lo);
+static int snutf_count(int c);
+static long snutf_decode(const unsigned char *pc);
+static void snutf_encode(long cpv, unsigned char *pb);
+static long snutf_hex(const char *pc);
+
+static int snsource_file_read(void *pCustom);
+static void snsource_file_free(void *pCustom);
+static int snsource_file_rewind(void *pCustom);
+
+static int snsource_str_read(void *pCustom);
+static void snsource_str_free(void *pCustom);
+static int snsource_str_rewind(void *pCustom);
+
+static int snsource_mem_read(void *pCustom);
+static void snsource_mem_free(void *pCustom);
+static int snsource_mem_rewind(void *pCustom);
+
+static int snsource_cat_read(void *pCustom);
+static void snsource_cat_free(void *pCustom);
+static int snsource_cat_rewind(void *pCustom);
+
+static int snsource_read(SNSOURCE *pIn);
+static long snsource_readCPV(SNSOURCE *pIn);
+static long snsource_index(SNSOURCE *pSrc, long offset, long *pCol);
+
+static int snmem_grow(SNMEMACCT *pAcct, long amount, int force);
+static void snmem_release(SNMEMACCT *pAcct, long amount);
+
+static void snstack_init(
+    SNSTACK   * pStack,
+    long        icap,
+    long        maxcap,
+    SNMEMACCT * pAcct);
+static void snstack_reset(SNSTACK *pStack, int full);
+static int snstack_push(SNSTACK *pStack, long v);
+static long snstack_pop(SNSTACK *pStack);
+static long snstack_peek(SNSTACK *pStack);
+static int snstack_inc(SNSTACK *pStack);
+static int snstack_dec(SNSTACK *pStack);
+static long snstack_count(SNSTACK *pStack);
+
+static void snbuffer_init(
+    SNBUFFER  * pBuffer,
+    long        icap,
+    long        maxcap,
+    SNMEMACCT * pAcct);
+static void snbuffer_reset(SNBUFFER *pBuffer, int full);
+static int snbuffer_appendByte(SNBUFFER *pBuffer, int c);
+static int snbuffer_append(SNBUFFER *pBuffer, long cpv);
+static char *snbuffer_get(SNBUFFER *pBuffer);
+static long snbuffer_last(SNBUFFER *pBuffer);
+static int snbuffer_less(SNBUFFER *pBuffer);
+
+static void snfilter_reset(SNFILTER *pFilter);
+static long snfilter_read(SNFILTER *pFilter, SNSOURCE *pIn);
+static long snfilter_count(SNFILTER *pFilter, SNSOURCE *pIn);
+static long snfilter_pos(SNFILTER *pFilter, SNSOURCE *pIn);
+static int snfilter_pushback(SNFILTER *pFilter);
+static int snfilter_poll(SNFILTER *pFilter);
+
+static int snchar_islegal(long c);
+static int snchar_isatomic(long c);
+static int snchar_isinclusive(long c);
+static int snchar_isexclusive(long c);
+static int snchar_strequals(int c, const char *pStr);
+static int snchar_strequals2(int c1, int c2, const char *pStr);
+
+static const SNDECENTRY *snstr_lookup(
+    const SNDECREG * pReg,
+    const char     * pPrefix);
+static int snstr_flush(SNBUFFER *pBuffer, const SNDECENTRY *pDec);
+
+static int snstr_readQuoted(
+    SNBUFFER         * pBuffer,
+    SNSOURCE         * pIn,
+    SNFILTER         * pFilter,
+    const SNDECENTRY * pDec);
+
+static int snstr_readCurlied(
+    SNBUFFER         * pBuffer,
+    SNSOURCE         * pIn,
+    SNFILTER         * pFilter,
+    const SNDECENTRY * pDec);
+
+static void sntk_skip(SNSOURCE *pIn, SNFILTER *pFilter);
+static void sntk_resync(SNSOURCE *pIn, SNFILTER *pFilter, int line);
+static int sntk_readToken(
+    SNBUFFER * pBuffer,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter,
+    long     * pStart);
+
+static void sntoken_read(
+    SNTOKEN  * pToken,
+    SNSOURCE * pIn,
+    SNFILTER * pFil);
+
+static void snscan_string(SNSCAN *pScan, long c);
+static int snscan_step(SNSCAN *pScan, long c);
+
+static void snsource_restring(SNSOURCE *pSrc, const char *pStr);
+static void snsource_rememory(SNSOURCE *pSrc, const char *pData, long len);
+
+static void snparser_recycle(SNPARSER *pParser);
+
+static void *snbatch_grow(void *pArray, long cap, size_t elsize);
+static void snbatch_reserveDoc(SNBATCH *pBatch);
+static void snbatch_reserveEnt(SNBATCH *pBatch);
+static long snbatch_store(SNBATCH *pBatch, const char *pStr, long len);
+
+static unsigned long snnames_hash(const char *pName, long len);
+static long snnames_find(
+    const SNSCHEMA * pSchema,
+    const SNNAMES  * pSet,
+    const char     * pName,
+    long             len);
+static long snnames_add(
+    SNSCHEMA   * pSchema,
+    SNNAMES    * pSet,
+    const char * pName,
+    long         len,
+    int          unique);
+static void snnames_free(SNNAMES *pSet);
+
+static int snnum_class(int c);
+static int snnum_shape(const char *pStr);
+
+static void snanalyzer_error(
+    SNANALYZER * pAn,
+    int          code,
+    long         line,
+    long         offset);
+static void snanalyzer_apply(
+    SNANALYZER * pAn,
+    int          pops,
+    int          pushes,
+    long         line,
+    long         offset);
+
+static void snfrag_release(SNFRAG *pFrag);
+static long snfrag_string(SNFRAG *pFrag, const char *pStr, long len);
+static void snfrag_add(SNFRAG *pFrag, const SNENTITY *pEnt, long line);
+static void snfrag_lex(SNFRAG *pFrag, const char *pData, long len);
+static int snfrag_load(
+    SNINCCACHE * pCache,
+    const char * pPath,
+    int          dialect,
+    SNFRAG    ** ppFrag);
+
+static void snreader_init(SNREADER *pReader);
+static void snreader_reset(SNREADER *pReader, int full);
+static int snreader_next(
+    SNREADER * pReader,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter);
+static int snreader_schema(SNREADER *pReader);
+static void snreader_read(
+    SNREADER * pReader,
+    SNENTITY * pEntity,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter);
+
+static void snreader_addEntityZ(SNREADER *pReader, int entity);
+static void snreader_addEntityS(
+    SNREADER * pReader,
+    int        entity,
+    char     * s,
+    long       len);
+static void snreader_addEntityL(
+    SNREADER * pReader,
+    int        entity,
+    long       l);
+static void snreader_addEntityT(
+    SNREADER * pReader,
+    int        entity,
+    char     * pPrefix,
+    long       prefix_len,
+    int        str_type,
+    char     * pData,
+    long       data_len);
+
+static int snreader_dispatch(
+    const SNENTITY   * pe,
+    const SNHANDLERS * pHandlers,
+    void             * ctx);
+static int snreader_run(
+    SNREADER         * pReader,
+    SNSOURCE         * pIn,
+    SNFILTER         * pFilter,
+    const SNHANDLERS * pHandlers,
+    void             * ctx);
+
+static int snreader_arrayPrefix(SNREADER *pReader);
+static int snreader_addError(
+    SNREADER * pReader,
+    int        code,
+    long       line,
+    long       offset);
+static int snreader_recover(
+    SNREADER * pReader,
+    int        code,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter);
+static int snreader_openPush(
+    SNREADER * pReader,
+    int        kind,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter);
+static void snreader_openPop(SNREADER *pReader);
+static int snreader_abandon(SNREADER *pReader);
+static void snreader_closeNext(SNREADER *pReader);
+static void snreader_metaBegin(SNREADER *pReader);
+static const SNMETAENTRY *snreader_metaFind(
+    const SNREADER * pReader,
+    const char     * pName);
+static void snreader_metaName(SNREADER *pReader, const char *pName);
+static int snreader_metaArg(
+    SNREADER   * pReader,
+    int          entity,
+    const char * pData,
+    long         len);
+static int snreader_metaArrays(SNREADER *pReader, long argc);
+static int snreader_metaCall(SNREADER *pReader);
+static int snreader_includeMeta(void *pCustom, const SNMETA *pMeta);
+static int snreader_include(SNREADER *pReader, const char *pPath);
+static int snreader_spliceMeta(SNREADER *pReader, SNINCLEVEL *pLevel);
+static void snreader_splice(SNREADER *pReader);
+static void snreader_fill(
+    SNREADER * pReader,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter);
+
+static int snblob_begin(void *pCustom, const char *pPrefix, int str_type);
+static int snblob_put(SNBLOB *pBlob, unsigned long v, int n);
+static int snblob_b64data(void *pCustom, const char *pData, long len);
+static int snblob_b64end(void *pCustom);
+static int snblob_hexdata(void *pCustom, const char *pData, long len);
+static int snblob_hexend(void *pCustom);
+
+/*
+ * The built-in decoders.
+ */
+static const SNDECODER snblob_b64 = {
+  &snblob_begin, &snblob_b64data, &snblob_b64end
+};
+
+static const SNDECODER snblob_hex = {
+  &snblob_begin, &snblob_hexdata, &snblob_hexend
+};
+
+/*
+ * Given a high surrogate and a low surrogate, return the supplemental
+ * codepoint that the pair selects.
+ * 
+ * A fault occurs if hi is not in high surrogate range or lo is not in
+ * low surrogate range.
+ * 
+ * Parameters:
+ * 
+ *   hi - the high surrogate
+ * 
+ *   lo - the low surrogate
+ * 
+ * Return:
+ * 
+ *   the supplemental codepoint
+ */
+static long snutf_pair(long hi, long lo) {
+  
+  long result = 0;
+  
+  /* Check parameters */
+  if ((hi < UNICODE_MIN_HI_SUR) || (hi > UNICODE_MAX_HI_SUR) ||
+      (lo < UNICODE_MIN_LO_SUR) || (lo > UNICODE_MAX_LO_SUR)) {
+    abort();
+  }
+  
+  /* Convert hi and lo into offsets within their surrogate ranges */
+  hi = hi - UNICODE_MIN_HI_SUR;
+  lo = lo - UNICODE_MIN_LO_SUR;
+  
+  /* Combine hi and lo with bit shifting */
+  result = (hi << 10) | lo;
+  
+  /* Use as offset into surrogate range */
+  result = result + UNICODE_MIN_SUPPLEMENTAL;
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Check a byte within a UTF-8 encoding to determine how many bytes long
+ * the encoding is.
+ * 
+ * c is the unsigned byte value to check.  It must be in range [0, 255].
+ * 
+ * The return value is one if the most significant bit of the byte is
+ * clear (indicating an ASCII character), two to four if the given byte
+ * is a UTF-8 lead byte, zero if the byte is a UTF-8 continuation byte,
+ * and -1 if the byte is not a valid UTF-8 byte.
+ * 
+ * If a value greater than zero is returned, then the whole encoded
+ * codepoint (including the leading byte) has that many bytes in it,
+ * where any bytes after the first are continuation bytes.
+ * 
+ * Parameters:
+ * 
+ *   c - the byte value to check
+ * 
+ * Return:
+ * 
+ *   the number of bytes in the encoded codepoint, or zero if the given
+ *   byte is a continuation byte, or -1 if the byte is not valid UTF-8
+ */
+static int snutf_count(int c) {
+  
+  int result = 0;
+  
+  /* Check parameter */
+  if ((c < 0) || (c > 255)) {
+    abort();
+  }
+  
+  /* Determine result */
+  if (c <= 127) {
+    /* Everything in [0, 127] has one byte */
+    result = 1;
+  
+  } else if ((c & 0xC0) == 0x80) {
+    /* 10?????? bytes are continuation bytes */
+    result = 0;
+    
+  } else if ((c & 0xE0) == 0xC0) {
+    /* 110????? bytes are lead bytes for two-byte encodings */
+    result = 2;
+    
+  } else if ((c & 0xF0) == 0xE0) {
+    /* 1110???? bytes are lead bytes for three-byte encodings */
+    result = 3;
+    
+  } else if ((c & 0xF8) == 0xF0) {
+    /* 11110??? bytes are lead bytes for four-byte encodings */
+    result = 4;
+    
+  } else {
+    /* Everything else is invalid UTF-8 */
+    result = -1;
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Decode a UTF-8 codepoint.
+ * 
+ * pc points to the start of an encoded UTF-8 codepoint.  Encoded UTF-8
+ * codepoints may have from one to four bytes for a codepoint.  This
+ * function will stop immediately and return an error if it encounters
+ * a faulty encoding, and it is guaranteed safe to use on nul-terminated
+ * strings, even if the strings have bad UTF-8 encodings.  (It will
+ * never read beyond the terminating nul, even if the terminating nul
+ * comes unexpectedly in the middle of an encoded UTF-8 codepoint.)
+ * 
+ * The leading byte pointed to by pc determines how many bytes are in
+ * the encoding.  You can use snutf_count() to get this information
  * given a byte value.  Encodings that have more than one byte will have
  * all bytes after the first byte be continuation bytes.
  * 
- * This function will check for and fail on overlong encodings -- that
- * is, encodings of codepoints that are unnecessarily long.  These are
- * blocked for security reasons, and should never occur in valid streams
- * of UTF-8.
+ * This function will check for and fail on overlong encodings -- that
+ * is, encodings of codepoints that are unnecessarily long.  These are
+ * blocked for security reasons, and should never occur in valid streams
+ * of UTF-8.
+ * 
+ * This function allows surrogates to be decoded, even though surrogates
+ * aren't supposed to be used in UTF-8.  Surrogates need to be resolved
+ * by looking at more than one codepoint at a time, so they can't be
+ * handled properly by this function.
+ * 
+ * Parameters:
+ * 
+ *   pc - pointer to the UTF-8 codepoint
+ * 
+ * Return:
+ * 
+ *   a Unicode codepoint (including surrogates!), or -1 if the UTF-8
+ *   encoding wasn't valid
+ */
+static long snutf_decode(const unsigned char *pc) {
+  
+  int status = 1;
+  int ec = 0;
+  int x = 0;
+  long result = 0;
+  
+  /* Check parameter */
+  if (pc == NULL) {
+    abort();
+  }
+  
+  /* Determine encoded length */
+  ec = snutf_count(*pc);
+  if (ec < 1) {
+    /* If start of encoding is a continuation byte or not a valid UTF-8
+     * byte, fail */
+    status = 0;
+  }
+  
+  /* If there is more than one byte in the encoding, make sure all
+   * additional bytes are continuation bytes */
+  if (status) {
+    for(x = 1; x < ec; x++) {
+      if (snutf_count(pc[x]) != 0) {
+        status = 0;
+        break;
+      }
+    }
+  }
+  
+  /* All UTF-8 bytes are available and of the correct type, so begin by
+   * getting the payload of the lead byte */
+  if (status) {
+    switch (ec) {
+      case 1:
+        /* For one-byte codes, the byte value is equal to the code */
+        result = pc[0];
+        break;
+      
+      case 2:
+        /* For two-byte codes, lead byte payload is ---PPPPP */
+        result = (pc[0] & 0x1F);
+        break;
+      
+      case 3:
+        /* For three-byte codes, lead byte payload is ----PPPP */
+        result = (pc[0] & 0x0F);
+        break;
+      
+      case 4:
+        /* For four-byte codes, lead byte payload is -----PPP */
+        result = (pc[0] & 0x07);
+        break;
+      
+      default:
+        /* Shouldn't happen */
+        abort();
+    }
+  }
+  
+  /* Include the payload from any continuation bytes -- continuation
+   * byte payload is --PPPPPP */
+  if (status) {
+    for(x = 1; x < ec; x++) {
+      result = (result << 6) | (pc[x] & 0x3F);
+    }
+  }
+  
+  /* Fail for any overlong encodings */
+  if (status) {
+    switch (ec) {
+      case 1:
+        /* One-byte encodings are never overlong */
+        break;
+      
+      case 2:
+        /* Two-byte encodings must be at least U+0080 */
+        if (result < 0x80L) {
+          status = 0;
+        }
+        break;
+      
+      case 3:
+        /* Three-byte encodings must be at least U+0800 */
+        if (result < 0x800L) {
+          status = 0;
+        }
+        break;
+      
+      case 4:
+        /* Four-byte encodings must be at least U+10000 */
+        if (result < 0x10000L) {
+          status = 0;
+        }
+        break;
+      
+      default:
+        /* Shouldn't happen */
+        abort();
+    }
+  }
+  
+  /* If we failed, set result to -1 */
+  if (!status) {
+    result = -1;
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Encode a Unicode codepoint into UTF-8.
+ * 
+ * The given codepoint must be in [0, UNICODE_MAX_CPV] range.  Also, it
+ * must NOT be in [UNICODE_MIN_SURROGATE, UNICODE_MAX_SURROGATE] range.
+ * 
+ * pb points to the buffer to write the encoded codepoint into.  This
+ * function will write from one to four bytes into the buffer.  Make
+ * sure there is enough room in the buffer for the encoded codepoint!
+ * 
+ * One way of handling the buffer is to allocate a buffer of five
+ * characters, initialize all the characters to nul, and then call this
+ * function on the buffer.  After this function returns, then, the
+ * result will be nul-terminated (except if the given codepoint is zero,
+ * in which case the result will be empty).
+ * 
+ * Parameters:
+ * 
+ *   cpv - the Unicode codepoint
+ * 
+ *   pb - the buffer to write the result into
+ */
+static void snutf_encode(long cpv, unsigned char *pb) {
+  
+  int ec = 0;
+  int c = 0;
+  int i = 0;
+  
+  /* Check parameters */
+  if (pb == NULL) {
+    abort();
+  }
+  if ((cpv < 0) || (cpv > UNICODE_MAX_CPV) ||
+        ((cpv >= UNICODE_MIN_SURROGATE) &&
+          (cpv <= UNICODE_MAX_SURROGATE))) {
+    abort();
+  }
+  
+  /* From the codepoint value, figure out the encoded length of the
+   * codepoint */
+  if (cpv < 0x80L) {
+    /* U+0000 to 0+007F has one-byte encodings */
+    ec = 1;
+  
+  } else if (cpv < 0x800L) {
+    /* U+0080 to U+07FF has two-byte encodings */
+    ec = 2;
+    
+  } else if (cpv < 0x10000L) {
+    /* U+0800 to U+FFFF has three-byte encodings */
+    ec = 3;
+    
+  } else if (cpv <= UNICODE_MAX_CPV) {
+    /* U+10000 to end of Unicode range has four-byte encodings */
+    ec = 4;
+    
+  } else {
+    /* Shouldn't happen */
+    abort();
+  }
+  
+  /* Align the cpv by left shifting so that everything has payload bits
+   * for three continuation bytes; that is, for one-byte codes, add
+   * 18 (= 6 x 3) bits; for two-byte codes, add 12 (= 6 x 2) bits; for
+   * three-byte codes, add 6 bits; and nothing for four-byte codes,
+   * which already have three continuation bytes */
+  if (ec == 1) {
+    cpv = cpv << 18;
+  
+  } else if (ec == 2) {
+    cpv = cpv << 12;
+    
+  } else if (ec == 3) {
+    cpv = cpv << 6;
+  }
+  
+  /* Lead byte payload is now always 18 bits shifted, so combine it with
+   * the appropriate marker bits and write the first encoded byte */
+  c = (int) (cpv >> 18);
+  
+  if (ec == 2) {
+    c = c | 0xC0;
+  
+  } else if (ec == 3) {
+    c = c | 0xE0;
+    
+  } else if (ec == 4) {
+    c = c | 0xF0;
+  }
+  
+  *pb = (unsigned char) c;
+  pb++;
+  
+  /* Mask out the lead byte payload, leaving just the continuation byte
+   * payloads */
+  cpv = cpv & 0x3ffffL;
+  
+  /* Write any continuation bytes */
+  for(i = 1; i < ec; i++) {
+    /* Get most significant continuation payload */
+    c = (int) (cpv >> 12);
+    
+    /* Add continuation marker bit */
+    c = c | 0x80;
+    
+    /* Output continuation byte */
+    *pb = (unsigned char) c;
+    pb++;
+    
+    /* Mask out most significant continuation payload */
+    cpv = cpv & 0xfffL;
+    
+    /* Shift continuation payloads left */
+    cpv = cpv << 6;
+  }
+}
+
+/*
+ * Decode four hexadecimal digits.
+ * 
+ * pc points to the four digits, which may be either uppercase or
+ * lowercase.  The digits do not need to be followed by anything in
+ * particular.
+ * 
+ * Parameters:
+ * 
+ *   pc - pointer to the digits
+ * 
+ * Return:
+ * 
+ *   the value of the digits, in range 0x0000 to 0xffff, or -1 if the
+ *   four characters are not all hexadecimal digits
+ */
+static long snutf_hex(const char *pc) {
+  
+  long result = 0;
+  int i = 0;
+  int c = 0;
+  
+  /* Check parameter */
+  if (pc == NULL) {
+    abort();
+  }
+  
+  /* Accumulate the digits, stopping at anything else (including the
+   * nul terminator) */
+  for(i = 0; i < 4; i++) {
+    c = (int) (((const unsigned char *) pc)[i]);
+    
+    if ((c >= ASCII_ZERO) && (c <= ASCII_NINE)) {
+      result = (result << 4) | (c - ASCII_ZERO);
+    
+    } else if ((c >= ASCII_UPPER_A) && (c <= ASCII_UPPER_F)) {
+      result = (result << 4) | (c - ASCII_UPPER_A + 10);
+      
+    } else if ((c >= ASCII_LOWER_A) && (c <= ASCII_LOWER_F)) {
+      result = (result << 4) | (c - ASCII_LOWER_A + 10);
+      
+    } else {
+      result = -1;
+      break;
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Reading callback for a stdio FILE * source.
+ * 
+ * The function prototype matches pfRead in SNSOURCE.  See the
+ * documentation of that field for further information.
+ */
+static int snsource_file_read(void *pCustom) {
+  
+  FILE *pIn = NULL;
+  int result = 0;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Convert parameter to a FILE * handle */
+  pIn = (FILE *) pCustom;
+  
+  /* Read from the file and check for EOF and I/O error conditions */
+  result = getc(pIn);
+  if (result == EOF) {
+    if (feof(pIn)) {
+      result = SNERR_EOF;
+    } else {
+      result = SNERR_IOERR;
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Destructor callback for a stdio FILE * source.
+ * 
+ * The function prototype matches pfDestruct in SNSOURCE.  See the
+ * documentation of that field for further information.
+ */
+static void snsource_file_free(void *pCustom) {
+  
+  FILE *pIn = NULL;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Convert parameter to a FILE * handle */
+  pIn = (FILE *) pCustom;
+  
+  /* Close the file */
+  fclose(pIn);
+}
+
+/*
+ * Rewind callback for a stdio FILE * source.
+ * 
+ * The function prototype matches pfRewind in SNSOURCE.  See the
+ * documentation of that field for further information.
+ */
+static int snsource_file_rewind(void *pCustom) {
+  
+  int status = 1;
+  FILE *pIn = NULL;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Convert parameter to a FILE * handle */
+  pIn = (FILE *) pCustom;
+  
+  /* Seek back to the beginning of the file */
+  if (fseek(pIn, 0, SEEK_SET)) {
+    status = 0;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Reading callback for a string source.
+ * 
+ * The function prototype matches pfRead in SNSOURCE.  See the
+ * documentation of that field for further information.
+ */
+static int snsource_str_read(void *pCustom) {
+  
+  SNSTRSRC *pStS = NULL;
+  int c = 0;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Convert parameter to the string handling structure */
+  pStS = (SNSTRSRC *) pCustom;
+  
+  /* Get current character */
+  c = *(pStS->pStr);
+  
+  /* If current character is not nul, then advance pointer; else, set
+   * return to EOF condition and don't advance pointer */
+  if (c != 0) {
+    (pStS->pStr)++;
+  } else {
+    c = SNERR_EOF;
+  }
+  
+  /* Return the character or EOF */
+  return c;
+}
+
+/*
+ * Destructor callback for a string source.
+ * 
+ * The function prototype matches pfDestruct in SNSOURCE.  See the
+ * documentation of that field for further information.
+ */
+static void snsource_str_free(void *pCustom) {
+  
+  SNSTRSRC *pStS = NULL;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Convert parameter to the string handling structure */
+  pStS = (SNSTRSRC *) pCustom;
+  
+  /* Free the structure */
+  free(pStS);
+}
+
+/*
+ * Rewind callback for a string source.
+ * 
+ * The function prototype matches pfRewind in SNSOURCE.  See the
+ * documentation of that field for further information.
+ */
+static int snsource_str_rewind(void *pCustom) {
+  
+  SNSTRSRC *pStS = NULL;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Convert parameter to the string handling structure */
+  pStS = (SNSTRSRC *) pCustom;
+  
+  /* Reset the string pointer back to its initial value */
+  pStS->pStr = pStS->pRewind;
+  
+  /* This operation always succeeds */
+  return 1;
+}
+
+/*
+ * Reading callback for a memory source.
+ * 
+ * The function prototype matches pfRead in SNSOURCE.  See the
+ * documentation of that field for further information.
+ */
+static int snsource_mem_read(void *pCustom) {
+  
+  SNMEMSRC *pMS = NULL;
+  int c = 0;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Convert parameter to the memory handling structure */
+  pMS = (SNMEMSRC *) pCustom;
+  
+  /* If there is data remaining, return the next byte and advance; else,
+   * return EOF condition */
+  if (pMS->pos < pMS->len) {
+    c = (pMS->pData)[pMS->pos];
+    (pMS->pos)++;
+  } else {
+    c = SNERR_EOF;
+  }
+  
+  /* Return the character or EOF */
+  return c;
+}
+
+/*
+ * Destructor callback for a memory source.
+ * 
+ * The function prototype matches pfDestruct in SNSOURCE.  See the
+ * documentation of that field for further information.
+ */
+static void snsource_mem_free(void *pCustom) {
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Free the structure */
+  free(pCustom);
+}
+
+/*
+ * Rewind callback for a memory source.
+ * 
+ * The function prototype matches pfRewind in SNSOURCE.  See the
+ * documentation of that field for further information.
+ */
+static int snsource_mem_rewind(void *pCustom) {
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Reset the position back to the beginning */
+  ((SNMEMSRC *) pCustom)->pos = 0;
+  
+  /* This operation always succeeds */
+  return 1;
+}
+
+/*
+ * Reading callback for a concatenated source.
+ * 
+ * The function prototype matches pfRead in SNSOURCE.  See the
+ * documentation of that field for further information.
+ * 
+ * Parts are read in order, moving on to the next part when a part
+ * reaches EOF.  Any other error of a part is reported as an I/O error.
+ */
+static int snsource_cat_read(void *pCustom) {
+  
+  SNCATSRC *pCS = NULL;
+  int c = SNERR_EOF;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Convert parameter to the concatenation handling structure */
+  pCS = (SNCATSRC *) pCustom;
+  
+  /* Read from the current part, moving past parts that are at EOF */
+  while (pCS->cur < pCS->count) {
+    c = snsource_read((pCS->ppParts)[pCS->cur]);
+    if (c != SNERR_EOF) {
+      break;
+    }
+    
+    (pCS->cur)++;
+    (pCS->pStart)[pCS->cur] = pCS->pos;
+  }
+  
+  /* Count bytes and report part errors as I/O errors */
+  if (c >= 0) {
+    if (pCS->pos < LONG_MAX) {
+      (pCS->pos)++;
+    }
+  } else if (c != SNERR_EOF) {
+    c = SNERR_IOERR;
+  }
+  
+  /* Return the character or EOF or error */
+  return c;
+}
+
+/*
+ * Destructor callback for a concatenated source.
+ * 
+ * The function prototype matches pfDestruct in SNSOURCE.  See the
+ * documentation of that field for further information.
+ * 
+ * The part sources are not freed.
+ */
+static void snsource_cat_free(void *pCustom) {
+  
+  SNCATSRC *pCS = NULL;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Free the arrays and the structure */
+  pCS = (SNCATSRC *) pCustom;
+  free(pCS->ppParts);
+  free(pCS->pStart);
+  free(pCS);
+}
+
+/*
+ * Rewind callback for a concatenated source.
+ * 
+ * The function prototype matches pfRewind in SNSOURCE.  See the
+ * documentation of that field for further information.
+ * 
+ * This is only used when all the parts support multipass.  All the
+ * parts are rewound, and the operation fails if any of them fails.
+ */
+static int snsource_cat_rewind(void *pCustom) {
+  
+  SNCATSRC *pCS = NULL;
+  int status = 1;
+  long i = 0;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  /* Convert parameter to the concatenation handling structure */
+  pCS = (SNCATSRC *) pCustom;
+  
+  /* Rewind all the parts */
+  for(i = 0; i < pCS->count; i++) {
+    if (!snsource_rewind((pCS->ppParts)[i])) {
+      status = 0;
+    }
+  }
+  
+  /* Go back to the first part */
+  pCS->cur = 0;
+  pCS->pos = 0;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Read a single byte from a source object.
+ * 
+ * The return value is an unsigned byte value in range [0, 255], or else
+ * SNERR_EOF or SNERR_IOERR.  SNERR_UTF8 is never generated by this
+ * function, but it may be returned because snsource_readCPV() may set
+ * the status of the source object to that error.
+ * 
+ * Clients are recommended to use snsource_readCPV() instead of directly
+ * using this function.
+ * 
+ * Parameters:
+ * 
+ *   pIn - the source to read from
+ * 
+ * Return:
+ * 
+ *   the next byte read, or SNERR_EOF if nothing remains in input
+ *   source, or SNERR_IOERR if there was an error reading the input
+ *   source, or SNERR_UTF8 if there was a previous UTF-8 decoding error
+ */
+static int snsource_read(SNSOURCE *pIn) {
+  
+  int result = 0;
+  
+  /* Check parameter */
+  if (pIn == NULL) {
+    abort();
+  }
+  
+  /* Determine first whether we have a special condition to return
+   * without invoking the callback */
+  if (pIn->status < 0) {
+    /* We have a special status code, so just use that */
+    result = pIn->status;
+    
+  } else {
+    /* No special status code, so we need to invoke the read callback;
+     * check first that the callback is defined */
+    if (pIn->pfRead == NULL) {
+      abort();
+    }
+    
+    /* Invoke the read callback */
+    result = (*(pIn->pfRead))(pIn->pCustom);
+    
+    /* Check range of returned result */
+    if (((result < 0) || (result > 255)) &&
+          (result != SNERR_EOF) && (result != SNERR_IOERR)) {
+      abort();
+    }
+    
+    /* If returned result was an unsigned byte value, increment the read
+     * count (unless it has overflown); otherwise, if it is a special
+     * return code, store it in status so we return it in future
+     * invocations */
+    if ((result >= 0) && (result <= 255)) {
+      if (pIn->read_count < LONG_MAX) {
+        (pIn->read_count)++;
+      }
+    } else {
+      pIn->status = result;
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Read a UTF-8 encoded Unicode codepoint from a source object.
+ * 
+ * The return value is a Unicode codepoint [0, UNICODE_MAX_CPV], or else
+ * SNERR_EOF if end of source file, SNERR_IOERR if I/O error reading
+ * from source, or SNERR_UTF8 if error decoding UTF-8.
+ * 
+ * This function will only decode a single UTF-8 codepoint.  It will
+ * check for overlong encodings and invalid encodings, causing the
+ * SNERR_UTF8 error if such illegal encodings occur.
+ * 
+ * This function WILL successfully decode surrogate codepoints, even
+ * though surrogates aren't supposed to be used in UTF-8.  It is assumed
+ * that surrogate pairs will be properly decoded at a higher level.
+ * 
+ * Parameters:
+ * 
+ *   pIn - the source to read from
+ * 
+ * Return:
+ * 
+ *   the next codepoint read (including surrogates!), or SNERR_EOF if
+ *   nothing remains in input source, or SNERR_IOERR if there was an
+ *   error reading the input source, or SNERR_UTF8 if there was a UTF-8
+ *   decoding error
+ */
+static long snsource_readCPV(SNSOURCE *pIn) {
+  
+  unsigned char buf[5];
+  long result = 0;
+  int err_num = 0;
+  int c = 0;
+  int ec = 0;
+  int i = 0;
+  
+  /* Initialize buffer */
+  memset(buf, 0, 5);
+  
+  /* Check parameters */
+  if (pIn == NULL) {
+    abort();
+  }
+  
+  /* Get the next byte */
+  c = snsource_read(pIn);
+  
+  /* If we got a special status return, then result is that; otherwise,
+   * proceed */
+  if (c < 0) {
+    /* Special status return, so that will be the result */
+    result = c;
+  
+  } else {
+    /* We read a byte, so determine how many bytes in the encoded
+     * codepoint */
+    ec = snutf_count(c);
+    if (ec < 1) {
+      /* Not a valid first byte of an encoded codepoint, so fail */
+      err_num = SNERR_UTF8;
+    } else if (ec > 4) {
+      /* Shouldn't happen */
+      abort();
+    }
+    
+    /* Write the character we just read into the decoding buffer */
+    if (!err_num) {
+      buf[0] = (unsigned char) c;
+    }
+    
+    /* Read any additional bytes into the decoding buffer -- EOF returns
+     * will be changed to UTF-8 decoding errors */
+    if (!err_num) {
+      for(i = 1; i < ec; i++) {
+        c = snsource_read(pIn);
+        if (c < 0) {
+          if (c == SNERR_EOF) {
+            err_num = SNERR_UTF8;
+          } else {
+            err_num = c;
+          }
+          break;
+        } else {
+          buf[i] = (unsigned char) c;
+        }
+      }
+    }
+    
+    /* Decode the buffered character bytes into a codepoint */
+    if (!err_num) {
+      result = snutf_decode(buf);
+      if (result < 0) {
+        err_num = SNERR_UTF8;
+      }
+    }
+  }
+  
+  /* If error occurred, set result to error code and store error code in
+   * status field of source */
+  if (err_num) {
+    result = err_num;
+    pIn->status = err_num;
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Charge memory growth to an accounting structure.
+ * 
+ * pAcct is the accounting structure, or NULL if the allocation is not
+ * accounted, in which case this function always succeeds and does
+ * nothing.
+ * 
+ * amount is the number of additional bytes that are about to be
+ * allocated.  It must not be negative.
+ * 
+ * If force is zero and the accounting structure has a budget that the
+ * growth would exceed, the growth is refused, the over-budget flag is
+ * set, and nothing is charged.  If force is non-zero, the growth is
+ * always charged even if it goes over budget.  This is for small
+ * allocations that have no way of reporting failure.
+ * 
+ * Parameters:
+ * 
+ *   pAcct - the accounting structure or NULL
+ * 
+ *   amount - the number of bytes to charge
+ * 
+ *   force - non-zero to charge even if over budget
+ * 
+ * Return:
+ * 
+ *   non-zero if the growth may proceed, zero if it was refused
+ */
+static int snmem_grow(SNMEMACCT *pAcct, long amount, int force) {
+  
+  int status = 1;
+  
+  /* Check parameters */
+  if (amount < 0) {
+    abort();
+  }
+  
+  /* Only proceed if accounting */
+  if (pAcct != NULL) {
+    
+    /* Check the budget unless forced */
+    if ((!force) && (pAcct->budget > 0)) {
+      if (amount > pAcct->budget - pAcct->current) {
+        pAcct->over = 1;
+        status = 0;
+      }
+    }
+    
+    /* Charge the growth and update the peak, saturating at LONG_MAX */
+    if (status) {
+      if (amount <= LONG_MAX - pAcct->current) {
+        pAcct->current += amount;
+      } else {
+        pAcct->current = LONG_MAX;
+      }
+      if (pAcct->current > pAcct->peak) {
+        pAcct->peak = pAcct->current;
+      }
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Credit released memory back to an accounting structure.
+ * 
+ * pAcct is the accounting structure, or NULL if the allocation was not
+ * accounted, in which case this function does nothing.
+ * 
+ * amount is the number of bytes that were released.  It must not be
+ * negative.
+ * 
+ * Parameters:
+ * 
+ *   pAcct - the accounting structure or NULL
+ * 
+ *   amount - the number of bytes released
+ */
+static void snmem_release(SNMEMACCT *pAcct, long amount) {
+  
+  /* Check parameters */
+  if (amount < 0) {
+    abort();
+  }
+  
+  /* Only proceed if accounting */
+  if (pAcct != NULL) {
+    if (amount < pAcct->current) {
+      pAcct->current -= amount;
+    } else {
+      pAcct->current = 0;
+    }
+  }
+}
+
+/*
+ * Look up a byte offset in the line-start index of a source.
+ * 
+ * The source must have a memory view.  offset must be in range zero up
+ * to and including the number of bytes that have been read through the
+ * source.  The line-start index is extended if necessary so that it
+ * covers the offset, by scanning the view for LF characters.
+ * 
+ * The returned line number is one greater than the number of LF
+ * characters that occur before the offset.  If pCol is not NULL, the
+ * column is written to it, which is one greater than the number of
+ * bytes between the start of the line and the offset.
+ * 
+ * The line and column saturate at LONG_MAX.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the source
+ * 
+ *   offset - the byte offset to look up
+ * 
+ *   pCol - pointer to receive the column, or NULL
+ * 
+ * Return:
+ * 
+ *   the line number of the offset
+ */
+static long snsource_index(SNSOURCE *pSrc, long offset, long *pCol) {
+  
+  const unsigned char *pc = NULL;
+  const unsigned char *pEnd = NULL;
+  long lo = 0;
+  long hi = 0;
+  long mid = 0;
+  long ls = 0;
+  long result = 0;
+  
+  /* Check parameters and state */
+  if (pSrc == NULL) {
+    abort();
+  }
+  if ((pSrc->pView == NULL) || (offset < 0) ||
+      (offset > pSrc->read_count)) {
+    abort();
+  }
+  
+  /* Extend the index to cover the offset if necessary, using memchr()
+   * to find each LF, which the C library typically vectorizes */
+  if (offset > pSrc->lines_scanned) {
+    pc = pSrc->pView + pSrc->lines_scanned;
+    pEnd = pSrc->pView + offset;
+    
+    for(pc = (const unsigned char *) memchr(pc, ASCII_LF,
+                                            (size_t) (pEnd - pc));
+        pc != NULL;
+        pc = (const unsigned char *) memchr(pc, ASCII_LF,
+                                            (size_t) (pEnd - pc))) {
+      
+      /* Move past the LF */
+      pc++;
+      
+      /* Grow the index if necessary */
+      if (pSrc->lines_count >= pSrc->lines_cap) {
+        if (pSrc->lines_cap < 1) {
+          pSrc->lines_cap = SNSOURCE_LINES_INIT;
+        } else if (pSrc->lines_cap <= LONG_MAX / 2) {
+          pSrc->lines_cap = pSrc->lines_cap * 2;
+        } else {
+          abort();
+        }
+        if ((size_t) pSrc->lines_cap > ((size_t) -1) / sizeof(long)) {
+          abort();
+        }
+        pSrc->pLines = (long *) realloc(pSrc->pLines,
+                          ((size_t) pSrc->lines_cap) * sizeof(long));
+        if (pSrc->pLines == NULL) {
+          abort();
+        }
+      }
+      
+      /* Record the start of the next line */
+      (pSrc->pLines)[pSrc->lines_count] = (long) (pc - pSrc->pView);
+      (pSrc->lines_count)++;
+      
+      /* Stop if the LF was the last byte to scan */
+      if (pc >= pEnd) {
+        break;
+      }
+    }
+    
+    pSrc->lines_scanned = offset;
+  }
+  
+  /* Binary search for the number of line starts at or before the
+   * offset */
+  lo = 0;
+  hi = pSrc->lines_count;
+  while (lo < hi) {
+    mid = lo + ((hi - lo) / 2);
+    if ((pSrc->pLines)[mid] <= offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  
+  /* Get the start of the line the offset is on */
+  if (lo > 0) {
+    ls = (pSrc->pLines)[lo - 1];
+  } else {
+    ls = 0;
+  }
+  
+  /* Compute line and column, saturating at LONG_MAX */
+  if (lo < LONG_MAX) {
+    result = lo + 1;
+  } else {
+    result = LONG_MAX;
+  }
+  
+  if (pCol != NULL) {
+    if (offset - ls < LONG_MAX) {
+      *pCol = (offset - ls) + 1;
+    } else {
+      *pCol = LONG_MAX;
+    }
+  }
+  
+  /* Return line */
+  return result;
+}
+
+/*
+ * Initialize a long stack.
+ * 
+ * Stacks must be initialized before they are used, or undefined 
+ * behavior occurs.  A full reset must be performed on the stack using
+ * snstack_reset() before the structure is released or a memory leak may
+ * occur.
+ * 
+ * icap is the initial allocation capacity in longs.  maxcap is the 
+ * maximum capacity for the buffer (in longs).
+ * 
+ * pAcct is the memory accounting structure that allocations of the
+ * stack are charged to, or NULL if the stack is not accounted.  If not
+ * NULL, it must remain valid for as long as the stack is in use.
+ * 
+ * icap must be greater than zero, maxcap must be greater than or equal
+ * to icap, and maxcap must be no greater than (LONG_MAX / 2) or a fault
+ * will occur.
+ * 
+ * If (sizeof(size_t) < 2), this function will always fault.  Otherwise,
+ * if (sizeof(size_t) < 4), this function will fault if maxcap
+ * multiplied by sizeof(long) exceeds 65535.  Otherwise, it must be that
+ * (sizeof(size_t) >= 4) and this function will fault if maxcap times
+ * sizeof(long) exceeds 2147483647.  This is to prevent memory
+ * allocation problems.
+ * 
+ * Do not initialize a stack that is already initialized, or a memory
+ * leak may occur.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - pointer to the stack to initialize
+ * 
+ *   icap - the initial allocation capacity in longs
+ * 
+ *   maxcap - the maximum allocation capacity in longs
+ * 
+ *   pAcct - the memory accounting structure or NULL
+ */
+static void snstack_init(
+    SNSTACK   * pStack,
+    long        icap,
+    long        maxcap,
+    SNMEMACCT * pAcct) {
+  
+  /* Check parameters */
+  if (pStack == NULL) {
+    abort();
+  }
+  
+  if ((icap <= 0) || (maxcap < icap) || (maxcap > (LONG_MAX / 2))) {
+    abort();
+  }
+  
+  if (sizeof(size_t) < 2) {
+    abort();
+  } else if (sizeof(size_t) < 4) {
+    if (maxcap > (65535L / sizeof(long))) {
+      abort();
+    }
+  } else {
+    if (maxcap > (2147483647L / sizeof(long))) {
+      abort();
+    }
+  }
+  
+  /* Initialize structure */
+  memset(pStack, 0, sizeof(SNSTACK));
+  pStack->pBuf = NULL;
+  pStack->count = 0;
+  pStack->cap = 0;
+  pStack->initcap = icap;
+  pStack->maxcap = maxcap;
+  pStack->pAcct = pAcct;
+}
+
+/*
+ * Reset a stack back to empty.
+ * 
+ * The stack must already have been initialized with snstack_init() or
+ * undefined behavior occurs.
+ * 
+ * full is non-zero to perform a full reset, zero to perform a fast
+ * reset.  A fast reset just clears the buffer to empty without
+ * releasing the allocated memory buffer, allowing it to be reused.  A
+ * full reset also releases the allocated memory buffer, clearing the
+ * structure all the way back to its initial state.
+ * 
+ * A full reset must be performed on all stacks before they are 
+ * released, or a memory leak may occur.
+ * 
+ * Parameters:
+ * 
+ *   pStack - the stack to reset
+ * 
+ *   full - non-zero for a full reset, zero for a partial reset
+ */
+static void snstack_reset(SNSTACK *pStack, int full) {
+  
+  /* Check parameters */
+  if (pStack == NULL) {
+    abort();
+  }
+  
+  /* Set the count back to zero */
+  pStack->count = 0;
+  
+  /* If a buffer is allocated, clear it all to zero */
+  if (pStack->cap > 0) {
+    memset(pStack->pBuf, 0, (size_t) (pStack->cap * sizeof(long)));
+  }
+  
+  /* If we're doing a full reset, release the buffer if allocated and
+   * reset capacity back to zero */
+  if (full && (pStack->cap > 0)) {
+    snmem_release(pStack->pAcct, (long) (pStack->cap * sizeof(long)));
+    free(pStack->pBuf);
+    pStack->pBuf = NULL;
+    pStack->cap = 0;
+  }
+}
+
+/*
+ * Push a long on top of a stack.
+ * 
+ * The long value v may have any value.
+ * 
+ * The function fails if there is no more capacity left for another
+ * long, or if growing the buffer would exceed the memory budget of the
+ * accounting structure.  The buffer is unmodified in this case.
+ * 
+ * Parameters:
+ * 
+ *   pStack - the stack to push a long onto
+ * 
+ *   v - the long value to push
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if no more capacity
+ */
+static int snstack_push(SNSTACK *pStack, long v) {
+  
+  int status = 1;
+  long newcap = 0;
+  
+  /* Check parameters */
+  if (pStack == NULL) {
+    abort();
+  }
+  
+  /* Proceed only if we are not completely maxed out of capacity */
+  if (pStack->count >= pStack->maxcap) {
+    status = 0;
+  }
+  
+  /* We have capacity left; first, make the initial allocation if we
+   * haven't allocated a memory buffer yet and the budget allows it */
+  if (status && (pStack->cap < 1)) {
+    if (snmem_grow(pStack->pAcct,
+          (long) (pStack->initcap * sizeof(long)), 0)) {
+      pStack->pBuf = (long *) malloc(
+                        (size_t) (pStack->initcap * sizeof(long)));
+      if (pStack->pBuf == NULL) {
+        abort();
+      }
+      memset(pStack->pBuf, 0,
+        (size_t) (pStack->initcap * sizeof(long)));
+      pStack->cap = pStack->initcap;
+      
+    } else {
+      /* Over budget */
+      status = 0;
+    }
+  }
+  
+  /* Next, increase allocated memory buffer if we need more space */
+  if (status && (pStack->count >= pStack->cap)) {
+    /* New capacity should usually be double current capacity */
+    newcap = pStack->cap * 2;
+    
+    /* If new capacity exceeds max capacity, set to max capacity */
+    if (newcap > pStack->maxcap) {
+      newcap = pStack->maxcap;
+    }
+    
+    /* Charge the growth against the budget */
+    if (!snmem_grow(pStack->pAcct,
+          (long) ((newcap - pStack->cap) * sizeof(long)), 0)) {
+      status = 0;
+    }
+    
+    /* Allocate new buffer */
+    if (status) {
+      pStack->pBuf = (long *) realloc(pStack->pBuf,
+                                (size_t) (newcap * sizeof(long)));
+      if (pStack->pBuf == NULL) {
+        abort();
+      }
+      
+      /* Initialize new space to zero */
+      memset((void *) (pStack->pBuf + pStack->cap),
+              0,
+              (size_t) ((newcap - pStack->cap) * sizeof(long)));
+      
+      /* Update capacity */
+      pStack->cap = newcap;
+    }
+  }
+  
+  /* Append the new long */
+  if (status) {
+    (pStack->pBuf)[pStack->count] = v;
+    (pStack->count)++;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Pop a long value off the top of a stack.
+ * 
+ * pStack is the stack object to a pop a value off of.  It must be
+ * properly initialized.  It must not be empty, or a fault will occur.
+ * 
+ * Parameters:
+ * 
+ *   pStack - the stack
+ * 
+ * Return:
+ * 
+ *   the popped long value
+ */
+static long snstack_pop(SNSTACK *pStack) {
+  
+  long v = 0;
+  
+  /* Check parameter */
+  if (pStack == NULL) {
+    abort();
+  }
+  
+  /* Check state */
+  if (pStack->count < 1) {
+    abort();
+  }
+  
+  /* Get the top of the stack */
+  v = pStack->pBuf[pStack->count - 1];
+  
+  /* Take the top element off the stack */
+  (pStack->count)--;
+  
+  /* Return the removed value */
+  return v;
+}
+
+/*
+ * Peek at the long value on top of a stack without removing it.
+ * 
+ * pStack is the stack object to peek at.  It must be properly
+ * initialized.  It must not be empty, or a fault will occur.
+ * 
+ * Parameters:
+ * 
+ *   pStack - the stack
+ * 
+ * Return:
+ * 
+ *   the peeked long value
+ */
+static long snstack_peek(SNSTACK *pStack) {
+  
+  /* Check parameter */
+  if (pStack == NULL) {
+    abort();
+  }
+  
+  /* Check state */
+  if (pStack->count < 1) {
+    abort();
+  }
+  
+  /* Return the top of the stack */
+  return pStack->pBuf[pStack->count - 1];
+}
+
+/*
+ * Increment the long value on top of a stack.
+ * 
+ * pStack is the stack object.  It must be properly initialized.  It
+ * must not be empty, or a fault will occur.
+ * 
+ * The function fails if the top of the stack has value LONG_MAX.
+ * 
+ * Parameters:
+ * 
+ *   pStack - the stack
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if long value already at maximum
+ */
+static int snstack_inc(SNSTACK *pStack) {
+  
+  int status = 1;
+  
+  /* Check parameter */
+  if (pStack == NULL) {
+    abort();
+  }
+  
+  /* Check state */
+  if (pStack->count < 1) {
+    abort();
+  }
+  
+  /* Increment if possible */
+  if (pStack->pBuf[pStack->count - 1] < LONG_MAX) {
+    (pStack->pBuf[pStack->count - 1])++;
+  } else {
+    status = 0;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Decrement the long value on top of a stack.
+ * 
+ * pStack is the stack object.  It must be properly initialized.  It
+ * must not be empty, or a fault will occur.
+ * 
+ * The function fails if the top of the stack has already has value less
+ * than one.
+ * 
+ * Note that this function will not decrement into negative range.
+ * 
+ * Parameters:
+ * 
+ *   pStack - the stack
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if long value already less than one
+ */
+static int snstack_dec(SNSTACK *pStack) {
+  
+  int status = 1;
+  
+  /* Check parameter */
+  if (pStack == NULL) {
+    abort();
+  }
+  
+  /* Check state */
+  if (pStack->count < 1) {
+    abort();
+  }
+  
+  /* Decrement if possible */
+  if (pStack->pBuf[pStack->count - 1] > 0) {
+    (pStack->pBuf[pStack->count - 1])--;
+  } else {
+    status = 0;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Get the number of elements on a given stack.
+ * 
+ * Parameters:
+ * 
+ *   pStack - the stack to query
+ * 
+ * Return:
+ * 
+ *   the number of elements on the stack
+ */
+static long snstack_count(SNSTACK *pStack) {
+  
+  /* Check parameter */
+  if (pStack == NULL) {
+    abort();
+  }
+  
+  /* Return count */
+  return (pStack->count);
+}
+
+/*
+ * Initialize a string buffer.
+ * 
+ * String buffers must be initialized before they are used, or undefined
+ * behavior occurs.  A full reset must be performed on the string buffer
+ * using snbuffer_reset() before the structure is released or a memory
+ * leak may occur.
+ * 
+ * icap is the initial allocation capacity in bytes.  maxcap is the
+ * maximum capacity in bytes for the buffer.  Note that the capacity
+ * counts bytes, not Unicode codepoints.
+ * 
+ * pAcct is the memory accounting structure that allocations of the
+ * buffer are charged to, or NULL if the buffer is not accounted.  If
+ * not NULL, it must remain valid for as long as the buffer is in use.
+ * 
+ * icap must be greater than zero, maxcap must be greater than or equal
+ * to icap, and maxcap must be no greater than (LONG_MAX / 2) or a fault
+ * will occur.
+ * 
+ * If (sizeof(size_t) < 2), this function will always fault.  Otherwise,
+ * if (sizeof(size_t) < 4), this function will fault if maxcap exceeds
+ * 65535.  Otherwise, (sizeof(size_t) >= 4) and this function will fault
+ * if maxcap exceeds 2147483647.  This is to prevent memory allocation
+ * problems.
+ * 
+ * Do not initialize a string buffer that is already initialized, or a
+ * memory leak may occur.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - pointer to the buffer to initialize
+ * 
+ *   icap - the initial allocation capacity
+ * 
+ *   maxcap - the maximum allocation capacity
+ * 
+ *   pAcct - the memory accounting structure or NULL
+ */
+static void snbuffer_init(
+    SNBUFFER  * pBuffer,
+    long        icap,
+    long        maxcap,
+    SNMEMACCT * pAcct) {
+  
+  /* Check parameters */
+  if (pBuffer == NULL) {
+    abort();
+  }
+  
+  if ((icap <= 0) || (maxcap < icap) || (maxcap > (LONG_MAX / 2))) {
+    abort();
+  }
+  
+  if (sizeof(size_t) < 2) {
+    abort();
+  } else if (sizeof(size_t) < 4) {
+    if (maxcap > 65535L) {
+      abort();
+    }
+  } else {
+    if (maxcap > 2147483647L) {
+      abort();
+    }
+  }
+  
+  /* Initialize structure */
+  memset(pBuffer, 0, sizeof(SNBUFFER));
+  pBuffer->pBuf = NULL;
+  pBuffer->count = 0;
+  pBuffer->cap = 0;
+  pBuffer->initcap = icap;
+  pBuffer->maxcap = maxcap;
+  pBuffer->pAcct = pAcct;
+}
+
+/*
+ * Reset a string buffer back to empty.
+ * 
+ * The string buffer must already have been initialized with
+ * snbuffer_init() or undefined behavior occurs.
+ * 
+ * full is non-zero to perform a full reset, zero to perform a fast
+ * reset.  A fast reset just clears the buffer to empty without
+ * releasing the allocated memory buffer, allowing it to be reused.  A
+ * full reset also releases the allocated memory buffer, clearing the
+ * structure all the way back to its initial state.
+ * 
+ * A full reset must be performed on all string buffers before they are
+ * released, or a memory leak may occur.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - the string buffer to reset
+ * 
+ *   full - non-zero for a full reset, zero for a partial reset
+ */
+static void snbuffer_reset(SNBUFFER *pBuffer, int full) {
+  
+  /* Check parameters */
+  if (pBuffer == NULL) {
+    abort();
+  }
+  
+  /* Set the count back to zero */
+  pBuffer->count = 0;
+  
+  /* If a buffer is allocated, clear it all to zero */
+  if (pBuffer->cap > 0) {
+    memset(pBuffer->pBuf, 0, (size_t) pBuffer->cap);
+  }
+  
+  /* If we're doing a full reset, release the buffer if allocated and
+   * reset capacity back to zero */
+  if (full && (pBuffer->cap > 0)) {
+    snmem_release(pBuffer->pAcct, pBuffer->cap);
+    free(pBuffer->pBuf);
+    pBuffer->pBuf = NULL;
+    pBuffer->cap = 0;
+  }
+}
+
+/*
+ * Append a byte value to a string buffer.
+ * 
+ * The character c may be any unsigned byte value except for zero.  That
+ * is, the range is 1-255.
+ * 
+ * The function fails if there is no more capacity left for another 
+ * byte, or if growing the buffer would exceed the memory budget of the
+ * accounting structure.  The buffer is unmodified in this case.
+ * 
+ * This is a low-level function.  Clients should use append() instead to
+ * work with Unicode codepoints.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - the string buffer to add a byte to
+ * 
+ *   c - the unsigned byte value to add
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if no more capacity
+ */
+static int snbuffer_appendByte(SNBUFFER *pBuffer, int c) {
+  
+  int status = 1;
+  long newcap = 0;
+  
+  /* Check parameters */
+  if ((pBuffer == NULL) || (c < 1) || (c > 255)) {
+    abort();
+  }
+  
+  /* Proceed only if we are not completely maxed out of capacity */
+  if (pBuffer->count >= (pBuffer->maxcap - 1)) {
+    status = 0;
+  }
+  
+  /* We have capacity left; first, make the initial allocation if we
+   * haven't allocated a memory buffer yet and the budget allows it */
+  if (status && (pBuffer->cap < 1)) {
+    if (snmem_grow(pBuffer->pAcct, pBuffer->initcap, 0)) {
+      pBuffer->pBuf = (char *) malloc((size_t) pBuffer->initcap);
+      if (pBuffer->pBuf == NULL) {
+        abort();
+      }
+      memset(pBuffer->pBuf, 0, (size_t) pBuffer->initcap);
+      pBuffer->cap = pBuffer->initcap;
+      
+    } else {
+      /* Over budget */
+      status = 0;
+    }
+  }
+  
+  /* Next, increase allocated memory buffer if we need more space */
+  if (status && (pBuffer->count >= (pBuffer->cap - 1))) {
+    /* New capacity should usually be double current capacity */
+    newcap = pBuffer->cap * 2;
+    
+    /* If new capacity exceeds max capacity, set to max capacity */
+    if (newcap > pBuffer->maxcap) {
+      newcap = pBuffer->maxcap;
+    }
+    
+    /* Charge the growth against the budget */
+    if (!snmem_grow(pBuffer->pAcct, newcap - pBuffer->cap, 0)) {
+      status = 0;
+    }
+    
+    /* Allocate new buffer */
+    if (status) {
+      pBuffer->pBuf = (char *) realloc(pBuffer->pBuf, (size_t) newcap);
+      if (pBuffer->pBuf == NULL) {
+        abort();
+      }
+      
+      /* Initialize new space to zero */
+      memset((pBuffer->pBuf + pBuffer->cap),
+              0,
+              (size_t) (newcap - pBuffer->cap));
+      
+      /* Update capacity */
+      pBuffer->cap = newcap;
+    }
+  }
+  
+  /* Add the new character */
+  if (status) {
+    ((unsigned char *) pBuffer->pBuf)[pBuffer->count] =
+      (unsigned char) c;
+    (pBuffer->count)++;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Append a Unicode codepoint to a string buffer.
+ * 
+ * cpv is the Unicode codepoint to append.  It must be greater than zero
+ * and no greater than UNICODE_MAX_CPV.  Furthermore, it may not be in
+ * surrogate range [UNICODE_MIN_SURROGATE, UNICODE_MAX_SURROGATE].
+ * 
+ * The codepoint will be encoded into UTF-8 and the bytes of the UTF-8
+ * encoding will be added to the string buffer.
+ * 
+ * The function fails if there is not enough capacity left for the full
+ * UTF-8 encoding of the codepoint, or if the memory budget prevents the
+ * buffer from growing.  In the latter case, the buffer may have part of
+ * the encoding appended, but callers treat this as an error anyway.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - the string buffer to add a codepoint to
+ * 
+ *   cpv - the Unicode codepoint to add
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if not enough capacity
+ */
+static int snbuffer_append(SNBUFFER *pBuffer, long cpv) {
+  
+  int status = 1;
+  unsigned char buf[5];
+  unsigned char *pc = NULL;
+  int elen = 0;
+  
+  /* Initialize buffer to all nul */
+  memset(buf, 0, 5);
+  
+  /* Check parameters */
+  if (pBuffer == NULL) {
+    abort();
+  }
+  if ((cpv < 1) || (cpv > UNICODE_MAX_CPV) ||
+      ((cpv >= UNICODE_MIN_SURROGATE) &&
+        (cpv <= UNICODE_MAX_SURROGATE))) {
+    abort();
+  }
+  
+  /* Encode the codepoint and get the encoded length */
+  snutf_encode(cpv, buf);
+  elen = (int) strlen(buf);
+  
+  /* Make sure we have enough capacity for the all the bytes */
+  if (pBuffer->count >= (pBuffer->maxcap - elen)) {
+    status = 0;
+  }
+  
+  /* Add each of the bytes -- this can only fail if the memory budget
+   * has been exceeded, since we already checked capacity */
+  if (status) {
+    for(pc = buf; *pc != 0; pc++) {
+      if (!snbuffer_appendByte(pBuffer, *pc)) {
+        status = 0;
+        break;
+      }
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Get a pointer to the current string stored in the buffer.
+ * 
+ * The string will be null-terminated.  The returned pointer remains
+ * valid until another character is appended to the buffer or the buffer
+ * is reset.
+ * 
+ * If this function has to make the initial allocation, the allocation
+ * is charged to the memory accounting structure even if that goes over
+ * budget, since this function has no way to report failure.
+ * 
+ * Clients should not modify the data pointed to, or undefined behavior
+ * occurs.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - the string buffer to query
+ * 
+ * Return:
+ * 
+ *   the current buffered string
+ */
+static char *snbuffer_get(SNBUFFER *pBuffer) {
+  
+  /* Check parameter */
+  if (pBuffer == NULL) {
+    abort();
+  }
+  
+  /* If we haven't made the initial allocation yet, do it */
+  if (pBuffer->cap < 1) {
+    snmem_grow(pBuffer->pAcct, pBuffer->initcap, 1);
+    pBuffer->pBuf = (char *) malloc((size_t) pBuffer->initcap);
+    if (pBuffer->pBuf == NULL) {
+      abort();
+    }
+    memset(pBuffer->pBuf, 0, (size_t) pBuffer->initcap);
+    pBuffer->cap = pBuffer->initcap;
+  }
+  
+  /* Return the pointer */
+  return pBuffer->pBuf;
+}
+
+/*
+ * Get the last Unicode codepoint in a buffer.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - the buffer to query
+ * 
+ * Return:
+ * 
+ *   the last Unicode codepoint, or zero if the buffer is empty
+ */
+static long snbuffer_last(SNBUFFER *pBuffer) {
+  
+  long c = 0;
+  unsigned char *pc = NULL;
+  int sw = 0;
+  
+  /* Check parameter */
+  if (pBuffer == NULL) {
+    abort();
+  }
+  
+  /* Get last codepoint if buffer not empty */
+  if (pBuffer->count > 0) {
+    
+    /* Find the last byte in the buffer that is not a continuation
+     * byte */
+    sw = 1;
+    for(pc = &(((unsigned char *) pBuffer->pBuf)[pBuffer->count - 1]);
+        snutf_count(*pc) == 0;
+        pc--) {
+      sw++;
+    }
+    
+    /* Get how many encoded bytes and make sure valid and matches how
+     * many bytes we moved back in the search */
+    if (snutf_count(*pc) != sw) {
+      /* Shouldn't happen because everything in buffer should be
+       * valid */
+      abort();
+    }
+    
+    /* Decode the last codepoint */
+    c = snutf_decode(pc);
+    if (c < 0) {
+      /* Shouldn't happen because everything in buffer should be
+       * valid */
+      abort();
+    }
+  }
+  
+  /* Return character or zero */
+  return c;
+}
+
+/*
+ * Remove the last codepoint from the given buffer.
+ * 
+ * The function fails if the buffer is empty.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - the buffer to remove a codepoint from
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if buffer already empty
+ */
+static int snbuffer_less(SNBUFFER *pBuffer) {
+  
+  int status = 1;
+  unsigned char *pc = NULL;
+  
+  /* Check parameter */
+  if (pBuffer == NULL) {
+    abort();
+  }
+  
+  /* Only proceed if not empty */
+  if (pBuffer->count > 0) {
+    /* Remove any continuation bytes from the end of the buffer */
+    for(pc = &(((unsigned char *) pBuffer->pBuf)[pBuffer->count - 1]);
+        snutf_count(*pc) == 0;
+        pc--) {
+      *pc = (unsigned char) 0;
+      (pBuffer->count)--;
+    }
+    
+    /* Remove the last codepoint from the buffer */
+    *pc = (unsigned char) 0;
+    (pBuffer->count)--;
+    
+  } else {
+    /* Buffer was empty */
+    status = 0;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Reset an input filter back to its original state.
+ * 
+ * This should also be used for initializing filter structures.
+ * 
+ * Parameters:
+ * 
+ *   pFilter - the filter to reset
+ */
+static void snfilter_reset(SNFILTER *pFilter) {
+  
+  /* Check parameter */
+  if (pFilter == NULL) {
+    abort();
+  }
+  
+  /* Clear structure */
+  memset(pFilter, 0, sizeof(SNFILTER));
+  
+  /* Set initial state */
+  pFilter->line_count = 0;
+  pFilter->c = 0;
+  pFilter->offset = 0;
+  pFilter->line_start = 0;
+  pFilter->lazy = 0;
+  pFilter->pushback = 0;
+  pFilter->poll = 0;
+  pFilter->cancel = 0;
+  pFilter->pfExpired = NULL;
+  pFilter->pExpiredCustom = NULL;
+}
+
+/*
+ * Read the next codepoint through the input filter.
+ * 
+ * The next codepoint value is in Unicode codepoint range, which is
+ * [0, UNICODE_MAX_CPV], excluding the surrogate characters, in range
+ * [UNICODE_MIN_SURROGATE, UNICODE_MAX_SURROGATE].
+ * 
+ * CR+LF to LF conversion, UTF-8 Byte Order Mark (BOM) filtering, and
+ * correction of encoded surrogate pairs to supplemental codepoints are
+ * performed by this function.
+ * 
+ * SNERR_ codes are returned if there is an error.  These codes are
+ * always less than zero, so they are easy to distinguish from Unicode
+ * codepoints, which are always zero or greater.
+ * 
+ * The provided input filter state must be properly initialized.
+ * 
+ * Parameters:
+ * 
+ *   pFilter - the input filter state
+ * 
+ *   pIn - the source to read from
+ * 
+ * Return:
+ * 
+ *   the next codepoint value, or an SNERR_ value that is less than zero
+ */
+static long snfilter_read(SNFILTER *pFilter, SNSOURCE *pIn) {
+  
+  int err_num = 0;
+  long c = 0;
+  long c2 = 0;
+  long start = 0;
+  
+  /* Check parameters */
+  if ((pFilter == NULL) || (pIn == NULL)) {
+    abort();
+  }
+  
+  /* If we're not in pushback mode and we don't have a special
+   * condition, we need to read another codepoint */
+  if ((!(pFilter->pushback)) &&
+        ((pFilter->line_count == 0) || (pFilter->c >= 0))) {
+    
+    /* Poll for cancellation if the poll interval has elapsed */
+    (pFilter->poll)--;
+    if (pFilter->poll < 0) {
+      if (!snfilter_poll(pFilter)) {
+        err_num = SNERR_CANCELLED;
+      }
+    }
+    
+    /* Read a codepoint, remembering where it starts */
+    if (!err_num) {
+      start = pIn->read_count;
+      c = snsource_readCPV(pIn);
+      if (c < 0) {
+        err_num = (int) c;
+      }
+    }
+    
+    /* If this is the first codepoint read, and it is the U+FEFF Byte
+     * Order Mark (BOM), then skip it by reading again */
+    if ((!err_num) && (pFilter->line_count == 0) && (c == 0xfeffL)) {
+      start = pIn->read_count;
+      c = snsource_readCPV(pIn);
+      if (c < 0) {
+        err_num = (int) c;
+      }
+    }
+    
+    /* If we read a CR, read the LF it must be paired with */
+    if ((!err_num) && (c == ASCII_CR)) {
+      
+      /* We read a CR, so read next character and make sure it is LF */
+      c = snsource_readCPV(pIn);
+      if (c < 0) {
+        err_num = (int) c;
+      } else if (c != ASCII_LF) {
+        err_num = SNERR_BADCR;
+      }
+    }
+    
+    /* If we read a low surrogate, error because it means surrogate is
+     * not paired properly */
+    if ((!err_num) && (c >= UNICODE_MIN_LO_SUR) && 
+          (c <= UNICODE_MAX_LO_SUR)) {
+      err_num = SNERR_UNPAIRED;
+    }
+    
+    /* If we read a high surrogate, read next codepoint which must be a
+     * low surrogate and then replace the character read with the
+     * supplemental codepoint selected by the surrogate pair */
+    if ((!err_num) && (c >= UNICODE_MIN_HI_SUR) &&
+          (c <= UNICODE_MAX_HI_SUR)) {
+      
+      /* Read the low surrogate */
+      c2 = snsource_readCPV(pIn);
+      if (c2 < 0) {
+        err_num = (int) c2;
+      } else if ((c2 < UNICODE_MIN_LO_SUR) ||
+                  (c2 > UNICODE_MAX_LO_SUR)) {
+        err_num = SNERR_UNPAIRED;
+      }
+      
+      /* Replace codepoint read with the supplemental codepoint */
+      if (!err_num) {
+        c = snutf_pair(c, c2);
+      }
+    }
+    
+    /* Update state of filter structure */
+    if (!err_num) {
+      if (pFilter->line_count == 0) {
+        /* Very first character -- set line count to one, and drop lazy
+         * line counting if the source has no memory view */
+        pFilter->c = c;
+        pFilter->line_count = 1;
+        if (pFilter->lazy && (pIn->pView == NULL)) {
+          pFilter->lazy = 0;
+        } else if (pFilter->lazy) {
+          pIn->lines_lazy = 1;
+        }
+        
+      } else {
+        /* Not the very first character -- unless counting lazily,
+         * increase line count by one if the previous character was LF
+         * and the line count is not at the overflow value of
+         * LONG_MAX */
+        if ((pFilter->c == ASCII_LF) && (!(pFilter->lazy)) &&
+              (pFilter->line_count < LONG_MAX)) {
+          (pFilter->line_count)++;
+          pFilter->line_start = start;
+        }
+        pFilter->c = c;
+      }
+      pFilter->offset = start;
+    }
+  }
+  
+  /* Clear the pushback flag if it is set -- even if there has been an
+   * error or EOF condition */
+  pFilter->pushback = 0;
+  
+  /* If we've encountered an error (or EOF), write it into the
+   * structure */
+  if (err_num) {
+    pFilter->c = err_num;
+  }
+  
+  /* Return the character or special condition */
+  return (pFilter->c);
+}
+
+/*
+ * Return the current line count.
+ * 
+ * The line count is always at least one and at most LONG_MAX.  The
+ * value of LONG_MAX is an overflow value, so any count of lines above
+ * that will just remain at LONG_MAX.
+ * 
+ * The line count is affected by pushback mode, changing backwards if
+ * characters are pushed back before a line break.
+ * 
+ * pIn is the source the filter is reading from.  It is only needed if
+ * the filter is counting lines lazily, and may be NULL otherwise.  In
+ * lazy mode, the line count is computed from the byte offset of the
+ * filter position using the line-start index of the source.
+ * 
+ * Parameters:
+ * 
+ *   pFilter - the input filter state
+ * 
+ *   pIn - the source the filter reads from, or NULL
+ * 
+ * Return:
+ * 
+ *   the current line count
+ */
+static long snfilter_count(SNFILTER *pFilter, SNSOURCE *pIn) {
+  
+  long lc = 0;
+  long pos = 0;
+  
+  /* Check parameter */
+  if (pFilter == NULL) {
+    abort();
+  }
+  
+  if (pFilter->lazy && (pFilter->line_count > 0)) {
+    /* Lazy mode after something has been read -- compute the line
+     * count from the line-start index; the position is the start of the
+     * current codepoint if it has been pushed back or if the filter is
+     * in an error state, or else everything read so far */
+    pos = snfilter_pos(pFilter, pIn);
+    if (pos < LONG_MAX) {
+      lc = snsource_index(pIn, pos, NULL);
+    } else {
+      lc = LONG_MAX;
+    }
+    
+  } else {
+    /* Read current line count */
+    lc = pFilter->line_count;
+    
+    /* If line count is zero, change it to one to indicate the line
+     * count at the start of the file */
+    if (lc < 1) {
+      lc = 1;
+    }
+    
+    /* If we're not in pushback mode, c is LF, we're not at the very
+     * beginning of the file, and line_count is less than LONG_MAX,
+     * increase the line count by one */
+    if ((!(pFilter->pushback)) && (pFilter->line_count > 0) &&
+          (pFilter->c == ASCII_LF) && (lc < LONG_MAX)) {
+      lc++;
+    }
+  }
+  
+  /* Return the adjusted line count */
+  return lc;
+}
+
+/*
+ * Return the byte offset of the current filter position within the
+ * source.
+ * 
+ * The current position is the start of the most recent codepoint if it
+ * has been pushed back or if the filter is in an error state, or else
+ * the number of bytes read through the source so far.  In other words,
+ * it is the offset of the first byte the filter has not yet consumed.
+ * 
+ * The result is LONG_MAX if the byte count of the source has
+ * overflowed.
+ * 
+ * Parameters:
+ * 
+ *   pFilter - the input filter state
+ * 
+ *   pIn - the source the filter reads from
+ * 
+ * Return:
+ * 
+ *   the byte offset of the current position
+ */
+static long snfilter_pos(SNFILTER *pFilter, SNSOURCE *pIn) {
+  
+  long pos = 0;
+  
+  /* Check parameters */
+  if ((pFilter == NULL) || (pIn == NULL)) {
+    abort();
+  }
+  
+  /* Determine position */
+  if ((pFilter->line_count > 0) &&
+        (pFilter->pushback || (pFilter->c < 0))) {
+    pos = pFilter->offset;
+  } else {
+    pos = pIn->read_count;
+  }
+  
+  /* Return position */
+  return pos;
+}
+
+/*
+ * Set the pushback flag, so the character that was just read will be
+ * read again.
+ * 
+ * This call is ignored if the filter state is currently in an EOF or
+ * error condition.
+ * 
+ * The call fails if the filter state is already in pushback mode or if
+ * no characters have been read yet.
+ * 
+ * Parameters:
+ * 
+ *   pFilter - the filter state
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if pushback mode could not be set
+ */
+static int snfilter_pushback(SNFILTER *pFilter) {
+  
+  int status = 1;
+  
+  /* Check parameter */
+  if (pFilter == NULL) {
+    abort();
+  }
+  
+  /* Only proceed if not in special state */
+  if ((pFilter->line_count == 0) || (pFilter->c >= 0)) {
+    
+    /* We can only set the pushback flag if it is not already set and at
+     * least one character has been read */
+    if ((pFilter->line_count > 0) && (!(pFilter->pushback))) {
+      pFilter->pushback = 1;
+    } else {
+      status = 0;
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Poll the cancellation flag and the deadline callback of an input
+ * filter.
+ * 
+ * If parsing may continue, this also resets the poll countdown to
+ * SNFILTER_POLL_INTERVAL.  If the deadline callback reports expiry, the
+ * cancellation flag is set so that the callback is not invoked again.
+ * 
+ * Parameters:
+ * 
+ *   pFilter - the filter state
+ * 
+ * Return:
+ * 
+ *   non-zero if parsing may continue, zero if it has been cancelled
+ */
+static int snfilter_poll(SNFILTER *pFilter) {
+  
+  /* Check parameter */
+  if (pFilter == NULL) {
+    abort();
+  }
+  
+  /* If not already cancelled, check the deadline callback */
+  if ((!(pFilter->cancel)) && (pFilter->pfExpired != NULL)) {
+    if ((*(pFilter->pfExpired))(pFilter->pExpiredCustom)) {
+      pFilter->cancel = 1;
+    }
+  }
+  
+  /* Reset the countdown only if we may continue, so that a cancelled
+   * filter keeps failing even before its first codepoint is recorded */
+  if (!(pFilter->cancel)) {
+    pFilter->poll = SNFILTER_POLL_INTERVAL;
+  }
+  
+  /* Return whether we may continue */
+  return (pFilter->cancel ? 0 : 1);
+}
+
+/*
+ * Determine whether the given character is legal, outside of string
+ * literals and comments.
+ * 
+ * This range includes all visible, printing ASCII characters, plus
+ * Space (SP), Horizontal Tab (HT), and Line Feed (LF).
+ * 
+ * Parameters:
+ * 
+ *   c - the character to check
+ * 
+ * Return:
+ * 
+ *   non-zero if legal, zero if not
+ */
+static int snchar_islegal(long c) {
+  
+  int result = 0;
+  
+  if (((c >= ASCII_VISIBLE_MIN) && (c <= ASCII_VISIBLE_MAX)) ||
+      (c == ASCII_SP) || (c == ASCII_HT) || (c == ASCII_LF)) {
+    result = 1;
+  } else {
+    result = 0;
+  }
+  
+  return result;
+}
+
+/*
+ * Determine whether the given character is an atomic primitive
+ * character.
+ * 
+ * These characters can stand by themselves as a full token.
+ * 
+ * Parameters:
+ * 
+ *   c - the character to check
+ * 
+ * Return:
+ * 
+ *   non-zero if atomic, zero if not
+ */
+static int snchar_isatomic(long c) {
+  
+  int result = 0;
+  
+  if ((c == ASCII_LPAREN) || (c == ASCII_RPAREN) ||
+      (c == ASCII_LSQR) || (c == ASCII_RSQR) ||
+      (c == ASCII_COMMA) || (c == ASCII_PERCENT) ||
+      (c == ASCII_SEMICOLON) || (c == ASCII_DQUOTE) ||
+      (c == ASCII_LCURL) || (c == ASCII_RCURL)) {
+    result = 1;
+  } else {
+    result = 0;
+  }
+  
+  return result;
+}
+
+/*
+ * Determine whether the given character is an inclusive token closer.
+ * 
+ * Inclusive token closers end the token and are included as the last
+ * character of the token.
+ * 
+ * Parameters:
+ * 
+ *   c - the character to check
+ * 
+ * Return:
+ * 
+ *   non-zero if inclusive, zero if not
+ */
+static int snchar_isinclusive(long c) {
+  
+  int result = 0;
+  
+  if ((c == ASCII_DQUOTE) || (c == ASCII_LCURL)) {
+    result = 1;
+  } else {
+    result = 0;
+  }
+  
+  return result;
+}
+
+/*
+ * Determine whether the given character is an exclusive token closer.
+ * 
+ * Exclusive token closers end the token but are not included as the
+ * last character of the token.
+ * 
+ * Parameters:
+ * 
+ *   c - the character to check
+ * 
+ * Return:
+ * 
+ *   non-zero if exclusive, zero if not
+ */
+static int snchar_isexclusive(long c) {
+  
+  int result = 0;
+  
+  if ((c == ASCII_HT) || (c == ASCII_SP) || (c == ASCII_LF) ||
+      (c == ASCII_LPAREN) || (c == ASCII_RPAREN) ||
+      (c == ASCII_LSQR) || (c == ASCII_RSQR) ||
+      (c == ASCII_COMMA) || (c == ASCII_PERCENT) ||
+      (c == ASCII_SEMICOLON) || (c == ASCII_POUNDSIGN) ||
+      (c == ASCII_RCURL)) {
+    result = 1;
+  } else {
+    result = 0;
+  }
+  
+  return result;
+}
+
+/*
+ * Determine whether a given string consists purely of the given byte.
+ * 
+ * c is a unsigned byte value in 7-bit range excluding nul (1-127) and
+ * pStr points to a null-terminated string.
+ * 
+ * This function returns non-zero only if the string has exactly one
+ * byte, which is equal to c.
+ * 
+ * Parameters:
+ * 
+ *   c - the byte
+ * 
+ *   pStr - pointer to the string
+ * 
+ * Return:
+ * 
+ *   non-zero if string is equal to byte, zero if not
+ */
+static int snchar_strequals(int c, const char *pStr) {
+  
+  char strb[2];
+  int result = 0;
+  
+  /* Initialize buffer */
+  memset(&(strb[0]), 0, 2);
+  
+  /* Check parameters */
+  if ((c < 1) || (c > 127) || (pStr == NULL)) {
+    abort();
+  }
+  
+  /* Write character into local buffer */
+  strb[0] = (char) c;
+  
+  /* Compare strings */
+  if (strcmp(pStr, &(strb[0])) == 0) {
+    result = 1;
+  } else {
+    result = 0;
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Determine whether a given string consists purely of two given bytes.
+ * 
+ * c1 and c2 are unsigned byte values in 7-bit range excluding nul
+ * (1-127) and pStr points to a null-terminated string.
+ * 
+ * This function returns non-zero only if the string has exactly two
+ * bytes, the first of which equals c1 and the second of which equals
+ * c2.
+ * 
+ * Parameters:
+ * 
+ *   c1 - the first byte
+ * 
+ *   c2 - the second byte
+ * 
+ *   pStr - pointer to the string
+ * 
+ * Return:
+ * 
+ *   non-zero if string is equal to the two bytes, zero if not
+ */
+static int snchar_strequals2(int c1, int c2, const char *pStr) {
+  
+  char strb[3];
+  int result = 0;
+  
+  /* Initialize buffer */
+  memset(&(strb[0]), 0, 3);
+  
+  /* Check parameters */
+  if ((c1 < 1) || (c1 > 127) || (pStr == NULL) ||
+      (c2 < 1) || (c2 > 127)) {
+    abort();
+  }
+  
+  /* Write characters into local buffer */
+  strb[0] = (char) c1;
+  strb[1] = (char) c2;
+  
+  /* Compare strings */
+  if (strcmp(pStr, &(strb[0])) == 0) {
+    result = 1;
+  } else {
+    result = 0;
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Find the decoder registered for a string prefix.
+ * 
+ * pReg is the decoder registry, or NULL if there is none.  pPrefix is
+ * the nul-terminated string prefix.
+ * 
+ * Parameters:
+ * 
+ *   pReg - the decoder registry or NULL
+ * 
+ *   pPrefix - the string prefix
+ * 
+ * Return:
+ * 
+ *   the registered decoder, or NULL if no decoder is registered for the
+ *   prefix
+ */
+static const SNDECENTRY *snstr_lookup(
+    const SNDECREG * pReg,
+    const char     * pPrefix) {
+  
+  const SNDECENTRY *pResult = NULL;
+  int i = 0;
+  
+  /* Check parameters */
+  if (pPrefix == NULL) {
+    abort();
+  }
+  
+  /* Search the registry */
+  if (pReg != NULL) {
+    for(i = 0; i < pReg->count; i++) {
+      if (strcmp((pReg->entries[i]).pPrefix, pPrefix) == 0) {
+        pResult = &(pReg->entries[i]);
+        break;
+      }
+    }
+  }
+  
+  /* Return result */
+  return pResult;
+}
+
+/*
+ * Pass the string data collected in a buffer to a decoder and empty the
+ * buffer.
+ * 
+ * Nothing is passed to the decoder if the buffer is empty.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - the buffer holding string data
+ * 
+ *   pDec - the decoder
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNERR_DECODE if the decoder rejected the
+ *   data
+ */
+static int snstr_flush(SNBUFFER *pBuffer, const SNDECENTRY *pDec) {
+  
+  int err_num = 0;
+  
+  /* Check parameters */
+  if ((pBuffer == NULL) || (pDec == NULL)) {
+    abort();
+  }
+  
+  /* Pass any collected data to the decoder and empty the buffer */
+  if (pBuffer->count > 0) {
+    if ((*((pDec->pDecoder)->pfData))(pDec->pCustom,
+          snbuffer_get(pBuffer), pBuffer->count)) {
+      err_num = SNERR_DECODE;
+    }
+    snbuffer_reset(pBuffer, 0);
+  }
+  
+  /* Return okay or error code */
+  return err_num;
+}
+
+/*
+ * Read a quoted string.
+ * 
+ * pBuffer is the buffer into which the string data will be read.  It
+ * must be properly initialized.  This function will reset the buffer
+ * and then write the string data into it.
+ * 
+ * pIn is the source to read data from.
+ * 
+ * pFilter is the input filter to read the data through.  It should be
+ * in the proper state.
+ * 
+ * This function assumes that the opening quote as already been read.
+ * The first character read is therefore the first character of string
+ * data.  The closing quote will be read and consumed by this function.
+ * 
+ * pDec is the decoder for the string, or NULL if there is none.  If
+ * there is a decoder, the string data is passed to it in chunks as it
+ * is read, and the buffer will be empty on return.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - the buffer to read the string data into
+ * 
+ *   pIn - the source to read the string data from
+ * 
+ *   pFilter - the input filter
+ * 
+ *   pDec - the decoder or NULL
+ * 
+ * Return:
+ * 
+ *   zero if successful, or one of the SNERR constants if error
+ */
+static int snstr_readQuoted(
+    SNBUFFER         * pBuffer,
+    SNSOURCE         * pIn,
+    SNFILTER         * pFilter,
+    const SNDECENTRY * pDec) {
+  
+  int err_num = 0;
+  int esc_count = 0;
+  long c = 0;
+  
+  /* Check parameters */
+  if ((pBuffer == NULL) || (pIn == NULL) || (pFilter == NULL)) {
+    abort();
+  }
+  
+  /* Reset the buffer */
+  snbuffer_reset(pBuffer, 0);
+  
+  /* Begin decoding if there is a decoder */
+  if (pDec != NULL) {
+    if ((*((pDec->pDecoder)->pfBegin))(pDec->pCustom,
+          pDec->pPrefix, SNSTRING_QUOTED)) {
+      err_num = SNERR_DECODE;
+    }
+  }
+  
+  /* Read all string data */
+  while (!err_num) {
+    
+    /* Read a character */
+    c = snfilter_read(pFilter, pIn);
+    if (c < 0) {
+      if (c == SNERR_EOF) {
+        err_num = SNERR_OPENSTR;
+      } else {
+        err_num = (int) c;
+      }
+    }
+    
+    /* If this character is a double quote and the escape count is not
+     * odd, then we are done so leave loop */
+    if ((!err_num) && ((esc_count & 0x1) == 0) && (c == ASCII_DQUOTE)) {
+      break;
+    }
+    
+    /* Update escape count -- increment if current character is a
+     * backslash, clear otherwise; only least significant bit of the
+     * count is important so mask out upper bits to prevent overflow */
+    if ((!err_num) && (c == ASCII_BACKSLASH)) {
+      esc_count = (esc_count + 1) & 0x1;
+    } else {
+      esc_count = 0;
+    }
+    
+    /* Make sure character is not a null character */
+    if ((!err_num) && (c == 0)) {
+      err_num = SNERR_NULLCHR;
+    }
+    
+    /* Append character to buffer */
+    if (!err_num) {
+      if (!snbuffer_append(pBuffer, c)) {
+        err_num = SNERR_LONGSTR;
+      }
+    }
+    
+    /* If decoding, pass full chunks to the decoder */
+    if ((!err_num) && (pDec != NULL) &&
+        (pBuffer->count >= SNSTR_DECODE_CHUNK)) {
+      err_num = snstr_flush(pBuffer, pDec);
+    }
+  }
+  
+  /* If decoding, pass the rest of the data and finish */
+  if ((!err_num) && (pDec != NULL)) {
+    err_num = snstr_flush(pBuffer, pDec);
+    if (!err_num) {
+      if ((*((pDec->pDecoder)->pfEnd))(pDec->pCustom)) {
+        err_num = SNERR_DECODE;
+      }
+    }
+  }
+  
+  /* Return okay or error code */
+  return err_num;
+}
+
+/*
+ * Read a curly-quoted string.
+ * 
+ * pBuffer is the buffer into which the string data will be read.  It
+ * must be properly initialized.  This function will reset the buffer
+ * and then write the string data into it.
+ * 
+ * pIn is the source to read data from.
+ * 
+ * pFilter is the input filter to read the data through.  It should be
+ * in the proper state.
+ * 
+ * This function assumes that the opening curly bracket as already been
+ * read.  The first character read is therefore the first character of
+ * string data.  The closing curly bracket will be read and consumed by
+ * this function.
+ * 
+ * pDec is the decoder for the string, or NULL if there is none.  If
+ * there is a decoder, the string data is passed to it in chunks as it
+ * is read, and the buffer will be empty on return.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - the buffer to read the string data into
+ * 
+ *   pIn - the source to read the string data from
+ * 
+ *   pFilter - the input filter
+ * 
+ *   pDec - the decoder or NULL
+ * 
+ * Return:
+ * 
+ *   zero if successful, or one of the SNERR constants if error
+ */
+static int snstr_readCurlied(
+    SNBUFFER         * pBuffer,
+    SNSOURCE         * pIn,
+    SNFILTER         * pFilter,
+    const SNDECENTRY * pDec) {
+  
+  int err_num = 0;
+  int esc_count = 0;
+  long nest_level = 1;
+  long c = 0;
+  
+  /* Check parameters */
+  if ((pBuffer == NULL) || (pIn == NULL) || (pFilter == NULL)) {
+    abort();
+  }
+  
+  /* Reset the buffer */
+  snbuffer_reset(pBuffer, 0);
+  
+  /* Begin decoding if there is a decoder */
+  if (pDec != NULL) {
+    if ((*((pDec->pDecoder)->pfBegin))(pDec->pCustom,
+          pDec->pPrefix, SNSTRING_CURLY)) {
+      err_num = SNERR_DECODE;
+    }
+  }
+  
+  /* Read all string data */
+  while (!err_num) {
+    
+    /* Read a character */
+    c = snfilter_read(pFilter, pIn);
+    if (c < 0) {
+      if (c == SNERR_EOF) {
+        err_num = SNERR_OPENSTR;
+      } else {
+        err_num = (int) c;
+      }
+    }
+    
+    /* If escape count is not odd, update the nesting level if current
+     * character is a curly bracket */
+    if ((!err_num) && ((esc_count & 0x1) == 0)) {
+      if (c == ASCII_LCURL) {
+        
+        /* Left curly -- increase nesting level, watching for
+         * overflow */
+        if (nest_level < LONG_MAX) {
+          nest_level++;
+        } else {
+          err_num = SNERR_DEEPCURLY;
+        }
+        
+      } else if (c == ASCII_RCURL) {
+        /* Right curly -- decrease nesting level */
+        nest_level--;
+      }
+    }
+    
+    /* If nesting level has been brought down to zero, leave loop */
+    if ((!err_num) && (nest_level < 1)) {
+      break;
+    }
+    
+    /* Update escape count -- increment if current character is a
+     * backslash, clear otherwise; only least significant bit of the
+     * count is important so mask out upper bits to prevent overflow */
+    if ((!err_num) && (c == ASCII_BACKSLASH)) {
+      esc_count = (esc_count + 1) & 0x1;
+    } else {
+      esc_count = 0;
+    }
+    
+    /* Make sure character is not a null character */
+    if ((!err_num) && (c == 0)) {
+      err_num = SNERR_NULLCHR;
+    }
+    
+    /* Append character to buffer */
+    if (!err_num) {
+      if (!snbuffer_append(pBuffer, c)) {
+        err_num = SNERR_LONGSTR;
+      }
+    }
+    
+    /* If decoding, pass full chunks to the decoder */
+    if ((!err_num) && (pDec != NULL) &&
+        (pBuffer->count >= SNSTR_DECODE_CHUNK)) {
+      err_num = snstr_flush(pBuffer, pDec);
+    }
+  }
+  
+  /* If decoding, pass the rest of the data and finish */
+  if ((!err_num) && (pDec != NULL)) {
+    err_num = snstr_flush(pBuffer, pDec);
+    if (!err_num) {
+      if ((*((pDec->pDecoder)->pfEnd))(pDec->pCustom)) {
+        err_num = SNERR_DECODE;
+      }
+    }
+  }
+  
+  /* Return okay or error code */
+  return err_num;
+}
+
+/*
+ * Skip over zero or more characters of whitespace and comments.
+ * 
+ * After this operation, the source and filter will be positioned at the
+ * first character that is not whitespace and not part of a comment, or
+ * at the first special or error condition that was encountered.
+ * 
+ * Parameters:
+ * 
+ *   pIn - the input source
+ * 
+ *   pFilter - the filter to pass the input through
+ */
+static void sntk_skip(SNSOURCE *pIn, SNFILTER *pFilter) {
+  
+  long c = 0;
+  
+  /* Check parameters */
+  if ((pIn == NULL) || (pFilter == NULL)) {
+    abort();
+  }
+  
+  /* Skip over whitespace and comments */
+  while (c >= 0) {
+    
+    /* Skip over zero or more characters of whitespace */
+    for(c = snfilter_read(pFilter, pIn);
+        (c == ASCII_SP) || (c == ASCII_HT) || (c == ASCII_LF);
+        c = snfilter_read(pFilter, pIn));
+    
+    /* If we encountered anything except the pound sign, set pushback
+     * mode (unless a special condition) and leave the loop */
+    if (c != ASCII_POUNDSIGN) {
+      if (c >= 0) {
+        if (!snfilter_pushback(pFilter)) {
+          abort();  /* shouldn't happen */
+        }
+      }
+      break;
+    }
+    
+    /* We encountered the start of a comment -- read until we encounter
+     * LF or some special condition */
+    for(c = snfilter_read(pFilter, pIn);
+        (c >= 0) && (c != ASCII_LF);
+        c = snfilter_read(pFilter, pIn));
+  }
+}
+
+/*
+ * Skip over input after an error so that reading can continue.
+ * 
+ * If line is non-zero, input is skipped up to and including the next
+ * line feed.  If line is zero, input is skipped up to and including the
+ * next whitespace character, which is the end of the token that was
+ * being read when the error occurred.
+ * 
+ * Skipping also stops if a special or error condition is encountered.
+ * The condition will be encountered again by the next read.
+ * 
+ * Parameters:
+ * 
+ *   pIn - the input source
+ * 
+ *   pFilter - the filter to pass the input through
+ * 
+ *   line - non-zero to skip to the end of the line, zero to skip to the
+ *   end of the token
+ */
+static void sntk_resync(SNSOURCE *pIn, SNFILTER *pFilter, int line) {
+  
+  long c = 0;
+  
+  /* Check parameters */
+  if ((pIn == NULL) || (pFilter == NULL)) {
+    abort();
+  }
+  
+  /* Skip characters */
+  for(c = snfilter_read(pFilter, pIn);
+      c >= 0;
+      c = snfilter_read(pFilter, pIn)) {
+    if (c == ASCII_LF) {
+      break;
+    }
+    if ((!line) && ((c == ASCII_SP) || (c == ASCII_HT))) {
+      break;
+    }
+  }
+}
+
+/*
+ * Read a token.
+ * 
+ * pBuffer is the buffer into which the token will be read.  It must be
+ * properly initialized.  This function will reset the buffer and then
+ * write the token into it.
+ * 
+ * pIn is the source to read data from.
+ * 
+ * pFilter is the input filter to read the data through.  It should be
+ * in the proper state.
+ * 
+ * This function will skip over comments and whitespace before reading
+ * the token.
+ * 
+ * For string tokens, this function only reads the opening token and not
+ * the data that follows it.  Input will be positioned such that the
+ * next byte read will the first byte of string data.
+ * 
+ * Note that it is not possible to use this function to iterate through
+ * all the tokens in a Shastina source file, because this function
+ * doesn't handle string data.
+ * 
+ * If the function is successful, the byte offset within the source of
+ * the first character of the token is written to pStart.
+ * 
+ * Parameters:
+ * 
+ *   pBuffer - the buffer to read the token into
+ * 
+ *   pIn - the input source to read the token from
+ * 
+ *   pFilter - the input filter
+ * 
+ *   pStart - pointer to receive the starting byte offset
+ * 
+ * Return:
+ * 
+ *   zero if successful, or one of the SNERR constants if error
+ */
+static int sntk_readToken(
+    SNBUFFER * pBuffer,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter,
+    long     * pStart) {
+  
+  int err_num = 0;
+  long c = 0;
+  long c2 = 0;
+  int term = 0;
+  int leave = 0;
+  int omit = 0;
+  
+  /* Check parameters */
+  if ((pBuffer == NULL) || (pIn == NULL) || (pFilter == NULL) ||
+      (pStart == NULL)) {
+    abort();
+  }
+  
+  /* Reset the buffer */
+  snbuffer_reset(pBuffer, 0);
+  
+  /* Skip over whitespace and comments */
+  sntk_skip(pIn, pFilter);
+  
+  /* Read a character and record where it starts */
+  c = snfilter_read(pFilter, pIn);
+  if (c < 0) {
+    err_num = (int) c;
+  } else {
+    *pStart = pFilter->offset;
+  }
+  
+  /* Check that the character is legal */
+  if (!err_num) {
+    if (!snchar_islegal(c)) {
+      err_num = SNERR_BADCHAR;
+    }
+  }
+  
+  /* Add the first character to the buffer */
+  if (!err_num) {
+    if (!snbuffer_append(pBuffer, c)) {
+      err_num = SNERR_LONGTOKEN;
+    }
+  }
+  
+  /* If the first character is a vertical bar, check if the second
+   * character is a semicolon, forming the |; pair; set the term flag
+   * in this case and add the semicolon to the token; else, unread the
+   * second character */
+  if ((!err_num) && (c == ASCII_BAR)) {
+    c2 = snfilter_read(pFilter, pIn);
+    if (c2 < 0) {
+      err_num = (int) c2;
+    }
+    
+    if ((!err_num) && (c2 == ASCII_SEMICOLON)) {
+      term = 1;
+      if (!snbuffer_append(pBuffer, c2)) {
+        err_num = SNERR_LONGTOKEN;
+      }
+    } else {
+      if (!snfilter_pushback(pFilter)) {
+        abort();  /* shouldn't happen */
+      }
+    }
+  }
+  
+  /* If the first character read is not atomic and the term flag is not
+   * set, read additional characters into the token up to the exclusive
+   * or inclusive character that ends the token */
+  if ((!err_num) && (!term)) {
+    if (!snchar_isatomic(c)) {
+      
+      /* Read the additional characters */
+      while (!err_num) {
+        
+        /* Read another character */
+        c = snfilter_read(pFilter, pIn);
+        if (c < 0) {
+          err_num = (int) c;
+        }
+        
+        /* Make sure the character is legal */
+        if (!err_num) {
+          if (!snchar_islegal(c)) {
+            err_num = SNERR_BADCHAR;
+          }
+        }
+        
+        /* If the character is inclusive, set the leave flag */
+        if (!err_num) {
+          if (snchar_isinclusive(c)) {
+            leave = 1;
+          }
+        }
+        
+        /* If the character is exclusive, set the leave and omit
+         * flags, and push back the character */
+        if (!err_num) {
+          if (snchar_isexclusive(c)) {
+            leave = 1;
+            omit = 1;
+            if (!snfilter_pushback(pFilter)) {
+              abort();  /* shouldn't happen */
+            }
+          }
+        }
+        
+        /* If the omit flag is not set, add the character to the
+         * token */
+        if ((!err_num) && (!omit)) {
+          if (!snbuffer_append(pBuffer, c)) {
+            err_num = SNERR_LONGTOKEN;
+          }
+        }
+        
+        /* If the leave flag is set, leave the loop */
+        if ((!err_num) && leave) {
+          break;
+        }
+      }
+    }
+  }
+  
+  /* Return okay or error number */
+  return err_num;
+}
+
+/*
+ * Read a complete token from the given file.
+ * 
+ * pToken is the structure to receive the read token.  Only the pKey,
+ * pValue, spans, and pDecoders fields need to be filled in upon entry.  Upon
+ * return, all fields will be filled in.  See the structure documentation for
+ * further information.
+ * 
+ * pIn is the source to read data from.
+ * 
+ * pFilter is the input filter to read the data through.  It should be
+ * in the proper state.
+ * 
+ * This function differs from sntk_readToken() in that this function can
+ * also read string data.
+ * 
+ * Parameters:
+ * 
+ *   pToken - the token structure
+ * 
+ *   pIn - the input source
+ * 
+ *   pFil - the filter to pass input through
+ */
+static void sntoken_read(
+    SNTOKEN  * pToken,
+    SNSOURCE * pIn,
+    SNFILTER * pFil) {
+  
+  int err_num = 0;
+  long c = 0;
+  const SNDECENTRY *pDec = NULL;
+  
+  /* Check parameters */
+  if ((pToken == NULL) || (pIn == NULL) || (pFil == NULL)) {
+    abort();
+  }
+  if ((pToken->pKey == NULL) || (pToken->pValue == NULL) ||
+      (pToken->pKey == pToken->pValue)) {
+    abort();
+  }
+  
+  /* Reset both buffers and the token fields */
+  snbuffer_reset(pToken->pKey, 0);
+  snbuffer_reset(pToken->pValue, 0);
+  pToken->status = 0;
+  pToken->str_type = 0;
+  pToken->start = 0;
+  pToken->end = 0;
+  pToken->col = 0;
+  
+  /* Read a token into the key buffer */
+  err_num = sntk_readToken(pToken->pKey, pIn, pFil, &(pToken->start));
+  
+  /* If recording spans, determine the starting column while the filter
+   * is still on the line the token starts on */
+  if ((!err_num) && pToken->spans) {
+    if (!(pFil->lazy)) {
+      pToken->col = (pToken->start - pFil->line_start) + 1;
+    } else if (pToken->start < LONG_MAX) {
+      snsource_index(pIn, pToken->start, &(pToken->col));
+    } else {
+      pToken->col = LONG_MAX;
+    }
+  }
+  
+  /* Identify the token by its last character, also setting the str_type
+   * flag for string tokens */
+  if (!err_num) {
+    /* Get last character */
+    c = snbuffer_last(pToken->pKey);
+    
+    /* Identify token */
+    if (c == ASCII_DQUOTE) {
+      pToken->status = SNTOKEN_STRING;
+      pToken->str_type = SNSTRING_QUOTED;
+    
+    } else if (c == ASCII_LCURL) {
+      pToken->status = SNTOKEN_STRING;
+      pToken->str_type = SNSTRING_CURLY;
+    
+    } else {
+      pToken->status = SNTOKEN_SIMPLE;
+    }
+  }
+  
+  /* For simple tokens, distinguish between SIMPLE and FINAL */
+  if ((!err_num) && (pToken->status == SNTOKEN_SIMPLE)) {
+    if (snchar_strequals2(ASCII_BAR, ASCII_SEMICOLON,
+          snbuffer_get(pToken->pKey))) {
+      pToken->status = SNTOKEN_FINAL;
+    }
+  }
+  
+  /* For string tokens, remove the last character, so the key buffer
+   * only has the prefix */
+  if ((!err_num) && (pToken->status == SNTOKEN_STRING)) {
+    if (!snbuffer_less(pToken->pKey)) {
+      abort();  /* shouldn't happen */
+    }
+  }
+  
+  /* For string tokens, read the string data into the value buffer */
+  if ((!err_num) && (pToken->status == SNTOKEN_STRING)) {
+    pDec = snstr_lookup(pToken->pDecoders, snbuffer_get(pToken->pKey));
+    if (pToken->str_type == SNSTRING_QUOTED) {
+      /* Quoted string */
+      err_num = snstr_readQuoted(pToken->pValue, pIn, pFil, pDec);
+      
+    } else if (pToken->str_type == SNSTRING_CURLY) {
+      /* Curly string */
+      err_num = snstr_readCurlied(pToken->pValue, pIn, pFil, pDec);
+      
+    } else {
+      /* Unknown string type */
+      abort();
+    }
+  }
+  
+  /* If recording spans, the token ends at the current position */
+  if ((!err_num) && pToken->spans) {
+    pToken->end = snfilter_pos(pFil, pIn);
+  } else {
+    pToken->start = 0;
+  }
+  
+  /* If an error was encountered, clear the buffers and the fields, and
+   * set the status to the error */
+  if (err_num) {
+    snbuffer_reset(pToken->pKey, 0);
+    snbuffer_reset(pToken->pValue, 0);
+    pToken->str_type = 0;
+    pToken->start = 0;
+    pToken->end = 0;
+    pToken->col = 0;
+    pToken->status = err_num;
+  }
+}
+
+/*
+ * Enter the data of a string in a document scanner.
+ * 
+ * Parameters:
+ * 
+ *   pScan - the scanner
+ * 
+ *   c - the inclusive token closer that begins the string data
+ */
+static void snscan_string(SNSCAN *pScan, long c) {
+  
+  /* Check parameters */
+  if (pScan == NULL) {
+    abort();
+  }
+  
+  /* Begin a quoted or a curlied string */
+  if (c == ASCII_DQUOTE) {
+    pScan->state = SNSCAN_QUOTED;
+    pScan->esc = 0;
+    
+  } else if (c == ASCII_LCURL) {
+    pScan->state = SNSCAN_CURLY;
+    pScan->esc = 0;
+    pScan->nest = 1;
+    
+  } else {
+    abort();
+  }
+}
+
+/*
+ * Advance a document scanner by one byte.
+ * 
+ * The states follow sntk_skip(), sntk_readToken(), snstr_readQuoted(),
+ * and snstr_readCurlied(), using the same character classes.  CR bytes
+ * must not be passed, since the input filter turns CR+LF into LF before
+ * the tokenizer sees it.
+ * 
+ * Parameters:
+ * 
+ *   pScan - the scanner
+ * 
+ *   c - the byte value
+ * 
+ * Return:
+ * 
+ *   non-zero if the byte completed the |; terminator, zero otherwise
+ */
+static int snscan_step(SNSCAN *pScan, long c) {
+  
+  int result = 0;
+  int handled = 0;
+  
+  /* Check parameter */
+  if (pScan == NULL) {
+    abort();
+  }
+  
+  /* A bar that begins a token forms the terminator with a semicolon,
+   * and otherwise begins an ordinary token */
+  if (pScan->state == SNSCAN_BAR) {
+    if (c == ASCII_SEMICOLON) {
+      snscan_reset(pScan);
+      result = 1;
+      handled = 1;
+    } else {
+      pScan->state = SNSCAN_TOKEN;
+    }
+  }
+  
+  /* Within a token, an inclusive closer begins the string data, and an
+   * exclusive closer ends the token and is then handled between
+   * tokens */
+  if ((!handled) && (pScan->state == SNSCAN_TOKEN)) {
+    if (snchar_isinclusive(c)) {
+      snscan_string(pScan, c);
+      handled = 1;
+    } else if (snchar_isexclusive(c)) {
+      pScan->state = SNSCAN_GAP;
+    } else {
+      handled = 1;
+    }
+  }
+  
+  /* Between tokens, skip whitespace and atomic tokens, and begin
+   * comments, strings, and other tokens; bytes that can not begin a
+   * token are left for the parser to report */
+  if ((!handled) && (pScan->state == SNSCAN_GAP)) {
+    if (c == ASCII_POUNDSIGN) {
+      pScan->state = SNSCAN_COMMENT;
+    } else if (c == ASCII_BAR) {
+      pScan->state = SNSCAN_BAR;
+    } else if (snchar_isinclusive(c)) {
+      snscan_string(pScan, c);
+    } else if ((c == ASCII_SP) || (c == ASCII_HT) || (c == ASCII_LF) ||
+                snchar_isatomic(c) || (!snchar_islegal(c))) {
+      pScan->state = SNSCAN_GAP;
+    } else {
+      pScan->state = SNSCAN_TOKEN;
+    }
+    handled = 1;
+  }
+  
+  /* Comments run to the end of the line */
+  if ((!handled) && (pScan->state == SNSCAN_COMMENT)) {
+    if (c == ASCII_LF) {
+      pScan->state = SNSCAN_GAP;
+    }
+    handled = 1;
+  }
+  
+  /* Quoted strings end at a double quote that is not escaped */
+  if ((!handled) && (pScan->state == SNSCAN_QUOTED)) {
+    if (((pScan->esc & 0x1) == 0) && (c == ASCII_DQUOTE)) {
+      pScan->state = SNSCAN_GAP;
+    } else if (c == ASCII_BACKSLASH) {
+      pScan->esc = (pScan->esc + 1) & 0x1;
+    } else {
+      pScan->esc = 0;
+    }
+    handled = 1;
+  }
+  
+  /* Curlied strings end when the curly brackets that are not escaped
+   * are balanced */
+  if ((!handled) && (pScan->state == SNSCAN_CURLY)) {
+    if ((pScan->esc & 0x1) == 0) {
+      if ((c == ASCII_LCURL) && (pScan->nest < LONG_MAX)) {
+        (pScan->nest)++;
+      } else if (c == ASCII_RCURL) {
+        (pScan->nest)--;
+      }
+    }
+    
+    if (pScan->nest < 1) {
+      pScan->state = SNSCAN_GAP;
+    } else if (c == ASCII_BACKSLASH) {
+      pScan->esc = (pScan->esc + 1) & 0x1;
+    } else {
+      pScan->esc = 0;
+    }
+    handled = 1;
+  }
+  
+  /* Any other state is unrecognized */
+  if (!handled) {
+    abort();
+  }
+  
+  /* Return whether the document ended */
+  return result;
+}
+
+/*
+ * Release a reference to a fragment.
+ * 
+ * The fragment is freed when its last reference is released.
+ * 
+ * Parameters:
+ * 
+ *   pFrag - the fragment
+ */
+static void snfrag_release(SNFRAG *pFrag) {
+  
+  /* Check parameter and state */
+  if (pFrag == NULL) {
+    abort();
+  }
+  if (pFrag->refs < 1) {
+    abort();
+  }
+  
+  /* Drop the reference and free if it was the last */
+  (pFrag->refs)--;
+  if (pFrag->refs < 1) {
+    free(pFrag->pPath);
+    free(pFrag->pEnts);
+    free(pFrag->pArena);
+    free(pFrag);
+  }
+}
+
+/*
+ * Copy a string into the string arena of a fragment.
+ * 
+ * The string is nul-terminated in the arena.  If pStr is NULL, nothing
+ * is copied and -1 is returned.
+ * 
+ * Parameters:
+ * 
+ *   pFrag - the fragment
+ * 
+ *   pStr - the string, or NULL
+ * 
+ *   len - the length of the string in bytes
+ * 
+ * Return:
+ * 
+ *   the arena offset of the string, or -1
+ */
+static long snfrag_string(SNFRAG *pFrag, const char *pStr, long len) {
+  
+  long result = -1;
+  long newcap = 0;
+  char *pNew = NULL;
+  
+  /* Check parameters */
+  if ((pFrag == NULL) || (len < 0)) {
+    abort();
+  }
+  
+  if (pStr != NULL) {
+    /* Grow the arena if necessary */
+    if (len >= pFrag->arena_cap - pFrag->arena_len) {
+      newcap = pFrag->arena_cap;
+      if (newcap < 1) {
+        newcap = SNFRAG_ARENA_INIT;
+      }
+      while (len >= newcap - pFrag->arena_len) {
+        if (newcap > LONG_MAX / 2) {
+          abort();
+        }
+        newcap *= 2;
+      }
+      
+      pNew = (char *) realloc(pFrag->pArena, (size_t) newcap);
+      if (pNew == NULL) {
+        abort();
+      }
+      pFrag->pArena = pNew;
+      pFrag->arena_cap = newcap;
+    }
+    
+    /* Copy the string */
+    result = pFrag->arena_len;
+    memcpy(pFrag->pArena + result, pStr, (size_t) len);
+    (pFrag->pArena)[result + len] = (char) 0;
+    pFrag->arena_len += (len + 1);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Add a record for an entity to a fragment.
+ * 
+ * The key and value of the entity are copied into the arena of the
+ * fragment.
+ * 
+ * Parameters:
+ * 
+ *   pFrag - the fragment
+ * 
+ *   pEnt - the entity
+ * 
+ *   line - the line number of the entity
+ */
+static void snfrag_add(SNFRAG *pFrag, const SNENTITY *pEnt, long line) {
+  
+  long newcap = 0;
+  SNFRAGENT *pNew = NULL;
+  SNFRAGENT *pfe = NULL;
+  
+  /* Check parameters */
+  if ((pFrag == NULL) || (pEnt == NULL)) {
+    abort();
+  }
+  
+  /* Grow the records if necessary */
+  if (pFrag->count >= pFrag->cap) {
+    newcap = pFrag->cap * 2;
+    if (newcap < 1) {
+      newcap = SNFRAG_INIT;
+    }
+    pNew = (SNFRAGENT *) realloc(pFrag->pEnts,
+                          ((size_t) newcap) * sizeof(SNFRAGENT));
+    if (pNew == NULL) {
+      abort();
+    }
+    pFrag->pEnts = pNew;
+    pFrag->cap = newcap;
+  }
+  
+  /* Fill in the record */
+  pfe = &((pFrag->pEnts)[pFrag->count]);
+  memset(pfe, 0, sizeof(SNFRAGENT));
+  
+  pfe->status = pEnt->status;
+  pfe->str_type = pEnt->str_type;
+  pfe->count = pEnt->count;
+  pfe->key = snfrag_string(pFrag, pEnt->pKey, pEnt->key_len);
+  pfe->key_len = pEnt->key_len;
+  pfe->value = snfrag_string(pFrag, pEnt->pValue, pEnt->value_len);
+  pfe->value_len = pEnt->value_len;
+  pfe->line = line;
+  pfe->start = pEnt->start;
+  pfe->end = pEnt->end;
+  pfe->col = pEnt->col;
+  
+  (pFrag->count)++;
+}
+
+/*
+ * Read the data of an included file into the records of a fragment.
+ * 
+ * The data is parsed as a complete Shastina document with its own
+ * parser, which records spans and uses the escape dialect of the
+ * fragment.  Include metacommands are recorded rather than followed.
+ * If the document has an error, the records hold the entities before
+ * the error, and the error and its line number are stored in the
+ * fragment.
+ * 
+ * Parameters:
+ * 
+ *   pFrag - the empty fragment
+ * 
+ *   pData - the file data
+ * 
+ *   len - the length of the file data in bytes
+ */
+static void snfrag_lex(SNFRAG *pFrag, const char *pData, long len) {
+  
+  SNPARSER *pParser = NULL;
+  SNSOURCE *pSrc = NULL;
+  SNENTITY ent;
+  
+  /* Initialize structures */
+  memset(&ent, 0, sizeof(SNENTITY));
+  
+  /* Check parameters */
+  if ((pFrag == NULL) || (pData == NULL) || (len < 0)) {
+    abort();
+  }
+  
+  /* Set up a parser that records includes in the fragment */
+  pParser = snparser_alloc();
+  pSrc = snsource_memory(pData, len);
+  snparser_mode(pParser, SNMODE_SPANS);
+  snparser_unescape(pParser, pFrag->dialect);
+  (pParser->reader).pIncFrag = pFrag;
+  
+  /* Record all the entities */
+  for(snparser_read(pParser, &ent, pSrc);
+      ent.status > 0;
+      snparser_read(pParser, &ent, pSrc)) {
+    snfrag_add(pFrag, &ent, snparser_count(pParser));
+  }
+  if (ent.status < 0) {
+    pFrag->err = ent.status;
+    pFrag->err_line = snparser_count(pParser);
+  }
+  
+  /* Release the parser and source */
+  snsource_free(pSrc);
+  snparser_free(pParser);
+}
+
+/*
+ * Get the fragment for an included file from a cache.
+ * 
+ * The file is always read in full and hashed.  If the cache has a
+ * fragment for the same path and dialect with the same length and hash,
+ * it is used.  Otherwise, the file is parsed into a new fragment that
+ * replaces any stale fragment for the path and dialect in the cache.
+ * 
+ * The caller receives a reference to the fragment, which must be
+ * released with snfrag_release().
+ * 
+ * Parameters:
+ * 
+ *   pCache - the include cache
+ * 
+ *   pPath - the path of the file
+ * 
+ *   dialect - the escape dialect to read the file with
+ * 
+ *   ppFrag - receives the fragment
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNERR_INCLUDE if the file could not be read
+ */
+static int snfrag_load(
+    SNINCCACHE * pCache,
+    const char * pPath,
+    int          dialect,
+    SNFRAG    ** ppFrag) {
+  
+  int err_code = 0;
+  FILE *pFile = NULL;
+  char *pData = NULL;
+  char *pNew = NULL;
+  long len = 0;
+  long cap = 0;
+  long i = 0;
+  size_t got = 0;
+  unsigned long hash = 0;
+  SNFRAG *pFrag = NULL;
+  SNFRAG **ppLink = NULL;
+  
+  /* Check parameters */
+  if ((pCache == NULL) || (pPath == NULL) || (ppFrag == NULL)) {
+    abort();
+  }
+  *ppFrag = NULL;
+  
+  /* Read the whole file */
+  pFile = fopen(pPath, "rb");
+  if (pFile == NULL) {
+    err_code = SNERR_INCLUDE;
+  }
+  
+  while ((!err_code) && (!feof(pFile))) {
+    if (len >= cap) {
+      if (cap < 1) {
+        cap = SNFRAG_READ_INIT;
+      } else if (cap <= LONG_MAX / 2) {
+        cap *= 2;
+      } else {
+        abort();
+      }
+      pNew = (char *) realloc(pData, (size_t) cap);
+      if (pNew == NULL) {
+        abort();
+      }
+      pData = pNew;
+    }
+    
+    got = fread(pData + len, 1, (size_t) (cap - len), pFile);
+    len += (long) got;
+    if (ferror(pFile)) {
+      err_code = SNERR_INCLUDE;
+    }
+  }
+  
+  if (pFile != NULL) {
+    fclose(pFile);
+  }
+  
+  /* Hash the file data with 32-bit FNV-1a */
+  if (!err_code) {
+    hash = 2166136261UL;
+    for(i = 0; i < len; i++) {
+      hash ^= (unsigned long) ((unsigned char) pData[i]);
+      hash = (hash * 16777619UL) & 0xffffffffUL;
+    }
+  }
+  
+  /* Look for a fragment of the path and dialect, dropping it from the
+   * cache if it is stale */
+  if (!err_code) {
+    ppLink = &(pCache->pFrags);
+    while (*ppLink != NULL) {
+      if (((*ppLink)->dialect == dialect) &&
+          (strcmp((*ppLink)->pPath, pPath) == 0)) {
+        pFrag = *ppLink;
+        if ((pFrag->src_len != len) || (pFrag->hash != hash)) {
+          *ppLink = pFrag->pNext;
+          pFrag->pNext = NULL;
+          snfrag_release(pFrag);
+          pFrag = NULL;
+        }
+        break;
+      }
+      ppLink = &((*ppLink)->pNext);
+    }
+  }
+  
+  /* If nothing usable was cached, parse the file into a new fragment
+   * and add it to the cache */
+  if ((!err_code) && (pFrag == NULL)) {
+    pFrag = (SNFRAG *) malloc(sizeof(SNFRAG));
+    if (pFrag == NULL) {
+      abort();
+    }
+    memset(pFrag, 0, sizeof(SNFRAG));
+    
+    pFrag->pPath = (char *) malloc(strlen(pPath) + 1);
+    if (pFrag->pPath == NULL) {
+      abort();
+    }
+    strcpy(pFrag->pPath, pPath);
+    
+    pFrag->dialect = dialect;
+    pFrag->src_len = len;
+    pFrag->hash = hash;
+    pFrag->pEnts = NULL;
+    pFrag->count = 0;
+    pFrag->cap = 0;
+    pFrag->pArena = NULL;
+    pFrag->arena_len = 0;
+    pFrag->arena_cap = 0;
+    pFrag->err = 0;
+    pFrag->err_line = 0;
+    pFrag->refs = 1;
+    
+    snfrag_lex(pFrag, (pData != NULL) ? pData : "", len);
+    
+    pFrag->pNext = pCache->pFrags;
+    pCache->pFrags = pFrag;
+  }
+  
+  /* Give the caller a reference */
+  if (!err_code) {
+    (pFrag->refs)++;
+    *ppFrag = pFrag;
+  }
+  
+  /* Release the file data */
+  free(pData);
+  
+  /* Return result */
+  return err_code;
+}
+
+/*
+ * Initialize a Shastina reader state structure.
+ * 
+ * All Shastina readers must be initialized before they are used, or
+ * undefined behavior occurs.
+ * 
+ * Do not re-initialize a Shastina reader that is already initialized,
+ * or a memory leak may occur.
+ * 
+ * Shastina readers must be fully reset with snreader_reset() before
+ * they are released, or a memory leak may occur.
+ * 
+ * The reader must not be moved in memory after it is initialized,
+ * because its buffers and stacks point back to its memory accounting
+ * structure.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader structure to initialize
+ */
+static void snreader_init(SNREADER *pReader) {
+  
+  /* Check parameter */
+  if (pReader == NULL) {
+    abort();
+  }
+  
+  /* Initialize */
+  memset(pReader, 0, sizeof(SNREADER));
+  
+  pReader->status = 0;
+  pReader->queue_count = 0;
+  pReader->queue_read = 0;
+  
+  pReader->mem.budget = 0;
+  pReader->mem.current = 0;
+  pReader->mem.peak = 0;
+  pReader->mem.over = 0;
+  
+  snbuffer_init(&(pReader->buf_key),
+    SNREADER_KEY_INIT, SNREADER_KEY_MAX, &(pReader->mem));
+  snbuffer_init(&(pReader->buf_value),
+    SNREADER_VAL_INIT, SNREADER_VAL_MAX, &(pReader->mem));
+  
+  snstack_init(&(pReader->stack_array),
+    SNREADER_AGSTACK_INIT, SNREADER_AGSTACK_MAX, &(pReader->mem));
+  snstack_init(&(pReader->stack_group),
+    SNREADER_AGSTACK_INIT, SNREADER_AGSTACK_MAX, &(pReader->mem));
+  
+  pReader->meta_flag = 0;
+  pReader->array_flag = 0;
+  pReader->spans = 0;
+  
+  pReader->recover = 0;
+  pReader->pErrs = NULL;
+  pReader->errs_cap = 0;
+  pReader->errs_stored = 0;
+  pReader->errs_total = 0;
+  
+  snstack_init(&(pReader->stack_open),
+    SNREADER_OPEN_INIT, SNREADER_OPEN_MAX + 3, &(pReader->mem));
+  pReader->closing = 0;
+  pReader->close_start = 0;
+  pReader->close_end = 0;
+  pReader->close_col = 0;
+  
+  pReader->unescape = 0;
+  (pReader->decoders).count = 0;
+  
+  (pReader->metas).count = 0;
+  pReader->meta_mode = SNREADER_META_PASS;
+  snbuffer_init(&(pReader->buf_meta),
+    SNREADER_META_INIT, SNREADER_META_MAX, &(pReader->mem));
+  snstack_init(&(pReader->stack_meta),
+    SNREADER_METARG_INIT, SNREADER_METARG_MAX, &(pReader->mem));
+  pReader->ppArgv = NULL;
+  pReader->pArgl = NULL;
+  pReader->pArgt = NULL;
+  pReader->args_cap = 0;
+  
+  pReader->pIncCache = NULL;
+  pReader->pIncFrag = NULL;
+  pReader->frag_line = 0;
+  pReader->inc_depth = 0;
+  pReader->inc_line = 0;
+
+  pReader->pSchema = NULL;
+  pReader->sig_state = SNSIG_START;
+}
+
+/*
+ * Reset a Shastina reader back to its initial state.
+ * 
+ * If full is non-zero, a full reset will be performed.  If full is
+ * zero, a fast reset is performed.  A full reset releases all memory
+ * buffers, while a fast reset keeps the memory buffers allocated.
+ * 
+ * A full reset must be performed on a reader before it is released, or
+ * a memory leak occurs.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader structure to reset
+ * 
+ *   full - non-zero for full reset, zero for fast reset
+ */
+static void snreader_reset(SNREADER *pReader, int full) {
+  
+  /* Check parameters */
+  if (pReader == NULL) {
+    abort();
+  }
+  
+  /* Reset buffers and stacks */
+  snbuffer_reset(&(pReader->buf_key), full);
+  snbuffer_reset(&(pReader->buf_value), full);
+  
+  snstack_reset(&(pReader->stack_array), full);
+  snstack_reset(&(pReader->stack_group), full);
+  
+  snbuffer_reset(&(pReader->buf_meta), full);
+  snstack_reset(&(pReader->stack_meta), full);
+  
+  snstack_reset(&(pReader->stack_open), full);
+  
+  /* Release the argument arrays on a full reset */
+  if (full && (pReader->args_cap > 0)) {
+    free((void *) pReader->ppArgv);
+    free(pReader->pArgl);
+    free(pReader->pArgt);
+    pReader->ppArgv = NULL;
+    pReader->pArgl = NULL;
+    pReader->pArgt = NULL;
+    snmem_release(&(pReader->mem), pReader->args_cap *
+      ((long) (sizeof(const char *) + sizeof(long) + sizeof(int))));
+    pReader->args_cap = 0;
+  }
+  
+  /* Release the fragments on the include stack */
+  while (pReader->inc_depth > 0) {
+    (pReader->inc_depth)--;
+    snfrag_release((pReader->incs[pReader->inc_depth]).pFrag);
+    (pReader->incs[pReader->inc_depth]).pFrag = NULL;
+  }
+  pReader->inc_line = 0;
+  
+  /* Release the error list on a full reset */
+  if (full && (pReader->pErrs != NULL)) {
+    free(pReader->pErrs);
+    pReader->pErrs = NULL;
+    snmem_release(&(pReader->mem),
+      pReader->errs_cap * ((long) sizeof(SNERRINFO)));
+    pReader->errs_cap = 0;
+  }
+  
+  /* Reset fields */
+  pReader->status = 0;
+  pReader->queue_count = 0;
+  pReader->queue_read = 0;
+  
+  pReader->meta_flag = 0;
+  pReader->array_flag = 0;
+  pReader->meta_mode = SNREADER_META_PASS;
+  
+  pReader->errs_stored = 0;
+  pReader->errs_total = 0;
+  
+  pReader->closing = 0;
+  
+  pReader->sig_state = SNSIG_START;
+}
+
+/*
+ * Move a reader on to the next document in its source.
+ * 
+ * The reader must have reached the EOF entity of the current document
+ * or be in an error state, or a fault occurs.  If the reader is in an
+ * error state, that error is returned and nothing is done.
+ * 
+ * Otherwise, the reader is given a fast reset, which keeps its buffers
+ * allocated and leaves its settings unchanged, and whitespace and
+ * comments are skipped in the source.  The filter is not reset, so
+ * line counts and byte offsets continue from the previous document.
+ * 
+ * If the source then ends, zero is returned.  If something else
+ * follows, it is left unread and one is returned.  If the source or
+ * the filter encounters an error, it is latched in the reader status
+ * and returned.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   pIn - the input source
+ * 
+ *   pFilter - the input filter
+ * 
+ * Return:
+ * 
+ *   one if another document follows, zero at the end of the source, or
+ *   an SNERR_ code (which is always negative) if there was an error
+ */
+static int snreader_next(
+    SNREADER * pReader,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter) {
+  
+  int result = 0;
+  long c = 0;
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (pIn == NULL) || (pFilter == NULL)) {
+    abort();
+  }
+  
+  /* Return an error that has already happened */
+  result = pReader->status;
+  
+  /* Check that the current document is finished */
+  if (!result) {
+    if ((pReader->queue_count < 1) ||
+        ((pReader->queue[pReader->queue_read]).status !=
+          SNENTITY_EOF)) {
+      abort();
+    }
+  }
+  
+  /* Reset the reader and skip to the start of the next document */
+  if (!result) {
+    snreader_reset(pReader, 0);
+    sntk_skip(pIn, pFilter);
+    
+    /* Check what the skip stopped on, which is pushed back or latched
+     * in the filter, so reading it here does not consume it */
+    c = snfilter_read(pFilter, pIn);
+    if (c >= 0) {
+      if (!snfilter_pushback(pFilter)) {
+        abort();  /* shouldn't happen */
+      }
+      result = 1;
+      
+    } else if (c == SNERR_EOF) {
+      result = 0;
+      
+    } else {
+      result = (int) c;
+      pReader->status = result;
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Read an entity from a Shastina source file.
+ * 
+ * pReader is the reader object, which must be properly initialized.
+ * 
+ * pEntity is the entity structure that will be filled in.  Its state
+ * upon entry to the function is irrelevant.  Upon return, it will hold
+ * the results of the operation.  See the structure documentation for
+ * further information.
+ * 
+ * pIn is the input source to read from.
+ * 
+ * pFilter is the input filter to pass the input through.  It must be
+ * properly initialized.
+ * 
+ * Once an error is encountered, the reader object will return that same
+ * error each time this function is called without doing anything
+ * further.
+ * 
+ * Once the End Of File (EOF) entity is returned, this function will
+ * return the EOF entity on all subsequent calls without doing anything
+ * further.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   pEntity - pointer to the entity to receive the results
+ * 
+ *   pIn - the input source
+ * 
+ *   pFilter - the input filter
+ */
+static void snreader_read(
+    SNREADER * pReader,
+    SNENTITY * pEntity,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter) {
+  
+  int err_code = 0;
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (pEntity == NULL) || (pIn == NULL) ||
+      (pFilter == NULL)) {
+    abort();
+  }
+  
+  /* Clear provided entity */
+  memset(pEntity, 0, sizeof(SNENTITY));
+  
+  /* Fail immediately if reader is in error state */
+  err_code = pReader->status;
+  
+  /* If queue is empty, fill it until something is in it, taking
+   * entities from included files before the source */
+  while ((!err_code) && (pReader->queue_count < 1)) {
+    if (pReader->inc_depth > 0) {
+      snreader_splice(pReader);
+    } else {
+      snreader_fill(pReader, pIn, pFilter);
+    }
+    err_code = pReader->status;
+  }
+  
+  /* Return either an entity or an error code */
+  if (!err_code) {
+    /* Copy current entity to provided entity */
+    memcpy(pEntity, &(pReader->queue[pReader->queue_read]),
+            sizeof(SNENTITY));
+    
+    /* If current entity is not EOF, then remove it from queue */
+    if ((pReader->queue[pReader->queue_read]).status !=
+          SNENTITY_EOF) {
+      
+      (pReader->queue_read)++;
+      if (pReader->queue_read >= pReader->queue_count) {
+        /* We've read everything in the queue, so clear it */
+        pReader->queue_count = 0;
+        pReader->queue_read = 0;
+      }
+    }
+    
+  } else {
+    /* Error status -- write into the entity */
+    pEntity->status = err_code;
+  }
+}
+
+/*
+ * Invoke the handler for an entity.
+ * 
+ * pe is the entity, which must not be an error.  pHandlers is the table
+ * of handlers, and ctx is the context passed through to the handler.
+ * If the handler for the entity type is NULL, nothing is invoked.
+ * 
+ * Parameters:
+ * 
+ *   pe - the entity
+ * 
+ *   pHandlers - the handler table
+ * 
+ *   ctx - the client context
+ * 
+ * Return:
+ * 
+ *   the return value of the handler, or zero if no handler was invoked
+ */
+static int snreader_dispatch(
+    const SNENTITY   * pe,
+    const SNHANDLERS * pHandlers,
+    void             * ctx) {
+  
+  int result = 0;
+  
+  /* Check parameters */
+  if ((pe == NULL) || (pHandlers == NULL)) {
+    abort();
+  }
+  
+  /* Invoke the handler for the entity type */
+  switch (pe->status) {
+    
+    case SNENTITY_EOF:
+      if (pHandlers->pfEOF != NULL) {
+        result = (*(pHandlers->pfEOF))(ctx);
+      }
+      break;
+    
+    case SNENTITY_STRING:
+      if (pHandlers->pfString != NULL) {
+        result = (*(pHandlers->pfString))(ctx, pe->str_type,
+                    pe->pKey, pe->key_len, pe->pValue, pe->value_len);
+      }
+      break;
+    
+    case SNENTITY_BEGIN_META:
+      if (pHandlers->pfBeginMeta != NULL) {
+        result = (*(pHandlers->pfBeginMeta))(ctx);
+      }
+      break;
+    
+    case SNENTITY_END_META:
+      if (pHandlers->pfEndMeta != NULL) {
+        result = (*(pHandlers->pfEndMeta))(ctx);
+      }
+      break;
+    
+    case SNENTITY_META_TOKEN:
+      if (pHandlers->pfMetaToken != NULL) {
+        result = (*(pHandlers->pfMetaToken))(ctx,
+                    pe->pKey, pe->key_len);
+      }
+      break;
+    
+    case SNENTITY_META_STRING:
+      if (pHandlers->pfMetaString != NULL) {
+        result = (*(pHandlers->pfMetaString))(ctx, pe->str_type,
+                    pe->pKey, pe->key_len, pe->pValue, pe->value_len);
+      }
+      break;
+    
+    case SNENTITY_NUMERIC:
+      if (pHandlers->pfNumeric != NULL) {
+        result = (*(pHandlers->pfNumeric))(ctx, pe->pKey, pe->key_len);
+      }
+      break;
+    
+    case SNENTITY_VARIABLE:
+      if (pHandlers->pfVariable != NULL) {
+        result = (*(pHandlers->pfVariable))(ctx, pe->pKey, pe->key_len);
+      }
+      break;
+    
+    case SNENTITY_CONSTANT:
+      if (pHandlers->pfConstant != NULL) {
+        result = (*(pHandlers->pfConstant))(ctx, pe->pKey, pe->key_len);
+      }
+      break;
+    
+    case SNENTITY_ASSIGN:
+      if (pHandlers->pfAssign != NULL) {
+        result = (*(pHandlers->pfAssign))(ctx, pe->pKey, pe->key_len);
+      }
+      break;
+    
+    case SNENTITY_GET:
+      if (pHandlers->pfGet != NULL) {
+        result = (*(pHandlers->pfGet))(ctx, pe->pKey, pe->key_len);
+      }
+      break;
+    
+    case SNENTITY_BEGIN_GROUP:
+      if (pHandlers->pfBeginGroup != NULL) {
+        result = (*(pHandlers->pfBeginGroup))(ctx);
+      }
+      break;
+    
+    case SNENTITY_END_GROUP:
+      if (pHandlers->pfEndGroup != NULL) {
+        result = (*(pHandlers->pfEndGroup))(ctx);
+      }
+      break;
+    
+    case SNENTITY_ARRAY:
+      if (pHandlers->pfArray != NULL) {
+        result = (*(pHandlers->pfArray))(ctx, pe->count);
+      }
+      break;
+    
+    case SNENTITY_OPERATION:
+      if (pHandlers->pfOperation != NULL) {
+        result = (*(pHandlers->pfOperation))(ctx,
+                    pe->pKey, pe->key_len);
+      }
+      break;
+    
+    default:
+      /* Unrecognized entity type */
+      abort();
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Run through entities in a Shastina source file, invoking handlers for
+ * each entity directly from the entity queue.
+ * 
+ * pReader is the reader object, which must be properly initialized.
+ * 
+ * pIn is the input source to read from.
+ * 
+ * pFilter is the input filter to pass the input through.  It must be
+ * properly initialized.
+ * 
+ * pHandlers is the table of handlers and ctx is the context passed
+ * through to them.  See snparser_run() in the header for the
+ * specification.
+ * 
+ * This is equivalent to calling snreader_read() in a loop and invoking
+ * handlers on each entity, except that entities are never copied out of
+ * the queue.
+ * 
+ * The entities still go through the queue rather than being passed to
+ * the handlers from snreader_fill().  A single token may complete
+ * several entities, such as the END_GROUP and BEGIN_GROUP of an array
+ * separator, and included files are spliced in through the queue.  If a
+ * handler stops the run partway through such a token, the remaining
+ * entities must stay queued for the next run or for snreader_read().
+ * What the run saves is the copy into the client's entity structure and
+ * the branching on the entity type in the client.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   pIn - the input source
+ * 
+ *   pFilter - the input filter
+ * 
+ *   pHandlers - the handler table
+ * 
+ *   ctx - the client context
+ * 
+ * Return:
+ * 
+ *   zero if the EOF entity was reached, one if a handler stopped the
+ *   run, or an SNERR_ code if there was an error
+ */
+static int snreader_run(
+    SNREADER         * pReader,
+    SNSOURCE         * pIn,
+    SNFILTER         * pFilter,
+    const SNHANDLERS * pHandlers,
+    void             * ctx) {
+  
+  int result = 0;
+  int eof = 0;
+  const SNENTITY *pe = NULL;
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (pIn == NULL) || (pFilter == NULL) ||
+      (pHandlers == NULL)) {
+    abort();
+  }
+  
+  /* Keep going until EOF, error, or a handler stops the run */
+  while (!result) {
+    
+    /* If queue is empty, fill it until something is in it, taking
+     * entities from included files before the source */
+    result = pReader->status;
+    while ((!result) && (pReader->queue_count < 1)) {
+      if (pReader->inc_depth > 0) {
+        snreader_splice(pReader);
+      } else {
+        snreader_fill(pReader, pIn, pFilter);
+      }
+      result = pReader->status;
+    }
+    if (result) {
+      break;
+    }
+    
+    /* Get the current entity, and if it is not EOF, remove it from the
+     * queue -- the queue slot remains valid until the next fill, which
+     * can not happen before the handler returns */
+    pe = &(pReader->queue[pReader->queue_read]);
+    if (pe->status != SNENTITY_EOF) {
+      (pReader->queue_read)++;
+      if (pReader->queue_read >= pReader->queue_count) {
+        pReader->queue_count = 0;
+        pReader->queue_read = 0;
+      }
+    } else {
+      eof = 1;
+    }
+    
+    /* Invoke the handler, stopping if it returns non-zero, and stop
+     * after the EOF entity in any case, with zero to report that the EOF
+     * entity was handled even if its handler returned non-zero */
+    if (snreader_dispatch(pe, pHandlers, ctx) && (!eof)) {
+      result = 1;
+    }
+    if (eof) {
+      break;
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Add an entity with no parameters (type "Z") to the queue of a given
+ * reader.
+ * 
+ * pReader is the reader to add the entity to.
+ * 
+ * entity is the SNENTITY_ constant describing the kind of entity.
+ * 
+ * The only entities allowed by this function are:
+ * 
+ *   - SNENTITY_EOF
+ *   - SNENTITY_BEGIN_META
+ *   - SNENTITY_END_META
+ *   - SNENTITY_BEGIN_GROUP
+ *   - SNENTITY_END_GROUP
+ * 
+ * Passing any other kind of entity code results in a fault.
+ * 
+ * The queue of the reader must not be full or this function will fault.
+ * See SNREADER_MAXQUEUE for more information.
+ * 
+ * If the reader is in an error state, this call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   entity - the entity code
+ */
+static void snreader_addEntityZ(SNREADER *pReader, int entity) {
+  
+  SNENTITY *pe = NULL;
+  
+  /* Check parameters */
+  if (pReader == NULL) {
+    abort();
+  }
+  if ((entity != SNENTITY_EOF) &&
+      (entity != SNENTITY_BEGIN_META) &&
+      (entity != SNENTITY_END_META) &&
+      (entity != SNENTITY_BEGIN_GROUP) &&
+      (entity != SNENTITY_END_GROUP)) {
+    abort();
+  }
+  
+  /* Proceed only if reader not in error state */
+  if (!(pReader->status)) {
+    /* Make sure room for another entity */
+    if (pReader->queue_count >= SNREADER_MAXQUEUE) {
+      abort();
+    }
+    
+    /* Get entity pointer and clear anything left from an earlier use of
+     * the queue slot */
+    pe = &(pReader->queue[pReader->queue_count]);
+    memset(pe, 0, sizeof(SNENTITY));
+    
+    /* Fill in entity */
+    pe->status = entity;
+    
+    /* Increase the entity count */
+    (pReader->queue_count)++;
+  }
+}
+
+/*
+ * Add an entity with one string parameter (type "S") to the queue of a
+ * given reader.
+ * 
+ * pReader is the reader to add the entity to.
+ * 
+ * entity is the SNENTITY_ constant describing the kind of entity.
+ * 
+ * s is the string parameter.  len is its length in bytes, not
+ * including the terminating nul.
+ * 
+ * The only entities allowed by this function are:
+ * 
+ *   - SNENTITY_META_TOKEN
+ *   - SNENTITY_NUMERIC
+ *   - SNENTITY_VARIABLE
+ *   - SNENTITY_CONSTANT
+ *   - SNENTITY_ASSIGN
+ *   - SNENTITY_GET
+ *   - SNENTITY_OPERATION
+ * 
+ * Passing any other kind of entity code results in a fault.
+ * 
+ * The queue of the reader must not be full or this function will fault.
+ * See SNREADER_MAXQUEUE for more information.
+ * 
+ * If the reader is in an error state, this call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   entity - the entity code
+ * 
+ *   s - the string parameter
+ * 
+ *   len - the length of the string parameter
+ */
+static void snreader_addEntityS(
+    SNREADER * pReader,
+    int        entity,
+    char     * s,
+    long       len) {
+  
+  SNENTITY *pe = NULL;
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (s == NULL) || (len < 0)) {
+    abort();
+  }
+  if ((entity != SNENTITY_META_TOKEN) &&
+      (entity != SNENTITY_NUMERIC) &&
+      (entity != SNENTITY_VARIABLE) &&
+      (entity != SNENTITY_CONSTANT) &&
+      (entity != SNENTITY_ASSIGN) &&
+      (entity != SNENTITY_GET) &&
+      (entity != SNENTITY_OPERATION)) {
+    abort();
+  }
+      
+  /* Proceed only if reader not in error state */
+  if (!(pReader->status)) {
+    /* Make sure room for another entity */
+    if (pReader->queue_count >= SNREADER_MAXQUEUE) {
+      abort();
+    }
+    
+    /* Get entity pointer and clear anything left from an earlier use of
+     * the queue slot */
+    pe = &(pReader->queue[pReader->queue_count]);
+    memset(pe, 0, sizeof(SNENTITY));
+    
+    /* Fill in entity */
+    pe->status = entity;
+    pe->pKey = s;
+    pe->key_len = len;
+    
+    /* Increase the entity count */
+    (pReader->queue_count)++;
+  }
+}
+
+/*
+ * Add an entity with one long parameter (type "L") to the queue of a
+ * given reader.
+ * 
+ * pReader is the reader to add the entity to.
+ * 
+ * entity is the SNENTITY_ constant describing the kind of entity.
+ * 
+ * l is the long parameter.
+ * 
+ * The only entities allowed by this function are:
+ * 
+ *   - SNENTITY_ARRAY
+ * 
+ * Passing any other kind of entity code results in a fault.
+ * 
+ * The queue of the reader must not be full or this function will fault.
+ * See SNREADER_MAXQUEUE for more information.
+ * 
+ * If the reader is in an error state, this call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   entity - the entity code
+ * 
+ *   l - the long value
+ */
+static void snreader_addEntityL(
+    SNREADER * pReader,
+    int        entity,
+    long       l) {
+  
+  SNENTITY *pe = NULL;
+  
+  /* Check parameters */
+  if (pReader == NULL) {
+    abort();
+  }
+  if (entity != SNENTITY_ARRAY) {
+    abort();
+  }
+  
+  /* Proceed only if reader not in error state */
+  if (!(pReader->status)) {
+    /* Make sure room for another entity */
+    if (pReader->queue_count >= SNREADER_MAXQUEUE) {
+      abort();
+    }
+    
+    /* Get entity pointer and clear anything left from an earlier use of
+     * the queue slot */
+    pe = &(pReader->queue[pReader->queue_count]);
+    memset(pe, 0, sizeof(SNENTITY));
+    
+    /* Fill in entity */
+    pe->status = entity;
+    pe->count = l;
+    
+    /* Increase the entity count */
+    (pReader->queue_count)++;
+  }
+}
+
+/*
+ * Add an entity with prefix, type, and data parameters (type "T") to
+ * the queue of a given reader.
+ * 
+ * pReader is the reader to add the entity to.
+ * 
+ * entity is the SNENTITY_ constant describing the kind of entity.
+ * 
+ * pPrefix points to the prefix string.  prefix_len is its length in
+ * bytes, not including the terminating nul.
+ * 
+ * str_type is the string type.  It must be one of the SNSTRING_
+ * constants.
+ * 
+ * pData points to the string data.  data_len is its length in bytes,
+ * not including the terminating nul.
+ * 
+ * The only entities allowed by this function are:
+ * 
+ *   - SNENTITY_STRING
+ *   - SNENTITY_META_STRING
+ * 
+ * Passing any other kind of entity code results in a fault.
+ * 
+ * The queue of the reader must not be full or this function will fault.
+ * See SNREADER_MAXQUEUE for more information.
+ * 
+ * If the reader is in an error state, this call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   entity - the entity code
+ * 
+ *   pPrefix - the prefix string
+ * 
+ *   prefix_len - the length of the prefix string
+ * 
+ *   str_type - the string type
+ * 
+ *   pData - the string data
+ * 
+ *   data_len - the length of the string data
+ */
+static void snreader_addEntityT(
+    SNREADER * pReader,
+    int        entity,
+    char     * pPrefix,
+    long       prefix_len,
+    int        str_type,
+    char     * pData,
+    long       data_len) {
+  
+  SNENTITY *pe = NULL;
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (pPrefix == NULL) || (pData == NULL) ||
+      (prefix_len < 0) || (data_len < 0)) {
+    abort();
+  }
+  if ((str_type != SNSTRING_QUOTED) && (str_type != SNSTRING_CURLY)) {
+    abort();
+  }
+  if ((entity != SNENTITY_STRING) &&
+      (entity != SNENTITY_META_STRING)) {
+    abort();
+  }
+  
+  /* Proceed only if reader not in error state */
+  if (!(pReader->status)) {
+    /* Make sure room for another entity */
+    if (pReader->queue_count >= SNREADER_MAXQUEUE) {
+      abort();
+    }
+    
+    /* Get entity pointer and clear anything left from an earlier use of
+     * the queue slot */
+    pe = &(pReader->queue[pReader->queue_count]);
+    memset(pe, 0, sizeof(SNENTITY));
+    
+    /* Fill in entity */
+    pe->status = entity;
+    pe->pKey = pPrefix;
+    pe->key_len = prefix_len;
+    pe->str_type = str_type;
+    pe->pValue = pData;
+    pe->value_len = data_len;
+    
+    /* Increase the entity count */
+    (pReader->queue_count)++;
+  }
+}
+
+/*
+ * Perform the array prefix operation.
+ * 
+ * This should be performed before processing any token except for "]".
+ * 
+ * pReader is the reader object.  The reader must not be in an error
+ * state, or a fault occurs.
+ * 
+ * This operation only does something if the array flag is on.  In that
+ * case, the array flag is turned off, the array and grouping stacks are
+ * adjusted to indicate a new array, and a BEGIN_GROUP entity is added
+ * to the reader.
+ * 
+ * These are operations that should have properly been done when the "["
+ * token was processed.  But that token needs to know whether the array
+ * is empty (followed immediately by a "]" token) or non-empty.  Hence,
+ * it sets the array flag and its processing is delayed until the next
+ * token, which calls into this array prefix operation to do the delayed
+ * array operation if the array flag is set.
+ * 
+ * This is therefore done before every token except for "]", which
+ * handles the situation differently because the empty array case is
+ * different.  Hence, this function must *not* be called before the "]"
+ * token.
+ * 
+ * If the stacks can not grow, the stacks are left as they were before
+ * the operation and an error is returned.  The caller is responsible
+ * for setting the reader into an error state.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNERR_DEEPARRAY if the arrays are nested too
+ *   deeply
+ */
+static int snreader_arrayPrefix(SNREADER *pReader) {
+  
+  int err_code = 0;
+  
+  /* Check parameter and state */
+  if (pReader == NULL) {
+    abort();
+  }
+  if (pReader->status) {
+    abort();
+  }
+  
+  /* Only do something if array flag is set */
+  if (pReader->array_flag) {
+    
+    /* Clear the array flag */
+    pReader->array_flag = 0;
+    
+    /* Push a value of one on top of the array stack and a value of zero
+     * on top of the grouping stack to begin a new array */
+    if (!snstack_push(&(pReader->stack_array), 1)) {
+      err_code = SNERR_DEEPARRAY;
+    }
+    
+    if (!err_code) {
+      if (!snstack_push(&(pReader->stack_group), 0)) {
+        snstack_pop(&(pReader->stack_array));
+        err_code = SNERR_DEEPARRAY;
+      }
+    }
+    
+    /* If the array could not be opened, it is no longer open in
+     * recovery mode either */
+    if (err_code) {
+      snreader_openPop(pReader);
+    }
+    
+    /* Add a BEGIN_GROUP entity */
+    if (!err_code) {
+      snreader_addEntityZ(pReader, SNENTITY_BEGIN_GROUP);
+    }
+  }
+  
+  /* Return status */
+  return err_code;
+}
+
+/*
+ * Record an error in the error list of a reader in recovery mode.
+ * 
+ * code is the SNERR_ code of the error, and line and offset are the
+ * line number and byte offset where it was detected.
+ * 
+ * If SNREADER_ERRS_MAX records are already stored, the error is only
+ * counted.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   code - the error code
+ * 
+ *   line - the line number of the error
+ * 
+ *   offset - the byte offset of the error
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the error list could not grow
+ *   because of the memory budget
+ */
+static int snreader_addError(
+    SNREADER * pReader,
+    int        code,
+    long       line,
+    long       offset) {
+  
+  int status = 1;
+  long newcap = 0;
+  SNERRINFO *pe = NULL;
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (code >= 0)) {
+    abort();
+  }
+  
+  /* Grow the list if it is full and not yet at maximum capacity */
+  if ((pReader->errs_stored >= pReader->errs_cap) &&
+      (pReader->errs_cap < SNREADER_ERRS_MAX)) {
+    
+    /* Determine new capacity */
+    if (pReader->errs_cap < 1) {
+      newcap = SNREADER_ERRS_INIT;
+    } else {
+      newcap = pReader->errs_cap * 2;
+      if (newcap > SNREADER_ERRS_MAX) {
+        newcap = SNREADER_ERRS_MAX;
+      }
+    }
+    
+    /* Charge the growth and reallocate */
+    if (snmem_grow(&(pReader->mem),
+          (newcap - pReader->errs_cap) * ((long) sizeof(SNERRINFO)),
+          0)) {
+      pe = (SNERRINFO *) realloc(pReader->pErrs,
+              (size_t) (newcap * ((long) sizeof(SNERRINFO))));
+      if (pe == NULL) {
+        abort();
+      }
+      pReader->pErrs = pe;
+      pReader->errs_cap = newcap;
+      
+    } else {
+      status = 0;
+    }
+  }
+  
+  /* Store the record if there is room */
+  if (status && (pReader->errs_stored < pReader->errs_cap)) {
+    pe = &((pReader->pErrs)[pReader->errs_stored]);
+    pe->code = code;
+    pe->line = line;
+    pe->offset = offset;
+    (pReader->errs_stored)++;
+  }
+  
+  /* Count the error */
+  if (status && (pReader->errs_total < LONG_MAX)) {
+    (pReader->errs_total)++;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Attempt to recover from an error in recovery mode.
+ * 
+ * code is the SNERR_ code of the error.
+ * 
+ * If the error can be recovered from, it is recorded in the error list
+ * at the current position of the input filter, and input is skipped as
+ * necessary to resynchronize:
+ * 
+ *   (1) Illegal characters and overlong tokens skip to the end of the
+ *       token.
+ * 
+ *   (2) Errors within string data skip to the end of the line.
+ * 
+ *   (3) Structural errors discard the offending token, so that the
+ *       entities that are returned remain properly nested.
+ * 
+ * Structures left open at the |; token are not handled here.  See
+ * snreader_abandon() for those.
+ * 
+ * Errors from the input source and filter, errors caused by the memory
+ * budget, and unterminated strings can not be recovered from.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   code - the error code
+ * 
+ *   pIn - the input source
+ * 
+ *   pFilter - the input filter
+ * 
+ * Return:
+ * 
+ *   zero if the error was recovered from, otherwise the error code that
+ *   the reader should stop with
+ */
+static int snreader_recover(
+    SNREADER * pReader,
+    int        code,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter) {
+  
+  int sync = SNREADER_SYNC_FATAL;
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (code >= 0) ||
+      (pIn == NULL) || (pFilter == NULL)) {
+    abort();
+  }
+  
+  /* Determine how to resynchronize */
+  switch (code) {
+    
+    case SNERR_BADCHAR:
+    case SNERR_LONGTOKEN:
+      sync = SNREADER_SYNC_TOKEN;
+      break;
+    
+    case SNERR_LONGSTR:
+    case SNERR_NULLCHR:
+    case SNERR_DEEPCURLY:
+    case SNERR_DECODE:
+      sync = SNREADER_SYNC_LINE;
+      break;
+    
+    case SNERR_DEEPARRAY:
+    case SNERR_METANEST:
+    case SNERR_SEMICOLON:
+    case SNERR_DEEPGROUP:
+    case SNERR_RPAREN:
+    case SNERR_RSQR:
+    case SNERR_OPENGROUP:
+    case SNERR_LONGARRAY:
+    case SNERR_OPENMETA:
+    case SNERR_OPENARRAY:
+    case SNERR_COMMA:
+    case SNERR_ESCAPE:
+      sync = SNREADER_SYNC_DROP;
+      break;
+    
+    case SNERR_SIGNATURE:
+    case SNERR_OPERATOR:
+    case SNERR_PREFIX:
+    case SNERR_NUMERIC:
+    case SNERR_LONGMETA:
+      sync = SNREADER_SYNC_NONE;
+      break;
+      
+    default:
+      sync = SNREADER_SYNC_FATAL;
+  }
+  
+  /* Record the error unless fatal */
+  if (sync != SNREADER_SYNC_FATAL) {
+    if (!snreader_addError(pReader, code,
+          snfilter_count(pFilter, pIn), snfilter_pos(pFilter, pIn))) {
+      code = SNERR_BUDGET;
+      sync = SNREADER_SYNC_FATAL;
+    }
+  }
+  
+  /* Resynchronize */
+  if (sync == SNREADER_SYNC_TOKEN) {
+    sntk_resync(pIn, pFilter, 0);
+    
+  } else if (sync == SNREADER_SYNC_LINE) {
+    sntk_resync(pIn, pFilter, 1);
+  }
+  
+  /* Clear the error if recovered */
+  if (sync != SNREADER_SYNC_FATAL) {
+    code = 0;
+  }
+  
+  /* Return the remaining error, if any */
+  return code;
+}
+
+/*
+ * Record a structure that has just been opened on the open stack of a
+ * reader.
+ * 
+ * Nothing is done unless the reader is in recovery mode.  kind is one
+ * of the SNREADER_OPEN_ constants.  The position that is recorded is
+ * the current position of the input filter, which is just after the
+ * token that opened the structure.
+ * 
+ * Groups and arrays can not be opened if SNREADER_OPEN_MAX longs are
+ * already on the stack.  Any structure can not be opened if the stack
+ * can not grow because of the memory budget.  The stack is unchanged in
+ * those cases and an error is returned.  The caller is responsible for
+ * leaving the structure closed.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   kind - the kind of structure
+ * 
+ *   pIn - the input source
+ * 
+ *   pFilter - the input filter
+ * 
+ * Return:
+ * 
+ *   zero if successful, otherwise SNERR_DEEPGROUP, SNERR_DEEPARRAY, or
+ *   SNERR_METANEST according to the kind of structure
+ */
+static int snreader_openPush(
+    SNREADER * pReader,
+    int        kind,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter) {
+  
+  int status = 1;
+  int err_code = 0;
+  long count = 0;
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (pIn == NULL) || (pFilter == NULL)) {
+    abort();
+  }
+  if ((kind != SNREADER_OPEN_GROUP) && (kind != SNREADER_OPEN_ARRAY) &&
+      (kind != SNREADER_OPEN_META)) {
+    abort();
+  }
+  
+  /* Only do something in recovery mode */
+  if (pReader->recover) {
+    
+    /* Check the nesting limit, which does not apply to metacommands */
+    count = snstack_count(&(pReader->stack_open));
+    if ((kind != SNREADER_OPEN_META) && (count >= SNREADER_OPEN_MAX)) {
+      status = 0;
+    }
+    
+    /* Push the kind and the position */
+    if (status) {
+      status = snstack_push(&(pReader->stack_open), (long) kind);
+    }
+    if (status) {
+      status = snstack_push(&(pReader->stack_open),
+                  snfilter_count(pFilter, pIn));
+    }
+    if (status) {
+      status = snstack_push(&(pReader->stack_open),
+                  snfilter_pos(pFilter, pIn));
+    }
+    
+    /* If failed, undo any partial push and report the error */
+    if (!status) {
+      while (snstack_count(&(pReader->stack_open)) > count) {
+        snstack_pop(&(pReader->stack_open));
+      }
+      if (kind == SNREADER_OPEN_GROUP) {
+        err_code = SNERR_DEEPGROUP;
+      } else if (kind == SNREADER_OPEN_ARRAY) {
+        err_code = SNERR_DEEPARRAY;
+      } else {
+        err_code = SNERR_METANEST;
+      }
+    }
+  }
+  
+  /* Return status */
+  return err_code;
+}
+
+/*
+ * Remove the innermost structure from the open stack of a reader after
+ * it has been closed.
+ * 
+ * Nothing is done unless the reader is in recovery mode.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ */
+static void snreader_openPop(SNREADER *pReader) {
+  
+  int i = 0;
+  
+  /* Check parameter */
+  if (pReader == NULL) {
+    abort();
+  }
+  
+  /* Only do something in recovery mode */
+  if (pReader->recover) {
+    if (snstack_count(&(pReader->stack_open)) < 3) {
+      abort();
+    }
+    for(i = 0; i < 3; i++) {
+      snstack_pop(&(pReader->stack_open));
+    }
+  }
+}
+
+/*
+ * Abandon the structures that are still open at the |; token in
+ * recovery mode.
+ * 
+ * The reader must be in recovery mode and must not already be closing,
+ * or a fault occurs.
+ * 
+ * One error is recorded for each open structure, innermost first, with
+ * the position of the token that opened it.  The error is SNERR_OPENMETA
+ * for a metacommand, SNERR_OPENARRAY for an array, and SNERR_OPENGROUP
+ * for a group.  If anything is open, the closing flag is then set, so
+ * that snreader_closeNext() closes the structures one by one.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNERR_BUDGET if the error list could not
+ *   grow
+ */
+static int snreader_abandon(SNREADER *pReader) {
+  
+  int err_code = 0;
+  int code = 0;
+  long i = 0;
+  long *pOpen = NULL;
+  
+  /* Check parameter and state */
+  if (pReader == NULL) {
+    abort();
+  }
+  if ((!(pReader->recover)) || pReader->closing) {
+    abort();
+  }
+  
+  /* Record an error for each open structure, innermost first */
+  pOpen = (pReader->stack_open).pBuf;
+  for(i = snstack_count(&(pReader->stack_open)) - 3;
+      (!err_code) && (i >= 0);
+      i -= 3) {
+    if (pOpen[i] == SNREADER_OPEN_GROUP) {
+      code = SNERR_OPENGROUP;
+    } else if (pOpen[i] == SNREADER_OPEN_ARRAY) {
+      code = SNERR_OPENARRAY;
+    } else {
+      code = SNERR_OPENMETA;
+    }
+    if (!snreader_addError(pReader, code, pOpen[i + 1], pOpen[i + 2])) {
+      err_code = SNERR_BUDGET;
+    }
+  }
+  
+  /* Start closing if anything is open */
+  if ((!err_code) && (snstack_count(&(pReader->stack_open)) > 0)) {
+    pReader->closing = 1;
+  }
+  
+  /* Return status */
+  return err_code;
+}
+
+/*
+ * Close the innermost open structure of a reader that is closing after
+ * the |; token in recovery mode, or add the EOF entity if nothing is
+ * left open.
+ * 
+ * A metacommand that is passed through is closed with an END_META
+ * entity, while one that is intercepted is discarded without calling
+ * its handler.  A group is closed with an END_GROUP entity.  An array
+ * is closed with the END_GROUP entity of its last element followed by
+ * an ARRAY entity, in the same way as the "]" token.
+ * 
+ * The reader must be in recovery mode, or a fault occurs.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ */
+static void snreader_closeNext(SNREADER *pReader) {
+  
+  long kind = 0;
+  long count = 0;
+  
+  /* Check parameter and state */
+  if (pReader == NULL) {
+    abort();
+  }
+  if (!(pReader->recover)) {
+    abort();
+  }
+  
+  /* Get the innermost open structure, if any */
+  count = snstack_count(&(pReader->stack_open));
+  if (count > 0) {
+    kind = ((pReader->stack_open).pBuf)[count - 3];
+    snreader_openPop(pReader);
+  }
+  
+  /* Close it */
+  if (kind == SNREADER_OPEN_META) {
+    if (!(pReader->meta_flag)) {
+      abort();  /* shouldn't happen */
+    }
+    if (pReader->meta_mode == SNREADER_META_PASS) {
+      snreader_addEntityZ(pReader, SNENTITY_END_META);
+    }
+    pReader->meta_flag = 0;
+    pReader->meta_mode = SNREADER_META_PASS;
+    
+  } else if (kind == SNREADER_OPEN_GROUP) {
+    if (!snstack_dec(&(pReader->stack_group))) {
+      abort();  /* shouldn't happen */
+    }
+    snreader_addEntityZ(pReader, SNENTITY_END_GROUP);
+    
+  } else if (kind == SNREADER_OPEN_ARRAY) {
+    if ((snstack_count(&(pReader->stack_array)) < 1) ||
+        (snstack_peek(&(pReader->stack_group)) != 0)) {
+      abort();  /* shouldn't happen */
+    }
+    snreader_addEntityZ(pReader, SNENTITY_END_GROUP);
+    snreader_addEntityL(pReader, SNENTITY_ARRAY,
+      snstack_pop(&(pReader->stack_array)));
+    snstack_pop(&(pReader->stack_group));
+    
+  } else {
+    /* Nothing left open */
+    pReader->closing = 0;
+    snreader_addEntityZ(pReader, SNENTITY_EOF);
+  }
+}
+
+/*
+ * Validate the entities that a token has added to the queue against
+ * the schema of a reader.
+ * 
+ * The reader must have a schema and the queue must hold only the
+ * entities generated by the current token, or a fault occurs.
+ * 
+ * While the signature has not been checked, queued entities advance
+ * the signature state, and anything other than the signature at the
+ * start of the document is a signature error.  Signature errors do not
+ * drop any entities.
+ * 
+ * Operations, strings, and numerics that the schema does not allow are
+ * removed from the queue and the corresponding error is returned.
+ * Allowed operations and strings receive their schema IDs.  If there
+ * is more than one error, the first is returned.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ * Return:
+ * 
+ *   zero if the entities are valid, otherwise a schema error code
+ */
+static int snreader_schema(SNREADER *pReader) {
+  
+  const SNSCHEMA *pSchema = NULL;
+  SNENTITY *pe = NULL;
+  int err_code = 0;
+  int ent_err = 0;
+  long idx = 0;
+  int i = 0;
+  int j = 0;
+  
+  /* Check parameters and state */
+  if (pReader == NULL) {
+    abort();
+  }
+  if ((pReader->pSchema == NULL) || (pReader->queue_read != 0)) {
+    abort();
+  }
+  pSchema = pReader->pSchema;
+  
+  for(i = 0; i < pReader->queue_count; i++) {
+    pe = &(pReader->queue[i]);
+    ent_err = 0;
+    
+    /* Advance the signature state */
+    if (pSchema->has_sig && (pReader->sig_state != SNSIG_DONE)) {
+      idx = pReader->sig_state - 1;
+      if (pReader->sig_state == SNSIG_START) {
+        if (pe->status == SNENTITY_BEGIN_META) {
+          pReader->sig_state = 1;
+        } else {
+          pReader->sig_state = SNSIG_DONE;
+          err_code = SNERR_SIGNATURE;
+        }
+        
+      } else if ((pe->status == SNENTITY_META_TOKEN) &&
+          ((pSchema->sig).pLen[idx] == pe->key_len) &&
+          (memcmp(pSchema->pArena + (pSchema->sig).pOff[idx],
+                    pe->pKey, (size_t) pe->key_len) == 0)) {
+        (pReader->sig_state)++;
+        if (pReader->sig_state > (pSchema->sig).count) {
+          pReader->sig_state = SNSIG_DONE;
+        }
+        
+      } else {
+        pReader->sig_state = SNSIG_DONE;
+        if (!err_code) {
+          err_code = SNERR_SIGNATURE;
+        }
+      }
+    }
+    
+    /* Check the entity and look up its ID */
+    if ((pe->status == SNENTITY_OPERATION) && pSchema->has_ops) {
+      pe->id = snnames_find(pSchema, &(pSchema->ops),
+                  pe->pKey, pe->key_len);
+      if (pe->id == 0) {
+        ent_err = SNERR_OPERATOR;
+      }
+      
+    } else if ((pe->status == SNENTITY_STRING) && pSchema->has_prefixes) {
+      pe->id = snnames_find(pSchema, &(pSchema->prefixes),
+                  pe->pKey, pe->key_len);
+      if (pe->id == 0) {
+        ent_err = SNERR_PREFIX;
+      }
+      
+    } else if ((pe->status == SNENTITY_NUMERIC) && pSchema->has_numeric) {
+      if (!(snnum_shape(pe->pKey) & pSchema->shapes)) {
+        ent_err = SNERR_NUMERIC;
+      }
+    }
+    
+    /* Keep the entity unless it was rejected */
+    if (ent_err) {
+      if (!err_code) {
+        err_code = ent_err;
+      }
+    } else {
+      if (j != i) {
+        memcpy(&(pReader->queue[j]), pe, sizeof(SNENTITY));
+      }
+      j++;
+    }
+  }
+  pReader->queue_count = j;
+  
+  /* Return result */
+  return err_code;
+}
+
+/* 
+ * Begin a metacommand in a reader.
+ * 
+ * This is called for the % token that opens a metacommand.  If no
+ * handlers are registered and includes are not enabled, or the
+ * signature metacommand of a schema is still expected, the metacommand
+ * is passed through and a BEGIN_META entity is added.  Otherwise,
+ * nothing is added and the reader waits for the name of the
+ * metacommand.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ */
+static void snreader_metaBegin(SNREADER *pReader) {
+  
+  int intercept = 0;
+  
+  /* Check parameter */
+  if (pReader == NULL) {
+    abort();
+  }
+  
+  /* Decide whether handlers or includes apply */
+  if (((pReader->metas).count > 0) || (pReader->pIncCache != NULL) ||
+        (pReader->pIncFrag != NULL)) {
+    if ((pReader->pSchema == NULL) || (!((pReader->pSchema)->has_sig)) ||
+        (pReader->sig_state == SNSIG_DONE)) {
+      intercept = 1;
+    }
+  }
+
+  if (intercept) {
+    pReader->meta_mode = SNREADER_META_NAME;
+    snbuffer_reset(&(pReader->buf_meta), 0);
+    snstack_reset(&(pReader->stack_meta), 0);
+    
+  } else {
+    pReader->meta_mode = SNREADER_META_PASS;
+    snreader_addEntityZ(pReader, SNENTITY_BEGIN_META);
+  }
+}
+
+/*
+ * Find the registered handler for a metacommand name.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   pName - the nul-terminated metacommand name
+ * 
+ * Return:
+ * 
+ *   the registry entry, or NULL if the name has no handler
+ */
+static const SNMETAENTRY *snreader_metaFind(
+    const SNREADER * pReader,
+    const char     * pName) {
+  
+  const SNMETAENTRY *pResult = NULL;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (pName == NULL)) {
+    abort();
+  }
+  
+  /* Search the registry */
+  for(i = 0; i < (pReader->metas).count; i++) {
+    if (strcmp(((pReader->metas).entries[i]).pName, pName) == 0) {
+      pResult = &((pReader->metas).entries[i]);
+      break;
+    }
+  }
+  
+  /* Return result */
+  return pResult;
+}
+
+/*
+ * Decide how to handle a metacommand once its first token or string
+ * has been read.
+ * 
+ * pName is the first token, or NULL if the metacommand starts with a
+ * string.  Metacommands with a registered handler, and include
+ * metacommands if includes are enabled, have their arguments collected.
+ * Other metacommands are skipped if any handlers are registered, or
+ * passed through otherwise, in which case the BEGIN_META entity that
+ * was held back is added.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   pName - the metacommand name, or NULL
+ */
+static void snreader_metaName(SNREADER *pReader, const char *pName) {
+  
+  const SNMETAENTRY *pEntry = NULL;
+  int include = 0;
+  
+  /* Check parameter and state */
+  if (pReader == NULL) {
+    abort();
+  }
+  if (pReader->meta_mode != SNREADER_META_NAME) {
+    abort();
+  }
+  
+  /* Look up the name */
+  if (pName != NULL) {
+    pEntry = snreader_metaFind(pReader, pName);
+    if ((pEntry == NULL) && (strcmp(pName, SNREADER_INCLUDE) == 0) &&
+        ((pReader->pIncCache != NULL) || (pReader->pIncFrag != NULL))) {
+      include = 1;
+    }
+  }
+  
+  /* Choose the mode, copying the handler so that it may change the
+   * registry */
+  if (pEntry != NULL) {
+    memcpy(&(pReader->meta_entry), pEntry, sizeof(SNMETAENTRY));
+    pReader->meta_mode = SNREADER_META_COLLECT;
+    
+  } else if (include) {
+    (pReader->meta_entry).pName = SNREADER_INCLUDE;
+    (pReader->meta_entry).pfMeta = &snreader_includeMeta;
+    (pReader->meta_entry).pCustom = (void *) pReader;
+    pReader->meta_mode = SNREADER_META_COLLECT;
+    
+  } else if ((pReader->metas).count > 0) {
+    pReader->meta_mode = SNREADER_META_SKIP;
+    
+  } else {
+    pReader->meta_mode = SNREADER_META_PASS;
+    snreader_addEntityZ(pReader, SNENTITY_BEGIN_META);
+  }
+}
+
+/*
+ * Handle a token or string within a metacommand whose arguments are
+ * collected or skipped.
+ * 
+ * Nothing is done for skipped metacommands.  For metacommands with a
+ * handler, the argument is copied into the metacommand arena.
+ * 
+ * entity is SNENTITY_META_TOKEN or SNENTITY_META_STRING.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   entity - the type of the argument
+ * 
+ *   pData - the argument data
+ * 
+ *   len - the length of the argument data in bytes
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNERR_LONGMETA if the argument did not fit,
+ *   in which case the rest of the metacommand is skipped
+ */
+static int snreader_metaArg(
+    SNREADER   * pReader,
+    int          entity,
+    const char * pData,
+    long         len) {
+  
+  int err_code = 0;
+  long j = 0;
+  
+  /* Check parameters and state */
+  if ((pReader == NULL) || (pData == NULL) || (len < 0)) {
+    abort();
+  }
+  if ((entity != SNENTITY_META_TOKEN) &&
+      (entity != SNENTITY_META_STRING)) {
+    abort();
+  }
+  if ((pReader->meta_mode != SNREADER_META_COLLECT) &&
+      (pReader->meta_mode != SNREADER_META_SKIP)) {
+    abort();
+  }
+  
+  /* Collect the argument, followed by a placeholder for its nul */
+  if (pReader->meta_mode == SNREADER_META_COLLECT) {
+    if (!snstack_push(&(pReader->stack_meta), (pReader->buf_meta).count)) {
+      err_code = SNERR_LONGMETA;
+    }
+    if (!err_code) {
+      if (!snstack_push(&(pReader->stack_meta), (long) entity)) {
+        err_code = SNERR_LONGMETA;
+      }
+    }
+    for(j = 0; (!err_code) && (j < len); j++) {
+      if (!snbuffer_appendByte(&(pReader->buf_meta),
+              ((const unsigned char *) pData)[j])) {
+        err_code = SNERR_LONGMETA;
+      }
+    }
+    if (!err_code) {
+      if (!snbuffer_appendByte(&(pReader->buf_meta), 0xff)) {
+        err_code = SNERR_LONGMETA;
+      }
+    }
+    
+    /* Skip the rest of a metacommand that does not fit */
+    if (err_code) {
+      pReader->meta_mode = SNREADER_META_SKIP;
+    }
+  }
+  
+  /* Return result */
+  return err_code;
+}
+
+/*
+ * Make sure the argument arrays of a reader can hold the arguments of a
+ * metacommand and the terminating NULL.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   argc - the number of arguments
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNERR_BUDGET if the arrays could not be
+ *   grown
+ */
+static int snreader_metaArrays(SNREADER *pReader, long argc) {
+  
+  int err_code = 0;
+  long newcap = 0;
+  long unit = 0;
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (argc < 0)) {
+    abort();
+  }
+  
+  /* Grow the arrays if necessary */
+  if (argc >= pReader->args_cap) {
+    newcap = SNREADER_METARG_INIT;
+    while (newcap <= argc) {
+      newcap *= 2;
+    }
+    
+    unit = (long) (sizeof(const char *) + sizeof(long) + sizeof(int));
+    if (snmem_grow(&(pReader->mem),
+          (newcap - pReader->args_cap) * unit, 0)) {
+      free((void *) pReader->ppArgv);
+      free(pReader->pArgl);
+      free(pReader->pArgt);
+      
+      pReader->ppArgv = (const char **) malloc(
+                          ((size_t) newcap) * sizeof(const char *));
+      pReader->pArgl = (long *) malloc(((size_t) newcap) * sizeof(long));
+      pReader->pArgt = (int *) malloc(((size_t) newcap) * sizeof(int));
+      if ((pReader->ppArgv == NULL) || (pReader->pArgl == NULL) ||
+          (pReader->pArgt == NULL)) {
+        abort();
+      }
+      pReader->args_cap = newcap;
+      
+    } else {
+      err_code = SNERR_BUDGET;
+    }
+  }
+  
+  /* Return result */
+  return err_code;
+}
+
+/*
+ * Call the handler of a metacommand whose arguments were collected.
+ * 
+ * This is called for the semicolon that closes the metacommand.  The
+ * placeholders in the metacommand arena are replaced with nuls in
+ * place, the argument arrays are filled in, and the handler is called.
+ * The arena is then emptied.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ * Return:
+ * 
+ *   zero if successful, SNERR_BUDGET if the argument arrays could not
+ *   be allocated, or the error code returned by the handler
+ */
+static int snreader_metaCall(SNREADER *pReader) {
+  
+  int err_code = 0;
+  long argc = 0;
+  long i = 0;
+  long off = 0;
+  long end = 0;
+  char *pArena = NULL;
+  const long *pArgs = NULL;
+  SNMETA meta;
+  
+  /* Initialize structures */
+  memset(&meta, 0, sizeof(SNMETA));
+  
+  /* Check parameter and state */
+  if (pReader == NULL) {
+    abort();
+  }
+  if (pReader->meta_mode != SNREADER_META_COLLECT) {
+    abort();
+  }
+  
+  /* Get the argument count and make room for the arguments */
+  argc = snstack_count(&(pReader->stack_meta)) / 2;
+  err_code = snreader_metaArrays(pReader, argc);
+  
+  /* Terminate each argument in place and fill in the arrays */
+  if (!err_code) {
+    pArena = snbuffer_get(&(pReader->buf_meta));
+    pArgs = (pReader->stack_meta).pBuf;
+    for(i = 0; i < argc; i++) {
+      off = pArgs[2 * i];
+      if (i < argc - 1) {
+        end = pArgs[2 * (i + 1)] - 1;
+      } else {
+        end = (pReader->buf_meta).count - 1;
+      }
+      
+      pArena[end] = (char) 0;
+      (pReader->ppArgv)[i] = pArena + off;
+      (pReader->pArgl)[i] = end - off;
+      (pReader->pArgt)[i] = (int) pArgs[(2 * i) + 1];
+    }
+    (pReader->ppArgv)[argc] = NULL;
+    (pReader->pArgl)[argc] = 0;
+    (pReader->pArgt)[argc] = 0;
+    
+    meta.argc = argc;
+    meta.argv = pReader->ppArgv;
+    meta.argl = pReader->pArgl;
+    meta.argt = pReader->pArgt;
+  }
+  
+  /* Call the handler */
+  if (!err_code) {
+    err_code = ((pReader->meta_entry).pfMeta)(
+                  (pReader->meta_entry).pCustom, &meta);
+    if (err_code > 0) {
+      abort();
+    }
+  }
+  
+  /* Empty the arena */
+  snbuffer_reset(&(pReader->buf_meta), 0);
+  snstack_reset(&(pReader->stack_meta), 0);
+  
+  /* Return result */
+  return err_code;
+}
+
+/*
+ * Handler for include metacommands.
+ * 
+ * pCustom is the reader.  The metacommand must have exactly one string
+ * argument, which is the path of the file to include.  If the reader is
+ * reading a fragment, the include is recorded in the fragment.
+ * Otherwise, the file is pushed on the include stack.
  * 
- * This function allows surrogates to be decoded, even though surrogates
- * aren't supposed to be used in UTF-8.  Surrogates need to be resolved
- * by looking at more than one codepoint at a time, so they can't be
- * handled properly by this function.
+ * Parameters:
+ * 
+ *   pCustom - the reader object
+ * 
+ *   pMeta - the metacommand arguments
+ * 
+ * Return:
+ * 
+ *   zero if successful or an SNERR_ code
+ */
+static int snreader_includeMeta(void *pCustom, const SNMETA *pMeta) {
+  
+  int err_code = 0;
+  SNREADER *pReader = NULL;
+  SNENTITY ent;
+  
+  /* Initialize structures */
+  memset(&ent, 0, sizeof(SNENTITY));
+  
+  /* Check parameters */
+  if ((pCustom == NULL) || (pMeta == NULL)) {
+    abort();
+  }
+  pReader = (SNREADER *) pCustom;
+  
+  /* Check the arguments */
+  if ((pMeta->argc != 2) ||
+      ((pMeta->argt)[1] != SNENTITY_META_STRING)) {
+    err_code = SNERR_INCLUDE;
+  }
+  
+  /* Record or follow the include */
+  if ((!err_code) && (pReader->pIncFrag != NULL)) {
+    ent.status = SNFRAG_INCLUDE;
+    ent.pKey = (char *) (pMeta->argv)[1];
+    ent.key_len = (pMeta->argl)[1];
+    snfrag_add(pReader->pIncFrag, &ent, pReader->frag_line);
+    
+  } else if (!err_code) {
+    err_code = snreader_include(pReader, (pMeta->argv)[1]);
+  }
+  
+  /* Return result */
+  return err_code;
+}
+
+/*
+ * Push an included file on the include stack of a reader.
+ * 
+ * A relative path that is included from an included file is taken
+ * relative to the directory of that file.  Paths included from the
+ * source are used as they are.
  * 
  * Parameters:
  * 
- *   pc - pointer to the UTF-8 codepoint
+ *   pReader - the reader object
+ * 
+ *   pPath - the path of the file
  * 
  * Return:
  * 
- *   a Unicode codepoint (including surrogates!), or -1 if the UTF-8
- *   encoding wasn't valid
+ *   zero if successful, SNERR_DEEPINCLUDE if the include stack is full,
+ *   or SNERR_INCLUDE if the file could not be read or includes are not
+ *   enabled
  */
-static long snutf_decode(const unsigned char *pc) {
+static int snreader_include(SNREADER *pReader, const char *pPath) {
   
-  int status = 1;
-  int ec = 0;
-  int x = 0;
-  long result = 0;
+  int err_code = 0;
+  const char *pBase = NULL;
+  const char *pSlash = NULL;
+  char *pFull = NULL;
+  size_t dlen = 0;
+  SNFRAG *pFrag = NULL;
   
-  /* Check parameter */
-  if (pc == NULL) {
+  /* Check parameters */
+  if ((pReader == NULL) || (pPath == NULL)) {
     abort();
   }
   
-  /* Determine encoded length */
-  ec = snutf_count(*pc);
-  if (ec < 1) {
-    /* If start of encoding is a continuation byte or not a valid UTF-8
-     * byte, fail */
-    status = 0;
+  /* Check that includes are enabled and the stack has room */
+  if (pReader->pIncCache == NULL) {
+    err_code = SNERR_INCLUDE;
+  } else if (pReader->inc_depth >= SNREADER_MAXINCLUDE) {
+    err_code = SNERR_DEEPINCLUDE;
   }
   
-  /* If there is more than one byte in the encoding, make sure all
-   * additional bytes are continuation bytes */
-  if (status) {
-    for(x = 1; x < ec; x++) {
-      if (snutf_count(pc[x]) != 0) {
-        status = 0;
-        break;
+  /* Make relative paths relative to the including file */
+  if ((!err_code) && (pReader->inc_depth > 0) && (pPath[0] != '/')) {
+    pBase = ((pReader->incs[pReader->inc_depth - 1]).pFrag)->pPath;
+    pSlash = strrchr(pBase, '/');
+    if (pSlash != NULL) {
+      dlen = (size_t) (pSlash - pBase) + 1;
+      pFull = (char *) malloc(dlen + strlen(pPath) + 1);
+      if (pFull == NULL) {
+        abort();
       }
+      memcpy(pFull, pBase, dlen);
+      strcpy(pFull + dlen, pPath);
+      pPath = pFull;
     }
   }
   
-  /* All UTF-8 bytes are available and of the correct type, so begin by
-   * getting the payload of the lead byte */
-  if (status) {
-    switch (ec) {
-      case 1:
-        /* For one-byte codes, the byte value is equal to the code */
-        result = pc[0];
-        break;
-      
-      case 2:
-        /* For two-byte codes, lead byte payload is ---PPPPP */
-        result = (pc[0] & 0x1F);
-        break;
-      
-      case 3:
-        /* For three-byte codes, lead byte payload is ----PPPP */
-        result = (pc[0] & 0x0F);
-        break;
-      
-      case 4:
-        /* For four-byte codes, lead byte payload is -----PPP */
-        result = (pc[0] & 0x07);
-        break;
-      
-      default:
-        /* Shouldn't happen */
-        abort();
-    }
+  /* Get the fragment and push it */
+  if (!err_code) {
+    err_code = snfrag_load(pReader->pIncCache, pPath,
+                  pReader->unescape, &pFrag);
+  }
+  if (!err_code) {
+    (pReader->incs[pReader->inc_depth]).pFrag = pFrag;
+    (pReader->incs[pReader->inc_depth]).pos = 0;
+    (pReader->inc_depth)++;
   }
   
-  /* Include the payload from any continuation bytes -- continuation
-   * byte payload is --PPPPPP */
-  if (status) {
-    for(x = 1; x < ec; x++) {
-      result = (result << 6) | (pc[x] & 0x3F);
+  /* Release the combined path */
+  if (pFull != NULL) {
+    free(pFull);
+  }
+  
+  /* Return result */
+  return err_code;
+}
+
+/*
+ * Dispatch a metacommand from an included file to its handler.
+ * 
+ * This is used when handlers are registered, with the record at the
+ * current position of the include level being the BEGIN_META entity of
+ * the metacommand.  The handler is called with arguments that point
+ * straight into the arena of the fragment, or the metacommand is
+ * skipped if it has no handler.  The position is moved past the
+ * END_META entity.
+ * 
+ * If the fragment ends within the metacommand because of an error, the
+ * metacommand is skipped.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   pLevel - the include level
+ * 
+ * Return:
+ * 
+ *   zero if successful, SNERR_BUDGET if the argument arrays could not
+ *   be allocated, or the error code returned by the handler
+ */
+static int snreader_spliceMeta(SNREADER *pReader, SNINCLEVEL *pLevel) {
+  
+  int err_code = 0;
+  long first = 0;
+  long last = 0;
+  long argc = 0;
+  long i = 0;
+  const SNFRAG *pFrag = NULL;
+  const SNFRAGENT *pfe = NULL;
+  const SNMETAENTRY *pEntry = NULL;
+  SNMETA meta;
+  
+  /* Initialize structures */
+  memset(&meta, 0, sizeof(SNMETA));
+  
+  /* Check parameters */
+  if ((pReader == NULL) || (pLevel == NULL)) {
+    abort();
+  }
+  pFrag = pLevel->pFrag;
+  
+  /* Find the end of the metacommand */
+  first = pLevel->pos + 1;
+  last = first;
+  while ((last < pFrag->count) &&
+          ((pFrag->pEnts)[last].status != SNENTITY_END_META)) {
+    last++;
+  }
+  argc = last - first;
+  
+  /* Look up the handler */
+  if ((last < pFrag->count) && (argc > 0)) {
+    pfe = &((pFrag->pEnts)[first]);
+    if (pfe->status == SNENTITY_META_TOKEN) {
+      pEntry = snreader_metaFind(pReader, pFrag->pArena + pfe->key);
     }
   }
   
-  /* Fail for any overlong encodings */
-  if (status) {
-    switch (ec) {
-      case 1:
-        /* One-byte encodings are never overlong */
-        break;
-      
-      case 2:
-        /* Two-byte encodings must be at least U+0080 */
-        if (result < 0x80L) {
-          status = 0;
-        }
-        break;
-      
-      case 3:
-        /* Three-byte encodings must be at least U+0800 */
-        if (result < 0x800L) {
-          status = 0;
+  /* Fill in the arguments and call the handler */
+  if (pEntry != NULL) {
+    memcpy(&(pReader->meta_entry), pEntry, sizeof(SNMETAENTRY));
+    err_code = snreader_metaArrays(pReader, argc);
+    
+    if (!err_code) {
+      for(i = 0; i < argc; i++) {
+        pfe = &((pFrag->pEnts)[first + i]);
+        if (pfe->status == SNENTITY_META_TOKEN) {
+          (pReader->ppArgv)[i] = pFrag->pArena + pfe->key;
+          (pReader->pArgl)[i] = pfe->key_len;
+        } else {
+          (pReader->ppArgv)[i] = pFrag->pArena + pfe->value;
+          (pReader->pArgl)[i] = pfe->value_len;
         }
-        break;
+        (pReader->pArgt)[i] = pfe->status;
+      }
+      (pReader->ppArgv)[argc] = NULL;
+      (pReader->pArgl)[argc] = 0;
+      (pReader->pArgt)[argc] = 0;
       
-      case 4:
-        /* Four-byte encodings must be at least U+10000 */
-        if (result < 0x10000L) {
-          status = 0;
-        }
-        break;
+      meta.argc = argc;
+      meta.argv = pReader->ppArgv;
+      meta.argl = pReader->pArgl;
+      meta.argt = pReader->pArgt;
       
-      default:
-        /* Shouldn't happen */
+      err_code = ((pReader->meta_entry).pfMeta)(
+                    (pReader->meta_entry).pCustom, &meta);
+      if (err_code > 0) {
         abort();
+      }
     }
   }
   
-  /* If we failed, set result to -1 */
-  if (!status) {
-    result = -1;
+  /* Move past the metacommand */
+  if (last < pFrag->count) {
+    pLevel->pos = last + 1;
+  } else {
+    pLevel->pos = last;
   }
   
   /* Return result */
-  return result;
+  return err_code;
 }
 
 /*
- * Encode a Unicode codepoint into UTF-8.
+ * Take the next entity from the included file on top of the include
+ * stack of a reader, in an effort to fill the entity queue.
  * 
- * The given codepoint must be in [0, UNICODE_MAX_CPV] range.  Also, it
- * must NOT be in [UNICODE_MIN_SURROGATE, UNICODE_MAX_SURROGATE] range.
+ * The include stack must not be empty and the queue must be empty, or
+ * a fault occurs.  As with snreader_fill(), call this function in a
+ * loop until something is in the queue.
  * 
- * pb points to the buffer to write the encoded codepoint into.  This
- * function will write from one to four bytes into the buffer.  Make
- * sure there is enough room in the buffer for the encoded codepoint!
+ * Nested includes are pushed on the include stack.  When the fragment
+ * on top of the stack is finished, it is popped, unless it stopped with
+ * an error, in which case the error is set in the reader.  Entities
+ * from fragments are validated against the schema, if there is one.
  * 
- * One way of handling the buffer is to allocate a buffer of five
- * characters, initialize all the characters to nul, and then call this
- * function on the buffer.  After this function returns, then, the
- * result will be nul-terminated (except if the given codepoint is zero,
- * in which case the result will be empty).
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ */
+static void snreader_splice(SNREADER *pReader) {
+  
+  int err_code = 0;
+  SNINCLEVEL *pLevel = NULL;
+  const SNFRAG *pFrag = NULL;
+  const SNFRAGENT *pfe = NULL;
+  SNENTITY *pe = NULL;
+  
+  /* Check parameter and state */
+  if (pReader == NULL) {
+    abort();
+  }
+  if ((pReader->inc_depth < 1) || (pReader->queue_count > 0) ||
+      pReader->status) {
+    abort();
+  }
+  pLevel = &(pReader->incs[pReader->inc_depth - 1]);
+  pFrag = pLevel->pFrag;
+  
+  if (pLevel->pos >= pFrag->count) {
+    /* End of the fragment -- report its error or pop it */
+    if (pFrag->err) {
+      err_code = pFrag->err;
+      pReader->inc_line = pFrag->err_line;
+      
+    } else {
+      (pReader->inc_depth)--;
+      snfrag_release(pLevel->pFrag);
+      pLevel->pFrag = NULL;
+    }
+    
+  } else {
+    /* Get the next record */
+    pfe = &((pFrag->pEnts)[pLevel->pos]);
+    pReader->inc_line = pfe->line;
+    
+    if (pfe->status == SNFRAG_INCLUDE) {
+      /* Nested include */
+      (pLevel->pos)++;
+      err_code = snreader_include(pReader, pFrag->pArena + pfe->key);
+      
+    } else if ((pfe->status == SNENTITY_BEGIN_META) &&
+                ((pReader->metas).count > 0)) {
+      /* Metacommand for the handlers */
+      err_code = snreader_spliceMeta(pReader, pLevel);
+      
+    } else {
+      /* Queue the entity */
+      (pLevel->pos)++;
+      
+      pe = &(pReader->queue[0]);
+      memset(pe, 0, sizeof(SNENTITY));
+      pe->status = pfe->status;
+      pe->str_type = pfe->str_type;
+      pe->count = pfe->count;
+      if (pfe->key >= 0) {
+        pe->pKey = pFrag->pArena + pfe->key;
+        pe->key_len = pfe->key_len;
+      }
+      if (pfe->value >= 0) {
+        pe->pValue = pFrag->pArena + pfe->value;
+        pe->value_len = pfe->value_len;
+      }
+      if (pReader->spans) {
+        pe->start = pfe->start;
+        pe->end = pfe->end;
+        pe->col = pfe->col;
+      }
+      pReader->queue_count = 1;
+      pReader->queue_read = 0;
+      
+      if (pReader->pSchema != NULL) {
+        err_code = snreader_schema(pReader);
+      }
+    }
+  }
+  
+  /* If error, set error in reader */
+  if (err_code) {
+    pReader->status = err_code;
+  }
+}
+
+/* 
+ * Read a token from a Shastina source file in an effort to fill the
+ * entity queue.
+ * 
+ * Clients should not use this function directly.  Use snreader_read()
+ * instead (which makes use of this function).
+ * 
+ * The reader must not be in an error state and the queue must be empty.
+ * If these conditions are not satisfied, a fault occurs.  A fault may
+ * also occur if SNREADER_MAXQUEUE is not large enough -- see that
+ * constant for further information.
+ * 
+ * Not all tokens result in entities being read, so to ensure the entity
+ * buffer is filled with at least one entity, call this function in a
+ * loop.
  * 
  * Parameters:
  * 
- *   cpv - the Unicode codepoint
+ *   pReader - the reader object
  * 
- *   pb - the buffer to write the result into
+ *   pIn - the input file
+ * 
+ *   pFilter - the filter to pass input through
  */
-static void snutf_encode(long cpv, unsigned char *pb) {
+static void snreader_fill(
+    SNREADER * pReader,
+    SNSOURCE * pIn,
+    SNFILTER * pFilter) {
   
-  int ec = 0;
-  int c = 0;
+  int err_code = 0;
+  int handler = 0;
+  int firstchar = 0;
   int i = 0;
+  char *pks = NULL;
+  long klen = 0;
+  long vlen = 0;
+  SNTOKEN tk;
   
-  /* Check parameters */
-  if (pb == NULL) {
+  /* Initialize structures */
+  memset(&tk, 0, sizeof(SNTOKEN));
+  
+  /* Check parameters and state */
+  if ((pReader == NULL) || (pIn == NULL) || (pFilter == NULL)) {
     abort();
   }
-  if ((cpv < 0) || (cpv > UNICODE_MAX_CPV) ||
-        ((cpv >= UNICODE_MIN_SURROGATE) &&
-          (cpv <= UNICODE_MAX_SURROGATE))) {
+  if (pReader->status) {
     abort();
   }
-  
-  /* From the codepoint value, figure out the encoded length of the
-   * codepoint */
-  if (cpv < 0x80L) {
-    /* U+0000 to 0+007F has one-byte encodings */
-    ec = 1;
-  
-  } else if (cpv < 0x800L) {
-    /* U+0080 to U+07FF has two-byte encodings */
-    ec = 2;
-    
-  } else if (cpv < 0x10000L) {
-    /* U+0800 to U+FFFF has three-byte encodings */
-    ec = 3;
-    
-  } else if (cpv <= UNICODE_MAX_CPV) {
-    /* U+10000 to end of Unicode range has four-byte encodings */
-    ec = 4;
-    
-  } else {
-    /* Shouldn't happen */
+  if (pReader->queue_count > 0) {
     abort();
   }
   
-  /* Align the cpv by left shifting so that everything has payload bits
-   * for three continuation bytes; that is, for one-byte codes, add
-   * 18 (= 6 x 3) bits; for two-byte codes, add 12 (= 6 x 2) bits; for
-   * three-byte codes, add 6 bits; and nothing for four-byte codes,
-   * which already have three continuation bytes */
-  if (ec == 1) {
-    cpv = cpv << 18;
+  /* If grouping stack is empty, initialize it with a value of zero;
+   * this can only fail if the memory budget is exhausted */
+  if (snstack_count(&(pReader->stack_group)) < 1) {
+    if (!snstack_push(&(pReader->stack_group), 0)) {
+      err_code = SNERR_DEEPGROUP;
+    }
+  }
   
-  } else if (ec == 2) {
-    cpv = cpv << 12;
+  /* Read a token, unless closing after the |; token, in which case
+   * that token is processed again */
+  if ((!err_code) && pReader->closing) {
+    tk.pKey = &(pReader->buf_key);
+    tk.pValue = &(pReader->buf_value);
+    tk.status = SNTOKEN_FINAL;
+    tk.start = pReader->close_start;
+    tk.end = pReader->close_end;
+    tk.col = pReader->close_col;
     
-  } else if (ec == 3) {
-    cpv = cpv << 6;
+  } else if (!err_code) {
+    tk.pKey = &(pReader->buf_key);
+    tk.pValue = &(pReader->buf_value);
+    tk.spans = pReader->spans;
+    if ((!(pReader->meta_flag)) && ((pReader->decoders).count > 0)) {
+      tk.pDecoders = &(pReader->decoders);
+    } else {
+      tk.pDecoders = NULL;
+    }
+    sntoken_read(&tk, pIn, pFilter);
+    if (tk.status < 0) {
+      err_code = tk.status;
+    }
   }
   
-  /* Lead byte payload is now always 18 bits shifted, so combine it with
-   * the appropriate marker bits and write the first encoded byte */
-  c = (int) (cpv >> 18);
-  
-  if (ec == 2) {
-    c = c | 0xC0;
-  
-  } else if (ec == 3) {
-    c = c | 0xE0;
-    
-  } else if (ec == 4) {
-    c = c | 0xF0;
+  /* Get the key string pointer and its length */
+  if (!err_code) {
+    pks = snbuffer_get(tk.pKey);
+    klen = (tk.pKey)->count;
   }
   
-  *pb = (unsigned char) c;
-  pb++;
+  /* If requested, decode escapes in string data in place */
+  if ((!err_code) && (tk.status == SNTOKEN_STRING) &&
+      pReader->unescape) {
+    vlen = snescape_decode(snbuffer_get(tk.pValue),
+                snbuffer_get(tk.pValue), (tk.pValue)->count,
+                pReader->unescape);
+    if (vlen >= 0) {
+      (tk.pValue)->count = vlen;
+    } else {
+      err_code = (int) vlen;
+    }
+  }
   
-  /* Mask out the lead byte payload, leaving just the continuation byte
-   * payloads */
-  cpv = cpv & 0x3ffffL;
+  /* Perform array prefix operation if not in metacommand mode, except
+   * for "]" token */
+  if ((!err_code) && (!pReader->meta_flag)) {
+    if (tk.status == SNTOKEN_SIMPLE) {
+      if (!snchar_strequals(ASCII_RSQR, pks)) {
+        /* Simple token except for "]" */
+        err_code = snreader_arrayPrefix(pReader);
+      }
+      
+    } else {
+      /* Not in metacommand mode and not a simple token */
+      err_code = snreader_arrayPrefix(pReader);
+    }
+  }
   
-  /* Write any continuation bytes */
-  for(i = 1; i < ec; i++) {
-    /* Get most significant continuation payload */
-    c = (int) (cpv >> 12);
-    
-    /* Add continuation marker bit */
-    c = c | 0x80;
+  /* Handle the token types */
+  if ((tk.status == SNTOKEN_SIMPLE) && (!err_code)) {
+    /* Simple token -- handle non-primitive and primitive cases */
+    if (snchar_strequals(ASCII_PERCENT, pks)) {
+      /* % token -- enter metacommand mode */
+      if (!pReader->meta_flag) {
+        err_code = snreader_openPush(pReader, SNREADER_OPEN_META,
+                      pIn, pFilter);
+        if (!err_code) {
+          pReader->meta_flag = 1;
+          snreader_metaBegin(pReader);
+        }
+        
+      } else {
+        /* Nested metacommands */
+        err_code = SNERR_METANEST;
+      }
+      
+    } else if (snchar_strequals(ASCII_SEMICOLON, pks)) {
+      /* ; token -- leave metacommand mode */
+      if (pReader->meta_flag) {
+        pReader->meta_flag = 0;
+        snreader_openPop(pReader);
+        if (pReader->meta_mode == SNREADER_META_PASS) {
+          snreader_addEntityZ(pReader, SNENTITY_END_META);
+        } else if (pReader->meta_mode == SNREADER_META_COLLECT) {
+          if (pReader->pIncFrag != NULL) {
+            pReader->frag_line = snfilter_count(pFilter, pIn);
+          }
+          err_code = snreader_metaCall(pReader);
+          handler = 1;
+        }
+        pReader->meta_mode = SNREADER_META_PASS;
+        
+      } else {
+        /* Semicolon outside of metacommand */
+        err_code = SNERR_SEMICOLON;
+      }
+      
+    } else if (pReader->meta_flag) {
+      /* Other simple tokens in metacommand mode */
+      if (pReader->meta_mode == SNREADER_META_NAME) {
+        snreader_metaName(pReader, pks);
+      }
+      if (pReader->meta_mode == SNREADER_META_PASS) {
+        snreader_addEntityS(pReader, SNENTITY_META_TOKEN, pks, klen);
+      } else {
+        err_code = snreader_metaArg(pReader,
+                      SNENTITY_META_TOKEN, pks, klen);
+      }
+      
+    } else {
+      /* Primitive tokens -- first, get first byte */
+      firstchar = pks[0];
+      
+      /* Handle the various primitive tokens */
+      if ((firstchar == ASCII_PLUS) ||
+          (firstchar == ASCII_HYPHEN) ||
+          ((firstchar >= ASCII_ZERO) && (firstchar <= ASCII_NINE))) {
+        /* Numeric token */
+        snreader_addEntityS(pReader, SNENTITY_NUMERIC, pks, klen);
+        
+      } else if (firstchar == ASCII_QUESTION) {
+        /* Declare variable */
+        snreader_addEntityS(pReader, SNENTITY_VARIABLE,
+          (pks + 1), (klen - 1));
+        
+      } else if (firstchar == ASCII_ATSIGN) {
+        /* Declare constant */
+        snreader_addEntityS(pReader, SNENTITY_CONSTANT,
+          (pks + 1), (klen - 1));
+        
+      } else if (firstchar == ASCII_COLON) {
+        /* Assign variable */
+        snreader_addEntityS(pReader, SNENTITY_ASSIGN,
+          (pks + 1), (klen - 1));
+        
+      } else if (firstchar == ASCII_EQUALS) {
+        /* Get variable or constant value */
+        snreader_addEntityS(pReader, SNENTITY_GET,
+          (pks + 1), (klen - 1));
+        
+      } else if (snchar_strequals(ASCII_LPAREN, pks)) {
+        /* Begin group */
+        err_code = snreader_openPush(pReader, SNREADER_OPEN_GROUP,
+                      pIn, pFilter);
+        if (!err_code) {
+          if (snstack_inc(&(pReader->stack_group))) {
+            snreader_addEntityZ(pReader, SNENTITY_BEGIN_GROUP);
+          } else {
+            /* Too much group nesting */
+            snreader_openPop(pReader);
+            err_code = SNERR_DEEPGROUP;
+          }
+        }
+        
+      } else if (snchar_strequals(ASCII_RPAREN, pks)) {
+        /* End group */
+        if (snstack_dec(&(pReader->stack_group))) {
+          snreader_openPop(pReader);
+          snreader_addEntityZ(pReader, SNENTITY_END_GROUP);
+        } else {
+          /* Closing parenthesis without an opening parenthesis */
+          err_code = SNERR_RPAREN;
+        }
+        
+      } else if (snchar_strequals(ASCII_LSQR, pks)) {
+        /* Begin array */
+        err_code = snreader_openPush(pReader, SNREADER_OPEN_ARRAY,
+                      pIn, pFilter);
+        if (!err_code) {
+          pReader->array_flag = 1;
+        }
+        
+      } else if (snchar_strequals(ASCII_RSQR, pks)) {
+        /* End array */
+        if (!(pReader->array_flag)) {
+          /* Non-empty array -- check that array stack is not empty and
+           * that value on top of grouping stack is zero, then perform
+           * operation */
+          if (snstack_count(&(pReader->stack_array)) > 0) {
+            if (snstack_peek(&(pReader->stack_group)) == 0) {
+              snreader_addEntityZ(pReader, SNENTITY_END_GROUP);
+              snreader_addEntityL(pReader, SNENTITY_ARRAY,
+                snstack_pop(&(pReader->stack_array)));
+              snstack_pop(&(pReader->stack_group));
+              snreader_openPop(pReader);
+              
+            } else {
+              /* Still unclosed parentheses in current element */
+              err_code = SNERR_OPENGROUP;
+            }
+            
+          } else {
+            /* "]" without a corresponding opening bracket */
+            err_code = SNERR_RSQR;
+          }
+          
+        } else {
+          /* Empty array */
+          pReader->array_flag = 0;
+          snreader_openPop(pReader);
+          snreader_addEntityL(pReader, SNENTITY_ARRAY, 0);
+        }
+        
+      } else if (snchar_strequals(ASCII_COMMA, pks)) {
+        /* Array separator -- check that array stack is not empty and
+         * that value on top of grouping stack is zero, then perform
+         * operation */
+        if (snstack_count(&(pReader->stack_array)) > 0) {
+          if (snstack_peek(&(pReader->stack_group)) == 0) {
+            if (snstack_inc(&(pReader->stack_array))) {
+              snreader_addEntityZ(pReader, SNENTITY_END_GROUP);
+              snreader_addEntityZ(pReader, SNENTITY_BEGIN_GROUP);
+              
+            } else {
+              /* Too many array elements */
+              err_code = SNERR_LONGARRAY;
+            }
+              
+          } else {
+            /* Open parentheses in current element */
+            err_code = SNERR_OPENGROUP;
+          }
+            
+        } else {
+          /* Comma used outside of array */
+          err_code = SNERR_COMMA;
+        }
+        
+      } else {
+        /* Operator */
+        snreader_addEntityS(pReader, SNENTITY_OPERATION, pks, klen);
+      }
+    }
     
-    /* Output continuation byte */
-    *pb = (unsigned char) c;
-    pb++;
+  } else if ((tk.status == SNTOKEN_STRING) && (!err_code)) {
+    /* String token -- either a normal string or a meta string */
+    if (pReader->meta_flag &&
+          (pReader->meta_mode == SNREADER_META_NAME)) {
+      snreader_metaName(pReader, NULL);
+    }
+    if (pReader->meta_flag &&
+          (pReader->meta_mode == SNREADER_META_PASS)) {
+      /* Meta string */
+      snreader_addEntityT(pReader, SNENTITY_META_STRING,
+        pks, klen, tk.str_type,
+        snbuffer_get(tk.pValue), (tk.pValue)->count);
+    } else if (pReader->meta_flag) {
+      /* Meta string for a metacommand handler */
+      err_code = snreader_metaArg(pReader, SNENTITY_META_STRING,
+        snbuffer_get(tk.pValue), (tk.pValue)->count);
+    } else {
+      /* Normal string */
+      snreader_addEntityT(pReader, SNENTITY_STRING,
+        pks, klen, tk.str_type,
+        snbuffer_get(tk.pValue), (tk.pValue)->count);
+    }
+  
+  } else if ((tk.status == SNTOKEN_FINAL) && (!err_code) &&
+              pReader->recover) {
+    /* Final token in recovery mode -- the first time through, abandon
+     * any structures that are still open and keep the span of the
+     * token; then close one structure, or add the EOF entity if nothing
+     * is left open */
+    if (!(pReader->closing)) {
+      err_code = snreader_abandon(pReader);
+      pReader->close_start = tk.start;
+      pReader->close_end = tk.end;
+      pReader->close_col = tk.col;
+    }
+    if (!err_code) {
+      snreader_closeNext(pReader);
+    }
     
-    /* Mask out most significant continuation payload */
-    cpv = cpv & 0xfffL;
+  } else if ((tk.status == SNTOKEN_FINAL) && (!err_code)) {
+    /* Final token */
+    if (!(pReader->meta_flag)) {
+      if ((!pReader->array_flag) &&
+            (snstack_count(&(pReader->stack_array)) == 0)) {
+        if (snstack_peek(&(pReader->stack_group)) == 0) {
+          
+          /* Add the EOF entity */
+          snreader_addEntityZ(pReader, SNENTITY_EOF);
+          
+        } else {
+          /* Open parentheses group remains */
+          err_code = SNERR_OPENGROUP;
+        }
+      } else {
+        /* Open array remains */
+        err_code = SNERR_OPENARRAY;
+      }
+    } else {
+      /* Open metacommand remains */
+      err_code = SNERR_OPENMETA;
+    }
     
-    /* Shift continuation payloads left */
-    cpv = cpv << 6;
+  } else if (!err_code) {
+    /* Unknown token type */
+    abort();
   }
-}
 
-/*
- * Reading callback for a stdio FILE * source.
- * 
- * The function prototype matches pfRead in SNSOURCE.  See the
- * documentation of that field for further information.
- */
-static int snsource_file_read(void *pCustom) {
-  
-  FILE *pIn = NULL;
-  int result = 0;
+  /* Validate the new entities against the schema, if there is one */
+  if ((!err_code) && (pReader->pSchema != NULL)) {
+    err_code = snreader_schema(pReader);
+  }
+
+  /* Error if now an error state in reader */
+  if (!err_code) {
+    err_code = pReader->status;
+  }
   
-  /* Check parameter */
-  if (pCustom == NULL) {
-    abort();
+  /* If a buffer or stack failed to grow because of the memory budget,
+   * report that instead of the capacity error it caused */
+  if (err_code && (pReader->mem).over) {
+    err_code = SNERR_BUDGET;
   }
   
-  /* Convert parameter to a FILE * handle */
-  pIn = (FILE *) pCustom;
+  /* In recovery mode, record the error and resynchronize if possible,
+   * except for errors returned by metacommand handlers */
+  if (err_code && pReader->recover && (!handler)) {
+    err_code = snreader_recover(pReader, err_code, pIn, pFilter);
+  }
   
-  /* Read from the file and check for EOF and I/O error conditions */
-  result = getc(pIn);
-  if (result == EOF) {
-    if (feof(pIn)) {
-      result = SNERR_EOF;
-    } else {
-      result = SNERR_IOERR;
+  /* If recording spans, give every entity generated by the token the
+   * span of the token */
+  if ((!err_code) && pReader->spans) {
+    for(i = 0; i < pReader->queue_count; i++) {
+      (pReader->queue[i]).start = tk.start;
+      (pReader->queue[i]).end = tk.end;
+      (pReader->queue[i]).col = tk.col;
     }
   }
   
-  /* Return result */
-  return result;
+  /* If error, set error in reader */
+  if (err_code) {
+    pReader->status = err_code;
+  }
 }
 
 /*
- * Destructor callback for a stdio FILE * source.
+ * Begin decoding binary data into a blob.
  * 
- * The function prototype matches pfDestruct in SNSOURCE.  See the
- * documentation of that field for further information.
+ * This is the begin callback of the built-in decoders.  pCustom is the
+ * SNBLOB structure.  The length and decoding state are reset.
+ * 
+ * Parameters:
+ * 
+ *   pCustom - the blob
+ * 
+ *   pPrefix - the string prefix
+ * 
+ *   str_type - the string type
+ * 
+ * Return:
+ * 
+ *   zero
  */
-static void snsource_file_free(void *pCustom) {
+static int snblob_begin(void *pCustom, const char *pPrefix, int str_type) {
   
-  FILE *pIn = NULL;
+  SNBLOB *pBlob = NULL;
   
-  /* Check parameter */
-  if (pCustom == NULL) {
+  /* Check parameters */
+  if ((pCustom == NULL) || (pPrefix == NULL)) {
+    abort();
+  }
+  if ((str_type != SNSTRING_QUOTED) && (str_type != SNSTRING_CURLY)) {
     abort();
   }
+  pBlob = (SNBLOB *) pCustom;
   
-  /* Convert parameter to a FILE * handle */
-  pIn = (FILE *) pCustom;
+  /* Reset the blob */
+  pBlob->len = 0;
+  pBlob->acc = 0;
+  pBlob->digits = 0;
+  pBlob->pad = 0;
   
-  /* Close the file */
-  fclose(pIn);
+  /* Return okay */
+  return 0;
 }
 
 /*
- * Rewind callback for a stdio FILE * source.
+ * Append bytes to a blob.
  * 
- * The function prototype matches pfRewind in SNSOURCE.  See the
- * documentation of that field for further information.
+ * v holds the bytes to append, with the first byte in the most
+ * significant position.  n is the number of bytes, in range one to
+ * three.
+ * 
+ * Parameters:
+ * 
+ *   pBlob - the blob
+ * 
+ *   v - the bytes to append
+ * 
+ *   n - the number of bytes
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the blob is full
  */
-static int snsource_file_rewind(void *pCustom) {
+static int snblob_put(SNBLOB *pBlob, unsigned long v, int n) {
   
   int status = 1;
-  FILE *pIn = NULL;
   
-  /* Check parameter */
-  if (pCustom == NULL) {
+  /* Check parameters */
+  if ((pBlob == NULL) || (n < 1) || (n > 3)) {
     abort();
   }
   
-  /* Convert parameter to a FILE * handle */
-  pIn = (FILE *) pCustom;
-  
-  /* Seek back to the beginning of the file */
-  if (fseek(pIn, 0, SEEK_SET)) {
+  /* Check for room */
+  if (n > pBlob->cap - pBlob->len) {
     status = 0;
   }
   
+  /* Append the bytes */
+  if (status) {
+    for( ; n > 0; n--) {
+      (pBlob->pData)[pBlob->len] =
+        (unsigned char) ((v >> (8 * (n - 1))) & 0xff);
+      (pBlob->len)++;
+    }
+  }
+  
   /* Return status */
   return status;
 }
 
 /*
- * Reading callback for a string source.
+ * Decode a chunk of base64 data into a blob.
  * 
- * The function prototype matches pfRead in SNSOURCE.  See the
- * documentation of that field for further information.
- */
-static int snsource_str_read(void *pCustom) {
-  
-  SNSTRSRC *pStS = NULL;
-  int c = 0;
-  
-  /* Check parameter */
-  if (pCustom == NULL) {
-    abort();
-  }
-  
-  /* Convert parameter to the string handling structure */
-  pStS = (SNSTRSRC *) pCustom;
-  
-  /* Get current character */
-  c = *(pStS->pStr);
-  
-  /* If current character is not nul, then advance pointer; else, set
-   * return to EOF condition and don't advance pointer */
-  if (c != 0) {
-    (pStS->pStr)++;
-  } else {
-    c = SNERR_EOF;
-  }
-  
-  /* Return the character or EOF */
-  return c;
-}
-
-/*
- * Destructor callback for a string source.
+ * This is the data callback of the built-in base64 decoder.  Runs of
+ * four base64 digits are decoded straight from the table into three
+ * bytes at a time.  Whitespace is skipped, and anything else that gets
+ * in the way of a run is handled one digit at a time.
  * 
- * The function prototype matches pfDestruct in SNSOURCE.  See the
- * documentation of that field for further information.
- */
-static void snsource_str_free(void *pCustom) {
-  
-  SNSTRSRC *pStS = NULL;
-  
-  /* Check parameter */
-  if (pCustom == NULL) {
-    abort();
-  }
-  
-  /* Convert parameter to the string handling structure */
-  pStS = (SNSTRSRC *) pCustom;
-  
-  /* Free the structure */
-  free(pStS);
-}
-
-/*
- * Rewind callback for a string source.
+ * Parameters:
  * 
- * The function prototype matches pfRewind in SNSOURCE.  See the
- * documentation of that field for further information.
+ *   pCustom - the blob
+ * 
+ *   pData - the chunk of data
+ * 
+ *   len - the length of the chunk
+ * 
+ * Return:
+ * 
+ *   zero if successful, non-zero if the data is not valid base64 or the
+ *   blob is full
  */
-static int snsource_str_rewind(void *pCustom) {
+static int snblob_b64data(void *pCustom, const char *pData, long len) {
   
-  SNSTRSRC *pStS = NULL;
+  int err = 0;
+  long i = 0;
+  int v = 0;
+  int fast = 0;
+  unsigned long q = 0;
+  SNBLOB *pBlob = NULL;
+  const unsigned char *pc = NULL;
   
-  /* Check parameter */
-  if (pCustom == NULL) {
+  /* Check parameters */
+  if ((pCustom == NULL) || (pData == NULL) || (len < 0)) {
     abort();
   }
+  pBlob = (SNBLOB *) pCustom;
+  pc = (const unsigned char *) pData;
   
-  /* Convert parameter to the string handling structure */
-  pStS = (SNSTRSRC *) pCustom;
-  
-  /* Reset the string pointer back to its initial value */
-  pStS->pStr = pStS->pRewind;
+  /* Decode the chunk */
+  while ((!err) && (i < len)) {
+    
+    /* Fast path -- a full quantum of four digits at a quantum
+     * boundary */
+    fast = 0;
+    if ((pBlob->digits == 0) && (pBlob->pad == 0) && (len - i >= 4)) {
+      if ((snblob_b64table[pc[i    ]] >= 0) &&
+          (snblob_b64table[pc[i + 1]] >= 0) &&
+          (snblob_b64table[pc[i + 2]] >= 0) &&
+          (snblob_b64table[pc[i + 3]] >= 0)) {
+        q = (((unsigned long) snblob_b64table[pc[i    ]]) << 18) |
+            (((unsigned long) snblob_b64table[pc[i + 1]]) << 12) |
+            (((unsigned long) snblob_b64table[pc[i + 2]]) <<  6) |
+             ((unsigned long) snblob_b64table[pc[i + 3]]);
+        if (!snblob_put(pBlob, q, 3)) {
+          err = 1;
+        }
+        i += 4;
+        fast = 1;
+      }
+    }
+    
+    /* Slow path -- a single byte, unless the fast path already decoded
+     * a run, in which case there is nothing more to do this time */
+    if (!fast) {
+      v = snblob_b64table[pc[i]];
+      i++;
+    } else {
+      v = SNBLOB_SPACE;
+    }
+    
+    if (v >= 0) {
+      /* Digit, which may not follow padding */
+      if (pBlob->pad > 0) {
+        err = 1;
+      } else {
+        pBlob->acc = (pBlob->acc << 6) | ((unsigned long) v);
+        (pBlob->digits)++;
+        if (pBlob->digits >= 4) {
+          if (!snblob_put(pBlob, pBlob->acc, 3)) {
+            err = 1;
+          }
+          pBlob->acc = 0;
+          pBlob->digits = 0;
+        }
+      }
+      
+    } else if (v == SNBLOB_PAD) {
+      /* Padding, which can only complete a partial quantum */
+      (pBlob->pad)++;
+      if ((pBlob->digits < 2) || (pBlob->digits + pBlob->pad > 4)) {
+        err = 1;
+      }
+      
+    } else if (v != SNBLOB_SPACE) {
+      /* Not valid in base64 */
+      err = 1;
+    }
+  }
   
-  /* This operation always succeeds */
-  return 1;
+  /* Return status */
+  return err;
 }
 
 /*
- * Read a single byte from a source object.
- * 
- * The return value is an unsigned byte value in range [0, 255], or else
- * SNERR_EOF or SNERR_IOERR.  SNERR_UTF8 is never generated by this
- * function, but it may be returned because snsource_readCPV() may set
- * the status of the source object to that error.
+ * Finish decoding base64 data into a blob.
  * 
- * Clients are recommended to use snsource_readCPV() instead of directly
- * using this function.
+ * A final partial quantum of two or three digits is decoded into one or
+ * two bytes.  If there is padding, it must complete the quantum.
  * 
  * Parameters:
  * 
- *   pIn - the source to read from
+ *   pCustom - the blob
  * 
  * Return:
  * 
- *   the next byte read, or SNERR_EOF if nothing remains in input
- *   source, or SNERR_IOERR if there was an error reading the input
- *   source, or SNERR_UTF8 if there was a previous UTF-8 decoding error
+ *   zero if successful, non-zero if the data is incomplete or the blob
+ *   is full
  */
-static int snsource_read(SNSOURCE *pIn) {
+static int snblob_b64end(void *pCustom) {
   
-  int result = 0;
+  int err = 0;
+  SNBLOB *pBlob = NULL;
   
   /* Check parameter */
-  if (pIn == NULL) {
+  if (pCustom == NULL) {
     abort();
   }
+  pBlob = (SNBLOB *) pCustom;
   
-  /* Determine first whether we have a special condition to return
-   * without invoking the callback */
-  if (pIn->status < 0) {
-    /* We have a special status code, so just use that */
-    result = pIn->status;
-    
-  } else {
-    /* No special status code, so we need to invoke the read callback;
-     * check first that the callback is defined */
-    if (pIn->pfRead == NULL) {
-      abort();
-    }
-    
-    /* Invoke the read callback */
-    result = (*(pIn->pfRead))(pIn->pCustom);
-    
-    /* Check range of returned result */
-    if (((result < 0) || (result > 255)) &&
-          (result != SNERR_EOF) && (result != SNERR_IOERR)) {
-      abort();
-    }
-    
-    /* If returned result was an unsigned byte value, increment the read
-     * count (unless it has overflown); otherwise, if it is a special
-     * return code, store it in status so we return it in future
-     * invocations */
-    if ((result >= 0) && (result <= 255)) {
-      if (pIn->read_count < LONG_MAX) {
-        (pIn->read_count)++;
+  /* Check padding */
+  if ((pBlob->pad > 0) && (pBlob->digits + pBlob->pad != 4)) {
+    err = 1;
+  }
+  
+  /* Decode the final partial quantum */
+  if (!err) {
+    if (pBlob->digits == 2) {
+      if (!snblob_put(pBlob, pBlob->acc >> 4, 1)) {
+        err = 1;
       }
-    } else {
-      pIn->status = result;
+    } else if (pBlob->digits == 3) {
+      if (!snblob_put(pBlob, pBlob->acc >> 2, 2)) {
+        err = 1;
+      }
+    } else if (pBlob->digits != 0) {
+      err = 1;
     }
   }
   
-  /* Return result */
-  return result;
+  /* Return status */
+  return err;
 }
 
 /*
- * Read a UTF-8 encoded Unicode codepoint from a source object.
+ * Decode a chunk of base16 data into a blob.
  * 
- * The return value is a Unicode codepoint [0, UNICODE_MAX_CPV], or else
- * SNERR_EOF if end of source file, SNERR_IOERR if I/O error reading
- * from source, or SNERR_UTF8 if error decoding UTF-8.
+ * This is the data callback of the built-in hex decoder.  Pairs of
+ * digits are decoded straight from the table a byte at a time, and
+ * whitespace is skipped.
  * 
- * This function will only decode a single UTF-8 codepoint.  It will
- * check for overlong encodings and invalid encodings, causing the
- * SNERR_UTF8 error if such illegal encodings occur.
+ * Parameters:
  * 
- * This function WILL successfully decode surrogate codepoints, even
- * though surrogates aren't supposed to be used in UTF-8.  It is assumed
- * that surrogate pairs will be properly decoded at a higher level.
+ *   pCustom - the blob
  * 
- * Parameters:
+ *   pData - the chunk of data
  * 
- *   pIn - the source to read from
+ *   len - the length of the chunk
  * 
  * Return:
  * 
- *   the next codepoint read (including surrogates!), or SNERR_EOF if
- *   nothing remains in input source, or SNERR_IOERR if there was an
- *   error reading the input source, or SNERR_UTF8 if there was a UTF-8
- *   decoding error
+ *   zero if successful, non-zero if the data is not valid base16 or the
+ *   blob is full
  */
-static long snsource_readCPV(SNSOURCE *pIn) {
-  
-  unsigned char buf[5];
-  long result = 0;
-  int err_num = 0;
-  int c = 0;
-  int ec = 0;
-  int i = 0;
+static int snblob_hexdata(void *pCustom, const char *pData, long len) {
   
-  /* Initialize buffer */
-  memset(buf, 0, 5);
+  int err = 0;
+  long i = 0;
+  int v = 0;
+  int v2 = 0;
+  int fast = 0;
+  SNBLOB *pBlob = NULL;
+  const unsigned char *pc = NULL;
   
   /* Check parameters */
-  if (pIn == NULL) {
+  if ((pCustom == NULL) || (pData == NULL) || (len < 0)) {
     abort();
   }
+  pBlob = (SNBLOB *) pCustom;
+  pc = (const unsigned char *) pData;
   
-  /* Get the next byte */
-  c = snsource_read(pIn);
-  
-  /* If we got a special status return, then result is that; otherwise,
-   * proceed */
-  if (c < 0) {
-    /* Special status return, so that will be the result */
-    result = c;
-  
-  } else {
-    /* We read a byte, so determine how many bytes in the encoded
-     * codepoint */
-    ec = snutf_count(c);
-    if (ec < 1) {
-      /* Not a valid first byte of an encoded codepoint, so fail */
-      err_num = SNERR_UTF8;
-    } else if (ec > 4) {
-      /* Shouldn't happen */
-      abort();
-    }
-    
-    /* Write the character we just read into the decoding buffer */
-    if (!err_num) {
-      buf[0] = (unsigned char) c;
-    }
+  /* Decode the chunk */
+  while ((!err) && (i < len)) {
     
-    /* Read any additional bytes into the decoding buffer -- EOF returns
-     * will be changed to UTF-8 decoding errors */
-    if (!err_num) {
-      for(i = 1; i < ec; i++) {
-        c = snsource_read(pIn);
-        if (c < 0) {
-          if (c == SNERR_EOF) {
-            err_num = SNERR_UTF8;
-          } else {
-            err_num = c;
-          }
-          break;
+    /* Fast path -- a pair of digits at a byte boundary */
+    fast = 0;
+    if ((pBlob->digits == 0) && (len - i >= 2)) {
+      v = snblob_hextable[pc[i]];
+      v2 = snblob_hextable[pc[i + 1]];
+      if ((v >= 0) && (v2 >= 0)) {
+        if (pBlob->len < pBlob->cap) {
+          (pBlob->pData)[pBlob->len] = (unsigned char) ((v << 4) | v2);
+          (pBlob->len)++;
         } else {
-          buf[i] = (unsigned char) c;
+          err = 1;
         }
+        i += 2;
+        fast = 1;
       }
     }
     
-    /* Decode the buffered character bytes into a codepoint */
-    if (!err_num) {
-      result = snutf_decode(buf);
-      if (result < 0) {
-        err_num = SNERR_UTF8;
+    /* Slow path -- a single byte, unless the fast path already decoded
+     * a run, in which case there is nothing more to do this time */
+    if (!fast) {
+      v = snblob_hextable[pc[i]];
+      i++;
+    } else {
+      v = SNBLOB_SPACE;
+    }
+    
+    if (v >= 0) {
+      pBlob->acc = (pBlob->acc << 4) | ((unsigned long) v);
+      (pBlob->digits)++;
+      if (pBlob->digits >= 2) {
+        if (!snblob_put(pBlob, pBlob->acc, 1)) {
+          err = 1;
+        }
+        pBlob->acc = 0;
+        pBlob->digits = 0;
       }
+      
+    } else if (v != SNBLOB_SPACE) {
+      /* Not valid in base16 */
+      err = 1;
     }
   }
   
-  /* If error occurred, set result to error code and store error code in
-   * status field of source */
-  if (err_num) {
-    result = err_num;
-    pIn->status = err_num;
+  /* Return status */
+  return err;
+}
+
+/*
+ * Finish decoding base16 data into a blob.
+ * 
+ * Parameters:
+ * 
+ *   pCustom - the blob
+ * 
+ * Return:
+ * 
+ *   zero if successful, non-zero if there is an odd number of digits
+ */
+static int snblob_hexend(void *pCustom) {
+  
+  int err = 0;
+  
+  /* Check parameter */
+  if (pCustom == NULL) {
+    abort();
   }
   
-  /* Return result */
-  return result;
+  /* Digits must pair up */
+  if (((SNBLOB *) pCustom)->digits != 0) {
+    err = 1;
+  }
+  
+  /* Return status */
+  return err;
 }
 
 /*
- * Initialize a long stack.
+ * Point a string source at a new string, as if it had just been
+ * constructed with snsource_string().
  * 
- * Stacks must be initialized before they are used, or undefined 
- * behavior occurs.  A full reset must be performed on the stack using
- * snstack_reset() before the structure is released or a memory leak may
- * occur.
+ * The source must be a string source.  Its line-start index remains
+ * allocated but is emptied.
  * 
- * icap is the initial allocation capacity in longs.  maxcap is the 
- * maximum capacity for the buffer (in longs).
+ * Parameters:
  * 
- * icap must be greater than zero, maxcap must be greater than or equal
- * to icap, and maxcap must be no greater than (LONG_MAX / 2) or a fault
- * will occur.
+ *   pSrc - the string source
  * 
- * If (sizeof(size_t) < 2), this function will always fault.  Otherwise,
- * if (sizeof(size_t) < 4), this function will fault if maxcap
- * multiplied by sizeof(long) exceeds 65535.  Otherwise, it must be that
- * (sizeof(size_t) >= 4) and this function will fault if maxcap times
- * sizeof(long) exceeds 2147483647.  This is to prevent memory
- * allocation problems.
+ *   pStr - the new string
+ */
+static void snsource_restring(SNSOURCE *pSrc, const char *pStr) {
+  
+  SNSTRSRC *pStS = NULL;
+  
+  /* Check parameters */
+  if ((pSrc == NULL) || (pStr == NULL)) {
+    abort();
+  }
+  if (pSrc->pfRead != &snsource_str_read) {
+    abort();
+  }
+  
+  /* Point the string structure at the new string */
+  pStS = (SNSTRSRC *) pSrc->pCustom;
+  pStS->pStr = (const unsigned char *) pStr;
+  pStS->pRewind = (const unsigned char *) pStr;
+  
+  /* Reset the source state */
+  pSrc->read_count = 0;
+  pSrc->status = 0;
+  pSrc->pView = (const unsigned char *) pStr;
+  pSrc->lines_count = 0;
+  pSrc->lines_scanned = 0;
+  pSrc->lines_lazy = 0;
+  pSrc->pPoolNext = NULL;
+}
+
+/*
+ * Point a memory source at new data, as if it had just been constructed
+ * with snsource_memory().
  * 
- * Do not initialize a stack that is already initialized, or a memory
- * leak may occur.
+ * The source must be a memory source.  Its line-start index remains
+ * allocated but is emptied.
  * 
  * Parameters:
  * 
- *   pBuffer - pointer to the stack to initialize
+ *   pSrc - the memory source
  * 
- *   icap - the initial allocation capacity in longs
+ *   pData - the new data
  * 
- *   maxcap - the maximum allocation capacity in longs
+ *   len - the length of the new data
  */
-static void snstack_init(SNSTACK *pStack, long icap, long maxcap) {
+static void snsource_rememory(SNSOURCE *pSrc, const char *pData, long len) {
+  
+  SNMEMSRC *pMS = NULL;
   
   /* Check parameters */
-  if (pStack == NULL) {
+  if ((pSrc == NULL) || (pData == NULL) || (len < 0)) {
     abort();
   }
-  
-  if ((icap <= 0) || (maxcap < icap) || (maxcap > (LONG_MAX / 2))) {
+  if (pSrc->pfRead != &snsource_mem_read) {
     abort();
   }
   
-  if (sizeof(size_t) < 2) {
-    abort();
-  } else if (sizeof(size_t) < 4) {
-    if (maxcap > (65535L / sizeof(long))) {
-      abort();
-    }
-  } else {
-    if (maxcap > (2147483647L / sizeof(long))) {
-      abort();
-    }
-  }
+  /* Point the memory structure at the new data */
+  pMS = (SNMEMSRC *) pSrc->pCustom;
+  pMS->pData = (const unsigned char *) pData;
+  pMS->len = len;
+  pMS->pos = 0;
   
-  /* Initialize structure */
-  memset(pStack, 0, sizeof(SNSTACK));
-  pStack->pBuf = NULL;
-  pStack->count = 0;
-  pStack->cap = 0;
-  pStack->initcap = icap;
-  pStack->maxcap = maxcap;
+  /* Reset the source state */
+  pSrc->read_count = 0;
+  pSrc->status = 0;
+  pSrc->pView = (const unsigned char *) pData;
+  pSrc->lines_count = 0;
+  pSrc->lines_scanned = 0;
+  pSrc->lines_lazy = 0;
+  pSrc->pPoolNext = NULL;
 }
 
 /*
- * Reset a stack back to empty.
+ * Reset a parser to the state of a newly allocated parser, while
+ * keeping its buffers and stacks allocated.
  * 
- * The stack must already have been initialized with snstack_init() or
- * undefined behavior occurs.
+ * Parameters:
  * 
- * full is non-zero to perform a full reset, zero to perform a fast
- * reset.  A fast reset just clears the buffer to empty without
- * releasing the allocated memory buffer, allowing it to be reused.  A
- * full reset also releases the allocated memory buffer, clearing the
- * structure all the way back to its initial state.
+ *   pParser - the parser
+ */
+static void snparser_recycle(SNPARSER *pParser) {
+  
+  SNREADER *pReader = NULL;
+  
+  /* Check parameter */
+  if (pParser == NULL) {
+    abort();
+  }
+  pReader = &(pParser->reader);
+  
+  /* Fast reset of the reader, then clear the settings that resets do
+   * not change */
+  snreader_reset(pReader, 0);
+  pReader->spans = 0;
+  pReader->recover = 0;
+  pReader->unescape = 0;
+  (pReader->decoders).count = 0;
+  (pReader->metas).count = 0;
+  pReader->pIncCache = NULL;
+  pReader->pSchema = NULL;
+  
+  /* Drop the memory budget and start the peak over from what remains
+   * allocated */
+  (pReader->mem).budget = 0;
+  (pReader->mem).over = 0;
+  (pReader->mem).peak = (pReader->mem).current;
+  
+  /* Reset the filter and forget the source */
+  snfilter_reset(&(pParser->filter));
+  pParser->pSrc = NULL;
+  pParser->pPoolNext = NULL;
+}
+
+/*
+ * Reallocate a column of a batch to a new capacity.
  * 
- * A full reset must be performed on all stacks before they are 
- * released, or a memory leak may occur.
+ * pArray is the current column, or NULL if not allocated yet.  cap is
+ * the new capacity in elements and elsize is the size of each element.
+ * A fault occurs if the allocation fails.
  * 
  * Parameters:
  * 
- *   pStack - the stack to reset
+ *   pArray - the current column or NULL
  * 
- *   full - non-zero for a full reset, zero for a partial reset
+ *   cap - the new capacity in elements
+ * 
+ *   elsize - the size of each element
+ * 
+ * Return:
+ * 
+ *   the reallocated column
  */
-static void snstack_reset(SNSTACK *pStack, int full) {
+static void *snbatch_grow(void *pArray, long cap, size_t elsize) {
+  
+  void *pResult = NULL;
   
   /* Check parameters */
-  if (pStack == NULL) {
+  if ((cap < 1) || (elsize < 1) ||
+      ((size_t) cap > ((size_t) -1) / elsize)) {
     abort();
   }
   
-  /* Set the count back to zero */
-  pStack->count = 0;
+  /* Reallocate */
+  pResult = realloc(pArray, ((size_t) cap) * elsize);
+  if (pResult == NULL) {
+    abort();
+  }
   
-  /* If a buffer is allocated, clear it all to zero */
-  if (pStack->cap > 0) {
-    memset(pStack->pBuf, 0, (size_t) (pStack->cap * sizeof(long)));
+  /* Return result */
+  return pResult;
+}
+
+/*
+ * Make sure the document columns of a batch have room for one more
+ * document.
+ * 
+ * Parameters:
+ * 
+ *   pBatch - the batch
+ */
+static void snbatch_reserveDoc(SNBATCH *pBatch) {
+  
+  long newcap = 0;
+  
+  /* Check parameter */
+  if (pBatch == NULL) {
+    abort();
   }
   
-  /* If we're doing a full reset, release the buffer if allocated and
-   * reset capacity back to zero */
-  if (full && (pStack->cap > 0)) {
-    free(pStack->pBuf);
-    pStack->pBuf = NULL;
-    pStack->cap = 0;
+  /* Double the capacity if full */
+  if (pBatch->doc_count >= pBatch->doc_cap) {
+    if (pBatch->doc_cap < 1) {
+      newcap = SNBATCH_INIT;
+    } else if (pBatch->doc_cap <= LONG_MAX / 2) {
+      newcap = pBatch->doc_cap * 2;
+    } else {
+      abort();
+    }
+    
+    pBatch->pDocFirst = (long *) snbatch_grow(
+                          pBatch->pDocFirst, newcap, sizeof(long));
+    pBatch->pDocEntities = (long *) snbatch_grow(
+                          pBatch->pDocEntities, newcap, sizeof(long));
+    pBatch->pDocStatus = (int *) snbatch_grow(
+                          pBatch->pDocStatus, newcap, sizeof(int));
+    pBatch->pDocLine = (long *) snbatch_grow(
+                          pBatch->pDocLine, newcap, sizeof(long));
+    pBatch->doc_cap = newcap;
   }
 }
 
 /*
- * Push a long on top of a stack.
+ * Make sure the entity columns of a batch have room for one more
+ * entity.
  * 
- * The long value v may have any value.
+ * Parameters:
  * 
- * The function fails if there is no more capacity left for another
- * long.  The buffer is unmodified in this case.
+ *   pBatch - the batch
+ */
+static void snbatch_reserveEnt(SNBATCH *pBatch) {
+  
+  long newcap = 0;
+  
+  /* Check parameter */
+  if (pBatch == NULL) {
+    abort();
+  }
+  
+  /* Double the capacity if full */
+  if (pBatch->ent_count >= pBatch->ent_cap) {
+    if (pBatch->ent_cap < 1) {
+      newcap = SNBATCH_INIT;
+    } else if (pBatch->ent_cap <= LONG_MAX / 2) {
+      newcap = pBatch->ent_cap * 2;
+    } else {
+      abort();
+    }
+    
+    pBatch->pStatus = (int *) snbatch_grow(
+                        pBatch->pStatus, newcap, sizeof(int));
+    pBatch->pStrType = (int *) snbatch_grow(
+                        pBatch->pStrType, newcap, sizeof(int));
+    pBatch->pCount = (long *) snbatch_grow(
+                        pBatch->pCount, newcap, sizeof(long));
+    pBatch->pKey = (long *) snbatch_grow(
+                        pBatch->pKey, newcap, sizeof(long));
+    pBatch->pKeyLen = (long *) snbatch_grow(
+                        pBatch->pKeyLen, newcap, sizeof(long));
+    pBatch->pValue = (long *) snbatch_grow(
+                        pBatch->pValue, newcap, sizeof(long));
+    pBatch->pValueLen = (long *) snbatch_grow(
+                        pBatch->pValueLen, newcap, sizeof(long));
+    pBatch->ent_cap = newcap;
+  }
+}
+
+/*
+ * Copy a string into the arena of a batch.
+ * 
+ * The string is stored with a terminating nul.
  * 
  * Parameters:
  * 
- *   pStack - the stack to push a long onto
+ *   pBatch - the batch
  * 
- *   v - the long value to push
+ *   pStr - the string to store
+ * 
+ *   len - the length of the string, not including any terminating nul
  * 
  * Return:
  * 
- *   non-zero if successful, zero if no more capacity
+ *   the offset of the stored string within the arena
  */
-static int snstack_push(SNSTACK *pStack, long v) {
+static long snbatch_store(SNBATCH *pBatch, const char *pStr, long len) {
   
-  int status = 1;
+  long result = 0;
   long newcap = 0;
   
   /* Check parameters */
-  if (pStack == NULL) {
+  if ((pBatch == NULL) || (pStr == NULL) || (len < 0)) {
+    abort();
+  }
+  if (len >= LONG_MAX - pBatch->arena_len) {
     abort();
   }
   
-  /* Proceed only if we are not completely maxed out of capacity */
-  if (pStack->count < pStack->maxcap) {
-    /* We have capacity left; first, make the initial allocation if we
-     * haven't allocated a memory buffer yet */
-    if (pStack->cap < 1) {
-      pStack->pBuf = (long *) malloc(
-                        (size_t) (pStack->initcap * sizeof(long)));
-      if (pStack->pBuf == NULL) {
-        abort();
-      }
-      memset(pStack->pBuf, 0,
-        (size_t) (pStack->initcap * sizeof(long)));
-      pStack->cap = pStack->initcap;
+  /* Grow the arena if necessary */
+  if (len + 1 > pBatch->arena_cap - pBatch->arena_len) {
+    newcap = pBatch->arena_cap;
+    if (newcap < SNBATCH_ARENA_INIT) {
+      newcap = SNBATCH_ARENA_INIT;
     }
-    
-    /* Next, increase allocated memory buffer if we need more space */
-    if (pStack->count >= pStack->cap) {
-      /* New capacity should usually be double current capacity */
-      newcap = pStack->cap * 2;
-      
-      /* If new capacity exceeds max capacity, set to max capacity */
-      if (newcap > pStack->maxcap) {
-        newcap = pStack->maxcap;
-      }
-      
-      /* Allocate new buffer */
-      pStack->pBuf = (long *) realloc(pStack->pBuf,
-                                (size_t) (newcap * sizeof(long)));
-      if (pStack->pBuf == NULL) {
-        abort();
+    while (len + 1 > newcap - pBatch->arena_len) {
+      if (newcap <= LONG_MAX / 2) {
+        newcap = newcap * 2;
+      } else {
+        newcap = LONG_MAX;
       }
-      
-      /* Initialize new space to zero */
-      memset((void *) (pStack->pBuf + pStack->cap),
-              0,
-              (size_t) ((newcap - pStack->cap) * sizeof(long)));
-      
-      /* Update capacity */
-      pStack->cap = newcap;
     }
-    
-    /* Append the new long */
-    (pStack->pBuf)[pStack->count] = v;
-    (pStack->count)++;
-    
-  } else {
-    /* Out of capacity */
-    status = 0;
+    pBatch->pArena = (char *) snbatch_grow(pBatch->pArena, newcap, 1);
+    pBatch->arena_cap = newcap;
   }
   
-  /* Return status */
-  return status;
+  /* Copy the string */
+  result = pBatch->arena_len;
+  memcpy(pBatch->pArena + result, pStr, (size_t) len);
+  (pBatch->pArena)[result + len] = (char) 0;
+  pBatch->arena_len += (len + 1);
+  
+  /* Return offset */
+  return result;
 }
 
 /*
- * Pop a long value off the top of a stack.
+ * Compute the hash of a name in a schema name set.
  * 
- * pStack is the stack object to a pop a value off of.  It must be
- * properly initialized.  It must not be empty, or a fault will occur.
+ * This is the 32-bit FNV-1a hash.
  * 
  * Parameters:
  * 
- *   pStack - the stack
+ *   pName - the name
+ * 
+ *   len - the length of the name
  * 
  * Return:
  * 
- *   the popped long value
+ *   the hash of the name
  */
-static long snstack_pop(SNSTACK *pStack) {
+static unsigned long snnames_hash(const char *pName, long len) {
   
-  long v = 0;
+  unsigned long h = 2166136261UL;
+  long i = 0;
   
-  /* Check parameter */
-  if (pStack == NULL) {
+  /* Check parameters */
+  if ((pName == NULL) || (len < 0)) {
     abort();
   }
   
-  /* Check state */
-  if (pStack->count < 1) {
-    abort();
+  /* Hash each byte */
+  for(i = 0; i < len; i++) {
+    h ^= (unsigned long) ((const unsigned char *) pName)[i];
+    h = (h * 16777619UL) & 0xffffffffUL;
   }
   
-  /* Get the top of the stack */
-  v = pStack->pBuf[pStack->count - 1];
-  
-  /* Take the top element off the stack */
-  (pStack->count)--;
-  
-  /* Return the removed value */
-  return v;
+  /* Return hash */
+  return h;
 }
 
 /*
- * Peek at the long value on top of a stack without removing it.
+ * Look up a name in a schema name set.
+ *
+ * Sets without a hash table contain nothing as far as this function is
+ * concerned.
+ *
+ * Parameters:
  * 
- * pStack is the stack object to peek at.  It must be properly
- * initialized.  It must not be empty, or a fault will occur.
+ *   pSchema - the schema holding the names
  * 
- * Parameters:
+ *   pSet - the name set
  * 
- *   pStack - the stack
+ *   pName - the name to look up
+ * 
+ *   len - the length of the name
  * 
  * Return:
  * 
- *   the peeked long value
+ *   the ID of the name, or zero if it is not in the set
  */
-static long snstack_peek(SNSTACK *pStack) {
+static long snnames_find(
+    const SNSCHEMA * pSchema,
+    const SNNAMES  * pSet,
+    const char     * pName,
+    long             len) {
+  
+  unsigned long mask = 0;
+  unsigned long slot = 0;
+  long result = 0;
+  long id = 0;
   
-  /* Check parameter */
-  if (pStack == NULL) {
+  /* Check parameters */
+  if ((pSchema == NULL) || (pSet == NULL) || (pName == NULL) ||
+      (len < 0)) {
     abort();
   }
-  
-  /* Check state */
-  if (pStack->count < 1) {
-    abort();
+
+  /* Probe the hash table until the name or an empty slot is found */
+  if (pSet->pSlots != NULL) {
+    mask = ((unsigned long) pSet->slot_cap) - 1;
+    slot = snnames_hash(pName, len) & mask;
+    for(id = pSet->pSlots[slot]; id != 0; id = pSet->pSlots[slot]) {
+      if ((pSet->pLen[id - 1] == len) &&
+          (memcmp(pSchema->pArena + pSet->pOff[id - 1],
+                    pName, (size_t) len) == 0)) {
+        result = id;
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
   }
   
-  /* Return the top of the stack */
-  return pStack->pBuf[pStack->count - 1];
+  /* Return result */
+  return result;
 }
 
 /*
- * Increment the long value on top of a stack.
- * 
- * pStack is the stack object.  It must be properly initialized.  It
- * must not be empty, or a fault will occur.
+ * Add a name to a schema name set.
  * 
- * The function fails if the top of the stack has value LONG_MAX.
+ * The name is copied into the string arena of the schema and given the
+ * next ID.  If unique is non-zero, the name is also entered into the
+ * hash table of the set.  Sets must either always or never be used with
+ * unique, and the caller must check that unique names are not already
+ * in the set with snnames_find().
  * 
  * Parameters:
  * 
- *   pStack - the stack
+ *   pSchema - the schema holding the names
  * 
- * Return:
+ *   pSet - the name set
  * 
- *   non-zero if successful, zero if long value already at maximum
+ *   pName - the name to add
+ * 
+ *   len - the length of the name
+ * 
+ *   unique - non-zero to enter the name into the hash table
+ *
+ * Return:
+ *
+ *   the ID of the new name
  */
-static int snstack_inc(SNSTACK *pStack) {
-  
-  int status = 1;
+static long snnames_add(
+    SNSCHEMA   * pSchema,
+    SNNAMES    * pSet,
+    const char * pName,
+    long         len,
+    int          unique) {
+  
+  unsigned long mask = 0;
+  unsigned long slot = 0;
+  long result = 0;
+  long newcap = 0;
+  long i = 0;
   
-  /* Check parameter */
-  if (pStack == NULL) {
+  /* Check parameters */
+  if ((pSchema == NULL) || (pSet == NULL) || (pName == NULL) ||
+      (len < 0)) {
     abort();
   }
-  
-  /* Check state */
-  if (pStack->count < 1) {
+  if ((len >= LONG_MAX - pSchema->arena_len) ||
+      (pSet->count >= LONG_MAX / 4)) {
     abort();
   }
   
-  /* Increment if possible */
-  if (pStack->pBuf[pStack->count - 1] < LONG_MAX) {
-    (pStack->pBuf[pStack->count - 1])++;
-  } else {
-    status = 0;
+/* Grow the arena if necessary */
+  if (len + 1 > pSchema->arena_cap - pSchema->arena_len) {
+    newcap = pSchema->arena_cap;
+    if (newcap < SNSCHEMA_ARENA_INIT) {
+      newcap = SNSCHEMA_ARENA_INIT;
+    }
+    while (len + 1 > newcap - pSchema->arena_len) {
+      if (newcap <= LONG_MAX / 2) {
+        newcap = newcap * 2;
+      } else {
+        newcap = LONG_MAX;
+      }
+    }
+    pSchema->pArena = (char *) snbatch_grow(pSchema->pArena, newcap, 1);
+    pSchema->arena_cap = newcap;
   }
   
-  /* Return status */
-  return status;
+  /* Grow the name lists if necessary */
+  if (pSet->count >= pSet->cap) {
+    newcap = pSet->cap * 2;
+    if (newcap < SNNAMES_INIT) {
+      newcap = SNNAMES_INIT;
+    }
+    pSet->pOff = (long *) snbatch_grow(pSet->pOff, newcap, sizeof(long));
+    pSet->pLen = (long *) snbatch_grow(pSet->pLen, newcap, sizeof(long));
+    pSet->cap = newcap;
+  }
+  
+  /* Copy the name and give it the next ID */
+  memcpy(pSchema->pArena + pSchema->arena_len, pName, (size_t) len);
+  (pSchema->pArena)[pSchema->arena_len + len] = (char) 0;
+  pSet->pOff[pSet->count] = pSchema->arena_len;
+  pSet->pLen[pSet->count] = len;
+  pSchema->arena_len += (len + 1);
+  (pSet->count)++;
+  result = pSet->count;
+  
+  /* If unique, rebuild the hash table when it would become more than
+   * half full, then enter the new name */
+  if (unique) {
+    if (pSet->count * 2 > pSet->slot_cap) {
+      newcap = pSet->slot_cap * 2;
+      if (newcap < SNNAMES_SLOTS_INIT) {
+        newcap = SNNAMES_SLOTS_INIT;
+      }
+      if (pSet->pSlots != NULL) {
+        free(pSet->pSlots);
+      }
+      pSet->pSlots = (long *) calloc((size_t) newcap, sizeof(long));
+      if (pSet->pSlots == NULL) {
+        abort();
+      }
+      pSet->slot_cap = newcap;
+      i = 0;
+    } else {
+      i = result - 1;
+    }
+    
+    mask = ((unsigned long) pSet->slot_cap) - 1;
+    for( ; i < pSet->count; i++) {
+      slot = snnames_hash(pSchema->pArena + pSet->pOff[i], pSet->pLen[i])
+              & mask;
+      while (pSet->pSlots[slot] != 0) {
+        slot = (slot + 1) & mask;
+      }
+      pSet->pSlots[slot] = i + 1;
+    }
+  }
+  
+  /* Return the new ID */
+  return result;
 }
 
 /*
- * Decrement the long value on top of a stack.
- * 
- * pStack is the stack object.  It must be properly initialized.  It
- * must not be empty, or a fault will occur.
- * 
- * The function fails if the top of the stack has already has value less
- * than one.
- * 
- * Note that this function will not decrement into negative range.
+ * Release the memory of a schema name set.
  * 
  * Parameters:
  * 
- *   pStack - the stack
- * 
- * Return:
- * 
- *   non-zero if successful, zero if long value already less than one
+ *   pSet - the name set
  */
-static int snstack_dec(SNSTACK *pStack) {
-  
-  int status = 1;
+static void snnames_free(SNNAMES *pSet) {
   
   /* Check parameter */
-  if (pStack == NULL) {
+  if (pSet == NULL) {
     abort();
   }
   
-  /* Check state */
-  if (pStack->count < 1) {
-    abort();
+  /* Release the arrays */
+  if (pSet->pSlots != NULL) {
+    free(pSet->pSlots);
+    pSet->pSlots = NULL;
   }
-  
-  /* Decrement if possible */
-  if (pStack->pBuf[pStack->count - 1] > 0) {
-    (pStack->pBuf[pStack->count - 1])--;
-  } else {
-    status = 0;
+  if (pSet->pOff != NULL) {
+    free(pSet->pOff);
+    pSet->pOff = NULL;
   }
-  
-  /* Return status */
-  return status;
+  if (pSet->pLen != NULL) {
+    free(pSet->pLen);
+    pSet->pLen = NULL;
+  }
+  pSet->slot_cap = 0;
+  pSet->count = 0;
+  pSet->cap = 0;
 }
 
 /*
- * Get the number of elements on a given stack.
+ * Get the class of a character for the numeric shape automaton.
+ * 
+ * The classes are the columns of snnum_dfa.
  * 
  * Parameters:
  * 
- *   pStack - the stack to query
+ *   c - the character, as an unsigned byte value
  * 
  * Return:
  * 
- *   the number of elements on the stack
+ *   the character class
  */
-static long snstack_count(SNSTACK *pStack) {
+static int snnum_class(int c) {
   
-  /* Check parameter */
-  if (pStack == NULL) {
-    abort();
+  int result = 0;
+  
+  if ((c == '+') || (c == '-')) {
+    result = 1;
+  } else if (c == '0') {
+    result = 2;
+  } else if ((c >= '1') && (c <= '9')) {
+    result = 3;
+  } else if (c == '.') {
+    result = 4;
+  } else if ((c == 'e') || (c == 'E')) {
+    result = 5;
+  } else if ((c == 'x') || (c == 'X')) {
+    result = 6;
+  } else if (((c >= 'a') && (c <= 'f')) || ((c >= 'A') && (c <= 'F'))) {
+    result = 7;
   }
   
-  /* Return count */
-  return (pStack->count);
+  return result;
 }
 
 /*
- * Initialize a string buffer.
- * 
- * String buffers must be initialized before they are used, or undefined
- * behavior occurs.  A full reset must be performed on the string buffer
- * using snbuffer_reset() before the structure is released or a memory
- * leak may occur.
- * 
- * icap is the initial allocation capacity in bytes.  maxcap is the
- * maximum capacity in bytes for the buffer.  Note that the capacity
- * counts bytes, not Unicode codepoints.
- * 
- * icap must be greater than zero, maxcap must be greater than or equal
- * to icap, and maxcap must be no greater than (LONG_MAX / 2) or a fault
- * will occur.
- * 
- * If (sizeof(size_t) < 2), this function will always fault.  Otherwise,
- * if (sizeof(size_t) < 4), this function will fault if maxcap exceeds
- * 65535.  Otherwise, (sizeof(size_t) >= 4) and this function will fault
- * if maxcap exceeds 2147483647.  This is to prevent memory allocation
- * problems.
- * 
- * Do not initialize a string buffer that is already initialized, or a
- * memory leak may occur.
+ * Determine the shape of a numeric entity.
  * 
  * Parameters:
  * 
- *   pBuffer - pointer to the buffer to initialize
+ *   pStr - the nul-terminated numeric string
  * 
- *   icap - the initial allocation capacity
+ * Return:
  * 
- *   maxcap - the maximum allocation capacity
+ *   the SNSHAPE_ flag of the shape, or zero if the string has none of
+ *   the shapes
  */
-static void snbuffer_init(SNBUFFER *pBuffer, long icap, long maxcap) {
+static int snnum_shape(const char *pStr) {
   
-  /* Check parameters */
-  if (pBuffer == NULL) {
-    abort();
-  }
+  const unsigned char *pc = NULL;
+  int state = 0;
   
-  if ((icap <= 0) || (maxcap < icap) || (maxcap > (LONG_MAX / 2))) {
+  /* Check parameter */
+  if (pStr == NULL) {
     abort();
   }
   
-  if (sizeof(size_t) < 2) {
-    abort();
-  } else if (sizeof(size_t) < 4) {
-    if (maxcap > 65535L) {
-      abort();
-    }
-  } else {
-    if (maxcap > 2147483647L) {
-      abort();
-    }
+  /* Run the automaton, stopping early in the dead state */
+  for(pc = (const unsigned char *) pStr;
+      (*pc != 0) && (state != SNNUM_DEAD); pc++) {
+    state = snnum_dfa[state][snnum_class((int) *pc)];
   }
   
-  /* Initialize structure */
-  memset(pBuffer, 0, sizeof(SNBUFFER));
-  pBuffer->pBuf = NULL;
-  pBuffer->count = 0;
-  pBuffer->cap = 0;
-  pBuffer->initcap = icap;
-  pBuffer->maxcap = maxcap;
+  /* Return the shape of the final state */
+  return (int) snnum_accept[state];
 }
 
 /*
- * Reset a string buffer back to empty.
- * 
- * The string buffer must already have been initialized with
- * snbuffer_init() or undefined behavior occurs.
+ * Record a stack effect error in an analyzer and mark the current
+ * frame as bad.
  * 
- * full is non-zero to perform a full reset, zero to perform a fast
- * reset.  A fast reset just clears the buffer to empty without
- * releasing the allocated memory buffer, allowing it to be reused.  A
- * full reset also releases the allocated memory buffer, clearing the
- * structure all the way back to its initial state.
+ * Parameters:
  * 
- * A full reset must be performed on all string buffers before they are
- * released, or a memory leak may occur.
+ *   pAn - the analyzer
  * 
- * Parameters:
+ *   code - the SNERR_ code
  * 
- *   pBuffer - the string buffer to reset
+ *   line - the line number of the error
  * 
- *   full - non-zero for a full reset, zero for a partial reset
+ *   offset - the byte offset of the error
  */
-static void snbuffer_reset(SNBUFFER *pBuffer, int full) {
+static void snanalyzer_error(
+    SNANALYZER * pAn,
+    int          code,
+    long         line,
+    long         offset) {
+  
+  long newcap = 0;
   
   /* Check parameters */
-  if (pBuffer == NULL) {
+  if ((pAn == NULL) || (code >= 0) || (pAn->frame_count < 1)) {
     abort();
   }
   
-  /* Set the count back to zero */
-  pBuffer->count = 0;
-  
-  /* If a buffer is allocated, clear it all to zero */
-  if (pBuffer->cap > 0) {
-    memset(pBuffer->pBuf, 0, (size_t) pBuffer->cap);
+  /* Grow the error list if necessary */
+  if (pAn->err_count >= pAn->err_cap) {
+    newcap = pAn->err_cap * 2;
+    if (newcap < SNANALYZER_ERRS_INIT) {
+      newcap = SNANALYZER_ERRS_INIT;
+    }
+    pAn->pErrs = (SNERRINFO *) snbatch_grow(
+                    pAn->pErrs, newcap, sizeof(SNERRINFO));
+    pAn->err_cap = newcap;
   }
   
-  /* If we're doing a full reset, release the buffer if allocated and
-   * reset capacity back to zero */
-  if (full && (pBuffer->cap > 0)) {
-    free(pBuffer->pBuf);
-    pBuffer->pBuf = NULL;
-    pBuffer->cap = 0;
-  }
+  /* Record the error */
+  (pAn->pErrs)[pAn->err_count].code = code;
+  (pAn->pErrs)[pAn->err_count].line = line;
+  (pAn->pErrs)[pAn->err_count].offset = offset;
+  (pAn->err_count)++;
+  
+  /* Mark the frame */
+  (pAn->pFrames)[pAn->frame_count - 1].bad = 1;
 }
 
 /*
- * Append a byte value to a string buffer.
- * 
- * The character c may be any unsigned byte value except for zero.  That
- * is, the range is 1-255.
+ * Apply a stack effect to the current frame of an analyzer.
  * 
- * The function fails if there is no more capacity left for another 
- * byte.  The buffer is unmodified in this case.
- * 
- * This is a low-level function.  Clients should use append() instead to
- * work with Unicode codepoints.
+ * pops and pushes are counts of values or SNEFFECT_ANY.  If the frame
+ * has a known depth and the effect pops more values than that, an
+ * underflow error is recorded.  After an unknown count or an error,
+ * the depth of the frame is no longer known.
  * 
  * Parameters:
  * 
- *   pBuffer - the string buffer to add a byte to
+ *   pAn - the analyzer
  * 
- *   c - the unsigned byte value to add
+ *   pops - the number of values popped, or SNEFFECT_ANY
  * 
- * Return:
+ *   pushes - the number of values pushed, or SNEFFECT_ANY
  * 
- *   non-zero if successful, zero if no more capacity
+ *   line - the line number for any error
+ * 
+ *   offset - the byte offset for any error
  */
-static int snbuffer_appendByte(SNBUFFER *pBuffer, int c) {
+static void snanalyzer_apply(
+    SNANALYZER * pAn,
+    int          pops,
+    int          pushes,
+    long         line,
+    long         offset) {
   
-  int status = 1;
-  long newcap = 0;
+  SNFRAME *pf = NULL;
   
   /* Check parameters */
-  if ((pBuffer == NULL) || (c < 1) || (c > 255)) {
+  if ((pAn == NULL) || (pAn->frame_count < 1) ||
+      ((pops < 0) && (pops != SNEFFECT_ANY)) ||
+      ((pushes < 0) && (pushes != SNEFFECT_ANY))) {
     abort();
   }
+  pf = &((pAn->pFrames)[pAn->frame_count - 1]);
   
-  /* Proceed only if we are not completely maxed out of capacity */
-  if (pBuffer->count < (pBuffer->maxcap - 1)) {
-    /* We have capacity left; first, make the initial allocation if we
-     * haven't allocated a memory buffer yet */
-    if (pBuffer->cap < 1) {
-      pBuffer->pBuf = (char *) malloc((size_t) pBuffer->initcap);
-      if (pBuffer->pBuf == NULL) {
-        abort();
-      }
-      memset(pBuffer->pBuf, 0, (size_t) pBuffer->initcap);
-      pBuffer->cap = pBuffer->initcap;
-    }
-    
-    /* Next, increase allocated memory buffer if we need more space */
-    if (pBuffer->count >= (pBuffer->cap - 1)) {
-      /* New capacity should usually be double current capacity */
-      newcap = pBuffer->cap * 2;
-      
-      /* If new capacity exceeds max capacity, set to max capacity */
-      if (newcap > pBuffer->maxcap) {
-        newcap = pBuffer->maxcap;
-      }
-      
-      /* Allocate new buffer */
-      pBuffer->pBuf = (char *) realloc(pBuffer->pBuf, (size_t) newcap);
-      if (pBuffer->pBuf == NULL) {
-        abort();
-      }
+  /* Pop values */
+  if (pf->known) {
+    if (pops == SNEFFECT_ANY) {
+      pf->known = 0;
       
-      /* Initialize new space to zero */
-      memset((pBuffer->pBuf + pBuffer->cap),
-              0,
-              (size_t) (newcap - pBuffer->cap));
+    } else if (pops > pf->depth) {
+      snanalyzer_error(pAn, SNERR_UNDERFLOW, line, offset);
+      pf->known = 0;
       
-      /* Update capacity */
-      pBuffer->cap = newcap;
+    } else {
+      pf->depth -= pops;
     }
-    
-    /* Add the new character */
-    ((unsigned char *) pBuffer->pBuf)[pBuffer->count] =
-      (unsigned char) c;
-    (pBuffer->count)++;
-    
-  } else {
-    /* Out of capacity */
-    status = 0;
   }
   
-  /* Return status */
-  return status;
+  /* Push values */
+  if (pf->known) {
+    if (pushes == SNEFFECT_ANY) {
+      pf->known = 0;
+    } else {
+      pf->depth += pushes;
+    }
+  }
 }
 
 /*
- * Append a Unicode codepoint to a string buffer.
- * 
- * cpv is the Unicode codepoint to append.  It must be greater than zero
- * and no greater than UNICODE_MAX_CPV.  Furthermore, it may not be in
- * surrogate range [UNICODE_MIN_SURROGATE, UNICODE_MAX_SURROGATE].
- * 
- * The codepoint will be encoded into UTF-8 and the bytes of the UTF-8
- * encoding will be added to the string buffer.
- * 
- * The function fails if there is not enough capacity left for the full
- * UTF-8 encoding of the codepoint.  The buffer is unmodified in this
- * case.
- * 
- * Parameters:
- * 
- *   pBuffer - the string buffer to add a codepoint to
- * 
- *   cpv - the Unicode codepoint to add
- * 
- * Return:
+ * Public functions
+ * ================
  * 
- *   non-zero if successful, zero if not enough capacity
+ * (see the header for specifications)
  */
-static int snbuffer_append(SNBUFFER *pBuffer, long cpv) {
+
+/*
+ * snsource_file function.
+ */
+SNSOURCE *snsource_file(FILE *pFile, int owner) {
   
-  int status = 1;
-  unsigned char buf[5];
-  unsigned char *pc = NULL;
-  int elen = 0;
+  SNSOURCE *pSrc = NULL;
   
-  /* Initialize buffer to all nul */
-  memset(buf, 0, 5);
+  /* Call through to stream function */
+  if (owner) {
+    pSrc = snsource_stream(pFile, SNSTREAM_OWNER);
+  } else {
+    pSrc = snsource_stream(pFile, SNSTREAM_NORMAL);
+  }
+  
+  /* Return new source */
+  return pSrc;
+}
+
+/*
+ * snsource_stream function.
+ */
+SNSOURCE *snsource_stream(FILE *pFile, int flags) {
+  
+  void (*pDestruct)(void *) = NULL;
+  int (*pRewind)(void *) = NULL;
   
   /* Check parameters */
-  if (pBuffer == NULL) {
-    abort();
-  }
-  if ((cpv < 1) || (cpv > UNICODE_MAX_CPV) ||
-      ((cpv >= UNICODE_MIN_SURROGATE) &&
-        (cpv <= UNICODE_MAX_SURROGATE))) {
+  if (pFile == NULL) {
     abort();
   }
   
-  /* Encode the codepoint and get the encoded length */
-  snutf_encode(cpv, buf);
-  elen = (int) strlen(buf);
-  
-  /* Make sure we have enough capacity for the all the bytes */
-  if (pBuffer->count >= (pBuffer->maxcap - elen)) {
-    status = 0;
+  /* Set destructor based on OWNER flag */
+  if (flags & SNSTREAM_OWNER) {
+    pDestruct = &snsource_file_free;
+  } else {
+    pDestruct = NULL;
   }
   
-  /* Add each of the bytes */
-  if (status) {
-    for(pc = buf; *pc != 0; pc++) {
-      if (!snbuffer_appendByte(pBuffer, *pc)) {
-        /* Shouldn't happen because we already checked that we have
-         * enough capacity remaining */
-        abort();
-      }
-    }
+  /* Set rewind routine based on RANDOM flag */
+  if (flags & SNSTREAM_RANDOM) {
+    pRewind = &snsource_file_rewind;
+  } else {
+    pRewind = NULL;
   }
   
-  /* Return status */
-  return status;
+  /* Call through to construct object */
+  return snsource_custom(
+            &snsource_file_read,
+            pDestruct,
+            pRewind,
+            (void *) pFile);
 }
 
 /*
- * Get a pointer to the current string stored in the buffer.
- * 
- * The string will be null-terminated.  The returned pointer remains
- * valid until another character is appended to the buffer or the buffer
- * is reset.
- * 
- * Clients should not modify the data pointed to, or undefined behavior
- * occurs.
- * 
- * Parameters:
- * 
- *   pBuffer - the string buffer to query
- * 
- * Return:
- * 
- *   the current buffered string
+ * snsource_string function.
  */
-static char *snbuffer_get(SNBUFFER *pBuffer) {
+SNSOURCE *snsource_string(const char *pStr) {
+  
+  SNSTRSRC *pStS = NULL;
+  SNSOURCE *pSrc = NULL;
   
   /* Check parameter */
-  if (pBuffer == NULL) {
+  if (pStr == NULL) {
     abort();
   }
   
-  /* If we haven't made the initial allocation yet, do it */
-  if (pBuffer->cap < 1) {
-    pBuffer->pBuf = (char *) malloc((size_t) pBuffer->initcap);
-    if (pBuffer->pBuf == NULL) {
-      abort();
-    }
-    memset(pBuffer->pBuf, 0, (size_t) pBuffer->initcap);
-    pBuffer->cap = pBuffer->initcap;
+  /* Allocate new structure */
+  pStS = (SNSTRSRC *) malloc(sizeof(SNSTRSRC));
+  if (pStS == NULL) {
+    abort();
   }
+  memset(pStS, 0, sizeof(SNSTRSRC));
   
-  /* Return the pointer */
-  return pBuffer->pBuf;
+  /* Copy the pointer into the structure */
+  pStS->pStr = (const unsigned char *) pStr;
+  pStS->pRewind = (const unsigned char *) pStr;
+  
+  /* Call through to construct object */
+  pSrc = snsource_custom(
+            &snsource_str_read,
+            &snsource_str_free,
+            &snsource_str_rewind,
+            (void *) pStS);
+  
+  /* The string is directly accessible, so give the source a memory
+   * view of it */
+  pSrc->pView = (const unsigned char *) pStr;
+  
+  /* Return the new source */
+  return pSrc;
 }
 
 /*
- * Get the last Unicode codepoint in a buffer.
- * 
- * Parameters:
- * 
- *   pBuffer - the buffer to query
- * 
- * Return:
- * 
- *   the last Unicode codepoint, or zero if the buffer is empty
+ * snsource_memory function.
  */
-static long snbuffer_last(SNBUFFER *pBuffer) {
+SNSOURCE *snsource_memory(const char *pData, long len) {
   
-  long c = 0;
-  unsigned char *pc = NULL;
-  int sw = 0;
+  SNMEMSRC *pMS = NULL;
+  SNSOURCE *pSrc = NULL;
   
-  /* Check parameter */
-  if (pBuffer == NULL) {
+  /* Check parameters */
+  if ((pData == NULL) || (len < 0)) {
     abort();
   }
   
-  /* Get last codepoint if buffer not empty */
-  if (pBuffer->count > 0) {
-    
-    /* Find the last byte in the buffer that is not a continuation
-     * byte */
-    sw = 1;
-    for(pc = &(((unsigned char *) pBuffer->pBuf)[pBuffer->count - 1]);
-        snutf_count(*pc) == 0;
-        pc--) {
-      sw++;
-    }
-    
-    /* Get how many encoded bytes and make sure valid and matches how
-     * many bytes we moved back in the search */
-    if (snutf_count(*pc) != sw) {
-      /* Shouldn't happen because everything in buffer should be
-       * valid */
-      abort();
-    }
-    
-    /* Decode the last codepoint */
-    c = snutf_decode(pc);
-    if (c < 0) {
-      /* Shouldn't happen because everything in buffer should be
-       * valid */
-      abort();
-    }
+  /* Allocate new structure */
+  pMS = (SNMEMSRC *) malloc(sizeof(SNMEMSRC));
+  if (pMS == NULL) {
+    abort();
   }
+  memset(pMS, 0, sizeof(SNMEMSRC));
   
-  /* Return character or zero */
-  return c;
+  /* Initialize structure */
+  pMS->pData = (const unsigned char *) pData;
+  pMS->len = len;
+  pMS->pos = 0;
+  
+  /* Call through to construct object */
+  pSrc = snsource_custom(
+            &snsource_mem_read,
+            &snsource_mem_free,
+            &snsource_mem_rewind,
+            (void *) pMS);
+  
+  /* The data is directly accessible, so give the source a memory view
+   * of it */
+  pSrc->pView = (const unsigned char *) pData;
+  
+  /* Return the new source */
+  return pSrc;
 }
 
 /*
- * Remove the last codepoint from the given buffer.
- * 
- * The function fails if the buffer is empty.
- * 
- * Parameters:
- * 
- *   pBuffer - the buffer to remove a codepoint from
- * 
- * Return:
- * 
- *   non-zero if successful, zero if buffer already empty
+ * snsource_concat function.
  */
-static int snbuffer_less(SNBUFFER *pBuffer) {
+SNSOURCE *snsource_concat(SNSOURCE **ppParts, long count) {
   
-  int status = 1;
-  unsigned char *pc = NULL;
+  SNCATSRC *pCS = NULL;
+  int multi = 1;
+  long i = 0;
   
-  /* Check parameter */
-  if (pBuffer == NULL) {
+  /* Check parameters */
+  if ((count < 0) || ((ppParts == NULL) && (count > 0))) {
     abort();
   }
+  for(i = 0; i < count; i++) {
+    if (ppParts[i] == NULL) {
+      abort();
+    }
+  }
   
-  /* Only proceed if not empty */
-  if (pBuffer->count > 0) {
-    /* Remove any continuation bytes from the end of the buffer */
-    for(pc = &(((unsigned char *) pBuffer->pBuf)[pBuffer->count - 1]);
-        snutf_count(*pc) == 0;
-        pc--) {
-      *pc = (unsigned char) 0;
-      (pBuffer->count)--;
+  /* Allocate new structure */
+  pCS = (SNCATSRC *) malloc(sizeof(SNCATSRC));
+  if (pCS == NULL) {
+    abort();
+  }
+  memset(pCS, 0, sizeof(SNCATSRC));
+  
+  /* Copy the part array and allocate the part offsets */
+  pCS->ppParts = (SNSOURCE **) malloc(
+                    ((size_t) (count + 1)) * sizeof(SNSOURCE *));
+  pCS->pStart = (long *) malloc(((size_t) (count + 1)) * sizeof(long));
+  if ((pCS->ppParts == NULL) || (pCS->pStart == NULL)) {
+    abort();
+  }
+  for(i = 0; i < count; i++) {
+    (pCS->ppParts)[i] = ppParts[i];
+  }
+  (pCS->ppParts)[count] = NULL;
+  
+  pCS->count = count;
+  pCS->cur = 0;
+  pCS->pos = 0;
+  (pCS->pStart)[0] = 0;
+  
+  /* The concatenation is multipass if all the parts are */
+  for(i = 0; i < count; i++) {
+    if (!snsource_ismulti(ppParts[i])) {
+      multi = 0;
     }
-    
-    /* Remove the last codepoint from the buffer */
-    *pc = (unsigned char) 0;
-    (pBuffer->count)--;
-    
-  } else {
-    /* Buffer was empty */
-    status = 0;
   }
   
-  /* Return status */
-  return status;
+  /* Call through to construct object */
+  return snsource_custom(
+            &snsource_cat_read,
+            &snsource_cat_free,
+            multi ? &snsource_cat_rewind : NULL,
+            (void *) pCS);
 }
 
 /*
- * Reset an input filter back to its original state.
- * 
- * This should also be used for initializing filter structures.
- * 
- * Parameters:
- * 
- *   pFilter - the filter to reset
+ * snsource_custom function.
  */
-static void snfilter_reset(SNFILTER *pFilter) {
+SNSOURCE *snsource_custom(
+    int (*read_func)(void *),
+    void (*free_func)(void *),
+    int (*rewind_func)(void *),
+    void *custom) {
   
-  /* Check parameter */
-  if (pFilter == NULL) {
+  SNSOURCE *pSrc = NULL;
+  
+  /* Check parameters */
+  if (read_func == NULL) {
     abort();
   }
   
-  /* Clear structure */
-  memset(pFilter, 0, sizeof(SNFILTER));
+  /* Allocate structure */
+  pSrc = (SNSOURCE *) malloc(sizeof(SNSOURCE));
+  if (pSrc == NULL) {
+    abort();
+  }
+  memset(pSrc, 0, sizeof(SNSOURCE));
   
-  /* Set initial state */
-  pFilter->line_count = 0;
-  pFilter->c = 0;
-  pFilter->pushback = 0;
+  /* Initialize structure */
+  pSrc->pfRead = read_func;
+  pSrc->pfDestruct = free_func;
+  pSrc->pfRewind = rewind_func;
+  
+  pSrc->read_count = 0;
+  pSrc->status = 0;
+  pSrc->pCustom = custom;
+  
+  pSrc->pView = NULL;
+  pSrc->pLines = NULL;
+  pSrc->lines_count = 0;
+  pSrc->lines_cap = 0;
+  pSrc->lines_scanned = 0;
+  pSrc->lines_lazy = 0;
+  
+  /* If a rewind routine was provided, rewind right away; errors ignored
+   * since they will immediately set structure into IOERR status */
+  if (rewind_func != NULL) {
+    snsource_rewind(pSrc);
+  }
+  
+  /* Return the new source object */
+  return pSrc;
 }
 
 /*
- * Read the next codepoint through the input filter.
- * 
- * The next codepoint value is in Unicode codepoint range, which is
- * [0, UNICODE_MAX_CPV], excluding the surrogate characters, in range
- * [UNICODE_MIN_SURROGATE, UNICODE_MAX_SURROGATE].
- * 
- * CR+LF to LF conversion, UTF-8 Byte Order Mark (BOM) filtering, and
- * correction of encoded surrogate pairs to supplemental codepoints are
- * performed by this function.
- * 
- * SNERR_ codes are returned if there is an error.  These codes are
- * always less than zero, so they are easy to distinguish from Unicode
- * codepoints, which are always zero or greater.
- * 
- * The provided input filter state must be properly initialized.
- * 
- * Parameters:
- * 
- *   pFilter - the input filter state
- * 
- *   pIn - the source to read from
- * 
- * Return:
- * 
- *   the next codepoint value, or an SNERR_ value that is less than zero
+ * snsource_view function.
  */
-static long snfilter_read(SNFILTER *pFilter, SNSOURCE *pIn) {
-  
-  int err_num = 0;
-  long c = 0;
-  long c2 = 0;
+void snsource_view(SNSOURCE *pSrc, const char *pView) {
   
-  /* Check parameters */
-  if ((pFilter == NULL) || (pIn == NULL)) {
+  /* Check parameters and state */
+  if ((pSrc == NULL) || (pView == NULL)) {
     abort();
   }
-  
-  /* If we're not in pushback mode and we don't have a special
-   * condition, we need to read another codepoint */
-  if ((!(pFilter->pushback)) &&
-        ((pFilter->line_count == 0) || (pFilter->c >= 0))) {
-    
-    /* Read a codepoint */
-    c = snsource_readCPV(pIn);
-    if (c < 0) {
-      err_num = (int) c;
-    }
-    
-    /* If this is the first codepoint read, and it is the U+FEFF Byte
-     * Order Mark (BOM), then skip it by reading again */
-    if ((!err_num) && (pFilter->line_count == 0) && (c == 0xfeffL)) {
-      c = snsource_readCPV(pIn);
-      if (c < 0) {
-        err_num = (int) c;
-      }
-    }
-    
-    /* If we read a CR, read the LF it must be paired with */
-    if ((!err_num) && (c == ASCII_CR)) {
-      
-      /* We read a CR, so read next character and make sure it is LF */
-      c = snsource_readCPV(pIn);
-      if (c < 0) {
-        err_num = (int) c;
-      } else if (c != ASCII_LF) {
-        err_num = SNERR_BADCR;
-      }
-    }
-    
-    /* If we read a low surrogate, error because it means surrogate is
-     * not paired properly */
-    if ((!err_num) && (c >= UNICODE_MIN_LO_SUR) && 
-          (c <= UNICODE_MAX_LO_SUR)) {
-      err_num = SNERR_UNPAIRED;
-    }
-    
-    /* If we read a high surrogate, read next codepoint which must be a
-     * low surrogate and then replace the character read with the
-     * supplemental codepoint selected by the surrogate pair */
-    if ((!err_num) && (c >= UNICODE_MIN_HI_SUR) &&
-          (c <= UNICODE_MAX_HI_SUR)) {
-      
-      /* Read the low surrogate */
-      c2 = snsource_readCPV(pIn);
-      if (c2 < 0) {
-        err_num = (int) c2;
-      } else if ((c2 < UNICODE_MIN_LO_SUR) ||
-                  (c2 > UNICODE_MAX_LO_SUR)) {
-        err_num = SNERR_UNPAIRED;
-      }
-      
-      /* Replace codepoint read with the supplemental codepoint */
-      if (!err_num) {
-        c = snutf_pair(c, c2);
-      }
-    }
-    
-    /* Update state of filter structure */
-    if (!err_num) {
-      if (pFilter->line_count == 0) {
-        /* Very first character -- set line count to one */
-        pFilter->c = c;
-        pFilter->line_count = 1;
-        
-      } else {
-        /* Not the very first character -- increase line count by one if
-         * the previous character was LF and the line count is not at
-         * the overflow value of LONG_MAX */
-        if ((pFilter->c == ASCII_LF) &&
-              (pFilter->line_count < LONG_MAX)) {
-          (pFilter->line_count)++;
-        }
-        pFilter->c = c;
-      }
-    }
+  if ((pSrc->read_count != 0) || (pSrc->pView != NULL)) {
+    abort();
   }
   
-  /* Clear the pushback flag if it is set -- even if there has been an
-   * error or EOF condition */
-  pFilter->pushback = 0;
+  /* Set the view */
+  pSrc->pView = (const unsigned char *) pView;
+}
+
+/*
+ * snsource_scan function.
+ */
+void snsource_scan(SNSOURCE *pSrc, long offset) {
   
-  /* If we've encountered an error (or EOF), write it into the
-   * structure */
-  if (err_num) {
-    pFilter->c = err_num;
+  /* Check parameters and state */
+  if (pSrc == NULL) {
+    abort();
+  }
+  if ((pSrc->pView == NULL) || (offset < 0) ||
+      (offset > pSrc->read_count)) {
+    abort();
   }
   
-  /* Return the character or special condition */
-  return (pFilter->c);
+  /* Extend the index if lazy line counting needs it; the lookup itself
+   * is not needed */
+  if (pSrc->lines_lazy) {
+    snsource_index(pSrc, offset, NULL);
+  }
 }
 
 /*
- * Return the current line count.
- * 
- * The line count is always at least one and at most LONG_MAX.  The
- * value of LONG_MAX is an overflow value, so any count of lines above
- * that will just remain at LONG_MAX.
- * 
- * The line count is affected by pushback mode, changing backwards if
- * characters are pushed back before a line break.
- * 
- * Parameters:
- * 
- *   pFilter - the input filter state
- * 
- * Return:
- * 
- *   the current line count
+ * snsource_free function.
+ */
+void snsource_free(SNSOURCE *pSrc) {
+  
+  /* Only proceed if non-NULL parameter passed */
+  if (pSrc != NULL) {
+    
+    /* If destructor is defined, call it */
+    if (pSrc->pfDestruct != NULL) {
+      (*(pSrc->pfDestruct))(pSrc->pCustom);
+    }
+    
+    /* Release the line-start index if allocated */
+    if (pSrc->pLines != NULL) {
+      free(pSrc->pLines);
+      pSrc->pLines = NULL;
+    }
+    
+    /* Release the structure */
+    free(pSrc);
+  }
+}
+
+/*
+ * snsource_bytes function.
  */
-static long snfilter_count(SNFILTER *pFilter) {
-  
-  long lc = 0;
+long snsource_bytes(SNSOURCE *pSrc) {
   
   /* Check parameter */
-  if (pFilter == NULL) {
+  if (pSrc == NULL) {
     abort();
   }
   
-  /* Read current line count */
-  lc = pFilter->line_count;
-  
-  /* If line count is zero, change it to one to indicate the line count
-   * at the start of the file */
-  if (lc < 1) {
-    lc = 1;
-  }
-  
-  /* If we're not in pushback mode, c is LF, we're not at the very
-   * beginning of the file, and line_count is less than LONG_MAX,
-   * increase the line count by one */
-  if ((!(pFilter->pushback)) && (pFilter->line_count > 0) &&
-        (pFilter->c == ASCII_LF) && (lc < LONG_MAX)) {
-    lc++;
-  }
-  
-  /* Return the adjusted line count */
-  return lc;
+  /* Return count */
+  return pSrc->read_count;
 }
 
 /*
- * Set the pushback flag, so the character that was just read will be
- * read again.
- * 
- * This call is ignored if the filter state is currently in an EOF or
- * error condition.
- * 
- * The call fails if the filter state is already in pushback mode or if
- * no characters have been read yet.
- * 
- * Parameters:
- * 
- *   pFilter - the filter state
- * 
- * Return:
- * 
- *   non-zero if successful, zero if pushback mode could not be set
+ * snsource_locate function.
  */
-static int snfilter_pushback(SNFILTER *pFilter) {
+int snsource_locate(
+    SNSOURCE * pSrc,
+    long       offset,
+    long     * pLine,
+    long     * pCol) {
   
   int status = 1;
+  long ln = 0;
   
-  /* Check parameter */
-  if (pFilter == NULL) {
+  /* Check parameters */
+  if ((pSrc == NULL) || (pLine == NULL) || (pCol == NULL)) {
     abort();
   }
   
-  /* Only proceed if not in special state */
-  if ((pFilter->line_count == 0) || (pFilter->c >= 0)) {
-    
-    /* We can only set the pushback flag if it is not already set and at
-     * least one character has been read */
-    if ((pFilter->line_count > 0) && (!(pFilter->pushback))) {
-      pFilter->pushback = 1;
-    } else {
-      status = 0;
-    }
+  /* Fail if no memory view or offset out of range */
+  if ((pSrc->pView == NULL) || (offset < 0) ||
+      (offset > pSrc->read_count) || (pSrc->read_count >= LONG_MAX)) {
+    status = 0;
+  }
+  
+  /* Look up the offset */
+  if (status) {
+    ln = snsource_index(pSrc, offset, pCol);
+    *pLine = ln;
   }
   
   /* Return status */
@@ -2438,161 +9997,110 @@ static int snfilter_pushback(SNFILTER *pFilter) {
 }
 
 /*
- * Determine whether the given character is legal, outside of string
- * literals and comments.
- * 
- * This range includes all visible, printing ASCII characters, plus
- * Space (SP), Horizontal Tab (HT), and Line Feed (LF).
- * 
- * Parameters:
- * 
- *   c - the character to check
- * 
- * Return:
- * 
- *   non-zero if legal, zero if not
+ * snsource_part function.
  */
-static int snchar_islegal(long c) {
+long snsource_part(SNSOURCE *pSrc, long offset, long *pPartOffset) {
   
-  int result = 0;
+  long result = -1;
+  long lo = 0;
+  long hi = 0;
+  long mid = 0;
+  const SNCATSRC *pCS = NULL;
   
-  if (((c >= ASCII_VISIBLE_MIN) && (c <= ASCII_VISIBLE_MAX)) ||
-      (c == ASCII_SP) || (c == ASCII_HT) || (c == ASCII_LF)) {
-    result = 1;
-  } else {
-    result = 0;
+  /* Check parameter */
+  if (pSrc == NULL) {
+    abort();
   }
   
-  return result;
-}
-
-/*
- * Determine whether the given character is an atomic primitive
- * character.
- * 
- * These characters can stand by themselves as a full token.
- * 
- * Parameters:
- * 
- *   c - the character to check
- * 
- * Return:
- * 
- *   non-zero if atomic, zero if not
- */
-static int snchar_isatomic(long c) {
-  
-  int result = 0;
+  /* Only concatenations have parts, and only offsets that have been
+   * read can be mapped */
+  if ((pSrc->pfRead == &snsource_cat_read) && (offset >= 0)) {
+    pCS = (const SNCATSRC *) pSrc->pCustom;
+    if ((pCS->count > 0) && (offset <= pCS->pos) &&
+        (pCS->pos < LONG_MAX)) {
+      result = 0;
+    }
+  }
   
-  if ((c == ASCII_LPAREN) || (c == ASCII_RPAREN) ||
-      (c == ASCII_LSQR) || (c == ASCII_RSQR) ||
-      (c == ASCII_COMMA) || (c == ASCII_PERCENT) ||
-      (c == ASCII_SEMICOLON) || (c == ASCII_DQUOTE) ||
-      (c == ASCII_LCURL) || (c == ASCII_RCURL)) {
-    result = 1;
-  } else {
-    result = 0;
+  /* Binary search for the last part that has been reached and starts
+   * at or before the offset */
+  if (result >= 0) {
+    lo = 0;
+    hi = pCS->cur;
+    if (hi >= pCS->count) {
+      hi = pCS->count - 1;
+    }
+    while (lo < hi) {
+      mid = lo + ((hi - lo + 1) / 2);
+      if ((pCS->pStart)[mid] <= offset) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
+      }
+    }
+    result = lo;
+    
+    if (pPartOffset != NULL) {
+      *pPartOffset = offset - (pCS->pStart)[result];
+    }
   }
   
+  /* Return result */
   return result;
 }
 
 /*
- * Determine whether the given character is an inclusive token closer.
- * 
- * Inclusive token closers end the token and are included as the last
- * character of the token.
- * 
- * Parameters:
- * 
- *   c - the character to check
- * 
- * Return:
- * 
- *   non-zero if inclusive, zero if not
+ * snsource_consume function.
  */
-static int snchar_isinclusive(long c) {
+int snsource_consume(SNSOURCE *pSrc) {
   
+  long c = 0;
   int result = 0;
   
-  if ((c == ASCII_DQUOTE) || (c == ASCII_LCURL)) {
-    result = 1;
-  } else {
-    result = 0;
+  /* Check parameter */
+  if (pSrc == NULL) {
+    abort();
   }
   
-  return result;
-}
-
-/*
- * Determine whether the given character is an exclusive token closer.
- * 
- * Exclusive token closers end the token but are not included as the
- * last character of the token.
- * 
- * Parameters:
- * 
- *   c - the character to check
- * 
- * Return:
- * 
- *   non-zero if exclusive, zero if not
- */
-static int snchar_isexclusive(long c) {
-  
-  int result = 0;
+  /* Keep reading until we get something besides SP HT CR LF */
+  for(c = snsource_readCPV(pSrc);
+      (c == ASCII_SP) || (c == ASCII_HT) ||
+      (c == ASCII_CR) || (c == ASCII_LF);
+      c = snsource_readCPV(pSrc));
   
-  if ((c == ASCII_HT) || (c == ASCII_SP) || (c == ASCII_LF) ||
-      (c == ASCII_LPAREN) || (c == ASCII_RPAREN) ||
-      (c == ASCII_LSQR) || (c == ASCII_RSQR) ||
-      (c == ASCII_COMMA) || (c == ASCII_PERCENT) ||
-      (c == ASCII_SEMICOLON) || (c == ASCII_POUNDSIGN) ||
-      (c == ASCII_RCURL)) {
+  /* Set result depending on what we stopped on */
+  if (c == SNERR_EOF) {
+    /* Nothing but whitespace and blank lines present, so succeed */
     result = 1;
+  
+  } else if (c == SNERR_IOERR) {
+    /* I/O error, so return that */
+    result = SNERR_IOERR;
+    
   } else {
-    result = 0;
+    /* In all other cases, including data bytes besides whitespace and
+     * line breaks and other kinds of errors, return a trailer error */
+    result = SNERR_TRAILER;
   }
   
+  /* Return result */
   return result;
 }
 
 /*
- * Determine whether a given string consists purely of the given byte.
- * 
- * c is a unsigned byte value in 7-bit range excluding nul (1-127) and
- * pStr points to a null-terminated string.
- * 
- * This function returns non-zero only if the string has exactly one
- * byte, which is equal to c.
- * 
- * Parameters:
- * 
- *   c - the byte
- * 
- *   pStr - pointer to the string
- * 
- * Return:
- * 
- *   non-zero if string is equal to byte, zero if not
+ * snsource_ismulti function.
  */
-static int snchar_strequals(int c, const char *pStr) {
+int snsource_ismulti(SNSOURCE *pSrc) {
   
-  char strb[2];
   int result = 0;
   
-  /* Initialize buffer */
-  memset(&(strb[0]), 0, 2);
-  
-  /* Check parameters */
-  if ((c < 1) || (c > 127) || (pStr == NULL)) {
+  /* Check parameter */
+  if (pSrc == NULL) {
     abort();
   }
   
-  /* Write character into local buffer */
-  strb[0] = (char) c;
-  
-  /* Compare strings */
-  if (strcmp(pStr, &(strb[0])) == 0) {
+  /* Presence of rewind function determines multipass support */
+  if (pSrc->pfRewind != NULL) {
     result = 1;
   } else {
     result = 0;
@@ -2603,1695 +10111,1663 @@ static int snchar_strequals(int c, const char *pStr) {
 }
 
 /*
- * Determine whether a given string consists purely of two given bytes.
- * 
- * c1 and c2 are unsigned byte values in 7-bit range excluding nul
- * (1-127) and pStr points to a null-terminated string.
- * 
- * This function returns non-zero only if the string has exactly two
- * bytes, the first of which equals c1 and the second of which equals
- * c2.
- * 
- * Parameters:
- * 
- *   c1 - the first byte
- * 
- *   c2 - the second byte
- * 
- *   pStr - pointer to the string
- * 
- * Return:
- * 
- *   non-zero if string is equal to the two bytes, zero if not
+ * snsource_rewind function.
  */
-static int snchar_strequals2(int c1, int c2, const char *pStr) {
+int snsource_rewind(SNSOURCE *pSrc) {
   
-  char strb[3];
-  int result = 0;
+  int status = 1;
+  
+  /* Check parameter and state */
+  if (pSrc == NULL) {
+    abort();
+  }
+  if (pSrc->pfRewind == NULL) {
+    abort();
+  }
   
-  /* Initialize buffer */
-  memset(&(strb[0]), 0, 3);
+  /* If source currently in EOF state, clear that */
+  if (pSrc->status == SNERR_EOF) {
+    pSrc->status = 0;
+  }
   
-  /* Check parameters */
-  if ((c1 < 1) || (c1 > 127) || (pStr == NULL) ||
-      (c2 < 1) || (c2 > 127)) {
-    abort();
+  /* If we are in an error state, rewind fails */
+  if (pSrc->status != 0) {
+    status = 0;
   }
   
-  /* Write characters into local buffer */
-  strb[0] = (char) c1;
-  strb[1] = (char) c2;
+  /* Attempt to rewind the source */
+  if (status) {
+    if (!(*(pSrc->pfRewind))(pSrc->pCustom)) {
+      status = 0;
+      pSrc->status = SNERR_IOERR;
+    }
+  }
   
-  /* Compare strings */
-  if (strcmp(pStr, &(strb[0])) == 0) {
-    result = 1;
-  } else {
-    result = 0;
+  /* If we rewound successfully, clear the read counter */
+  if (status) {
+    pSrc->read_count = 0;
   }
   
-  /* Return result */
-  return result;
+  /* Return status of operation */
+  return status;
 }
 
 /*
- * Read a quoted string.
- * 
- * pBuffer is the buffer into which the string data will be read.  It
- * must be properly initialized.  This function will reset the buffer
- * and then write the string data into it.
- * 
- * pIn is the source to read data from.
- * 
- * pFilter is the input filter to read the data through.  It should be
- * in the proper state.
- * 
- * This function assumes that the opening quote as already been read.
- * The first character read is therefore the first character of string
- * data.  The closing quote will be read and consumed by this function.
- * 
- * Parameters:
- * 
- *   pBuffer - the buffer to read the string data into
- * 
- *   pIn - the source to read the string data from
- * 
- *   pFilter - the input filter
- * 
- * Return:
- * 
- *   zero if successful, or one of the SNERR constants if error
+ * snparser_alloc function.
  */
-static int snstr_readQuoted(
-    SNBUFFER * pBuffer,
-    SNSOURCE * pIn,
-    SNFILTER * pFilter) {
+SNPARSER *snparser_alloc(void) {
   
-  int err_num = 0;
-  int esc_count = 0;
-  long c = 0;
+  SNPARSER *pParser = NULL;
   
-  /* Check parameters */
-  if ((pBuffer == NULL) || (pIn == NULL) || (pFilter == NULL)) {
+  /* Allocate structure */
+  pParser = (SNPARSER *) malloc(sizeof(SNPARSER));
+  if (pParser == NULL) {
     abort();
   }
+  memset(pParser, 0, sizeof(SNPARSER));
   
-  /* Reset the buffer */
-  snbuffer_reset(pBuffer, 0);
+  /* Initialize */
+  snreader_init(&(pParser->reader));
+  snfilter_reset(&(pParser->filter));
+  pParser->pSrc = NULL;
   
-  /* Read all string data */
-  while (!err_num) {
-    
-    /* Read a character */
-    c = snfilter_read(pFilter, pIn);
-    if (c < 0) {
-      if (c == SNERR_EOF) {
-        err_num = SNERR_OPENSTR;
-      } else {
-        err_num = (int) c;
-      }
-    }
-    
-    /* If this character is a double quote and the escape count is not
-     * odd, then we are done so leave loop */
-    if ((!err_num) && ((esc_count & 0x1) == 0) && (c == ASCII_DQUOTE)) {
-      break;
-    }
-    
-    /* Update escape count -- increment if current character is a
-     * backslash, clear otherwise; only least significant bit of the
-     * count is important so mask out upper bits to prevent overflow */
-    if ((!err_num) && (c == ASCII_BACKSLASH)) {
-      esc_count = (esc_count + 1) & 0x1;
-    } else {
-      esc_count = 0;
-    }
-    
-    /* Make sure character is not a null character */
-    if ((!err_num) && (c == 0)) {
-      err_num = SNERR_NULLCHR;
-    }
-    
-    /* Append character to buffer */
-    if (!err_num) {
-      if (!snbuffer_append(pBuffer, c)) {
-        err_num = SNERR_LONGSTR;
-      }
-    }
-  }
+  /* Charge the parser structure itself to the memory accounting */
+  snmem_grow(&((pParser->reader).mem), (long) sizeof(SNPARSER), 1);
   
-  /* Return okay or error code */
-  return err_num;
+  /* Return parser */
+  return pParser;
 }
 
 /*
- * Read a curly-quoted string.
- * 
- * pBuffer is the buffer into which the string data will be read.  It
- * must be properly initialized.  This function will reset the buffer
- * and then write the string data into it.
- * 
- * pIn is the source to read data from.
- * 
- * pFilter is the input filter to read the data through.  It should be
- * in the proper state.
- * 
- * This function assumes that the opening curly bracket as already been
- * read.  The first character read is therefore the first character of
- * string data.  The closing curly bracket will be read and consumed by
- * this function.
- * 
- * Parameters:
- * 
- *   pBuffer - the buffer to read the string data into
- * 
- *   pIn - the source to read the string data from
- * 
- *   pFilter - the input filter
- * 
- * Return:
- * 
- *   zero if successful, or one of the SNERR constants if error
+ * snparser_free function.
  */
-static int snstr_readCurlied(
-    SNBUFFER * pBuffer,
-    SNSOURCE * pIn,
-    SNFILTER * pFilter) {
+void snparser_free(SNPARSER *pParser) {
   
-  int err_num = 0;
-  int esc_count = 0;
-  long nest_level = 1;
-  long c = 0;
+  /* Only do something if not NULL */
+  if (pParser != NULL) {
+    /* Fully reset reader and release */
+    snreader_reset(&(pParser->reader), 1);
+    free(pParser);
+  }
+}
+
+/*
+ * snparser_read function.
+ */
+void snparser_read(
+    SNPARSER * pParser,
+    SNENTITY * pEntity,
+    SNSOURCE * pIn) {
   
   /* Check parameters */
-  if ((pBuffer == NULL) || (pIn == NULL) || (pFilter == NULL)) {
+  if ((pParser == NULL) || (pEntity == NULL) || (pIn == NULL)) {
     abort();
   }
   
-  /* Reset the buffer */
-  snbuffer_reset(pBuffer, 0);
-  
-  /* Read all string data */
-  while (!err_num) {
-    
-    /* Read a character */
-    c = snfilter_read(pFilter, pIn);
-    if (c < 0) {
-      if (c == SNERR_EOF) {
-        err_num = SNERR_OPENSTR;
-      } else {
-        err_num = (int) c;
-      }
-    }
-    
-    /* If escape count is not odd, update the nesting level if current
-     * character is a curly bracket */
-    if ((!err_num) && ((esc_count & 0x1) == 0)) {
-      if (c == ASCII_LCURL) {
-        
-        /* Left curly -- increase nesting level, watching for
-         * overflow */
-        if (nest_level < LONG_MAX) {
-          nest_level++;
-        } else {
-          err_num = SNERR_DEEPCURLY;
-        }
-        
-      } else if (c == ASCII_RCURL) {
-        /* Right curly -- decrease nesting level */
-        nest_level--;
-      }
-    }
-    
-    /* If nesting level has been brought down to zero, leave loop */
-    if ((!err_num) && (nest_level < 1)) {
-      break;
-    }
-    
-    /* Update escape count -- increment if current character is a
-     * backslash, clear otherwise; only least significant bit of the
-     * count is important so mask out upper bits to prevent overflow */
-    if ((!err_num) && (c == ASCII_BACKSLASH)) {
-      esc_count = (esc_count + 1) & 0x1;
-    } else {
-      esc_count = 0;
-    }
-    
-    /* Make sure character is not a null character */
-    if ((!err_num) && (c == 0)) {
-      err_num = SNERR_NULLCHR;
-    }
-    
-    /* Append character to buffer */
-    if (!err_num) {
-      if (!snbuffer_append(pBuffer, c)) {
-        err_num = SNERR_LONGSTR;
-      }
-    }
-  }
+  /* Remember the source for computing line counts */
+  pParser->pSrc = pIn;
   
-  /* Return okay or error code */
-  return err_num;
+  /* Call through to reader */
+  snreader_read(&(pParser->reader), pEntity, pIn, &(pParser->filter));
 }
 
 /*
- * Skip over zero or more characters of whitespace and comments.
- * 
- * After this operation, the source and filter will be positioned at the
- * first character that is not whitespace and not part of a comment, or
- * at the first special or error condition that was encountered.
- * 
- * Parameters:
- * 
- *   pIn - the input source
- * 
- *   pFilter - the filter to pass the input through
+ * snparser_readc function.
  */
-static void sntk_skip(SNSOURCE *pIn, SNFILTER *pFilter) {
+void snparser_readc(
+    SNPARSER  * pParser,
+    SNCOMPACT * pEntity,
+    SNSOURCE  * pIn) {
   
-  long c = 0;
+  SNENTITY ent;
+  
+  /* Initialize structures */
+  memset(&ent, 0, sizeof(SNENTITY));
   
   /* Check parameters */
-  if ((pIn == NULL) || (pFilter == NULL)) {
+  if ((pParser == NULL) || (pEntity == NULL) || (pIn == NULL)) {
     abort();
   }
   
-  /* Skip over whitespace and comments */
-  while (c >= 0) {
-    
-    /* Skip over zero or more characters of whitespace */
-    for(c = snfilter_read(pFilter, pIn);
-        (c == ASCII_SP) || (c == ASCII_HT) || (c == ASCII_LF);
-        c = snfilter_read(pFilter, pIn));
-    
-    /* If we encountered anything except the pound sign, set pushback
-     * mode (unless a special condition) and leave the loop */
-    if (c != ASCII_POUNDSIGN) {
-      if (c >= 0) {
-        if (!snfilter_pushback(pFilter)) {
-          abort();  /* shouldn't happen */
-        }
-      }
-      break;
+  /* Read the full entity */
+  snparser_read(pParser, &ent, pIn);
+  
+  /* Copy everything except the key */
+  memset(pEntity, 0, sizeof(SNCOMPACT));
+  pEntity->status = ent.status;
+  pEntity->str_type = ent.str_type;
+  pEntity->count = ent.count;
+  pEntity->pValue = ent.pValue;
+  pEntity->value_len = ent.value_len;
+  pEntity->start = ent.start;
+  pEntity->end = ent.end;
+  pEntity->col = ent.col;
+  pEntity->id = ent.id;
+  
+  /* Store the key inline if it fits, otherwise point to it */
+  if (ent.pKey != NULL) {
+    pEntity->key_len = ent.key_len;
+    if (ent.key_len < SNCOMPACT_INLINE) {
+      memcpy(pEntity->key, ent.pKey, (size_t) ent.key_len);
+    } else {
+      pEntity->pLongKey = ent.pKey;
     }
-    
-    /* We encountered the start of a comment -- read until we encounter
-     * LF or some special condition */
-    for(c = snfilter_read(pFilter, pIn);
-        (c >= 0) && (c != ASCII_LF);
-        c = snfilter_read(pFilter, pIn));
   }
 }
 
 /*
- * Read a token.
- * 
- * pBuffer is the buffer into which the token will be read.  It must be
- * properly initialized.  This function will reset the buffer and then
- * write the token into it.
- * 
- * pIn is the source to read data from.
- * 
- * pFilter is the input filter to read the data through.  It should be
- * in the proper state.
- * 
- * This function will skip over comments and whitespace before reading
- * the token.
- * 
- * For string tokens, this function only reads the opening token and not
- * the data that follows it.  Input will be positioned such that the
- * next byte read will the first byte of string data.
- * 
- * Note that it is not possible to use this function to iterate through
- * all the tokens in a Shastina source file, because this function
- * doesn't handle string data.
- * 
- * Parameters:
- * 
- *   pBuffer - the buffer to read the token into
- * 
- *   pIn - the input source to read the token from
- * 
- *   pFilter - the input filter
- * 
- * Return:
- * 
- *   zero if successful, or one of the SNERR constants if error
+ * sncompact_key function.
  */
-static int sntk_readToken(
-    SNBUFFER * pBuffer,
-    SNSOURCE * pIn,
-    SNFILTER * pFilter) {
+const char *sncompact_key(const SNCOMPACT *pEntity) {
   
-  int err_num = 0;
-  long c = 0;
-  long c2 = 0;
-  int term = 0;
-  int leave = 0;
-  int omit = 0;
+  const char *pResult = NULL;
   
-  /* Check parameters */
-  if ((pBuffer == NULL) || (pIn == NULL) || (pFilter == NULL)) {
+  /* Check parameter */
+  if (pEntity == NULL) {
     abort();
   }
   
-  /* Reset the buffer */
-  snbuffer_reset(pBuffer, 0);
-  
-  /* Skip over whitespace and comments */
-  sntk_skip(pIn, pFilter);
-  
-  /* Read a character */
-  c = snfilter_read(pFilter, pIn);
-  if (c < 0) {
-    err_num = (int) c;
-  }
-  
-  /* Check that the character is legal */
-  if (!err_num) {
-    if (!snchar_islegal(c)) {
-      err_num = SNERR_BADCHAR;
-    }
+  /* Get the key from wherever it is stored */
+  if (pEntity->pLongKey != NULL) {
+    pResult = pEntity->pLongKey;
+  } else {
+    pResult = pEntity->key;
   }
   
-  /* Add the first character to the buffer */
-  if (!err_num) {
-    if (!snbuffer_append(pBuffer, c)) {
-      err_num = SNERR_LONGTOKEN;
-    }
-  }
+  /* Return result */
+  return pResult;
+}
+
+/*
+ * snparser_run function.
+ */
+int snparser_run(
+    SNPARSER         * pParser,
+    SNSOURCE         * pIn,
+    const SNHANDLERS * pHandlers,
+    void             * ctx) {
   
-  /* If the first character is a vertical bar, check if the second
-   * character is a semicolon, forming the |; pair; set the term flag
-   * in this case and add the semicolon to the token; else, unread the
-   * second character */
-  if ((!err_num) && (c == ASCII_BAR)) {
-    c2 = snfilter_read(pFilter, pIn);
-    if (c2 < 0) {
-      err_num = (int) c2;
-    }
-    
-    if ((!err_num) && (c2 == ASCII_SEMICOLON)) {
-      term = 1;
-      if (!snbuffer_append(pBuffer, c2)) {
-        err_num = SNERR_LONGTOKEN;
-      }
-    } else {
-      if (!snfilter_pushback(pFilter)) {
-        abort();  /* shouldn't happen */
-      }
-    }
+  /* Check parameters */
+  if ((pParser == NULL) || (pIn == NULL) || (pHandlers == NULL)) {
+    abort();
   }
   
-  /* If the first character read is not atomic and the term flag is not
-   * set, read additional characters into the token up to the exclusive
-   * or inclusive character that ends the token */
-  if ((!err_num) && (!term)) {
-    if (!snchar_isatomic(c)) {
-      
-      /* Read the additional characters */
-      while (!err_num) {
-        
-        /* Read another character */
-        c = snfilter_read(pFilter, pIn);
-        if (c < 0) {
-          err_num = (int) c;
-        }
-        
-        /* Make sure the character is legal */
-        if (!err_num) {
-          if (!snchar_islegal(c)) {
-            err_num = SNERR_BADCHAR;
-          }
-        }
-        
-        /* If the character is inclusive, set the leave flag */
-        if (!err_num) {
-          if (snchar_isinclusive(c)) {
-            leave = 1;
-          }
-        }
-        
-        /* If the character is exclusive, set the leave and omit
-         * flags, and push back the character */
-        if (!err_num) {
-          if (snchar_isexclusive(c)) {
-            leave = 1;
-            omit = 1;
-            if (!snfilter_pushback(pFilter)) {
-              abort();  /* shouldn't happen */
-            }
-          }
-        }
-        
-        /* If the omit flag is not set, add the character to the
-         * token */
-        if ((!err_num) && (!omit)) {
-          if (!snbuffer_append(pBuffer, c)) {
-            err_num = SNERR_LONGTOKEN;
-          }
-        }
-        
-        /* If the leave flag is set, leave the loop */
-        if ((!err_num) && leave) {
-          break;
-        }
-      }
-    }
-  }
+  /* Remember the source for computing line counts */
+  pParser->pSrc = pIn;
   
-  /* Return okay or error number */
-  return err_num;
+  /* Call through to reader */
+  return snreader_run(&(pParser->reader), pIn, &(pParser->filter),
+                      pHandlers, ctx);
 }
 
 /*
- * Read a complete token from the given file.
- * 
- * pToken is the structure to receive the read token.  Only the pKey and
- * pValue fields need to be filled in upon entry.  Upon return, all 
- * fields will be filled in.  See the structure documentation for
- * further information.
- * 
- * pIn is the source to read data from.
- * 
- * pFilter is the input filter to read the data through.  It should be
- * in the proper state.
- * 
- * This function differs from sntk_readToken() in that this function can
- * also read string data.
- * 
- * Parameters:
- * 
- *   pToken - the token structure
- * 
- *   pIn - the input source
- * 
- *   pFil - the filter to pass input through
+ * snparser_next_document function.
  */
-static void sntoken_read(
-    SNTOKEN  * pToken,
-    SNSOURCE * pIn,
-    SNFILTER * pFil) {
-  
-  int err_num = 0;
-  long c = 0;
+int snparser_next_document(SNPARSER *pParser, SNSOURCE *pIn) {
   
   /* Check parameters */
-  if ((pToken == NULL) || (pIn == NULL) || (pFil == NULL)) {
+  if ((pParser == NULL) || (pIn == NULL)) {
     abort();
   }
-  if ((pToken->pKey == NULL) || (pToken->pValue == NULL) ||
-      (pToken->pKey == pToken->pValue)) {
+  if ((pParser->pSrc != NULL) && (pParser->pSrc != pIn)) {
     abort();
   }
   
-  /* Reset both buffers and the token fields */
-  snbuffer_reset(pToken->pKey, 0);
-  snbuffer_reset(pToken->pValue, 0);
-  pToken->status = 0;
-  pToken->str_type = 0;
+  /* Remember the source for computing line counts */
+  pParser->pSrc = pIn;
   
-  /* Read a token into the key buffer */
-  err_num = sntk_readToken(pToken->pKey, pIn, pFil);
+  /* Call through to reader */
+  return snreader_next(&(pParser->reader), pIn, &(pParser->filter));
+}
+
+/*
+ * snscan_reset function.
+ */
+void snscan_reset(SNSCAN *pScan) {
   
-  /* Identify the token by its last character, also setting the str_type
-   * flag for string tokens */
-  if (!err_num) {
-    /* Get last character */
-    c = snbuffer_last(pToken->pKey);
-    
-    /* Identify token */
-    if (c == ASCII_DQUOTE) {
-      pToken->status = SNTOKEN_STRING;
-      pToken->str_type = SNSTRING_QUOTED;
-    
-    } else if (c == ASCII_LCURL) {
-      pToken->status = SNTOKEN_STRING;
-      pToken->str_type = SNSTRING_CURLY;
-    
-    } else {
-      pToken->status = SNTOKEN_SIMPLE;
-    }
+  /* Check parameter */
+  if (pScan == NULL) {
+    abort();
   }
   
-  /* For simple tokens, distinguish between SIMPLE and FINAL */
-  if ((!err_num) && (pToken->status == SNTOKEN_SIMPLE)) {
-    if (snchar_strequals2(ASCII_BAR, ASCII_SEMICOLON,
-          snbuffer_get(pToken->pKey))) {
-      pToken->status = SNTOKEN_FINAL;
-    }
-  }
+  /* Set initial state */
+  memset(pScan, 0, sizeof(SNSCAN));
+  pScan->state = SNSCAN_GAP;
+  pScan->esc = 0;
+  pScan->nest = 0;
+}
+
+/*
+ * snscan_feed function.
+ */
+long snscan_feed(SNSCAN *pScan, const char *pData, long len) {
   
-  /* For string tokens, remove the last character, so the key buffer
-   * only has the prefix */
-  if ((!err_num) && (pToken->status == SNTOKEN_STRING)) {
-    if (!snbuffer_less(pToken->pKey)) {
-      abort();  /* shouldn't happen */
-    }
+  const unsigned char *pc = NULL;
+  long result = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pScan == NULL) || (pData == NULL) || (len < 0)) {
+    abort();
   }
   
-  /* For string tokens, read the string data into the value buffer */
-  if ((!err_num) && (pToken->status == SNTOKEN_STRING)) {
-    if (pToken->str_type == SNSTRING_QUOTED) {
-      /* Quoted string */
-      err_num = snstr_readQuoted(pToken->pValue, pIn, pFil);
-      
-    } else if (pToken->str_type == SNSTRING_CURLY) {
-      /* Curly string */
-      err_num = snstr_readCurlied(pToken->pValue, pIn, pFil);
-      
-    } else {
-      /* Unknown string type */
-      abort();
+  /* Step through the bytes until a terminator, leaving out CR bytes as
+   * the input filter does */
+  pc = (const unsigned char *) pData;
+  for(i = 0; (result == 0) && (i < len); i++) {
+    if (pc[i] != ASCII_CR) {
+      if (snscan_step(pScan, (long) pc[i])) {
+        result = i + 1;
+      }
     }
   }
   
-  /* If an error was encountered, clear the buffers and the fields, and
-   * set the status to the error */
-  if (err_num) {
-    snbuffer_reset(pToken->pKey, 0);
-    snbuffer_reset(pToken->pValue, 0);
-    pToken->str_type = 0;
-    pToken->status = err_num;
-  }
+  /* Return the length up to the terminator, or zero */
+  return result;
 }
 
 /*
- * Initialize a Shastina reader state structure.
- * 
- * All Shastina readers must be initialized before they are used, or
- * undefined behavior occurs.
- * 
- * Do not re-initialize a Shastina reader that is already initialized,
- * or a memory leak may occur.
- * 
- * Shastina readers must be fully reset with snreader_reset() before
- * they are released, or a memory leak may occur.
- * 
- * Parameters:
- * 
- *   pReader - the reader structure to initialize
+ * snparser_count function.
  */
-static void snreader_init(SNREADER *pReader) {
+long snparser_count(SNPARSER *pParser) {
+  
+  long result = 0;
   
   /* Check parameter */
-  if (pReader == NULL) {
+  if (pParser == NULL) {
     abort();
   }
   
-  /* Initialize */
-  memset(pReader, 0, sizeof(SNREADER));
+  /* Return the line in the included file, if in one, or else the
+   * line count of the source */
+  if ((pParser->reader).inc_depth > 0) {
+    result = (pParser->reader).inc_line;
+  } else {
+    result = snfilter_count(&(pParser->filter), pParser->pSrc);
+  }
+
+  /* Return line count */
+  return result;
+}
+
+/*
+ * snparser_mode function.
+ */
+void snparser_mode(SNPARSER *pParser, int flags) {
   
-  pReader->status = 0;
-  pReader->queue_count = 0;
-  pReader->queue_read = 0;
+  /* Check parameter and state */
+  if (pParser == NULL) {
+    abort();
+  }
+  if ((pParser->filter).line_count > 0) {
+    abort();
+  }
   
-  snbuffer_init(&(pReader->buf_key),
-    SNREADER_KEY_INIT, SNREADER_KEY_MAX);
-  snbuffer_init(&(pReader->buf_value),
-    SNREADER_VAL_INIT, SNREADER_VAL_MAX);
+  /* Set the lazy line counting flag */
+  if (flags & SNMODE_LAZYLINES) {
+    (pParser->filter).lazy = 1;
+  } else {
+    (pParser->filter).lazy = 0;
+  }
   
-  snstack_init(&(pReader->stack_array),
-    SNREADER_AGSTACK_INIT, SNREADER_AGSTACK_MAX);
-  snstack_init(&(pReader->stack_group),
-    SNREADER_AGSTACK_INIT, SNREADER_AGSTACK_MAX);
+  /* Set the span recording flag */
+  if (flags & SNMODE_SPANS) {
+    (pParser->reader).spans = 1;
+  } else {
+    (pParser->reader).spans = 0;
+  }
   
-  pReader->meta_flag = 0;
-  pReader->array_flag = 0;
+  /* Set the recovery mode flag */
+  if (flags & SNMODE_RECOVER) {
+    (pParser->reader).recover = 1;
+  } else {
+    (pParser->reader).recover = 0;
+  }
 }
 
 /*
- * Reset a Shastina reader back to its initial state.
- * 
- * If full is non-zero, a full reset will be performed.  If full is
- * zero, a fast reset is performed.  A full reset releases all memory
- * buffers, while a fast reset keeps the memory buffers allocated.
- * 
- * A full reset must be performed on a reader before it is released, or
- * a memory leak occurs.
- * 
- * Parameters:
- * 
- *   pReader - the reader structure to reset
- * 
- *   full - non-zero for full reset, zero for fast reset
+ * snparser_errcount function.
  */
-static void snreader_reset(SNREADER *pReader, int full) {
+long snparser_errcount(SNPARSER *pParser) {
   
-  /* Check parameters */
-  if (pReader == NULL) {
+  /* Check parameter */
+  if (pParser == NULL) {
     abort();
   }
   
-  /* Reset buffers and stacks */
-  snbuffer_reset(&(pReader->buf_key), full);
-  snbuffer_reset(&(pReader->buf_value), full);
-  
-  snstack_reset(&(pReader->stack_array), full);
-  snstack_reset(&(pReader->stack_group), full);
-  
-  /* Reset fields */
-  pReader->status = 0;
-  pReader->queue_count = 0;
-  pReader->queue_read = 0;
-  
-  pReader->meta_flag = 0;
-  pReader->array_flag = 0;
+  /* Return count */
+  return (pParser->reader).errs_total;
 }
 
 /*
- * Read an entity from a Shastina source file.
- * 
- * pReader is the reader object, which must be properly initialized.
- * 
- * pEntity is the entity structure that will be filled in.  Its state
- * upon entry to the function is irrelevant.  Upon return, it will hold
- * the results of the operation.  See the structure documentation for
- * further information.
- * 
- * pIn is the input source to read from.
- * 
- * pFilter is the input filter to pass the input through.  It must be
- * properly initialized.
- * 
- * Once an error is encountered, the reader object will return that same
- * error each time this function is called without doing anything
- * further.
- * 
- * Once the End Of File (EOF) entity is returned, this function will
- * return the EOF entity on all subsequent calls without doing anything
- * further.
- * 
- * Parameters:
- * 
- *   pReader - the reader object
- * 
- *   pEntity - pointer to the entity to receive the results
- * 
- *   pIn - the input source
- * 
- *   pFilter - the input filter
+ * snparser_errinfo function.
  */
-static void snreader_read(
-    SNREADER * pReader,
-    SNENTITY * pEntity,
-    SNSOURCE * pIn,
-    SNFILTER * pFilter) {
+int snparser_errinfo(SNPARSER *pParser, long i, SNERRINFO *pInfo) {
   
-  int err_code = 0;
+  int status = 0;
   
   /* Check parameters */
-  if ((pReader == NULL) || (pEntity == NULL) || (pIn == NULL) ||
-      (pFilter == NULL)) {
+  if ((pParser == NULL) || (i < 0) || (pInfo == NULL)) {
     abort();
   }
   
-  /* Clear provided entity */
-  memset(pEntity, 0, sizeof(SNENTITY));
+  /* Copy the record if it was kept */
+  if (i < (pParser->reader).errs_stored) {
+    memcpy(pInfo, &(((pParser->reader).pErrs)[i]), sizeof(SNERRINFO));
+    status = 1;
+  } else {
+    memset(pInfo, 0, sizeof(SNERRINFO));
+  }
   
-  /* Fail immediately if reader is in error state */
-  err_code = pReader->status;
+  /* Return status */
+  return status;
+}
+
+/*
+ * snparser_unescape function.
+ */
+void snparser_unescape(SNPARSER *pParser, int dialect) {
   
-  /* If queue is empty, fill it until something is in it */
-  while ((!err_code) && (pReader->queue_count < 1)) {
-    snreader_fill(pReader, pIn, pFilter);
-    err_code = pReader->status;
+  /* Check parameter */
+  if (pParser == NULL) {
+    abort();
   }
   
-  /* Return either an entity or an error code */
-  if (!err_code) {
-    /* Copy current entity to provided entity */
-    memcpy(pEntity, &(pReader->queue[pReader->queue_read]),
-            sizeof(SNENTITY));
-    
-    /* If current entity is not EOF, then remove it from queue */
-    if ((pReader->queue[pReader->queue_read]).status !=
-          SNENTITY_EOF) {
-      
-      (pReader->queue_read)++;
-      if (pReader->queue_read >= pReader->queue_count) {
-        /* We've read everything in the queue, so clear it */
-        pReader->queue_count = 0;
-        pReader->queue_read = 0;
-      }
-    }
-    
-  } else {
-    /* Error status -- write into the entity */
-    pEntity->status = err_code;
-  }
+  /* Set the dialect */
+  (pParser->reader).unescape = dialect;
 }
 
 /*
- * Add an entity with no parameters (type "Z") to the queue of a given
- * reader.
- * 
- * pReader is the reader to add the entity to.
- * 
- * entity is the SNENTITY_ constant describing the kind of entity.
- * 
- * The only entities allowed by this function are:
- * 
- *   - SNENTITY_EOF
- *   - SNENTITY_BEGIN_META
- *   - SNENTITY_END_META
- *   - SNENTITY_BEGIN_GROUP
- *   - SNENTITY_END_GROUP
- * 
- * Passing any other kind of entity code results in a fault.
- * 
- * The queue of the reader must not be full or this function will fault.
- * See SNREADER_MAXQUEUE for more information.
- * 
- * If the reader is in an error state, this call is ignored.
- * 
- * Parameters:
- * 
- *   pReader - the reader object
- * 
- *   entity - the entity code
+ * snparser_decoder function.
  */
-static void snreader_addEntityZ(SNREADER *pReader, int entity) {
+int snparser_decoder(
+    SNPARSER        * pParser,
+    const char      * pPrefix,
+    const SNDECODER * pDecoder,
+    void            * pCustom) {
   
-  SNENTITY *pe = NULL;
+  int status = 1;
+  int i = 0;
+  SNDECREG *pReg = NULL;
   
   /* Check parameters */
-  if (pReader == NULL) {
+  if ((pParser == NULL) || (pPrefix == NULL)) {
     abort();
   }
-  if ((entity != SNENTITY_EOF) &&
-      (entity != SNENTITY_BEGIN_META) &&
-      (entity != SNENTITY_END_META) &&
-      (entity != SNENTITY_BEGIN_GROUP) &&
-      (entity != SNENTITY_END_GROUP)) {
-    abort();
+  if (pDecoder != NULL) {
+    if ((pDecoder->pfBegin == NULL) || (pDecoder->pfData == NULL) ||
+        (pDecoder->pfEnd == NULL)) {
+      abort();
+    }
   }
   
-  /* Proceed only if reader not in error state */
-  if (!(pReader->status)) {
-    /* Make sure room for another entity */
-    if (pReader->queue_count >= SNREADER_MAXQUEUE) {
-      abort();
+  /* Find any existing registration of the prefix */
+  pReg = &((pParser->reader).decoders);
+  for(i = 0; i < pReg->count; i++) {
+    if (strcmp((pReg->entries[i]).pPrefix, pPrefix) == 0) {
+      break;
+    }
+  }
+  
+  if (pDecoder != NULL) {
+    /* Registering -- add a new entry if necessary */
+    if (i >= pReg->count) {
+      if (pReg->count < SNREADER_MAXDECODERS) {
+        (pReg->count)++;
+      } else {
+        status = 0;
+      }
     }
     
-    /* Get entity pointer */
-    pe = &(pReader->queue[pReader->queue_count]);
-    
-    /* Fill in entity */
-    pe->status = entity;
-    
-    /* Increase the entity count */
-    (pReader->queue_count)++;
+    /* Fill in the entry */
+    if (status) {
+      (pReg->entries[i]).pPrefix = pPrefix;
+      (pReg->entries[i]).pDecoder = pDecoder;
+      (pReg->entries[i]).pCustom = pCustom;
+    }
+    
+  } else if (i < pReg->count) {
+    /* Unregistering -- move the last entry into the removed entry */
+    (pReg->count)--;
+    if (i < pReg->count) {
+      memcpy(&(pReg->entries[i]), &(pReg->entries[pReg->count]),
+              sizeof(SNDECENTRY));
+    }
   }
+  
+  /* Return status */
+  return status;
 }
 
 /*
- * Add an entity with one string parameter (type "S") to the queue of a
- * given reader.
- * 
- * pReader is the reader to add the entity to.
- * 
- * entity is the SNENTITY_ constant describing the kind of entity.
- * 
- * s is the string parameter.
- * 
- * The only entities allowed by this function are:
- * 
- *   - SNENTITY_META_TOKEN
- *   - SNENTITY_NUMERIC
- *   - SNENTITY_VARIABLE
- *   - SNENTITY_CONSTANT
- *   - SNENTITY_ASSIGN
- *   - SNENTITY_GET
- *   - SNENTITY_OPERATION
- * 
- * Passing any other kind of entity code results in a fault.
- * 
- * The queue of the reader must not be full or this function will fault.
- * See SNREADER_MAXQUEUE for more information.
- * 
- * If the reader is in an error state, this call is ignored.
- * 
- * Parameters:
- * 
- *   pReader - the reader object
- * 
- *   entity - the entity code
- * 
- *   s - the string parameter
+ * snparser_meta function.
  */
-static void snreader_addEntityS(
-    SNREADER * pReader,
-    int        entity,
-    char     * s) {
+int snparser_meta(
+    SNPARSER   * pParser,
+    const char * pName,
+    int       (* pfMeta)(void *pCustom, const SNMETA *pMeta),
+    void       * pCustom) {
   
-  SNENTITY *pe = NULL;
+  int status = 1;
+  int i = 0;
+  SNMETAREG *pReg = NULL;
   
   /* Check parameters */
-  if ((pReader == NULL) || (s == NULL)) {
+  if ((pParser == NULL) || (pName == NULL)) {
     abort();
   }
-  if ((entity != SNENTITY_META_TOKEN) &&
-      (entity != SNENTITY_NUMERIC) &&
-      (entity != SNENTITY_VARIABLE) &&
-      (entity != SNENTITY_CONSTANT) &&
-      (entity != SNENTITY_ASSIGN) &&
-      (entity != SNENTITY_GET) &&
-      (entity != SNENTITY_OPERATION)) {
-    abort();
+  
+  /* Find any existing registration of the name */
+  pReg = &((pParser->reader).metas);
+  for(i = 0; i < pReg->count; i++) {
+    if (strcmp((pReg->entries[i]).pName, pName) == 0) {
+      break;
+    }
   }
-      
-  /* Proceed only if reader not in error state */
-  if (!(pReader->status)) {
-    /* Make sure room for another entity */
-    if (pReader->queue_count >= SNREADER_MAXQUEUE) {
-      abort();
+  
+  if (pfMeta != NULL) {
+    /* Registering -- add a new entry if necessary */
+    if (i >= pReg->count) {
+      if (pReg->count < SNREADER_MAXMETAS) {
+        (pReg->count)++;
+      } else {
+        status = 0;
+      }
     }
     
-    /* Get entity pointer */
-    pe = &(pReader->queue[pReader->queue_count]);
-    
-    /* Fill in entity */
-    pe->status = entity;
-    pe->pKey = s;
+    /* Fill in the entry */
+    if (status) {
+      (pReg->entries[i]).pName = pName;
+      (pReg->entries[i]).pfMeta = pfMeta;
+      (pReg->entries[i]).pCustom = pCustom;
+    }
     
-    /* Increase the entity count */
-    (pReader->queue_count)++;
+  } else if (i < pReg->count) {
+    /* Unregistering -- move the last entry into the removed entry */
+    (pReg->count)--;
+    if (i < pReg->count) {
+      memcpy(&(pReg->entries[i]), &(pReg->entries[pReg->count]),
+              sizeof(SNMETAENTRY));
+    }
   }
+  
+  /* Return status */
+  return status;
 }
 
 /*
- * Add an entity with one long parameter (type "L") to the queue of a
- * given reader.
- * 
- * pReader is the reader to add the entity to.
- * 
- * entity is the SNENTITY_ constant describing the kind of entity.
- * 
- * l is the long parameter.
- * 
- * The only entities allowed by this function are:
- * 
- *   - SNENTITY_ARRAY
- * 
- * Passing any other kind of entity code results in a fault.
- * 
- * The queue of the reader must not be full or this function will fault.
- * See SNREADER_MAXQUEUE for more information.
- * 
- * If the reader is in an error state, this call is ignored.
- * 
- * Parameters:
- * 
- *   pReader - the reader object
- * 
- *   entity - the entity code
- * 
- *   l - the long value
+ * sninccache_alloc function.
  */
-static void snreader_addEntityL(
-    SNREADER * pReader,
-    int        entity,
-    long       l) {
+SNINCCACHE *sninccache_alloc(void) {
   
-  SNENTITY *pe = NULL;
+  SNINCCACHE *pCache = NULL;
   
-  /* Check parameters */
-  if (pReader == NULL) {
+  /* Allocate the cache */
+  pCache = (SNINCCACHE *) malloc(sizeof(SNINCCACHE));
+  if (pCache == NULL) {
     abort();
   }
-  if (entity != SNENTITY_ARRAY) {
+  memset(pCache, 0, sizeof(SNINCCACHE));
+  
+  /* Start empty */
+  pCache->pFrags = NULL;
+  
+  /* Return cache */
+  return pCache;
+}
+
+/*
+ * sninccache_free function.
+ */
+void sninccache_free(SNINCCACHE *pCache) {
+  
+  SNFRAG *pFrag = NULL;
+  
+  /* Only do something if not NULL */
+  if (pCache != NULL) {
+    /* Release the references of the cache; fragments that parsers are
+     * still reading stay allocated until they are released */
+    while (pCache->pFrags != NULL) {
+      pFrag = pCache->pFrags;
+      pCache->pFrags = pFrag->pNext;
+      pFrag->pNext = NULL;
+      snfrag_release(pFrag);
+    }
+    free(pCache);
+  }
+}
+
+/*
+ * snparser_include function.
+ */
+void snparser_include(SNPARSER *pParser, SNINCCACHE *pCache) {
+  
+  /* Check parameter */
+  if (pParser == NULL) {
     abort();
   }
   
-  /* Proceed only if reader not in error state */
-  if (!(pReader->status)) {
-    /* Make sure room for another entity */
-    if (pReader->queue_count >= SNREADER_MAXQUEUE) {
-      abort();
-    }
-    
-    /* Get entity pointer */
-    pe = &(pReader->queue[pReader->queue_count]);
-    
-    /* Fill in entity */
-    pe->status = entity;
-    pe->count = l;
-    
-    /* Increase the entity count */
-    (pReader->queue_count)++;
+  /* Set the cache */
+  (pParser->reader).pIncCache = pCache;
+}
+
+/*
+ * snparser_file function.
+ */
+const char *snparser_file(SNPARSER *pParser) {
+  
+  const char *pResult = NULL;
+  const SNREADER *pReader = NULL;
+  
+  /* Check parameter */
+  if (pParser == NULL) {
+    abort();
+  }
+  pReader = &(pParser->reader);
+  
+  /* Get the path of the fragment on top of the include stack */
+  if (pReader->inc_depth > 0) {
+    pResult = ((pReader->incs[pReader->inc_depth - 1]).pFrag)->pPath;
   }
+  
+  /* Return result */
+  return pResult;
 }
 
 /*
- * Add an entity with prefix, type, and data parameters (type "T") to
- * the queue of a given reader.
- * 
- * pReader is the reader to add the entity to.
- * 
- * entity is the SNENTITY_ constant describing the kind of entity.
- * 
- * pPrefix points to the prefix string.
- * 
- * str_type is the string type.  It must be one of the SNSTRING_
- * constants.
- * 
- * pData points to the string data.
- * 
- * The only entities allowed by this function are:
- * 
- *   - SNENTITY_STRING
- *   - SNENTITY_META_STRING
- * 
- * Passing any other kind of entity code results in a fault.
- * 
- * The queue of the reader must not be full or this function will fault.
- * See SNREADER_MAXQUEUE for more information.
- * 
- * If the reader is in an error state, this call is ignored.
- * 
- * Parameters:
- * 
- *   pReader - the reader object
- * 
- *   entity - the entity code
+ * snparser_blob function.
  */
-static void snreader_addEntityT(
-    SNREADER * pReader,
-    int        entity,
-    char     * pPrefix,
-    int        str_type,
-    char     * pData) {
+int snparser_blob(
+    SNPARSER   * pParser,
+    const char * pPrefix,
+    int          encoding,
+    SNBLOB     * pBlob) {
   
-  SNENTITY *pe = NULL;
+  const SNDECODER *pDecoder = NULL;
   
   /* Check parameters */
-  if ((pReader == NULL) || (pPrefix == NULL) || (pData == NULL)) {
+  if ((pParser == NULL) || (pPrefix == NULL) || (pBlob == NULL)) {
     abort();
   }
-  if ((str_type != SNSTRING_QUOTED) && (str_type != SNSTRING_CURLY)) {
+  if ((pBlob->cap < 0) || ((pBlob->cap > 0) && (pBlob->pData == NULL))) {
     abort();
   }
-  if ((entity != SNENTITY_STRING) &&
-      (entity != SNENTITY_META_STRING)) {
+  
+  /* Select the built-in decoder */
+  if (encoding == SNBLOB_BASE64) {
+    pDecoder = &snblob_b64;
+  } else if (encoding == SNBLOB_BASE16) {
+    pDecoder = &snblob_hex;
+  } else {
     abort();
   }
   
-  /* Proceed only if reader not in error state */
-  if (!(pReader->status)) {
-    /* Make sure room for another entity */
-    if (pReader->queue_count >= SNREADER_MAXQUEUE) {
-      abort();
-    }
-    
-    /* Get entity pointer */
-    pe = &(pReader->queue[pReader->queue_count]);
-    
-    /* Fill in entity */
-    pe->status = entity;
-    pe->pKey = pPrefix;
-    pe->str_type = str_type;
-    pe->pValue = pData;
-    
-    /* Increase the entity count */
-    (pReader->queue_count)++;
+  /* Register the decoder */
+  return snparser_decoder(pParser, pPrefix, pDecoder, (void *) pBlob);
+}
+
+/*
+ * snparser_schema function.
+ */
+void snparser_schema(SNPARSER *pParser, const SNSCHEMA *pSchema) {
+  
+  /* Check parameter */
+  if (pParser == NULL) {
+    abort();
   }
+  
+  /* Set the schema */
+  (pParser->reader).pSchema = pSchema;
 }
 
 /*
- * Perform the array prefix operation.
- * 
- * This should be performed before processing any token except for "]".
- * 
- * pReader is the reader object.  The reader must not be in an error
- * state, or a fault occurs.
- * 
- * This operation only does something if the array flag is on.  In that
- * case, the array flag is turned off, the array and grouping stacks are
- * adjusted to indicate a new array, and a BEGIN_GROUP entity is added
- * to the reader.
- * 
- * These are operations that should have properly been done when the "["
- * token was processed.  But that token needs to know whether the array
- * is empty (followed immediately by a "]" token) or non-empty.  Hence,
- * it sets the array flag and its processing is delayed until the next
- * token, which calls into this array prefix operation to do the delayed
- * array operation if the array flag is set.
- * 
- * This is therefore done before every token except for "]", which
- * handles the situation differently because the empty array case is
- * different.  Hence, this function must *not* be called before the "]"
- * token.
- * 
- * This function may set the reader into an error state.
- * 
- * Parameters:
- * 
- *   pReader - the reader object
+ * snparser_budget function.
  */
-static void snreader_arrayPrefix(SNREADER *pReader) {
+void snparser_budget(SNPARSER *pParser, long bytes) {
   
-  int err_code = 0;
-  
-  /* Check parameter and state */
-  if (pReader == NULL) {
+  /* Check parameters */
+  if ((pParser == NULL) || (bytes < 0)) {
     abort();
   }
-  if (pReader->status) {
+  
+  /* Set the budget */
+  (pParser->reader).mem.budget = bytes;
+}
+
+/*
+ * snparser_memory function.
+ */
+long snparser_memory(SNPARSER *pParser) {
+  
+  /* Check parameter */
+  if (pParser == NULL) {
     abort();
   }
   
-  /* Only do something if array flag is set */
-  if (pReader->array_flag) {
-    
-    /* Clear the array flag */
-    pReader->array_flag = 0;
-    
-    /* Push a value of one on top of the array stack and a value of zero
-     * on top of the grouping stack to begin a new array */
-    if (!snstack_push(&(pReader->stack_array), 1)) {
-      err_code = SNERR_DEEPARRAY;
-    }
-    
-    if (!err_code) {
-      if (!snstack_push(&(pReader->stack_group), 0)) {
-        err_code = SNERR_DEEPARRAY;
-      }
-    }
-    
-    /* Add a BEGIN_GROUP entity */
-    if (!err_code) {
-      snreader_addEntityZ(pReader, SNENTITY_BEGIN_GROUP);
-    }
-  }
+  /* Return current usage */
+  return (pParser->reader).mem.current;
 }
 
-/* 
- * Read a token from a Shastina source file in an effort to fill the
- * entity queue.
- * 
- * Clients should not use this function directly.  Use snreader_read()
- * instead (which makes use of this function).
- * 
- * The reader must not be in an error state and the queue must be empty.
- * If these conditions are not satisfied, a fault occurs.  A fault may
- * also occur if SNREADER_MAXQUEUE is not large enough -- see that
- * constant for further information.
- * 
- * Not all tokens result in entities being read, so to ensure the entity
- * buffer is filled with at least one entity, call this function in a
- * loop.
- * 
- * Parameters:
- * 
- *   pReader - the reader object
- * 
- *   pIn - the input file
- * 
- *   pFilter - the filter to pass input through
+/*
+ * snparser_peak function.
  */
-static void snreader_fill(
-    SNREADER * pReader,
-    SNSOURCE * pIn,
-    SNFILTER * pFilter) {
+long snparser_peak(SNPARSER *pParser) {
   
-  int err_code = 0;
-  int firstchar = 0;
-  char *pks = NULL;
-  SNTOKEN tk;
+  /* Check parameter */
+  if (pParser == NULL) {
+    abort();
+  }
   
-  /* Initialize structures */
-  memset(&tk, 0, sizeof(SNTOKEN));
+  /* Return peak usage */
+  return (pParser->reader).mem.peak;
+}
+
+/*
+ * snparser_cancel function.
+ */
+void snparser_cancel(SNPARSER *pParser) {
   
-  /* Check parameters and state */
-  if ((pReader == NULL) || (pIn == NULL) || (pFilter == NULL)) {
+  /* Check parameter */
+  if (pParser == NULL) {
     abort();
   }
-  if (pReader->status) {
+  
+  /* Set the flag */
+  (pParser->filter).cancel = 1;
+}
+
+/*
+ * snparser_deadline function.
+ */
+void snparser_deadline(
+    SNPARSER * pParser,
+    int     (* expired_func)(void *),
+    void     * custom) {
+  
+  /* Check parameter */
+  if (pParser == NULL) {
     abort();
   }
-  if (pReader->queue_count > 0) {
+  
+  /* Install the callback */
+  (pParser->filter).pfExpired = expired_func;
+  (pParser->filter).pExpiredCustom = custom;
+}
+
+/*
+ * snpool_alloc function.
+ */
+SNPOOL *snpool_alloc(int warm, int max) {
+  
+  SNPOOL *pPool = NULL;
+  int i = 0;
+  
+  /* Check parameters */
+  if ((max < 0) || (warm < 0) || (warm > max)) {
     abort();
   }
   
-  /* If grouping stack is empty, initialize it with a value of zero */
-  if (snstack_count(&(pReader->stack_group)) < 1) {
-    if (!snstack_push(&(pReader->stack_group), 0)) {
-      abort();
-    }
+  /* Allocate structure */
+  pPool = (SNPOOL *) malloc(sizeof(SNPOOL));
+  if (pPool == NULL) {
+    abort();
   }
+  memset(pPool, 0, sizeof(SNPOOL));
   
-  /* Read a token */
-  tk.pKey = &(pReader->buf_key);
-  tk.pValue = &(pReader->buf_value);
-  sntoken_read(&tk, pIn, pFilter);
-  if (tk.status < 0) {
-    err_code = tk.status;
-  }
+  /* Initialize */
+  pPool->pParsers = NULL;
+  pPool->pSources = NULL;
+  pPool->parser_count = 0;
+  pPool->source_count = 0;
+  pPool->max = max;
   
-  /* Get the key string pointer */
-  if (!err_code) {
-    pks = snbuffer_get(tk.pKey);
+  /* Allocate the initial objects */
+  for(i = 0; i < warm; i++) {
+    snpool_putparser(pPool, snparser_alloc());
+    snpool_putsource(pPool, snsource_string(""));
   }
   
-  /* Perform array prefix operation if not in metacommand mode, except
-   * for "]" token */
-  if ((!err_code) && (!pReader->meta_flag)) {
-    if (tk.status == SNTOKEN_SIMPLE) {
-      if (!snchar_strequals(ASCII_RSQR, pks)) {
-        /* Simple token except for "]" */
-        snreader_arrayPrefix(pReader);
-      }
-      
-    } else {
-      /* Not in metacommand mode and not a simple token */
-      snreader_arrayPrefix(pReader);
-    }
-    
-    /* Check for errors from the prefix operation */
-    err_code = pReader->status;
-  }
+  /* Return the new pool */
+  return pPool;
+}
+
+/*
+ * snpool_free function.
+ */
+void snpool_free(SNPOOL *pPool) {
   
-  /* Handle the token types */
-  if ((tk.status == SNTOKEN_SIMPLE) && (!err_code)) {
-    /* Simple token -- handle non-primitive and primitive cases */
-    if (snchar_strequals(ASCII_PERCENT, pks)) {
-      /* % token -- enter metacommand mode */
-      if (!pReader->meta_flag) {
-        pReader->meta_flag = 1;
-        snreader_addEntityZ(pReader, SNENTITY_BEGIN_META);
-        
-      } else {
-        /* Nested metacommands */
-        err_code = SNERR_METANEST;
-      }
-      
-    } else if (snchar_strequals(ASCII_SEMICOLON, pks)) {
-      /* ; token -- leave metacommand mode */
-      if (pReader->meta_flag) {
-        pReader->meta_flag = 0;
-        snreader_addEntityZ(pReader, SNENTITY_END_META);
-        
-      } else {
-        /* Semicolon outside of metacommand */
-        err_code = SNERR_SEMICOLON;
-      }
-      
-    } else if (pReader->meta_flag) {
-      /* Other simple tokens in metacommand mode */
-      snreader_addEntityS(pReader, SNENTITY_META_TOKEN, pks);
-      
-    } else {
-      /* Primitive tokens -- first, get first byte */
-      firstchar = pks[0];
-      
-      /* Handle the various primitive tokens */
-      if ((firstchar == ASCII_PLUS) ||
-          (firstchar == ASCII_HYPHEN) ||
-          ((firstchar >= ASCII_ZERO) && (firstchar <= ASCII_NINE))) {
-        /* Numeric token */
-        snreader_addEntityS(pReader, SNENTITY_NUMERIC, pks);
-        
-      } else if (firstchar == ASCII_QUESTION) {
-        /* Declare variable */
-        snreader_addEntityS(pReader, SNENTITY_VARIABLE, (pks + 1));
-        
-      } else if (firstchar == ASCII_ATSIGN) {
-        /* Declare constant */
-        snreader_addEntityS(pReader, SNENTITY_CONSTANT, (pks + 1));
-        
-      } else if (firstchar == ASCII_COLON) {
-        /* Assign variable */
-        snreader_addEntityS(pReader, SNENTITY_ASSIGN, (pks + 1));
-        
-      } else if (firstchar == ASCII_EQUALS) {
-        /* Get variable or constant value */
-        snreader_addEntityS(pReader, SNENTITY_GET, (pks + 1));
-        
-      } else if (snchar_strequals(ASCII_LPAREN, pks)) {
-        /* Begin group */
-        if (snstack_inc(&(pReader->stack_group))) {
-          snreader_addEntityZ(pReader, SNENTITY_BEGIN_GROUP);
-        } else {
-          /* Too much group nesting */
-          err_code = SNERR_DEEPGROUP;
-        }
-        
-      } else if (snchar_strequals(ASCII_RPAREN, pks)) {
-        /* End group */
-        if (snstack_dec(&(pReader->stack_group))) {
-          snreader_addEntityZ(pReader, SNENTITY_END_GROUP);
-        } else {
-          /* Closing parenthesis without an opening parenthesis */
-          err_code = SNERR_RPAREN;
-        }
-        
-      } else if (snchar_strequals(ASCII_LSQR, pks)) {
-        /* Begin array */
-        pReader->array_flag = 1;
-        
-      } else if (snchar_strequals(ASCII_RSQR, pks)) {
-        /* End array */
-        if (!(pReader->array_flag)) {
-          /* Non-empty array -- check that array stack is not empty and
-           * that value on top of grouping stack is zero, then perform
-           * operation */
-          if (snstack_count(&(pReader->stack_array)) > 0) {
-            if (snstack_peek(&(pReader->stack_group)) == 0) {
-              snreader_addEntityZ(pReader, SNENTITY_END_GROUP);
-              snreader_addEntityL(pReader, SNENTITY_ARRAY,
-                snstack_pop(&(pReader->stack_array)));
-              snstack_pop(&(pReader->stack_group));
-              
-            } else {
-              /* Still unclosed parentheses in current element */
-              err_code = SNERR_OPENGROUP;
-            }
-            
-          } else {
-            /* "]" without a corresponding opening bracket */
-            err_code = SNERR_RSQR;
-          }
-          
-        } else {
-          /* Empty array */
-          pReader->array_flag = 0;
-          snreader_addEntityL(pReader, SNENTITY_ARRAY, 0);
-        }
-        
-      } else if (snchar_strequals(ASCII_COMMA, pks)) {
-        /* Array separator -- check that array stack is not empty and
-         * that value on top of grouping stack is zero, then perform
-         * operation */
-        if (snstack_count(&(pReader->stack_array)) > 0) {
-          if (snstack_peek(&(pReader->stack_group)) == 0) {
-            if (snstack_inc(&(pReader->stack_array))) {
-              snreader_addEntityZ(pReader, SNENTITY_END_GROUP);
-              snreader_addEntityZ(pReader, SNENTITY_BEGIN_GROUP);
-              
-            } else {
-              /* Too many array elements */
-              err_code = SNERR_LONGARRAY;
-            }
-              
-          } else {
-            /* Open parentheses in current element */
-            err_code = SNERR_OPENGROUP;
-          }
-            
-        } else {
-          /* Comma used outside of array */
-          err_code = SNERR_COMMA;
-        }
-        
-      } else {
-        /* Operator */
-        snreader_addEntityS(pReader, SNENTITY_OPERATION, pks);
-      }
-    }
+  SNPARSER *pParser = NULL;
+  SNSOURCE *pSrc = NULL;
+  
+  /* Only proceed if non-NULL parameter passed */
+  if (pPool != NULL) {
     
-  } else if ((tk.status == SNTOKEN_STRING) && (!err_code)) {
-    /* String token -- either a normal string or a meta string */
-    if (pReader->meta_flag) {
-      /* Meta string */
-      snreader_addEntityT(pReader, SNENTITY_META_STRING,
-        pks, tk.str_type, snbuffer_get(tk.pValue));
-    } else {
-      /* Normal string */
-      snreader_addEntityT(pReader, SNENTITY_STRING,
-        pks, tk.str_type, snbuffer_get(tk.pValue));
+    /* Free all kept parsers */
+    while (pPool->pParsers != NULL) {
+      pParser = pPool->pParsers;
+      pPool->pParsers = pParser->pPoolNext;
+      snparser_free(pParser);
     }
-  
-  } else if ((tk.status == SNTOKEN_FINAL) && (!err_code)) {
-    /* Final token */
-    if (!(pReader->meta_flag)) {
-      if ((!pReader->array_flag) &&
-            (snstack_count(&(pReader->stack_array)) == 0)) {
-        if (snstack_peek(&(pReader->stack_group)) == 0) {
-          
-          /* Add the EOF entity */
-          snreader_addEntityZ(pReader, SNENTITY_EOF);
-          
-        } else {
-          /* Open parentheses group remains */
-          err_code = SNERR_OPENGROUP;
-        }
-      } else {
-        /* Open array remains */
-        err_code = SNERR_OPENARRAY;
-      }
-    } else {
-      /* Open metacommand remains */
-      err_code = SNERR_OPENMETA;
+    
+    /* Free all kept sources */
+    while (pPool->pSources != NULL) {
+      pSrc = pPool->pSources;
+      pPool->pSources = pSrc->pPoolNext;
+      snsource_free(pSrc);
     }
     
-  } else if (!err_code) {
-    /* Unknown token type */
-    abort();
+    /* Release the structure */
+    free(pPool);
   }
+}
+
+/*
+ * snpool_parser function.
+ */
+SNPARSER *snpool_parser(SNPOOL *pPool) {
   
-  /* Error if now an error state in reader */
-  if (!err_code) {
-    err_code = pReader->status;
+  SNPARSER *pParser = NULL;
+  
+  /* Check parameter */
+  if (pPool == NULL) {
+    abort();
   }
   
-  /* If error, set error in reader */
-  if (err_code) {
-    pReader->status = err_code;
+  /* Take a kept parser if there is one, else allocate a new one */
+  if (pPool->pParsers != NULL) {
+    pParser = pPool->pParsers;
+    pPool->pParsers = pParser->pPoolNext;
+    (pPool->parser_count)--;
+    pParser->pPoolNext = NULL;
+    
+  } else {
+    pParser = snparser_alloc();
   }
+  
+  /* Return the parser */
+  return pParser;
 }
 
 /*
- * Public functions
- * ================
- * 
- * (see the header for specifications)
+ * snpool_putparser function.
  */
+void snpool_putparser(SNPOOL *pPool, SNPARSER *pParser) {
+  
+  /* Check parameters */
+  if ((pPool == NULL) || (pParser == NULL)) {
+    abort();
+  }
+  
+  /* Keep the parser if there is room, else free it */
+  if (pPool->parser_count < pPool->max) {
+    snparser_recycle(pParser);
+    pParser->pPoolNext = pPool->pParsers;
+    pPool->pParsers = pParser;
+    (pPool->parser_count)++;
+    
+  } else {
+    snparser_free(pParser);
+  }
+}
 
 /*
- * snsource_file function.
+ * snpool_string function.
  */
-SNSOURCE *snsource_file(FILE *pFile, int owner) {
+SNSOURCE *snpool_string(SNPOOL *pPool, const char *pStr) {
   
   SNSOURCE *pSrc = NULL;
   
-  /* Call through to stream function */
-  if (owner) {
-    pSrc = snsource_stream(pFile, SNSTREAM_OWNER);
+  /* Check parameters */
+  if ((pPool == NULL) || (pStr == NULL)) {
+    abort();
+  }
+  
+  /* Take a kept source if there is one, else construct a new one */
+  if (pPool->pSources != NULL) {
+    pSrc = pPool->pSources;
+    pPool->pSources = pSrc->pPoolNext;
+    (pPool->source_count)--;
+    snsource_restring(pSrc, pStr);
+    
   } else {
-    pSrc = snsource_stream(pFile, SNSTREAM_NORMAL);
+    pSrc = snsource_string(pStr);
   }
   
-  /* Return new source */
+  /* Return the source */
   return pSrc;
 }
 
 /*
- * snsource_stream function.
+ * snpool_putsource function.
  */
-SNSOURCE *snsource_stream(FILE *pFile, int flags) {
-  
-  void (*pDestruct)(void *) = NULL;
-  int (*pRewind)(void *) = NULL;
+void snpool_putsource(SNPOOL *pPool, SNSOURCE *pSrc) {
   
   /* Check parameters */
-  if (pFile == NULL) {
+  if ((pPool == NULL) || (pSrc == NULL)) {
     abort();
   }
   
-  /* Set destructor based on OWNER flag */
-  if (flags & SNSTREAM_OWNER) {
-    pDestruct = &snsource_file_free;
+  /* Keep the source if it is a string source and there is room, else
+   * free it */
+  if ((pSrc->pfRead == &snsource_str_read) &&
+      (pPool->source_count < pPool->max)) {
+    pSrc->pPoolNext = pPool->pSources;
+    pPool->pSources = pSrc;
+    (pPool->source_count)++;
+    
   } else {
-    pDestruct = NULL;
+    snsource_free(pSrc);
   }
+}
+
+/*
+ * snbatch_alloc function.
+ */
+SNBATCH *snbatch_alloc(void) {
   
-  /* Set rewind routine based on RANDOM flag */
-  if (flags & SNSTREAM_RANDOM) {
-    pRewind = &snsource_file_rewind;
-  } else {
-    pRewind = NULL;
+  SNBATCH *pBatch = NULL;
+  
+  /* Allocate structure */
+  pBatch = (SNBATCH *) malloc(sizeof(SNBATCH));
+  if (pBatch == NULL) {
+    abort();
   }
+  memset(pBatch, 0, sizeof(SNBATCH));
   
-  /* Call through to construct object */
-  return snsource_custom(
-            &snsource_file_read,
-            pDestruct,
-            pRewind,
-            (void *) pFile);
+  /* Initialize -- columns are allocated when first needed */
+  pBatch->doc_count = 0;
+  pBatch->ent_count = 0;
+  pBatch->arena_len = 0;
+  pBatch->doc_cap = 0;
+  pBatch->ent_cap = 0;
+  pBatch->arena_cap = 0;
+  
+  pBatch->pParser = snparser_alloc();
+  pBatch->pSrc = snsource_memory("", 0);
+  
+  /* Return the new batch */
+  return pBatch;
 }
 
 /*
- * snsource_string function.
+ * snbatch_free function.
  */
-SNSOURCE *snsource_string(const char *pStr) {
+void snbatch_free(SNBATCH *pBatch) {
   
-  SNSTRSRC *pStS = NULL;
+  /* Only proceed if non-NULL parameter passed */
+  if (pBatch != NULL) {
+    
+    /* Release the columns; free() ignores NULL */
+    free(pBatch->pDocFirst);
+    free(pBatch->pDocEntities);
+    free(pBatch->pDocStatus);
+    free(pBatch->pDocLine);
+    
+    free(pBatch->pStatus);
+    free(pBatch->pStrType);
+    free(pBatch->pCount);
+    free(pBatch->pKey);
+    free(pBatch->pKeyLen);
+    free(pBatch->pValue);
+    free(pBatch->pValueLen);
+    
+    free(pBatch->pArena);
+    
+    /* Release the parser and source */
+    snparser_free(pBatch->pParser);
+    snsource_free(pBatch->pSrc);
+    
+    /* Release the structure */
+    free(pBatch);
+  }
+}
+
+/*
+ * snparse_many function.
+ */
+long snparse_many(
+    SNBATCH           * pBatch,
+    const char *const * ppDocs,
+    const long        * pLens,
+    long                count) {
   
-  /* Check parameter */
-  if (pStr == NULL) {
+  long failed = 0;
+  long d = 0;
+  long e = 0;
+  SNENTITY ent;
+  
+  /* Initialize structures */
+  memset(&ent, 0, sizeof(SNENTITY));
+  
+  /* Check parameters */
+  if ((pBatch == NULL) || (count < 0)) {
     abort();
   }
-  
-  /* Allocate new structure */
-  pStS = (SNSTRSRC *) malloc(sizeof(SNSTRSRC));
-  if (pStS == NULL) {
+  if ((count > 0) && ((ppDocs == NULL) || (pLens == NULL))) {
     abort();
   }
-  memset(pStS, 0, sizeof(SNSTRSRC));
   
-  /* Copy the pointer into the structure */
-  pStS->pStr = (const unsigned char *) pStr;
-  pStS->pRewind = (const unsigned char *) pStr;
+  /* Clear the batch, keeping the columns allocated */
+  pBatch->doc_count = 0;
+  pBatch->ent_count = 0;
+  pBatch->arena_len = 0;
   
-  /* Call through to construct object */
-  return snsource_custom(
-            &snsource_str_read,
-            &snsource_str_free,
-            &snsource_str_rewind,
-            (void *) pStS);
+  /* Parse each document with the same parser and source */
+  for(d = 0; d < count; d++) {
+    
+    /* Reset the parser and point the source at the document; lines are
+     * counted lazily since they are only needed for errors */
+    snparser_recycle(pBatch->pParser);
+    snparser_mode(pBatch->pParser, SNMODE_LAZYLINES);
+    snsource_rememory(pBatch->pSrc, ppDocs[d], pLens[d]);
+    
+    /* Start the document's range */
+    snbatch_reserveDoc(pBatch);
+    (pBatch->pDocFirst)[d] = pBatch->ent_count;
+    (pBatch->pDocEntities)[d] = 0;
+    (pBatch->pDocStatus)[d] = 0;
+    (pBatch->pDocLine)[d] = 0;
+    (pBatch->doc_count)++;
+    
+    /* Read entities into the columns up to EOF or error */
+    for(snparser_read(pBatch->pParser, &ent, pBatch->pSrc);
+        ent.status > 0;
+        snparser_read(pBatch->pParser, &ent, pBatch->pSrc)) {
+      
+      snbatch_reserveEnt(pBatch);
+      e = pBatch->ent_count;
+      
+      (pBatch->pStatus)[e] = ent.status;
+      (pBatch->pStrType)[e] = ent.str_type;
+      (pBatch->pCount)[e] = ent.count;
+      
+      if (ent.pKey != NULL) {
+        (pBatch->pKey)[e] = snbatch_store(pBatch, ent.pKey, ent.key_len);
+        (pBatch->pKeyLen)[e] = ent.key_len;
+      } else {
+        (pBatch->pKey)[e] = -1;
+        (pBatch->pKeyLen)[e] = 0;
+      }
+      
+      if (ent.pValue != NULL) {
+        (pBatch->pValue)[e] = snbatch_store(pBatch,
+                                ent.pValue, ent.value_len);
+        (pBatch->pValueLen)[e] = ent.value_len;
+      } else {
+        (pBatch->pValue)[e] = -1;
+        (pBatch->pValueLen)[e] = 0;
+      }
+      
+      (pBatch->ent_count)++;
+      ((pBatch->pDocEntities)[d])++;
+    }
+    
+    /* Record any error */
+    if (ent.status < 0) {
+      (pBatch->pDocStatus)[d] = ent.status;
+      (pBatch->pDocLine)[d] = snparser_count(pBatch->pParser);
+      failed++;
+    }
+  }
+  
+  /* Return the number of documents that failed */
+  return failed;
 }
 
 /*
- * snsource_custom function.
+ * snescape_decode function.
  */
-SNSOURCE *snsource_custom(
-    int (*read_func)(void *),
-    void (*free_func)(void *),
-    int (*rewind_func)(void *),
-    void *custom) {
+long snescape_decode(
+    char       * pDest,
+    const char * pSrc,
+    long         len,
+    int          dialect) {
   
-  SNSOURCE *pSrc = NULL;
+  long result = 0;
+  long r = 0;
+  long run = 0;
+  long cpv = 0;
+  long lo = 0;
+  int c = 0;
+  int elen = 0;
+  const char *pc = NULL;
+  unsigned char buf[5];
   
   /* Check parameters */
-  if (read_func == NULL) {
+  if ((pDest == NULL) || (pSrc == NULL) || (len < 0)) {
+    abort();
+  }
+  
+  /* Decode until the source is consumed or there is an error; r is the
+   * read position in the source and result is the write position in
+   * the destination, which never gets ahead of r */
+  while ((result >= 0) && (r < len)) {
+    
+    /* Find the next backslash and copy the run of bytes before it */
+    pc = (const char *) memchr(pSrc + r, ASCII_BACKSLASH,
+                                (size_t) (len - r));
+    if (pc != NULL) {
+      run = (long) (pc - (pSrc + r));
+    } else {
+      run = len - r;
+    }
+    
+    if ((run > 0) && (pDest + result != pSrc + r)) {
+      memmove(pDest + result, pSrc + r, (size_t) run);
+    }
+    result += run;
+    r += run;
+    
+    /* If no backslash remains, we are done */
+    if (pc == NULL) {
+      break;
+    }
+    
+    /* Get the character following the backslash */
+    r++;
+    if (r < len) {
+      c = (int) (((const unsigned char *) pSrc)[r]);
+      r++;
+    } else {
+      c = -1;
+    }
+    
+    /* Decode the escape */
+    cpv = -1;
+    if ((dialect & SNESC_BASIC) &&
+        ((c == ASCII_BACKSLASH) || (c == ASCII_DQUOTE) ||
+          (c == ASCII_LCURL) || (c == ASCII_RCURL))) {
+      cpv = c;
+    
+    } else if ((dialect & SNESC_CONTROL) && (c == ASCII_LOWER_N)) {
+      cpv = ASCII_LF;
+      
+    } else if ((dialect & SNESC_CONTROL) && (c == ASCII_LOWER_T)) {
+      cpv = ASCII_HT;
+      
+    } else if ((dialect & SNESC_UNICODE) && (c == ASCII_LOWER_U)) {
+      /* Four hex digits, which may be the high surrogate of a pair
+       * that must be followed by the low surrogate */
+      if (len - r >= 4) {
+        cpv = snutf_hex(pSrc + r);
+        if (cpv >= 0) {
+          r += 4;
+        }
+      }
+      
+      if ((cpv >= UNICODE_MIN_HI_SUR) && (cpv <= UNICODE_MAX_HI_SUR)) {
+        lo = -1;
+        if ((len - r >= 6) && (pSrc[r] == ASCII_BACKSLASH) &&
+            (pSrc[r + 1] == ASCII_LOWER_U)) {
+          lo = snutf_hex(pSrc + r + 2);
+        }
+        
+        if ((lo >= UNICODE_MIN_LO_SUR) && (lo <= UNICODE_MAX_LO_SUR)) {
+          cpv = snutf_pair(cpv, lo);
+          r += 6;
+        } else {
+          cpv = -1;
+        }
+        
+      } else if ((cpv >= UNICODE_MIN_LO_SUR) &&
+                  (cpv <= UNICODE_MAX_LO_SUR)) {
+        /* Low surrogate without a high surrogate */
+        cpv = -1;
+      }
+      
+      /* Nul is not allowed in decoded strings */
+      if (cpv == 0) {
+        cpv = -1;
+      }
+    }
+    
+    /* Write the decoded codepoint or fail */
+    if (cpv > 0) {
+      memset(buf, 0, 5);
+      snutf_encode(cpv, buf);
+      elen = (int) strlen((const char *) buf);
+      memcpy(pDest + result, buf, (size_t) elen);
+      result += elen;
+      
+    } else {
+      result = SNERR_ESCAPE;
+    }
+  }
+  
+  /* Terminate the decoded string */
+  if (result >= 0) {
+    pDest[result] = (char) 0;
+  }
+  
+  /* Return length or error */
+  return result;
+}
+
+/*
+ * snschema_compile function.
+ */
+SNSCHEMA *snschema_compile(SNSOURCE *pIn, int *pErr, long *pLine) {
+  
+  SNSCHEMA *pSchema = NULL;
+  SNPARSER *pParser = NULL;
+  SNENTITY ent;
+  int err_code = 0;
+  int directive = SNSCHEMA_DIR_NAME;
+  int shape = 0;
+  int done = 0;
+  long line = 0;
+  
+  /* Initialize structures */
+  memset(&ent, 0, sizeof(SNENTITY));
+  
+  /* Check parameter */
+  if (pIn == NULL) {
     abort();
   }
   
-  /* Allocate structure */
-  pSrc = (SNSOURCE *) malloc(sizeof(SNSOURCE));
-  if (pSrc == NULL) {
-    abort();
+  /* Allocate an empty schema and a parser to read it with */
+  pSchema = (SNSCHEMA *) calloc(1, sizeof(SNSCHEMA));
+  if (pSchema == NULL) {
+    abort();
+  }
+  pParser = snparser_alloc();
+  
+  /* Compile each entity */
+  while ((!err_code) && (!done)) {
+    snparser_read(pParser, &ent, pIn);
+    
+    if (ent.status < 0) {
+      /* Parsing error */
+      err_code = ent.status;
+      
+    } else if (ent.status == SNENTITY_EOF) {
+      /* End of schema */
+      done = 1;
+      
+    } else if (ent.status == SNENTITY_BEGIN_META) {
+      /* Next token names the metacommand */
+      directive = SNSCHEMA_DIR_NAME;
+      
+    } else if ((ent.status == SNENTITY_META_TOKEN) &&
+                (directive == SNSCHEMA_DIR_NAME)) {
+      /* Begin a metacommand; the signature may only be given once */
+      if ((strcmp(ent.pKey, "signature") == 0) && (!pSchema->has_sig)) {
+        pSchema->has_sig = 1;
+        directive = SNSCHEMA_DIR_SIGNATURE;
+        
+      } else if (strcmp(ent.pKey, "operators") == 0) {
+        pSchema->has_ops = 1;
+        directive = SNSCHEMA_DIR_OPERATORS;
+        
+      } else if (strcmp(ent.pKey, "prefixes") == 0) {
+        pSchema->has_prefixes = 1;
+        directive = SNSCHEMA_DIR_PREFIXES;
+        
+      } else if (strcmp(ent.pKey, "numeric") == 0) {
+        pSchema->has_numeric = 1;
+        directive = SNSCHEMA_DIR_NUMERIC;
+        
+      } else {
+        err_code = SNERR_SCHEMA;
+      }
+      
+    } else if (ent.status == SNENTITY_META_TOKEN) {
+      /* Token within a metacommand */
+      if (directive == SNSCHEMA_DIR_SIGNATURE) {
+        snnames_add(pSchema, &(pSchema->sig), ent.pKey, ent.key_len, 0);
+        
+      } else if (directive == SNSCHEMA_DIR_OPERATORS) {
+        if (snnames_find(pSchema, &(pSchema->ops),
+              ent.pKey, ent.key_len) == 0) {
+          snnames_add(pSchema, &(pSchema->ops), ent.pKey, ent.key_len, 1);
+        } else {
+          err_code = SNERR_SCHEMA;
+        }
+        
+      } else if (directive == SNSCHEMA_DIR_NUMERIC) {
+        shape = 0;
+        if (strcmp(ent.pKey, "integer") == 0) {
+          shape = SNSHAPE_INTEGER;
+        } else if (strcmp(ent.pKey, "decimal") == 0) {
+          shape = SNSHAPE_DECIMAL;
+        } else if (strcmp(ent.pKey, "exponent") == 0) {
+          shape = SNSHAPE_EXPONENT;
+        } else if (strcmp(ent.pKey, "hex") == 0) {
+          shape = SNSHAPE_HEX;
+        } else {
+          err_code = SNERR_SCHEMA;
+        }
+        pSchema->shapes |= shape;
+        
+      } else {
+        err_code = SNERR_SCHEMA;
+      }
+      
+    } else if ((ent.status == SNENTITY_META_STRING) &&
+                (directive == SNSCHEMA_DIR_PREFIXES)) {
+      /* Prefix within a prefixes metacommand */
+      if (snnames_find(pSchema, &(pSchema->prefixes),
+            ent.pKey, ent.key_len) == 0) {
+        snnames_add(pSchema, &(pSchema->prefixes),
+          ent.pKey, ent.key_len, 1);
+      } else {
+        err_code = SNERR_SCHEMA;
+      }
+      
+    } else if (ent.status == SNENTITY_END_META) {
+      /* Metacommands must be named and signatures must not be empty */
+      if ((directive == SNSCHEMA_DIR_NAME) ||
+          ((directive == SNSCHEMA_DIR_SIGNATURE) &&
+            ((pSchema->sig).count < 1))) {
+        err_code = SNERR_SCHEMA;
+      }
+      
+    } else {
+      /* Anything else is not allowed in a schema */
+      err_code = SNERR_SCHEMA;
+    }
+  }
+  
+  /* Get the line of any error and release the parser */
+  if (err_code) {
+    line = snparser_count(pParser);
   }
-  memset(pSrc, 0, sizeof(SNSOURCE));
-  
-  /* Initialize structure */
-  pSrc->pfRead = read_func;
-  pSrc->pfDestruct = free_func;
-  pSrc->pfRewind = rewind_func;
+  snparser_free(pParser);
   
-  pSrc->read_count = 0;
-  pSrc->status = 0;
-  pSrc->pCustom = custom;
+  /* Free the schema on error */
+  if (err_code) {
+    snschema_free(pSchema);
+    pSchema = NULL;
+  }
   
-  /* If a rewind routine was provided, rewind right away; errors ignored
-   * since they will immediately set structure into IOERR status */
-  if (rewind_func != NULL) {
-    snsource_rewind(pSrc);
+  /* Report the error and line */
+  if (pErr != NULL) {
+    *pErr = err_code;
+  }
+  if (pLine != NULL) {
+    *pLine = line;
   }
   
-  /* Return the new source object */
-  return pSrc;
+  /* Return the schema or NULL */
+  return pSchema;
 }
 
 /*
- * snsource_free function.
+ * snschema_free function.
  */
-void snsource_free(SNSOURCE *pSrc) {
-  
-  /* Only proceed if non-NULL parameter passed */
-  if (pSrc != NULL) {
-    
-    /* If destructor is defined, call it */
-    if (pSrc->pfDestruct != NULL) {
-      (*(pSrc->pfDestruct))(pSrc->pCustom);
+void snschema_free(SNSCHEMA *pSchema) {
+  
+  if (pSchema != NULL) {
+    snnames_free(&(pSchema->sig));
+    snnames_free(&(pSchema->ops));
+    snnames_free(&(pSchema->prefixes));
+    if (pSchema->pArena != NULL) {
+      free(pSchema->pArena);
     }
-    
-    /* Release the structure */
-    free(pSrc);
+    free(pSchema);
   }
 }
 
 /*
- * snsource_bytes function.
+ * snschema_op function.
  */
-long snsource_bytes(SNSOURCE *pSrc) {
+long snschema_op(const SNSCHEMA *pSchema, const char *pName) {
   
-  /* Check parameter */
-  if (pSrc == NULL) {
+  long result = 0;
+  
+  /* Check parameters */
+  if ((pSchema == NULL) || (pName == NULL)) {
     abort();
   }
   
-  /* Return count */
-  return pSrc->read_count;
+  /* Look up the name */
+  result = snnames_find(pSchema, &(pSchema->ops),
+              pName, (long) strlen(pName));
+  
+  /* Return result */
+  return result;
 }
 
 /*
- * snsource_consume function.
+ * snschema_prefix function.
  */
-int snsource_consume(SNSOURCE *pSrc) {
+long snschema_prefix(const SNSCHEMA *pSchema, const char *pPrefix) {
   
-  long c = 0;
-  int result = 0;
+  long result = 0;
   
-  /* Check parameter */
-  if (pSrc == NULL) {
+  /* Check parameters */
+  if ((pSchema == NULL) || (pPrefix == NULL)) {
     abort();
   }
   
-  /* Keep reading until we get something besides SP HT CR LF */
-  for(c = snsource_readCPV(pSrc);
-      (c == ASCII_SP) || (c == ASCII_HT) ||
-      (c == ASCII_CR) || (c == ASCII_LF);
-      c = snsource_readCPV(pSrc));
-  
-  /* Set result depending on what we stopped on */
-  if (c == SNERR_EOF) {
-    /* Nothing but whitespace and blank lines present, so succeed */
-    result = 1;
-  
-  } else if (c == SNERR_IOERR) {
-    /* I/O error, so return that */
-    result = SNERR_IOERR;
-    
-  } else {
-    /* In all other cases, including data bytes besides whitespace and
-     * line breaks and other kinds of errors, return a trailer error */
-    result = SNERR_TRAILER;
-  }
+  /* Look up the prefix */
+  result = snnames_find(pSchema, &(pSchema->prefixes),
+              pPrefix, (long) strlen(pPrefix));
   
   /* Return result */
   return result;
 }
 
 /*
- * snsource_ismulti function.
+ * snanalyzer_alloc function.
  */
-int snsource_ismulti(SNSOURCE *pSrc) {
+SNANALYZER *snanalyzer_alloc(void) {
   
-  int result = 0;
+  SNANALYZER *pAn = NULL;
   
-  /* Check parameter */
-  if (pSrc == NULL) {
+  /* Allocate an empty analyzer */
+  pAn = (SNANALYZER *) calloc(1, sizeof(SNANALYZER));
+  if (pAn == NULL) {
     abort();
   }
   
-  /* Presence of rewind function determines multipass support */
-  if (pSrc->pfRewind != NULL) {
-    result = 1;
-  } else {
-    result = 0;
-  }
+  /* Begin with the top level frame */
+  snanalyzer_reset(pAn);
   
-  /* Return result */
-  return result;
+  /* Return the analyzer */
+  return pAn;
 }
 
 /*
- * snsource_rewind function.
+ * snanalyzer_free function.
  */
-int snsource_rewind(SNSOURCE *pSrc) {
+void snanalyzer_free(SNANALYZER *pAn) {
   
-  int status = 1;
+  if (pAn != NULL) {
+    snnames_free(&((pAn->names).ops));
+    if ((pAn->names).pArena != NULL) {
+      free((pAn->names).pArena);
+    }
+    if (pAn->pPops != NULL) {
+      free(pAn->pPops);
+    }
+    if (pAn->pPushes != NULL) {
+      free(pAn->pPushes);
+    }
+    if (pAn->pFrames != NULL) {
+      free(pAn->pFrames);
+    }
+    if (pAn->pGroups != NULL) {
+      free(pAn->pGroups);
+    }
+    if (pAn->pErrs != NULL) {
+      free(pAn->pErrs);
+    }
+    free(pAn);
+  }
+}
+
+/*
+ * snanalyzer_effect function.
+ */
+void snanalyzer_effect(
+    SNANALYZER * pAn,
+    const char * pName,
+    int          pops,
+    int          pushes) {
+  
+  long len = 0;
+  long id = 0;
+  long newcap = 0;
   
-  /* Check parameter and state */
-  if (pSrc == NULL) {
+  /* Check parameters */
+  if ((pAn == NULL) || (pName == NULL) ||
+      ((pops < 0) && (pops != SNEFFECT_ANY)) ||
+      ((pushes < 0) && (pushes != SNEFFECT_ANY))) {
     abort();
   }
-  if (pSrc->pfRewind == NULL) {
-    abort();
+  
+  /* Find the operation, adding it if it is new */
+  len = (long) strlen(pName);
+  id = snnames_find(&(pAn->names), &((pAn->names).ops), pName, len);
+  if (id == 0) {
+    id = snnames_add(&(pAn->names), &((pAn->names).ops), pName, len, 1);
   }
   
-  /* If source currently in EOF state, clear that */
-  if (pSrc->status == SNERR_EOF) {
-    pSrc->status = 0;
+  /* Grow the effect arrays if necessary */
+  if (id > pAn->effect_cap) {
+    newcap = pAn->effect_cap * 2;
+    if (newcap < id) {
+      newcap = id;
+    }
+    pAn->pPops = (int *) snbatch_grow(pAn->pPops, newcap, sizeof(int));
+    pAn->pPushes = (int *) snbatch_grow(
+                      pAn->pPushes, newcap, sizeof(int));
+    pAn->effect_cap = newcap;
   }
   
-  /* If we are in an error state, rewind fails */
-  if (pSrc->status != 0) {
-    status = 0;
+  /* Store the effect */
+  (pAn->pPops)[id - 1] = pops;
+  (pAn->pPushes)[id - 1] = pushes;
+}
+
+/*
+ * snanalyzer_reset function.
+ */
+void snanalyzer_reset(SNANALYZER *pAn) {
+  
+  /* Check parameter */
+  if (pAn == NULL) {
+    abort();
   }
   
-  /* Attempt to rewind the source */
-  if (status) {
-    if (!(*(pSrc->pfRewind))(pSrc->pCustom)) {
-      status = 0;
-      pSrc->status = SNERR_IOERR;
-    }
+  /* Make sure there is room for the top level frame */
+  if (pAn->frame_cap < 1) {
+    pAn->pFrames = (SNFRAME *) snbatch_grow(
+                      pAn->pFrames, SNANALYZER_FRAMES_INIT,
+                      sizeof(SNFRAME));
+    pAn->frame_cap = SNANALYZER_FRAMES_INIT;
   }
   
-  /* If we rewound successfully, clear the read counter */
-  if (status) {
-    pSrc->read_count = 0;
+  /* Clear results and begin with only the top level frame, which is
+   * never checked */
+  memset(pAn->pFrames, 0, sizeof(SNFRAME));
+  (pAn->pFrames)[0].group = -1;
+  pAn->frame_count = 1;
+  pAn->group_count = 0;
+  pAn->err_count = 0;
+}
+
+/*
+ * snanalyzer_entity function.
+ */
+void snanalyzer_entity(
+    SNANALYZER     * pAn,
+    const SNENTITY * pEntity,
+    long             line,
+    long             offset) {
+  
+  SNFRAME *pf = NULL;
+  long id = 0;
+  long newcap = 0;
+  int mark = 0;
+  
+  /* Check parameters */
+  if ((pAn == NULL) || (pEntity == NULL)) {
+    abort();
   }
   
-  /* Return status of operation */
-  return status;
+  switch (pEntity->status) {
+    
+    case SNENTITY_STRING:
+    case SNENTITY_NUMERIC:
+    case SNENTITY_GET:
+    case SNENTITY_ARRAY:
+      snanalyzer_apply(pAn, 0, 1, line, offset);
+      break;
+    
+    case SNENTITY_VARIABLE:
+    case SNENTITY_CONSTANT:
+    case SNENTITY_ASSIGN:
+      snanalyzer_apply(pAn, 1, 0, line, offset);
+      break;
+    
+    case SNENTITY_OPERATION:
+      id = snnames_find(&(pAn->names), &((pAn->names).ops),
+              pEntity->pKey, pEntity->key_len);
+      if (id != 0) {
+        snanalyzer_apply(pAn, (pAn->pPops)[id - 1],
+          (pAn->pPushes)[id - 1], line, offset);
+      } else {
+        snanalyzer_apply(pAn, SNEFFECT_ANY, SNEFFECT_ANY, line, offset);
+      }
+      break;
+    
+    case SNENTITY_BEGIN_GROUP:
+      /* Add an unknown marker for the new group */
+      if (pAn->group_count >= pAn->group_cap) {
+        newcap = pAn->group_cap * 2;
+        if (newcap < SNANALYZER_GROUPS_INIT) {
+          newcap = SNANALYZER_GROUPS_INIT;
+        }
+        pAn->pGroups = (unsigned char *) snbatch_grow(
+                          pAn->pGroups, newcap, 1);
+        pAn->group_cap = newcap;
+      }
+      (pAn->pGroups)[pAn->group_count] = (unsigned char) SNGROUP_UNKNOWN;
+      
+      /* Push a frame with a known depth of zero */
+      if (pAn->frame_count >= pAn->frame_cap) {
+        newcap = pAn->frame_cap * 2;
+        pAn->pFrames = (SNFRAME *) snbatch_grow(
+                          pAn->pFrames, newcap, sizeof(SNFRAME));
+        pAn->frame_cap = newcap;
+      }
+      pf = &((pAn->pFrames)[pAn->frame_count]);
+      pf->depth = 0;
+      pf->known = 1;
+      pf->bad = 0;
+      pf->group = pAn->group_count;
+      (pAn->frame_count)++;
+      (pAn->group_count)++;
+      break;
+    
+    case SNENTITY_END_GROUP:
+      if (pAn->frame_count < 2) {
+        abort();
+      }
+      pf = &((pAn->pFrames)[pAn->frame_count - 1]);
+      
+      /* Check that exactly one value is left */
+      if ((!pf->bad) && pf->known && (pf->depth != 1)) {
+        snanalyzer_error(pAn, SNERR_GROUPSIZE, line, offset);
+      }
+      
+      /* Mark the group */
+      if (pf->bad) {
+        mark = SNGROUP_INVALID;
+      } else if (pf->known) {
+        mark = SNGROUP_PROVEN;
+      } else {
+        mark = SNGROUP_UNKNOWN;
+      }
+      (pAn->pGroups)[pf->group] = (unsigned char) mark;
+      
+      /* The group leaves one value in the enclosing frame */
+      (pAn->frame_count)--;
+      snanalyzer_apply(pAn, 0, 1, line, offset);
+      break;
+    
+    default:
+      /* Errors, EOF, and metacommands have no effect */
+      break;
+  }
 }
 
 /*
- * snparser_alloc function.
+ * snanalyzer_run function.
  */
-SNPARSER *snparser_alloc(void) {
+long snanalyzer_run(SNANALYZER *pAn, SNPARSER *pParser, SNSOURCE *pIn) {
   
-  SNPARSER *pParser = NULL;
+  SNENTITY ent;
+  long result = 0;
   
-  /* Allocate structure */
-  pParser = (SNPARSER *) malloc(sizeof(SNPARSER));
-  if (pParser == NULL) {
+  /* Initialize structures */
+  memset(&ent, 0, sizeof(SNENTITY));
+  
+  /* Check parameters */
+  if ((pAn == NULL) || (pParser == NULL) || (pIn == NULL)) {
     abort();
   }
-  memset(pParser, 0, sizeof(SNPARSER));
   
-  /* Initialize */
-  snreader_init(&(pParser->reader));
-  snfilter_reset(&(pParser->filter));
+  /* Analyze each entity up to EOF or error */
+  snanalyzer_reset(pAn);
+  for(snparser_read(pParser, &ent, pIn);
+      ent.status > 0;
+      snparser_read(pParser, &ent, pIn)) {
+    snanalyzer_entity(pAn, &ent,
+      snparser_count(pParser), snsource_bytes(pIn));
+  }
   
-  /* Return parser */
-  return pParser;
+  /* Return the parsing error or the number of errors */
+  if (ent.status < 0) {
+    result = ent.status;
+  } else {
+    result = pAn->err_count;
+  }
+  return result;
 }
 
 /*
- * snparser_free function.
+ * snanalyzer_errcount function.
  */
-void snparser_free(SNPARSER *pParser) {
+long snanalyzer_errcount(const SNANALYZER *pAn) {
   
-  /* Only do something if not NULL */
-  if (pParser != NULL) {
-    /* Fully reset reader and release */
-    snreader_reset(&(pParser->reader), 1);
-    free(pParser);
+  /* Check parameter */
+  if (pAn == NULL) {
+    abort();
   }
+  
+  /* Return count */
+  return pAn->err_count;
 }
 
 /*
- * snparser_read function.
+ * snanalyzer_errinfo function.
  */
-void snparser_read(
-    SNPARSER * pParser,
-    SNENTITY * pEntity,
-    SNSOURCE * pIn) {
+void snanalyzer_errinfo(const SNANALYZER *pAn, long i, SNERRINFO *pInfo) {
   
   /* Check parameters */
-  if ((pParser == NULL) || (pEntity == NULL) || (pIn == NULL)) {
+  if ((pAn == NULL) || (pInfo == NULL)) {
+    abort();
+  }
+  if ((i < 0) || (i >= pAn->err_count)) {
     abort();
   }
   
-  /* Call through to reader */
-  snreader_read(&(pParser->reader), pEntity, pIn, &(pParser->filter));
+  /* Copy the error */
+  memcpy(pInfo, &((pAn->pErrs)[i]), sizeof(SNERRINFO));
 }
 
 /*
- * snparser_count function.
+ * snanalyzer_groups function.
  */
-long snparser_count(SNPARSER *pParser) {
+long snanalyzer_groups(const SNANALYZER *pAn) {
   
   /* Check parameter */
-  if (pParser == NULL) {
+  if (pAn == NULL) {
     abort();
   }
   
-  /* Return line count */
-  return snfilter_count(&(pParser->filter));
+  /* Return count */
+  return pAn->group_count;
+}
+
+/*
+ * snanalyzer_group function.
+ */
+int snanalyzer_group(const SNANALYZER *pAn, long g) {
+  
+  /* Check parameters */
+  if (pAn == NULL) {
+    abort();
+  }
+  if ((g < 0) || (g >= pAn->group_count)) {
+    abort();
+  }
+  
+  /* Return marker */
+  return (int) (pAn->pGroups)[g];
 }
 
 /*
@@ -4395,6 +11871,62 @@ const char *snerror_str(int code) {
       pResult = "Invalid UTF-8 encountered in input";
       break;
     
+    case SNERR_CANCELLED:
+      pResult = "Parsing cancelled";
+      break;
+    
+    case SNERR_BUDGET:
+      pResult = "Parser memory budget exceeded";
+      break;
+    
+    case SNERR_ESCAPE:
+      pResult = "Invalid escape sequence in string";
+      break;
+    
+    case SNERR_DECODE:
+      pResult = "String decoder rejected data";
+      break;
+    
+    case SNERR_SCHEMA:
+      pResult = "Invalid schema";
+      break;
+    
+    case SNERR_SIGNATURE:
+      pResult = "Missing or wrong signature";
+      break;
+    
+    case SNERR_OPERATOR:
+      pResult = "Operation not allowed by schema";
+      break;
+    
+    case SNERR_PREFIX:
+      pResult = "String prefix not allowed by schema";
+      break;
+    
+    case SNERR_NUMERIC:
+      pResult = "Numeric not allowed by schema";
+      break;
+    
+    case SNERR_UNDERFLOW:
+      pResult = "Stack effect pops hidden values";
+      break;
+    
+    case SNERR_GROUPSIZE:
+      pResult = "Group does not leave exactly one value";
+      break;
+      
+    case SNERR_LONGMETA:
+      pResult = "Metacommand is too long";
+      break;
+    
+    case SNERR_INCLUDE:
+      pResult = "Included file could not be read";
+      break;
+
+    case SNERR_DEEPINCLUDE:
+      pResult = "Too much include nesting";
+      break;
+
     default:
       pResult = "Unknown error";
   }
@@ -37,6 +37,20 @@
 #define SNERR_OPENARRAY (-21) /* Unclosed array */
 #define SNERR_COMMA     (-22) /* Comma used outside of array or meta */
 #define SNERR_UTF8      (-23) /* Invalid UTF-8 in input */
+#define SNERR_CANCELLED (-24) /* Parsing cancelled or deadline passed */
+#define SNERR_BUDGET    (-25) /* Parser memory budget exceeded */
+#define SNERR_ESCAPE    (-26) /* Invalid escape sequence in string */
+#define SNERR_DECODE    (-27) /* String decoder rejected data */
+#define SNERR_SCHEMA    (-28) /* Invalid schema */
+#define SNERR_SIGNATURE (-29) /* Missing or wrong signature */
+#define SNERR_OPERATOR  (-30) /* Operation not allowed by schema */
+#define SNERR_PREFIX    (-31) /* String prefix not allowed by schema */
+#define SNERR_NUMERIC   (-32) /* Numeric not allowed by schema */
+#define SNERR_UNDERFLOW (-33) /* Stack effect pops hidden values */
+#define SNERR_GROUPSIZE (-34) /* Group does not leave exactly one value */
+#define SNERR_LONGMETA  (-35) /* Metacommand is too long */
+#define SNERR_INCLUDE   (-36) /* Included file could not be read */
+#define SNERR_DEEPINCLUDE (-37) /* Too much include nesting */
 
 /*
  * Flags for use with snsource_stream().
@@ -57,6 +71,93 @@
 #define SNSTREAM_OWNER    (1)
 #define SNSTREAM_RANDOM   (2)
 
+/*
+ * Flags for use with snparser_mode().
+ * 
+ * SNMODE_NORMAL has a value of zero, meaning no special flags set.  The
+ * other flags can be combined with bitwise OR.
+ * 
+ * If LAZYLINES flag is set, then the parser does not count lines as it
+ * reads.  It only keeps track of byte offsets, and snparser_count()
+ * computes the line count on demand from a line-start index of the
+ * source, which is built lazily the first time a line count is
+ * requested.  This makes reading faster for clients that only need
+ * line numbers when reporting errors.  Lazy line counting requires a
+ * source that has a memory view of its data, such as the sources
+ * constructed by snsource_string().  For all other sources, the flag is
+ * ignored and lines are counted as normal.
+ * 
+ * If SPANS flag is set, then the parser records the source span of each
+ * entity in the start, end, and col fields of the SNENTITY structure.
+ * See the structure documentation for further information.
+ * 
+ * If RECOVER flag is set, then the parser does not stop at the first
+ * error it encounters.  Instead, it records the error, skips ahead to a
+ * point where it can resynchronize, and continues parsing, so that all
+ * the errors in a source file can be found in a single pass.  Use
+ * snparser_errcount() and snparser_errinfo() to get the errors that
+ * were recorded.  Errors that can not be recovered from still stop the
+ * parser as normal.  See snparser_errcount() for further information.
+ */
+#define SNMODE_NORMAL     (0)
+#define SNMODE_LAZYLINES  (1)
+#define SNMODE_SPANS      (2)
+#define SNMODE_RECOVER    (4)
+
+/*
+ * Escape dialect flags for use with snescape_decode() and
+ * snparser_unescape().
+ * 
+ * The flags can be combined with bitwise OR.  Each flag enables a set
+ * of escape sequences:
+ * 
+ *   SNESC_BASIC enables \\ \" \{ and \} which decode to the second
+ *   character of the sequence.
+ * 
+ *   SNESC_CONTROL enables \n and \t which decode to line feed and
+ *   horizontal tab.
+ * 
+ *   SNESC_UNICODE enables \uXXXX where XXXX is four hexadecimal digits
+ *   that select a Unicode codepoint, which is encoded in UTF-8.  A high
+ *   surrogate must be immediately followed by a \uXXXX escape that
+ *   selects a low surrogate, and the pair selects a supplemental
+ *   codepoint.  Escapes for unpaired surrogates and for nul are not
+ *   allowed.
+ * 
+ * Backslashes that do not begin an enabled escape sequence are errors.
+ */
+#define SNESC_BASIC   (1)
+#define SNESC_CONTROL (2)
+#define SNESC_UNICODE (4)
+
+/*
+ * Binary-to-text encodings supported by the built-in string decoders.
+ * 
+ * See snparser_blob().
+ */
+#define SNBLOB_BASE64 (1)
+#define SNBLOB_BASE16 (2)
+
+/*
+ * Special stack effect count for use with snanalyzer_effect().
+ * 
+ * SNEFFECT_ANY means that an operation pops or pushes a number of
+ * values that is only known at runtime.
+ */
+#define SNEFFECT_ANY (-1)
+
+/*
+ * Group markers returned by snanalyzer_group().
+ * 
+ * PROVEN groups always leave exactly one value on the stack, so the
+ * runtime does not need to check them.  INVALID groups never do, and an
+ * error has been recorded for them.  UNKNOWN groups depend on values
+ * that are only known at runtime, so the runtime must still check them.
+ */
+#define SNGROUP_UNKNOWN (0)
+#define SNGROUP_PROVEN  (1)
+#define SNGROUP_INVALID (2)
+
 /*
  * The types of entities.
  */
@@ -98,6 +199,38 @@ typedef struct SNSOURCE_TAG SNSOURCE;
 struct SNPARSER_TAG;
 typedef struct SNPARSER_TAG SNPARSER;
 
+/*
+ * The SNPOOL structure prototype.
+ * 
+ * The actual structure definition is given in the implementation file.
+ */
+struct SNPOOL_TAG;
+typedef struct SNPOOL_TAG SNPOOL;
+
+/*
+ * The SNSCHEMA structure prototype.
+ * 
+ * The actual structure definition is given in the implementation file.
+ */
+struct SNSCHEMA_TAG;
+typedef struct SNSCHEMA_TAG SNSCHEMA;
+
+/*
+ * The SNANALYZER structure prototype.
+ * 
+ * The actual structure definition is given in the implementation file.
+ */
+struct SNANALYZER_TAG;
+typedef struct SNANALYZER_TAG SNANALYZER;
+
+/*
+ * The SNINCCACHE structure prototype.
+ * 
+ * The actual structure definition is given in the implementation file.
+ */
+struct SNINCCACHE_TAG;
+typedef struct SNINCCACHE_TAG SNINCCACHE;
+
 /*
  * Structure for an entity read from a Shastina source file.
  */
@@ -138,6 +271,14 @@ typedef struct {
    */
   char *pKey;
   
+  /*
+   * The length in bytes of the key string, not including the
+   * terminating nul.
+   * 
+   * For entities where pKey is NULL, this is set to zero and ignored.
+   */
+  long key_len;
+  
   /*
    * Pointer to the null-terminated value string.
    * 
@@ -153,6 +294,14 @@ typedef struct {
    */
   char *pValue;
   
+  /*
+   * The length in bytes of the value string, not including the
+   * terminating nul.
+   * 
+   * For entities where pValue is NULL, this is set to zero and ignored.
+   */
+  long value_len;
+  
   /*
    * The string type.
    * 
@@ -174,386 +323,2300 @@ typedef struct {
    */
   long count;
   
+  /*
+   * The byte offset of the start of the entity within the source.
+   * 
+   * This is only filled in if the parser has the SNMODE_SPANS flag set.
+   * Otherwise, it is set to zero and ignored.
+   * 
+   * Offsets are counted in the same way as snsource_bytes(), so that
+   * the entity occupies bytes start up to but excluding end.  For
+   * string entities, the span includes the prefix and the quotes or
+   * curly brackets.
+   * 
+   * Spans are recorded per token.  When a single token generates more
+   * than one entity, all those entities have the span of the token.
+   * For example, the END_GROUP and ARRAY entities generated by "]" both
+   * have the span of the "]", and the BEGIN_GROUP entity that begins
+   * the first element of an array has the span of the first token of
+   * the element.
+   * 
+   * The offsets saturate at LONG_MAX.
+   */
+  long start;
+  
+  /*
+   * The byte offset of the first byte following the entity within the
+   * source.
+   * 
+   * This is only filled in if the parser has the SNMODE_SPANS flag set.
+   * Otherwise, it is set to zero and ignored.  See the start field for
+   * further information.
+   */
+  long end;
+  
+  /*
+   * The column that the entity starts on.
+   * 
+   * This is only filled in if the parser has the SNMODE_SPANS flag set.
+   * Otherwise, it is set to zero and ignored.
+   * 
+   * The column is one greater than the number of bytes between the
+   * start of the line and start.  Note that columns count bytes, not
+   * codepoints.  The line the entity starts on is the value of
+   * snparser_count() immediately after reading the entity, except for
+   * string entities that span several lines.
+   */
+  long col;
+  
+  /*
+   * The schema ID of the entity.
+   * 
+   * This is only filled in if the parser has a schema with an operator
+   * set or a prefix set (see snparser_schema()).  For OPERATION
+   * entities, it is the ID of the operation in the operator set.  For
+   * STRING entities, it is the ID of the string prefix in the prefix
+   * set.  IDs are numbered from one in the order the names appear in
+   * the schema.
+   * 
+   * For all other entities, and without a schema, this is set to zero
+   * and ignored.
+   */
+  long id;
+  
 } SNENTITY;
 
 /*
- * Simple wrapper around snsource_stream().
+ * The size of the inline key area of compact entities.
  * 
- * If owner is non-zero, then the flags will be SNSTREAM_OWNER.  If the
- * owner is zero, then the flags will be SNSTREAM_NORMAL (zero).
+ * Keys up to one less than this many bytes are stored inline, leaving
+ * room for the terminating nul.
+ */
+#define SNCOMPACT_INLINE (24)
+
+/*
+ * Compact variant of an entity, read with snparser_readc().
  * 
- * Parameters:
+ * The fields have the same meaning as the fields of the same name in
+ * SNENTITY, except for the key.  Short keys are stored by value in the
+ * inline key area, so they remain valid however long the compact entity
+ * is kept and wherever it is copied, without any string allocation.
  * 
- *   pFile - the file handle to wrap
+ * Use sncompact_key() to get the key regardless of where it is stored.
+ */
+typedef struct {
+  
+  /*
+   * The status of the entity.
+   * 
+   * See SNENTITY.
+   */
+  int status;
+  
+  /*
+   * The string type.
+   * 
+   * See SNENTITY.
+   */
+  int str_type;
+  
+  /*
+   * The count value.
+   * 
+   * See SNENTITY.
+   */
+  long count;
+  
+  /*
+   * The length in bytes of the key string, not including the
+   * terminating nul.
+   * 
+   * This is zero for entities that have no key.
+   */
+  long key_len;
+  
+  /*
+   * Pointer to the key string if it is too long to be stored inline,
+   * otherwise NULL.
+   * 
+   * Like the pKey field of SNENTITY, the pointer is only valid until
+   * the next entity is read.
+   */
+  char *pLongKey;
+  
+  /*
+   * Pointer to the value string, or NULL.
+   * 
+   * See SNENTITY.  Values are never stored inline.
+   */
+  char *pValue;
+  
+  /*
+   * The length in bytes of the value string.
+   * 
+   * See SNENTITY.
+   */
+  long value_len;
+  
+  /*
+   * The source span of the entity.
+   * 
+   * See SNENTITY.
+   */
+  long start;
+  long end;
+  long col;
+  
+  /*
+   * The schema ID of the entity.
+   * 
+   * See SNENTITY.
+   */
+  long id;
+  
+  /*
+   * The inline key area.
+   * 
+   * If key_len is less than SNCOMPACT_INLINE, this holds the
+   * nul-terminated key, which is empty for entities that have no key.
+   * Otherwise, this holds an empty string and the key is at pLongKey.
+   */
+  char key[SNCOMPACT_INLINE];
+  
+} SNCOMPACT;
+
+/*
+ * Columnar results of parsing many documents with snparse_many().
+ * 
+ * Allocate with snbatch_alloc() and free with snbatch_free().  All
+ * fields are read-only to clients.
+ * 
+ * Each document has a range of entities in the entity columns, which
+ * starts at index pDocFirst[d] and has pDocEntities[d] entities.  The
+ * EOF entity is not stored.  If the document failed to parse,
+ * pDocStatus[d] is the SNERR_ code and pDocLine[d] is the line number
+ * of the error, and the range holds the entities read before the error.
+ * Otherwise both are zero.
+ * 
+ * The entity columns hold the fields of the same name in SNENTITY for
+ * each entity.  Keys and values are copied into a single string arena,
+ * and the pKey and pValue columns hold offsets into the arena, or -1 if
+ * the entity has no key or value.  Strings in the arena are
+ * nul-terminated.
+ * 
+ * Everything in the batch remains valid until the batch is reused or
+ * freed.
+ */
+typedef struct {
+  
+  /*
+   * The number of documents, and the document columns.
+   */
+  long doc_count;
+  long *pDocFirst;
+  long *pDocEntities;
+  int *pDocStatus;
+  long *pDocLine;
+  
+  /*
+   * The number of entities in all documents, and the entity columns.
+   */
+  long ent_count;
+  int *pStatus;
+  int *pStrType;
+  long *pCount;
+  long *pKey;
+  long *pKeyLen;
+  long *pValue;
+  long *pValueLen;
+  
+  /*
+   * The string arena and the number of bytes used in it.
+   */
+  char *pArena;
+  long arena_len;
+  
+  /*
+   * Internal state, for use by the library only.
+   */
+  long doc_cap;
+  long ent_cap;
+  long arena_cap;
+  SNPARSER *pParser;
+  SNSOURCE *pSrc;
+  
+} SNBATCH;
+
+/*
+ * Structure describing an error recorded by a parser in recovery mode.
  * 
- *   flags - combination of SNSTREAM flags
+ * See snparser_errinfo().
+ */
+typedef struct {
+  
+  /*
+   * The error code, which is one of the SNERR_ constants.
+   */
+  int code;
+  
+  /*
+   * The line number where the error was detected.
+   * 
+   * This is the value snparser_count() would have returned right when
+   * the error was detected, or, for a structure that is still open at
+   * the |; token, right after the token that opened the structure.
+   */
+  long line;
+  
+  /*
+   * The byte offset within the source where the error was detected.
+   * 
+   * Offsets are counted in the same way as snsource_bytes().  This is
+   * usually the position just after the codepoint or token that caused
+   * the error.  For a structure that is still open at the |; token, it
+   * is the position just after the token that opened the structure.
+   */
+  long offset;
+  
+} SNERRINFO;
+
+/*
+ * Callbacks for a string prefix decoder.
  * 
- * Return:
+ * See snparser_decoder() for further information.
  * 
- *   a new Shastina source wrapping the file handle
+ * Each callback receives the custom data that was passed when the
+ * decoder was registered.  Each callback returns zero if successful or
+ * non-zero to reject the string, which causes an SNERR_DECODE error.
  */
-SNSOURCE *snsource_file(FILE *pFile, int owner);
+typedef struct {
+  
+  /*
+   * Called when a string with the decoder's prefix begins.
+   * 
+   * pPrefix is the prefix and str_type is one of the SNSTRING_
+   * constants.
+   */
+  int (*pfBegin)(void *pCustom, const char *pPrefix, int str_type);
+  
+  /*
+   * Called with each chunk of string data, in order.
+   * 
+   * The data is exactly as it appears in the source file, with escapes
+   * not decoded.  Chunks may break anywhere, including in the middle of
+   * a UTF-8 sequence, and they are not nul-terminated.  The pointer is
+   * only valid until the callback returns.
+   */
+  int (*pfData)(void *pCustom, const char *pData, long len);
+  
+  /*
+   * Called after the last chunk of string data.
+   */
+  int (*pfEnd)(void *pCustom);
+  
+} SNDECODER;
 
 /*
- * Allocate a Shastina source that wraps a stdio FILE handle.
+ * The arguments of a metacommand that are passed to a metacommand
+ * handler.
  * 
- * pFile is the file handle to wrap.  It must be open for reading or
- * undefined behavior occurs.  Nothing besides the allocated Shastina
- * source should use the file while the source object is allocated or
- * undefined behavior occurs.
+ * See snparser_meta() for further information.
  * 
- * flags is a combination of SNSTREAM flags, or SNSTREAM_NORMAL (zero)
- * if no flags are required.  See the documentation of the SNSTREAM
- * constants for further information.  Unrecognized flags are ignored.
+ * The arrays and the strings they point to are only valid until the
+ * handler returns.  The handler should not modify them.
+ */
+typedef struct {
+  
+  /*
+   * The number of arguments, including the metacommand name.
+   * 
+   * This is always at least one.
+   */
+  long argc;
+  
+  /*
+   * The arguments as nul-terminated strings.
+   * 
+   * argv[0] is the metacommand name, which is followed by the remaining
+   * tokens and strings of the metacommand in order.  argv[argc] is
+   * NULL.  The data of strings is given without their prefix and
+   * quotes, decoded if snparser_unescape() is in effect.
+   */
+  const char **argv;
+  
+  /*
+   * The length in bytes of each argument, not including the
+   * terminating nul.
+   */
+  const long *argl;
+  
+  /*
+   * The type of each argument, which is either SNENTITY_META_TOKEN or
+   * SNENTITY_META_STRING.
+   * 
+   * argv[0] is always a token.
+   */
+  const int *argt;
+  
+} SNMETA;
+
+/*
+ * Client buffer for the built-in binary-to-text decoders.
  * 
- * Calls to read from the Shastina source will read from the underlying
- * file handle.  If the RANDOM flag was specified, then multipass
- * support will be enabled.  Otherwise, reading is fully sequential and
- * no multipass operation is supported.
+ * Before registering the blob with snparser_blob(), the client fills in
+ * pData and cap.  After a string has been decoded into the blob, len
+ * holds the number of bytes that were decoded.
+ */
+typedef struct {
+  
+  /*
+   * The client's buffer that receives the decoded bytes.
+   */
+  unsigned char *pData;
+  
+  /*
+   * The capacity of the client's buffer in bytes.
+   * 
+   * Decoding fails if the decoded data would not fit.
+   */
+  long cap;
+  
+  /*
+   * The number of bytes that have been decoded into the buffer.
+   */
+  long len;
+  
+  /*
+   * Decoding state, for use by the decoder only.
+   */
+  unsigned long acc;
+  int digits;
+  int pad;
+  
+} SNBLOB;
+
+/*
+ * State of a document scanner.
+ * 
+ * A scanner finds the |; terminators of documents in data that arrives
+ * in pieces, such as from a non-blocking socket.  Initialize it with
+ * snscan_reset() and then pass it each piece with snscan_feed().  The
+ * fields are for use by the scanner only.
+ */
+typedef struct {
+  
+  int state;
+  int esc;
+  long nest;
+  
+} SNSCAN;
+
+/*
+ * Table of entity handlers for use with snparser_run().
+ * 
+ * Each field is a callback for one type of entity, or NULL if entities
+ * of that type should simply be skipped.  The first parameter of each
+ * callback is always the client context that was passed to
+ * snparser_run().
+ * 
+ * Callbacks return zero to continue or non-zero to stop the run after
+ * the current entity.
+ * 
+ * String parameters are passed as a pointer and a length in bytes.  The
+ * strings are also nul-terminated.  The pointers are only valid until
+ * the callback returns.  The client should not modify the data at the
+ * pointers.  See the SNENTITY structure for the meaning of the key and
+ * value of each entity type.
+ */
+typedef struct {
+  
+  /*
+   * Handler for the EOF entity.
+   */
+  int (*pfEOF)(void *ctx);
+  
+  /*
+   * Handler for STRING entities.
+   * 
+   * str_type is one of the SNSTRING_ constants.  pPrefix is the string
+   * prefix and pData is the string data.
+   */
+  int (*pfString)(
+      void       * ctx,
+      int          str_type,
+      const char * pPrefix,
+      long         prefix_len,
+      const char * pData,
+      long         data_len);
+  
+  /*
+   * Handler for BEGIN_META entities.
+   */
+  int (*pfBeginMeta)(void *ctx);
+  
+  /*
+   * Handler for END_META entities.
+   */
+  int (*pfEndMeta)(void *ctx);
+  
+  /*
+   * Handler for META_TOKEN entities.
+   */
+  int (*pfMetaToken)(void *ctx, const char *pKey, long key_len);
+  
+  /*
+   * Handler for META_STRING entities.
+   * 
+   * The parameters are the same as for STRING entities.
+   */
+  int (*pfMetaString)(
+      void       * ctx,
+      int          str_type,
+      const char * pPrefix,
+      long         prefix_len,
+      const char * pData,
+      long         data_len);
+  
+  /*
+   * Handler for NUMERIC entities.
+   */
+  int (*pfNumeric)(void *ctx, const char *pKey, long key_len);
+  
+  /*
+   * Handler for VARIABLE entities.
+   */
+  int (*pfVariable)(void *ctx, const char *pKey, long key_len);
+  
+  /*
+   * Handler for CONSTANT entities.
+   */
+  int (*pfConstant)(void *ctx, const char *pKey, long key_len);
+  
+  /*
+   * Handler for ASSIGN entities.
+   */
+  int (*pfAssign)(void *ctx, const char *pKey, long key_len);
+  
+  /*
+   * Handler for GET entities.
+   */
+  int (*pfGet)(void *ctx, const char *pKey, long key_len);
+  
+  /*
+   * Handler for BEGIN_GROUP entities.
+   */
+  int (*pfBeginGroup)(void *ctx);
+  
+  /*
+   * Handler for END_GROUP entities.
+   */
+  int (*pfEndGroup)(void *ctx);
+  
+  /*
+   * Handler for ARRAY entities.
+   * 
+   * count is the number of array elements.
+   */
+  int (*pfArray)(void *ctx, long count);
+  
+  /*
+   * Handler for OPERATION entities.
+   */
+  int (*pfOperation)(void *ctx, const char *pKey, long key_len);
+  
+} SNHANDLERS;
+
+/*
+ * Simple wrapper around snsource_stream().
+ * 
+ * If owner is non-zero, then the flags will be SNSTREAM_OWNER.  If the
+ * owner is zero, then the flags will be SNSTREAM_NORMAL (zero).
+ * 
+ * Parameters:
+ * 
+ *   pFile - the file handle to wrap
+ * 
+ *   flags - combination of SNSTREAM flags
+ * 
+ * Return:
+ * 
+ *   a new Shastina source wrapping the file handle
+ */
+SNSOURCE *snsource_file(FILE *pFile, int owner);
+
+/*
+ * Allocate a Shastina source that wraps a stdio FILE handle.
+ * 
+ * pFile is the file handle to wrap.  It must be open for reading or
+ * undefined behavior occurs.  Nothing besides the allocated Shastina
+ * source should use the file while the source object is allocated or
+ * undefined behavior occurs.
+ * 
+ * flags is a combination of SNSTREAM flags, or SNSTREAM_NORMAL (zero)
+ * if no flags are required.  See the documentation of the SNSTREAM
+ * constants for further information.  Unrecognized flags are ignored.
+ * 
+ * Calls to read from the Shastina source will read from the underlying
+ * file handle.  If the RANDOM flag was specified, then multipass
+ * support will be enabled.  Otherwise, reading is fully sequential and
+ * no multipass operation is supported.
+ * 
+ * Multipass sources will immediately be rewound during construction.
+ * 
+ * The returned source object should eventually be freed with
+ * snsource_free().
+ * 
+ * If the whole Shastina file is interpreted successfully, then after
+ * reading the |; EOF token, the underlying file handle will be
+ * positioned to read the byte immediately following the EOF token, and
+ * snsource_bytes() will have how many bytes total were read up to and
+ * including the semicolon in the |; EOF token.
+ * 
+ * If you want to make sure nothing besides whitespace and blank lines
+ * remains in the file after the |; EOF token, use snsource_consume().
+ * 
+ * Parameters:
+ * 
+ *   pFile - the file handle to wrap
+ * 
+ *   flags - combination of SNSTREAM flags
+ * 
+ * Return:
+ * 
+ *   a new Shastina source wrapping the file handle
+ */
+SNSOURCE *snsource_stream(FILE *pFile, int flags);
+
+/*
+ * Allocate a Shastina source that wraps a nul-terminated string.
+ * 
+ * pStr is a pointer to the nul-terminated string to wrap.  It must
+ * remain allocated and it must not be changed while the Shastina source
+ * is allocated or undefined behavior occurs.
+ * 
+ * The terminating nul character is interpreted as the "end of file" and
+ * is not included in the bytes that are read through the source.
+ * 
+ * Calls to read from the Shastina source will read bytes from the given
+ * string.  String sources have full support for multipass.
+ * 
+ * The returned source object should eventually be freed with
+ * snsource_free().
+ * 
+ * No destructor routine is registered, so you may safely pass static
+ * string data.  Note, however, that if you pass a dynamically allocated
+ * string, it will NOT be automatically freed when the Shastina source
+ * is closed.
+ * 
+ * If the whole Shastina file is interpreted successfully, then after
+ * reading the |; EOF token, snsource_bytes() will have how many bytes
+ * total were read up to and including the semicolon in the |; EOF
+ * token.
+ * 
+ * If you want to make sure nothing besides whitespace and blank lines
+ * remains in the string after the |; EOF token, use snsource_consume().
+ * 
+ * Parameters:
+ * 
+ *   pStr - the nul-terminated string to wrap
+ * 
+ * Return:
+ * 
+ *   a new Shastina source wrapping the string
+ */
+SNSOURCE *snsource_string(const char *pStr);
+
+/*
+ * Allocate a Shastina source that reads from data in memory.
+ * 
+ * pData points to the data and len is its length in bytes.  Unlike
+ * snsource_string(), the data does not need to be nul-terminated, and
+ * nul bytes within the data are read like any other byte.  Reading
+ * never goes beyond len bytes.
+ * 
+ * The data is not copied, so it must remain valid until the source is
+ * freed.  Memory sources have full support for multipass, and they have
+ * a memory view, so they support lazy line counting.
+ * 
+ * The returned source object should eventually be freed with
+ * snsource_free().
+ * 
+ * Parameters:
+ * 
+ *   pData - the data to read
+ * 
+ *   len - the length of the data in bytes
+ * 
+ * Return:
+ * 
+ *   a new Shastina source wrapping the data
+ */
+SNSOURCE *snsource_memory(const char *pData, long len);
+
+/*
+ * Allocate a Shastina source that reads several sources one after
+ * another, as if they were a single source.
+ * 
+ * ppParts is an array of count part sources, which are read in order.
+ * Each part is read from its current position until it reaches EOF,
+ * and then reading moves on to the next part.  Nothing is copied.  If a
+ * part has an I/O error or any other error, the concatenation has an
+ * I/O error.  count may be zero for an empty source.
+ * 
+ * The array is copied, but the parts are not.  They remain owned by the
+ * client, they must remain valid until the concatenation is freed, and
+ * they are not freed with it.  Each part must be a different source,
+ * and the parts should not be read except through the concatenation.
+ * 
+ * The concatenation supports multipass if all the parts do.  In that
+ * case, all the parts are rewound when the concatenation is constructed
+ * and whenever it is rewound, so reading starts at the beginning of
+ * each part rather than its current position.  Concatenations
+ * do not have a memory view, so they do not support lazy line counting
+ * or snsource_locate().  Use snsource_part() to map byte offsets back
+ * to the parts, and then look them up in the part.
+ * 
+ * The returned source object should eventually be freed with
+ * snsource_free().
+ * 
+ * Parameters:
+ * 
+ *   ppParts - the part sources
+ * 
+ *   count - the number of parts
+ * 
+ * Return:
+ * 
+ *   a new Shastina source reading the parts in order
+ */
+SNSOURCE *snsource_concat(SNSOURCE **ppParts, long count);
+
+/*
+ * Allocate a custom Shastina source.
+ * 
+ * This is the most flexible Shastina source constructor, which allows
+ * you full control over how the Shastina source works.  The other
+ * snsource_file() and snsource_string() constructors are much easier to
+ * use, but more limited.
+ * 
+ * read_func is a function pointer to a callback function.  It may not
+ * be NULL.  The void pointer it takes will always be the same as the
+ * custom parameter passed to this constructor function.  The read
+ * function should return the unsigned byte value (0-255) of the next
+ * byte from the input source, or SNERR_EOF if End Of File (EOF) has
+ * been reached, or SNERR_IOERR if there was an I/O error reading the
+ * input source.
+ * 
+ * Once the callback function has returned SNERR_EOF or SNERR_IOERR, it
+ * will not be called again.  However, multipass sources can clear the
+ * SNERR_EOF condition by rewinding.
+ * 
+ * free_func is a function pointer to a destructor function, or NULL if
+ * no destructor function is required.
+ * 
+ * If free_func is not NULL, then it will be called immediately before
+ * releasing the Shastina source object, with the void pointer set to
+ * the custom parameter passed to this constructor function.  The
+ * destructor may be used for freeing whatever is pointed to by the
+ * custom parameter.  If this is not needed, use NULL for the
+ * destructor.
+ * 
+ * rewind_func is a function pointer to a multipass rewinding function,
+ * or NULL if the source does not support multipass.  The void pointer
+ * it takes will always be the same as the custom parameter passed to
+ * this constructor function.  It should return non-zero if successful
+ * or zero if an I/O error prevented rewinding.  Failure to rewind
+ * results in SNERR_IOERR state for the source.
+ * 
+ * If rewind_func is provided, it will be called during this constructor
+ * routine to make sure the source starts at the beginning.  If it
+ * fails, the constructed source will start out in SNERR_IOERR state.
+ * 
+ * custom is a custom parameter that is passed through to both the read
+ * callback and the destructor function (if the destructor is defined).
+ * custom may be anything, including NULL.
+ * 
+ * The returned source object should eventually be freed with
+ * snsource_free().
+ * 
+ * Parameters:
+ * 
+ *   read_func - the read callback
+ * 
+ *   free_func - the destructor callback, or NULL
+ * 
+ *   rewind_func - the multipass rewind callback, or NULL
+ * 
+ *   custom - the custom data, which may be NULL
+ * 
+ * Return:
+ * 
+ *   a new, custom Shastina source
+ */
+SNSOURCE *snsource_custom(
+    int (*read_func)(void *),
+    void (*free_func)(void *),
+    int (*rewind_func)(void *),
+    void *custom);
+
+/*
+ * Declare a memory view of the data of a custom Shastina source.
+ * 
+ * This is for custom sources whose data is directly accessible in
+ * memory, such as a memory-mapped file.  pView points to the data, so
+ * that the byte at offset N from pView is the (N + 1)th byte that the
+ * read callback returns.  The data must remain readable at that address
+ * until the source is freed.
+ * 
+ * Sources with a memory view support lazy line counting (see
+ * SNMODE_LAZYLINES) and snsource_locate().  Only bytes that have
+ * already been read through the source are accessed through the view.
+ * 
+ * This must be called before anything has been read from the source,
+ * and only once, or a fault occurs.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the custom source
+ * 
+ *   pView - pointer to the source data
+ */
+void snsource_view(SNSOURCE *pSrc, const char *pView);
+
+/*
+ * Extend the line-start index of a source with a memory view.
+ * 
+ * The index that lazy line counting and snsource_locate() use is
+ * normally built on demand, reading the view up to each offset that is
+ * looked up.  This function extends it to cover all bytes before
+ * offset right away, so that later lookups never read the view below
+ * offset again.  It only does so if a parser counting lines lazily (see
+ * SNMODE_LAZYLINES) has read from the source, and does nothing
+ * otherwise, so that the index costs no memory when it is not used.
+ * 
+ * This is for custom sources that release the memory behind the read
+ * cursor as they go.  Call this from the read callback with the offset
+ * of the range that is about to be released, before releasing it.  The
+ * callback must therefore keep the SNSOURCE pointer in its custom data.
+ * 
+ * The source must have a memory view and offset must be in range zero
+ * up to and including the current value of snsource_bytes(), or a
+ * fault occurs.  Within the read callback, that value does not count
+ * the byte that is being read yet.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the source with a memory view
+ * 
+ *   offset - the byte offset to index up to
+ */
+void snsource_scan(SNSOURCE *pSrc, long offset);
+
+/*
+ * Free a Shastina source.
+ * 
+ * This call is ignored if NULL is passed.
+ * 
+ * The source object must not be used again after freeing it.
+ * 
+ * This call will also run any registered destructor routine within the
+ * source structure.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the source object to free or NULL
+ */
+void snsource_free(SNSOURCE *pSrc);
+
+/*
+ * Determine how many bytes have been successfully read through the
+ * source.
+ * 
+ * If the total number of bytes exceeds the range of a long, then
+ * LONG_MAX will be returned.
+ * 
+ * This count does NOT include any SNERR_EOF or SNERR_IOERR codes that
+ * were returned from the source.  It only includes actual bytes that
+ * were read through the source.
+ * 
+ * After successfully reading the |; entity, this count will be total
+ * number of bytes from the start of the file up to and including the
+ * semicolon in the |; entity.
+ * 
+ * For multipass sources, rewinding will reset this counter to zero.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the source object to query
+ * 
+ * Return:
+ * 
+ *   the number of bytes read through the source, or LONG_MAX if this
+ *   count exceeds the limit of a long
+ */
+long snsource_bytes(SNSOURCE *pSrc);
+
+/*
+ * Map a byte offset within a source to a line and column number.
+ * 
+ * This is only supported by sources that have a memory view of their
+ * data, such as the sources constructed by snsource_string().  For
+ * other sources, this function fails.
+ * 
+ * offset is a byte offset counted from the start of the source, in the
+ * same way as snsource_bytes().  It must be in range zero up to and
+ * including the current value of snsource_bytes(), or the function
+ * fails.
+ * 
+ * The line number is one greater than the number of LF bytes that
+ * occur before the offset.  (CR+LF line breaks therefore count once.)
+ * The column number is one greater than the number of bytes between the
+ * start of that line and the offset.  Note that columns count bytes,
+ * not codepoints.  Both values saturate at LONG_MAX.
+ * 
+ * The first call builds a line-start index of the data read so far,
+ * using a fast scan for LF bytes, and later calls extend the index as
+ * necessary.  Each lookup is then a binary search in the index.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the Shastina source object
+ * 
+ *   offset - the byte offset to look up
+ * 
+ *   pLine - pointer to receive the line number
+ * 
+ *   pCol - pointer to receive the column number
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the source has no memory view or
+ *   the offset is out of range
+ */
+int snsource_locate(
+    SNSOURCE * pSrc,
+    long       offset,
+    long     * pLine,
+    long     * pCol);
+
+/*
+ * Map a byte offset within a concatenated source to the part it falls
+ * in.
+ * 
+ * See snsource_concat().  offset is a byte offset counted from the
+ * start of the concatenation, in the same way as snsource_bytes(), such
+ * as the start and end fields of an entity span.  It must be in range
+ * zero up to and including the current value of snsource_bytes(), or
+ * the function fails.
+ * 
+ * The offset is mapped to the last part that has been reached and that
+ * starts at or before it.  An offset at the very end of a part is
+ * therefore mapped to the end of that part until the next part has
+ * been reached.
+ * 
+ * If pPartOffset is not NULL, it receives the byte offset within the
+ * part, counted from the position the part was at when the
+ * concatenation started reading it.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the Shastina source object
+ * 
+ *   offset - the byte offset to map
+ * 
+ *   pPartOffset - pointer to receive the offset within the part, or
+ *   NULL
+ * 
+ * Return:
+ * 
+ *   the index of the part, or -1 if the source is not a concatenation,
+ *   has no parts, or the offset is out of range
+ */
+long snsource_part(SNSOURCE *pSrc, long offset, long *pPartOffset);
+
+/*
+ * Consume the rest of the data in a source and make sure that there is
+ * nothing but whitespace and blank lines.
+ * 
+ * pSrc is the source object to consume.
+ * 
+ * This function will keep reading from the source until one of the
+ * following happens:
+ * 
+ *   (1) Something other than SP HT CR LF is read
+ *   (2) SNERR_EOF is encountered
+ *   (3) SNERR_IOERR is encountered
+ *   (4) Some other error is encountered
+ * 
+ * The function succeeds and returns greater than zero in case (2),
+ * which indicates that only whitespace and blank lines remained in the
+ * file.
+ * 
+ * The function fails and returns SNERR_TRAILER in case (1) or (4), or
+ * the error code SNERR_IOERR in case (3).
+ * 
+ * Do not use this function in the middle of parsing a Shastina file
+ * with the source or undefined behavior occurs.
+ * 
+ * This function is intended for cases where nothing should follow the
+ * |; EOF marker in the Shastina file.  Parsing stops at the semicolon
+ * in the |; EOF marker without reading any further than that.  This
+ * function can then make sure that nothing besides whitespace and blank
+ * lines remains after the |; EOF marker.
+ * 
+ * Note that after you use this function, snsource_bytes() will be
+ * changed to include the number of additional bytes consumed by this
+ * function.  You can therefore no longer use snsource_bytes() to count
+ * the number of bytes up to the |; EOF marker after calling this
+ * function.
+ * 
+ * You may call this on a source that has already reached EOF, in which
+ * case this function will just return greater than zero.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the Shastina source object
+ * 
+ * Return:
+ * 
+ *   greater than zero if all remaining data has been read from the
+ *   source and nothing besides whitespace and blank lines remained,
+ *   SNERR_TRAILER if something besides whitespace and blank lines was
+ *   encountered, SNERR_IOERR if there was an I/O error reading from the
+ *   source object
+ */
+int snsource_consume(SNSOURCE *pSrc);
+
+/*
+ * Determine whether a given Shastina source supports multipass
+ * operation.
+ * 
+ * Multipass sources can be rewound at any time to start reading again
+ * from the beginning.  Single-pass sources can only be read through
+ * once.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the Shastina source object
+ * 
+ * Return:
+ * 
+ *   non-zero if source supports multipass, zero if not
+ */
+int snsource_ismulti(SNSOURCE *pSrc);
+
+/*
+ * Rewind a Shastina source back to the beginning so it can be read
+ * again.
+ * 
+ * This is only supported by multipass sources.  A fault occurs if it is
+ * called on a single-pass source.  Use snsource_ismulti() to check
+ * whether a source supports this function.
+ * 
+ * If you are rewinding, you will probably need to allocate a new parser
+ * object to parse the file in the new pass.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the Shastina source object
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if an I/O error prevented a successful
+ *   rewind
+ */
+int snsource_rewind(SNSOURCE *pSrc);
+
+/*
+ * Allocate a new Shastina parser.
+ * 
+ * The parser must eventually be freed with snparser_free().
+ * 
+ * Return:
+ * 
+ *   a new Shastina parser
+ */
+SNPARSER *snparser_alloc(void);
+
+/*
+ * Free a Shastina parser.
+ * 
+ * This call is ignored if NULL is passed.
+ * 
+ * The parser object must not be used again after freeing it.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object to free or NULL
+ */
+void snparser_free(SNPARSER *pParser);
+
+/*
+ * Set the mode flags of a parser.
+ * 
+ * flags is a combination of SNMODE flags, or SNMODE_NORMAL (zero) if no
+ * flags are required.  See the documentation of the SNMODE constants
+ * for further information.  Unrecognized flags are ignored.
+ * 
+ * This must be called before the first entity is read with the parser,
+ * or a fault occurs.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   flags - combination of SNMODE flags
+ */
+void snparser_mode(SNPARSER *pParser, int flags);
+
+/*
+ * Decode escape sequences in string data as the parser is reading it.
+ * 
+ * dialect is a combination of SNESC_ flags, or zero to leave string
+ * data as it is, which is the default.  When non-zero, the data of
+ * STRING and META_STRING entities is decoded in place with
+ * snescape_decode() before the entity is returned, and the value_len
+ * field is the decoded length.
+ * 
+ * Invalid escapes cause the parser to stop with SNERR_ESCAPE, or in
+ * recovery mode, the string is discarded and the error is recorded.
+ * 
+ * This may be changed at any time.  It takes effect with the next
+ * string that is read.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   dialect - combination of SNESC_ flags, or zero
+ */
+void snparser_unescape(SNPARSER *pParser, int dialect);
+
+/*
+ * Register a decoder for strings with a particular prefix.
+ * 
+ * pPrefix is the string prefix, such as "b64" for strings like
+ * b64{...}.  The prefix string is not copied, so it must remain valid
+ * while it is registered.  The empty prefix may also be registered.
+ * 
+ * pDecoder is the decoder callbacks, which must remain valid while they
+ * are registered.  pCustom is passed through to the callbacks.  If
+ * pDecoder is NULL, any decoder registered for the prefix is removed.
+ * Registering a prefix that is already registered replaces the decoder.
+ * 
+ * When a STRING entity with a registered prefix is read, its string
+ * data is passed to the decoder in chunks as it is read, without ever
+ * collecting the whole string in the parser.  Decoded strings are
+ * therefore not limited in length.  The STRING entity is still returned
+ * once the string has been read, but its value is empty.
+ * 
+ * Decoders do not apply to META_STRING entities.
+ * 
+ * At most 16 prefixes may be registered with a parser.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   pPrefix - the string prefix
+ * 
+ *   pDecoder - the decoder callbacks, or NULL to unregister
+ * 
+ *   pCustom - custom data passed to the callbacks
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if too many prefixes are registered
+ */
+int snparser_decoder(
+    SNPARSER        * pParser,
+    const char      * pPrefix,
+    const SNDECODER * pDecoder,
+    void            * pCustom);
+
+/*
+ * Register a handler for metacommands with a particular name.
+ * 
+ * pName is the metacommand name, which is the first token of the
+ * metacommand, such as "include" for %include "a.txt";.  The name
+ * string is not copied, so it must remain valid while it is registered.
+ * 
+ * pfMeta is the handler, and pCustom is passed through to it.  If pfMeta
+ * is NULL, any handler registered for the name is removed.  Registering
+ * a name that is already registered replaces the handler.
+ * 
+ * While at least one handler is registered, metacommands are no longer
+ * returned as BEGIN_META, META_TOKEN, META_STRING, and END_META
+ * entities.  Instead, the arguments of a metacommand with a registered
+ * handler are collected into a single arena, and the handler is called
+ * once with all of them when the semicolon is read.  Metacommands that
+ * have no registered handler, or that start with a string rather than a
+ * token, are skipped without collecting anything.  The exception is the
+ * signature metacommand of a schema (see snparser_schema()), which is
+ * always returned as entities.
+ * 
+ * The handler returns zero to continue, or a negative error code that
+ * stops the parser as if it were a parsing error.  The error is not
+ * recovered from in recovery mode.  The handler may call
+ * snparser_meta() but no other functions on the parser.
+ * 
+ * Metacommands with a handler are limited to 512 arguments and to a
+ * total of 65534 bytes of arguments, including a terminating nul for
+ * each.  Longer metacommands cause SNERR_LONGMETA.
+ * 
+ * At most 16 names may be registered with a parser.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   pName - the metacommand name
+ * 
+ *   pfMeta - the handler, or NULL to unregister
+ * 
+ *   pCustom - custom data passed to the handler
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if too many names are registered
+ */
+int snparser_meta(
+    SNPARSER   * pParser,
+    const char * pName,
+    int       (* pfMeta)(void *pCustom, const SNMETA *pMeta),
+    void       * pCustom);
+
+/*
+ * Allocate a cache of included files for use with snparser_include().
+ * 
+ * The cache keeps every included file that has been read, parsed into
+ * entities, so that each file is only parsed once no matter how many
+ * times and by how many parsers it is included.  A single cache may be
+ * shared by all the parsers of a process, but it is not thread-safe, so
+ * parsers that share a cache must not be used from different threads
+ * at the same time.
+ * 
+ * Return:
+ * 
+ *   a new, empty cache
+ */
+SNINCCACHE *sninccache_alloc(void);
+
+/*
+ * Free a cache of included files.
+ * 
+ * This call is ignored if NULL is passed.
+ * 
+ * Parsers that use the cache must have includes disabled or be freed
+ * before they read anything more.  Included files that parsers are in
+ * the middle of remain valid until the parsers are reset or freed.
+ * 
+ * Parameters:
+ * 
+ *   pCache - the cache to free or NULL
+ */
+void sninccache_free(SNINCCACHE *pCache);
+
+/*
+ * Enable or disable include metacommands in a parser.
+ * 
+ * If pCache is not NULL, metacommands of the form %include "path"; are
+ * replaced by the entities of the named file.  The file must be a
+ * complete Shastina document that ends with the |; token.  Its entities
+ * are spliced into the entity stream in place of the metacommand,
+ * without its EOF entity.  Included files may include further files, up
+ * to a depth of 16, and a relative path in an included file is taken
+ * relative to the directory of that file.  Other metacommands are not
+ * affected, unless handlers are registered with snparser_meta().
+ * 
+ * Included files are parsed through the cache, which keeps their
+ * entities.  Each time a file is included, it is read and hashed, and
+ * it is only parsed again if its length or hash has changed.  The
+ * escape dialect set with snparser_unescape() applies to included
+ * files, but string prefix decoders do not.  Entities from included
+ * files are validated against the schema, if there is one, and
+ * metacommands in them are passed to registered handlers.
+ * 
+ * While entities come from an included file, snparser_count() returns
+ * the line number within that file and snparser_file() returns its
+ * path.  Spans are relative to the included file.  Key and value
+ * pointers of these entities point into the cache.
+ * 
+ * If an included file can not be read, or the metacommand does not
+ * have exactly one string argument, the parser stops with
+ * SNERR_INCLUDE.  Errors within included files stop the parser, even
+ * in recovery mode.  Memory used by the cache is not charged to the
+ * memory budget of the parser.
+ * 
+ * Includes are disabled by default.  The cache must remain valid while
+ * it is set.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   pCache - the include cache, or NULL to disable includes
+ */
+void snparser_include(SNPARSER *pParser, SNINCCACHE *pCache);
+
+/*
+ * Get the path of the included file that the parser is currently
+ * reading from.
+ * 
+ * See snparser_include().  After an error within an included file, this
+ * is the path of that file.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ * Return:
+ * 
+ *   the path of the included file, or NULL if entities are being read
+ *   from the source itself
+ */
+const char *snparser_file(SNPARSER *pParser);
+
+/*
+ * Register a built-in binary-to-text decoder for strings with a
+ * particular prefix.
+ * 
+ * This is a wrapper around snparser_decoder() that decodes strings into
+ * the client buffer of an SNBLOB structure.
+ * 
+ * encoding is SNBLOB_BASE64 for standard base64 with optional padding,
+ * or SNBLOB_BASE16 for hexadecimal digits of either case.  Spaces, tabs,
+ * and line breaks within the string data are ignored.  Escapes are not
+ * recognized.
+ * 
+ * Each string with the prefix is decoded into the start of the blob's
+ * buffer, and len is set to the decoded length, so the blob must be
+ * consumed when its STRING entity is returned, before the next string
+ * with the same prefix is read.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   pPrefix - the string prefix
+ * 
+ *   encoding - SNBLOB_BASE64 or SNBLOB_BASE16
+ * 
+ *   pBlob - the blob to decode into
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if too many prefixes are registered
+ */
+int snparser_blob(
+    SNPARSER   * pParser,
+    const char * pPrefix,
+    int          encoding,
+    SNBLOB     * pBlob);
+
+/*
+ * Set the schema that a parser validates its input against.
+ * 
+ * pSchema is a schema compiled with snschema_compile(), or NULL to stop
+ * validating.  The schema is not copied, so it must remain allocated
+ * while the parser uses it.  The parser never changes the schema, so
+ * any number of parsers, in any number of threads, may share one.
+ * 
+ * The schema should be set before the first entity is read.  It is
+ * kept by snparser_next_document(), and the signature is required again
+ * at the start of each document.
+ * 
+ * Validation runs as each token is read, and a violation is reported
+ * as an error at the point it occurs, with one of the following codes:
+ * 
+ *   SNERR_SIGNATURE - the document does not begin with the signature
+ *   metacommand
+ * 
+ *   SNERR_OPERATOR - an operation is not in the operator set
+ * 
+ *   SNERR_PREFIX - a string prefix is not in the prefix set
+ * 
+ *   SNERR_NUMERIC - a numeric entity does not have an allowed shape
+ * 
+ * In recovery mode (see SNMODE_RECOVER), these errors are recorded and
+ * the offending entity is dropped, except that signature errors drop
+ * nothing.  Entities that pass validation have their id field filled
+ * in as described for SNENTITY.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   pSchema - the schema, or NULL
+ */
+void snparser_schema(SNPARSER *pParser, const SNSCHEMA *pSchema);
+
+/*
+ * Return the number of errors a parser has recovered from.
+ * 
+ * This is always zero unless the parser has the SNMODE_RECOVER flag
+ * set.  Errors that stop the parser are not included in this count;
+ * they are reported by snparser_read() as normal.
+ * 
+ * In recovery mode, the parser recovers from errors as follows:
+ * 
+ *   (1) After an illegal character or an overlong token, input is
+ *       skipped to the end of the token.
+ * 
+ *   (2) After an overlong string, a nul character in a string, or too
+ *       much curly nesting, input is skipped to the end of the line.
+ * 
+ *   (3) Tokens that can not be used where they appear, such as an
+ *       unmatched ")" or a comma outside of an array, are discarded.
+ *       The entities that are returned therefore remain properly
+ *       nested.
+ * 
+ *   (4) If metacommands, arrays, or groups are still open at the |;
+ *       token, they are abandoned.  One error is recorded for each of
+ *       them, innermost first, at the position of the token that
+ *       opened it:  SNERR_OPENMETA, SNERR_OPENARRAY, or SNERR_OPENGROUP.
+ *       The entities that close them are then returned, innermost
+ *       first, as if the matching ";" "]" and ")" tokens had appeared
+ *       before the |; token, followed by the EOF entity.  An array is
+ *       closed with the END_GROUP of its last element and the ARRAY
+ *       entity.  A metacommand with a registered handler is discarded
+ *       without calling the handler.
+ * 
+ * The entities returned in recovery mode are therefore always properly
+ * nested.  To make this possible, the parser keeps the position of each
+ * open structure, which limits groups and arrays to 16384 levels of
+ * nesting in total.  Deeper nesting is reported as SNERR_DEEPGROUP or
+ * SNERR_DEEPARRAY, and the offending token is discarded.
+ * 
+ * I/O errors, encoding errors, unterminated strings, a missing |;
+ * token, cancellation, and running out of memory budget can not be
+ * recovered from.
+ * 
+ * Recovery is a best effort, so a single mistake in the source file
+ * may cause further errors to be recorded after it.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ * Return:
+ * 
+ *   the number of errors recovered from
+ */
+long snparser_errcount(SNPARSER *pParser);
+
+/*
+ * Get a recorded error from a parser in recovery mode.
+ * 
+ * i is the index of the error, where zero is the first error that was
+ * recorded.  Errors are recorded in the order they were encountered.
+ * 
+ * Only the first 1024 errors are kept.  If i is beyond the errors that
+ * were kept, zero is returned and the structure is cleared.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   i - the index of the error
+ * 
+ *   pInfo - the structure to receive the error record
+ * 
+ * Return:
+ * 
+ *   non-zero if the error record was returned, zero if there is no
+ *   such error record
+ */
+int snparser_errinfo(SNPARSER *pParser, long i, SNERRINFO *pInfo);
+
+/*
+ * Parse an entity from a Shastina source file.
+ * 
+ * pParser is the parser object.
+ * 
+ * pEntity is the entity structure that will be filled in.  Its state
+ * upon entry to the function is irrelevant.  Upon return, it will hold
+ * the results of the operation.  See the structure documentation for
+ * further information.
+ * 
+ * pIn is the input source to read from.
+ * 
+ * Once an error is encountered, the parser object will return that same
+ * error each time this function is called without doing anything
+ * further.
+ * 
+ * Once the End Of File (EOF) entity is returned, this function will
+ * return the EOF entity on all subsequent calls without doing anything
+ * further.
+ * 
+ * Parameters:
+ * 
+ *   pReader - the reader object
+ * 
+ *   pEntity - pointer to the entity to receive the results
+ * 
+ *   pIn - the input source
+ */
+void snparser_read(
+    SNPARSER * pParser,
+    SNENTITY * pEntity,
+    SNSOURCE * pIn);
+
+/*
+ * Parse an entity from a Shastina source file into a compact entity.
+ * 
+ * This is the same as snparser_read(), except that the entity is
+ * returned in the compact variant, where keys shorter than
+ * SNCOMPACT_INLINE bytes are stored by value.  See the SNCOMPACT
+ * structure for further information.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   pEntity - pointer to the compact entity to receive the results
+ * 
+ *   pIn - the input source
+ */
+void snparser_readc(
+    SNPARSER  * pParser,
+    SNCOMPACT * pEntity,
+    SNSOURCE  * pIn);
+
+/*
+ * Return the key of a compact entity.
+ * 
+ * This is either the inline key area or the pLongKey pointer, depending
+ * on the length of the key.  For entities that have no key, an empty
+ * string is returned.
+ * 
+ * The returned pointer is valid as long as the compact entity is, if the
+ * key is stored inline, or until the next entity is read otherwise.
+ * 
+ * Parameters:
+ * 
+ *   pEntity - the compact entity
+ * 
+ * Return:
+ * 
+ *   the key string
+ */
+const char *sncompact_key(const SNCOMPACT *pEntity);
+
+/*
+ * Parse a Shastina source file, invoking a handler for each entity.
+ * 
+ * pParser is the parser object.  pIn is the input source to read from.
+ * 
+ * pHandlers is the table of handlers.  See the SNHANDLERS structure for
+ * further information.  ctx is a client context that is passed through
+ * to each handler, which may be anything, including NULL.
+ * 
+ * Entities are passed to the handlers straight from the parser's
+ * internal queue, so this is faster than calling snparser_read() in a
+ * loop and branching on the entity type.  The queue itself is kept,
+ * since one token may complete several entities and a handler may stop
+ * the run between them.
+ * 
+ * The run continues until the EOF entity has been handled, an error is
+ * encountered, or a handler returns non-zero.  The run always ends with
+ * the EOF entity, so the return value of its handler does not matter
+ * and zero is returned either way.  If another handler stops the run,
+ * the parser is left positioned after the entity that was handled, so
+ * the run may be resumed by calling this function again, or entities
+ * may be read with snparser_read().  Handlers must not themselves read
+ * from the parser.
+ * 
+ * snparser_count() may be called from within handlers to get the line
+ * count for the current entity.
+ * 
+ * Errors are handled in the same way as snparser_read().  Once an error
+ * has been encountered, this function will return that same error
+ * without doing anything further.  Once the EOF entity has been
+ * handled, each further call will handle the EOF entity again.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   pIn - the input source
+ * 
+ *   pHandlers - the handler table
+ * 
+ *   ctx - the client context, which may be NULL
+ * 
+ * Return:
+ * 
+ *   zero if the EOF entity was handled, one if a handler stopped the
+ *   run, or an SNERR_ code (which is always negative) if there was an
+ *   error
+ */
+int snparser_run(
+    SNPARSER         * pParser,
+    SNSOURCE         * pIn,
+    const SNHANDLERS * pHandlers,
+    void             * ctx);
+
+/*
+ * Move a parser on to the next document in a source of concatenated
+ * documents.
+ * 
+ * pParser is the parser object, which must have read the EOF entity of
+ * the current document or stopped on an error, or a fault occurs.
+ * pIn is the input source, which must be the same source the current
+ * document was read from, or a fault occurs.
+ * 
+ * If the parser stopped on an error, that error is returned and
+ * nothing else is done.  Otherwise, the parser is reset for a new
+ * document while keeping its buffers and stacks allocated, so no memory
+ * is allocated.  Modes, decoders, and other settings stay as they are.
+ * Errors recorded in recovery mode are cleared.  Line counts and source
+ * spans continue to count from the start of the source.
+ * 
+ * Whitespace, blank lines, and comments after the |; token are then
+ * skipped.  If the source ends, the return value is zero.  Otherwise,
+ * the return value is one, and the next document can be read from the
+ * parser straight away.  Anything that is not a valid document is
+ * reported by the following reads.  If an error occurs while skipping,
+ * it is returned, and it is also returned by the following reads.
+ * 
+ * This allows a stream of concatenated documents to be read with a
+ * single parser:
+ * 
+ *   do {
+ *     ... read entities up to and including EOF ...
+ *   } while (snparser_next_document(pParser, pIn) > 0);
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   pIn - the input source
+ * 
+ * Return:
+ * 
+ *   one if another document follows, zero at the end of the source, or
+ *   an SNERR_ code (which is always negative) if there was an error
+ */
+int snparser_next_document(SNPARSER *pParser, SNSOURCE *pIn);
+
+/*
+ * Reset a document scanner to the start of a document.
+ * 
+ * This should also be used for initializing scanner structures.
+ * 
+ * Parameters:
+ * 
+ *   pScan - the scanner to reset
+ */
+void snscan_reset(SNSCAN *pScan);
+
+/*
+ * Scan data for the |; terminator at the end of a document.
+ * 
+ * pData points to the next len bytes of the data, which continue from
+ * the bytes passed in earlier calls since the last reset or terminator.
+ * The scanner follows the lexical rules of the parser, so that the |;
+ * terminator is only recognized where it begins a token, and not
+ * within strings, comments, or other tokens.  Only the lexical level is
+ * checked.  Anything else that is invalid is left for the parser to
+ * report, so a document that is framed this way may still fail to
+ * parse.
+ * 
+ * If a terminator is found, the return value is the number of bytes of
+ * pData up to and including the end of the terminator, and the scanner
+ * is left ready for the start of the next document.  The bytes after
+ * the terminator should then be passed again.  If no terminator is
+ * found, all len bytes have been scanned and the return value is zero.
+ * 
+ * Parameters:
+ * 
+ *   pScan - the scanner
+ * 
+ *   pData - the data to scan
+ * 
+ *   len - the number of bytes to scan, zero or greater
+ * 
+ * Return:
+ * 
+ *   the number of bytes up to the end of the terminator, or zero if
+ *   there is no terminator in the data
+ */
+long snscan_feed(SNSCAN *pScan, const char *pData, long len);
+
+/*
+ * Return the current line count.
+ * 
+ * The line count is always at least one and at most LONG_MAX.  The
+ * value of LONG_MAX is an overflow value, so any count of lines above
+ * that will just remain at LONG_MAX.
+ * 
+ * If the parser counts lines lazily (see SNMODE_LAZYLINES), the count
+ * is computed on demand from the source most recently passed to
+ * snparser_read(), which must still be allocated.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ * Return:
+ * 
+ *   the current line count
+ */
+long snparser_count(SNPARSER *pParser);
+
+/*
+ * Set the memory budget of a parser.
+ * 
+ * bytes is the maximum number of bytes of memory the parser may use, or
+ * zero for no limit (the default).  It may not be negative.
+ * 
+ * The count covers the parser structure itself and all of the buffers
+ * and stacks the parser grows as it reads entities.  These only grow on
+ * demand, when a long token, a long string, or deep nesting is
+ * encountered.  If growth would take the parser over budget, the read
+ * fails with SNERR_BUDGET, and as with all other errors, the parser
+ * then returns that same error on all subsequent reads.
+ * 
+ * The budget may be set at any time.  Setting it below the current
+ * usage does not release anything, but causes any further growth to
+ * fail.  A few small initial allocations are always charged even if
+ * they go over budget, since they can not fail, so usage may end up
+ * slightly above a very small budget.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   bytes - the budget in bytes, or zero for no limit
+ */
+void snparser_budget(SNPARSER *pParser, long bytes);
+
+/*
+ * Return the number of bytes of memory currently used by a parser.
+ * 
+ * See snparser_budget() for what is counted.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ * Return:
+ * 
+ *   the current memory usage in bytes
+ */
+long snparser_memory(SNPARSER *pParser);
+
+/*
+ * Return the highest number of bytes of memory a parser has used at
+ * any one time since it was allocated.
+ * 
+ * See snparser_budget() for what is counted.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ * Return:
+ * 
+ *   the peak memory usage in bytes
+ */
+long snparser_peak(SNPARSER *pParser);
+
+/*
+ * Request that a parser stop parsing.
+ * 
+ * This sets the cancellation flag of the parser.  The flag is polled
+ * while input is being read, once every few thousand codepoints (and
+ * also before the very first codepoint is read).  When the parser
+ * notices the flag, the current read fails and the parser enters the
+ * SNERR_CANCELLED error state.  As with all other errors, the parser
+ * will then return SNERR_CANCELLED each time snparser_read() is called
+ * without doing anything further.
+ * 
+ * The flag is stored in a volatile sig_atomic_t field, so it is safe to
+ * call this function from a signal handler.  It may also be called
+ * from another thread while the parser is busy, with the understanding
+ * that the parser will notice the request at its next poll.
+ * 
+ * The cancellation flag can not be cleared.  Free the parser and
+ * allocate a new one to parse again.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ */
+void snparser_cancel(SNPARSER *pParser);
+
+/*
+ * Install a deadline check on a parser.
+ * 
+ * expired_func is a callback that is polled at the same points where
+ * the cancellation flag is polled (see snparser_cancel()).  The void
+ * pointer it takes will always be the custom parameter passed to this
+ * function.  It should return non-zero if the parse should be stopped,
+ * or zero if parsing may continue.  Once the callback returns non-zero,
+ * the parser enters the SNERR_CANCELLED error state and the callback
+ * is not invoked again.
+ * 
+ * ANSI C does not provide a monotonic clock, so the parser does not
+ * keep time itself.  The intended use is for the callback to compare
+ * the current time on the platform's monotonic clock (for example,
+ * clock_gettime() with CLOCK_MONOTONIC on POSIX) against a deadline
+ * stored in the custom structure.  Since the callback is only invoked
+ * once every few thousand codepoints, the cost of reading the clock is
+ * negligible.
+ * 
+ * Passing NULL for expired_func removes any deadline check that was
+ * previously installed.
+ * 
+ * Parameters:
+ * 
+ *   pParser - the parser object
+ * 
+ *   expired_func - the deadline callback, or NULL
+ * 
+ *   custom - the custom data passed to the callback, which may be NULL
+ */
+void snparser_deadline(
+    SNPARSER * pParser,
+    int     (* expired_func)(void *),
+    void     * custom);
+
+/*
+ * Allocate a pool of reusable parser and string source objects.
+ * 
+ * Allocating a parser or source takes several memory allocations, and a
+ * parser's buffers and stacks grow further as it reads.  A pool keeps
+ * returned objects with their memory still allocated, so that in steady
+ * state, getting an object from the pool allocates nothing.
+ * 
+ * warm is the number of parsers and string sources to allocate up front.
+ * max is the maximum number of each kind of object the pool will keep.
+ * Objects returned to a full pool are freed.  warm must be in range
+ * zero up to max.
+ * 
+ * Pools are not thread-safe.  Use a separate pool in each thread.
+ * Objects are not tied to the pool they came from, so an object may be
+ * returned to the pool of whichever thread is finished with it, without
+ * any locking.
+ * 
+ * Parameters:
+ * 
+ *   warm - the number of objects of each kind to allocate up front
+ * 
+ *   max - the maximum number of objects of each kind to keep
+ * 
+ * Return:
+ * 
+ *   a new pool
+ */
+SNPOOL *snpool_alloc(int warm, int max);
+
+/*
+ * Free a pool and all the objects it is keeping.
+ * 
+ * This call is ignored if NULL is passed.
+ * 
+ * Objects that were taken from the pool and not returned are not
+ * affected.  They remain valid and must be freed normally or returned
+ * to another pool.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the pool to free or NULL
+ */
+void snpool_free(SNPOOL *pPool);
+
+/*
+ * Get a parser from a pool.
+ * 
+ * The parser is in the same state as a parser newly allocated with
+ * snparser_alloc().  If the pool is empty, a new parser is allocated.
+ * 
+ * The parser may be freed with snparser_free() instead of being
+ * returned to a pool.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the pool
+ * 
+ * Return:
+ * 
+ *   a parser
+ */
+SNPARSER *snpool_parser(SNPOOL *pPool);
+
+/*
+ * Return a parser to a pool.
+ * 
+ * The parser may have come from any pool or from snparser_alloc().  It
+ * is reset to the state of a newly allocated parser, including its
+ * mode, memory budget, decoders, cancellation, and deadline, but its
+ * buffers and stacks remain allocated.  If the pool is full, the parser
+ * is freed instead.
+ * 
+ * The parser must not be used again by the caller after it is returned.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the pool
+ * 
+ *   pParser - the parser to return
+ */
+void snpool_putparser(SNPOOL *pPool, SNPARSER *pParser);
+
+/*
+ * Get a string source from a pool.
+ * 
+ * The source is equivalent to one constructed with snsource_string() on
+ * the given string.  If the pool is empty, a new source is allocated.
+ * 
+ * The source may be freed with snsource_free() instead of being
+ * returned to a pool.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the pool
+ * 
+ *   pStr - the string to read
+ * 
+ * Return:
+ * 
+ *   a string source
+ */
+SNSOURCE *snpool_string(SNPOOL *pPool, const char *pStr);
+
+/*
+ * Return a source to a pool.
+ * 
+ * Only string sources, whether constructed with snpool_string() or
+ * snsource_string(), are kept by the pool.  Other kinds of sources, and
+ * string sources returned to a full pool, are freed.
+ * 
+ * The source must not be used again by the caller after it is returned.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the pool
+ * 
+ *   pSrc - the source to return
+ */
+void snpool_putsource(SNPOOL *pPool, SNSOURCE *pSrc);
+
+/*
+ * Allocate a batch for use with snparse_many().
+ * 
+ * Return:
+ * 
+ *   a new, empty batch
+ */
+SNBATCH *snbatch_alloc(void);
+
+/*
+ * Free a batch.
+ * 
+ * This call is ignored if NULL is passed.
  * 
- * Multipass sources will immediately be rewound during construction.
+ * Parameters:
  * 
- * The returned source object should eventually be freed with
- * snsource_free().
+ *   pBatch - the batch to free or NULL
+ */
+void snbatch_free(SNBATCH *pBatch);
+
+/*
+ * Parse many small documents into a batch.
  * 
- * If the whole Shastina file is interpreted successfully, then after
- * reading the |; EOF token, the underlying file handle will be
- * positioned to read the byte immediately following the EOF token, and
- * snsource_bytes() will have how many bytes total were read up to and
- * including the semicolon in the |; EOF token.
+ * ppDocs is an array of count pointers to documents in memory and pLens
+ * is an array of their lengths in bytes.  The documents do not need to
+ * be nul-terminated.  Each document is a complete Shastina source file
+ * that ends with the |; token.  Anything after the |; token is ignored.
  * 
- * If you want to make sure nothing besides whitespace and blank lines
- * remains in the file after the |; EOF token, use snsource_consume().
+ * Any previous contents of the batch are cleared, and the entities of
+ * all the documents are written into the columns of the batch.  See the
+ * SNBATCH structure for further information.
+ * 
+ * All the documents are parsed with a single parser and source that
+ * are kept in the batch and reset between documents, and the columns
+ * keep their memory when the batch is reused, so in steady state there
+ * is no allocation per document or per batch.
  * 
  * Parameters:
  * 
- *   pFile - the file handle to wrap
+ *   pBatch - the batch to receive the results
  * 
- *   flags - combination of SNSTREAM flags
+ *   ppDocs - the documents
+ * 
+ *   pLens - the lengths of the documents
+ * 
+ *   count - the number of documents
  * 
  * Return:
  * 
- *   a new Shastina source wrapping the file handle
+ *   the number of documents that failed to parse
  */
-SNSOURCE *snsource_stream(FILE *pFile, int flags);
+long snparse_many(
+    SNBATCH           * pBatch,
+    const char *const * ppDocs,
+    const long        * pLens,
+    long                count);
 
 /*
- * Allocate a Shastina source that wraps a nul-terminated string.
+ * Decode escape sequences in string data.
  * 
- * pStr is a pointer to the nul-terminated string to wrap.  It must
- * remain allocated and it must not be changed while the Shastina source
- * is allocated or undefined behavior occurs.
+ * pSrc points to the string data to decode and len is its length in
+ * bytes.  The string data does not need to be nul-terminated.
  * 
- * The terminating nul character is interpreted as the "end of file" and
- * is not included in the bytes that are read through the source.
+ * pDest points to the buffer that receives the decoded string.  It must
+ * have room for at least (len + 1) bytes.  Decoding never makes data
+ * longer, so pDest may be equal to pSrc to decode in place.  Otherwise,
+ * the buffers must not overlap.  The decoded string is always
+ * nul-terminated if decoding is successful.
  * 
- * Calls to read from the Shastina source will read bytes from the given
- * string.  String sources have full support for multipass.
+ * dialect is a combination of SNESC_ flags that selects which escape
+ * sequences are recognized.  See the SNESC_ constants for further
+ * information.
  * 
- * The returned source object should eventually be freed with
- * snsource_free().
+ * Runs of bytes between backslashes are located with memchr() and
+ * copied in bulk, so strings with few escapes decode at close to the
+ * speed of a memory copy.
  * 
- * No destructor routine is registered, so you may safely pass static
- * string data.  Note, however, that if you pass a dynamically allocated
- * string, it will NOT be automatically freed when the Shastina source
- * is closed.
+ * If an invalid escape is encountered, SNERR_ESCAPE is returned and the
+ * contents of the destination buffer are undefined.
  * 
- * If the whole Shastina file is interpreted successfully, then after
- * reading the |; EOF token, snsource_bytes() will have how many bytes
- * total were read up to and including the semicolon in the |; EOF
- * token.
+ * Parameters:
  * 
- * If you want to make sure nothing besides whitespace and blank lines
- * remains in the string after the |; EOF token, use snsource_consume().
+ *   pDest - the buffer to receive the decoded string
  * 
- * Parameters:
+ *   pSrc - the string data to decode
  * 
- *   pStr - the nul-terminated string to wrap
+ *   len - the length of the string data in bytes
+ * 
+ *   dialect - combination of SNESC_ flags
  * 
  * Return:
  * 
- *   a new Shastina source wrapping the string
+ *   the length of the decoded string in bytes, not including the
+ *   terminating nul, or SNERR_ESCAPE if there was an invalid escape
  */
-SNSOURCE *snsource_string(const char *pStr);
+long snescape_decode(
+    char       * pDest,
+    const char * pSrc,
+    long         len,
+    int          dialect);
 
 /*
- * Allocate a custom Shastina source.
+ * Compile a schema from a Shastina source.
  * 
- * This is the most flexible Shastina source constructor, which allows
- * you full control over how the Shastina source works.  The other
- * snsource_file() and snsource_string() constructors are much easier to
- * use, but more limited.
+ * A schema is itself a Shastina document that contains nothing but the
+ * following metacommands, each of which is optional:
  * 
- * read_func is a function pointer to a callback function.  It may not
- * be NULL.  The void pointer it takes will always be the same as the
- * custom parameter passed to this constructor function.  The read
- * function should return the unsigned byte value (0-255) of the next
- * byte from the input source, or SNERR_EOF if End Of File (EOF) has
- * been reached, or SNERR_IOERR if there was an I/O error reading the
- * input source.
+ *   %signature name ...;
  * 
- * Once the callback function has returned SNERR_EOF or SNERR_IOERR, it
- * will not be called again.  However, multipass sources can clear the
- * SNERR_EOF condition by rewinding.
+ *     Each document must begin with a metacommand whose first tokens
+ *     are the given tokens, in order.  Further tokens and strings may
+ *     follow them.  This may appear only once, with at least one token.
  * 
- * free_func is a function pointer to a destructor function, or NULL if
- * no destructor function is required.
+ *   %operators name ...;
  * 
- * If free_func is not NULL, then it will be called immediately before
- * releasing the Shastina source object, with the void pointer set to
- * the custom parameter passed to this constructor function.  The
- * destructor may be used for freeing whatever is pointed to by the
- * custom parameter.  If this is not needed, use NULL for the
- * destructor.
+ *     Only the named operations are allowed.  This may appear more than
+ *     once, and the names add up.  Operations are given IDs from one in
+ *     the order they are named.  If there is an operators metacommand
+ *     without any names, no operations are allowed.
  * 
- * rewind_func is a function pointer to a multipass rewinding function,
- * or NULL if the source does not support multipass.  The void pointer
- * it takes will always be the same as the custom parameter passed to
- * this constructor function.  It should return non-zero if successful
- * or zero if an I/O error prevented rewinding.  Failure to rewind
- * results in SNERR_IOERR state for the source.
+ *   %prefixes "" name"" ...;
  * 
- * If rewind_func is provided, it will be called during this constructor
- * routine to make sure the source starts at the beginning.  If it
- * fails, the constructed source will start out in SNERR_IOERR state.
+ *     Only the given string prefixes are allowed.  The prefixes are
+ *     given as strings, so that the empty prefix can be written as a
+ *     string without a prefix.  The string data and type are ignored.
+ *     Otherwise, this works the same way as the operators metacommand.
  * 
- * custom is a custom parameter that is passed through to both the read
- * callback and the destructor function (if the destructor is defined).
- * custom may be anything, including NULL.
+ *   %numeric shape ...;
  * 
- * The returned source object should eventually be freed with
- * snsource_free().
+ *     Only numeric entities with one of the given shapes are allowed.
+ *     The shapes are "integer" for an optional sign and decimal digits,
+ *     "decimal" for an integer followed by a point and more digits,
+ *     "exponent" for an integer or decimal followed by "e" or "E" and
+ *     an optionally signed integer, and "hex" for an optional sign,
+ *     "0x" or "0X", and hexadecimal digits.
  * 
- * Parameters:
+ * Anything that is not restricted by a schema is allowed.  For example,
+ * without an operators metacommand, all operations are allowed and
+ * their IDs are zero.  A complete schema might look like this:
  * 
- *   read_func - the read callback
+ *   %signature my-format 2;
+ *   %operators point line fill;
+ *   %prefixes "" color"";
+ *   %numeric integer decimal;
+ *   |;
  * 
- *   free_func - the destructor callback, or NULL
+ * Compilation reads the source up to and including the |; token.  The
+ * names are compiled into hash tables and the numeric shapes into a
+ * state table, so that validation adds little to the cost of parsing.
  * 
- *   rewind_func - the multipass rewind callback, or NULL
+ * If compilation fails, NULL is returned.  If pErr is not NULL, it
+ * receives the error code, which is SNERR_SCHEMA for a schema that is
+ * valid Shastina but not a valid schema, or a parsing error code.  If
+ * pLine is not NULL, it receives the line number of the error.  Both
+ * are set to zero on success.
  * 
- *   custom - the custom data, which may be NULL
+ * The returned schema should eventually be freed with snschema_free().
+ * 
+ * Parameters:
+ * 
+ *   pIn - the source to read the schema from
+ * 
+ *   pErr - pointer to receive the error code, or NULL
+ * 
+ *   pLine - pointer to receive the error line, or NULL
  * 
  * Return:
  * 
- *   a new, custom Shastina source
+ *   the compiled schema, or NULL if there was an error
  */
-SNSOURCE *snsource_custom(
-    int (*read_func)(void *),
-    void (*free_func)(void *),
-    int (*rewind_func)(void *),
-    void *custom);
+SNSCHEMA *snschema_compile(SNSOURCE *pIn, int *pErr, long *pLine);
 
 /*
- * Free a Shastina source.
- * 
- * This call is ignored if NULL is passed.
- * 
- * The source object must not be used again after freeing it.
+ * Free a compiled schema.
  * 
- * This call will also run any registered destructor routine within the
- * source structure.
+ * This call is ignored if NULL is passed.  No parser may still be using
+ * the schema.
  * 
  * Parameters:
  * 
- *   pSrc - the source object to free or NULL
+ *   pSchema - the schema to free, or NULL
  */
-void snsource_free(SNSOURCE *pSrc);
+void snschema_free(SNSCHEMA *pSchema);
 
 /*
- * Determine how many bytes have been successfully read through the
- * source.
+ * Look up the ID of an operation in the operator set of a schema.
  * 
- * If the total number of bytes exceeds the range of a long, then
- * LONG_MAX will be returned.
+ * Parameters:
  * 
- * This count does NOT include any SNERR_EOF or SNERR_IOERR codes that
- * were returned from the source.  It only includes actual bytes that
- * were read through the source.
+ *   pSchema - the schema
  * 
- * After successfully reading the |; entity, this count will be total
- * number of bytes from the start of the file up to and including the
- * semicolon in the |; entity.
+ *   pName - the nul-terminated operation name
  * 
- * For multipass sources, rewinding will reset this counter to zero.
+ * Return:
+ * 
+ *   the ID of the operation, or zero if it is not in the operator set
+ */
+long snschema_op(const SNSCHEMA *pSchema, const char *pName);
+
+/*
+ * Look up the ID of a string prefix in the prefix set of a schema.
  * 
  * Parameters:
  * 
- *   pSrc - the source object to query
+ *   pSchema - the schema
+ * 
+ *   pPrefix - the nul-terminated string prefix
  * 
  * Return:
  * 
- *   the number of bytes read through the source, or LONG_MAX if this
- *   count exceeds the limit of a long
+ *   the ID of the prefix, or zero if it is not in the prefix set
  */
-long snsource_bytes(SNSOURCE *pSrc);
+long snschema_prefix(const SNSCHEMA *pSchema, const char *pPrefix);
 
 /*
- * Consume the rest of the data in a source and make sure that there is
- * nothing but whitespace and blank lines.
- * 
- * pSrc is the source object to consume.
- * 
- * This function will keep reading from the source until one of the
- * following happens:
- * 
- *   (1) Something other than SP HT CR LF is read
- *   (2) SNERR_EOF is encountered
- *   (3) SNERR_IOERR is encountered
- *   (4) Some other error is encountered
+ * Allocate a stack effect analyzer.
+ * 
+ * An analyzer checks the grouping rule of the Shastina specification
+ * statically.  Each group, including the groups that Shastina inserts
+ * around array elements, must leave exactly one value on the stack
+ * without popping any of the values that were hidden when it began.
+ * 
+ * The analyzer models the recommended client architecture.  STRING,
+ * NUMERIC, and GET entities push one value.  VARIABLE, CONSTANT, and
+ * ASSIGN entities pop one value.  ARRAY entities push the element
+ * count, and each array element is a group.  OPERATION entities have
+ * the effects declared with snanalyzer_effect(), and operations that
+ * have not been declared have an unknown effect.  Metacommands have no
+ * effect on the stack.
+ * 
+ * Analysis is a single pass over the entity stream with no backtracking.
+ * Each group is given a marker, which is SNGROUP_PROVEN if the group is
+ * correct whatever happens at runtime, SNGROUP_INVALID if it can never
+ * be correct, and SNGROUP_UNKNOWN if it depends on unknown effects.
+ * Groups are numbered from zero in the order of their BEGIN_GROUP
+ * entities, so a runtime can count BEGIN_GROUP entities as it executes
+ * and skip its depth check for proven groups.
+ * 
+ * The analyzer should eventually be freed with snanalyzer_free().
  * 
- * The function succeeds and returns greater than zero in case (2),
- * which indicates that only whitespace and blank lines remained in the
- * file.
+ * Return:
  * 
- * The function fails and returns SNERR_TRAILER in case (1) or (4), or
- * the error code SNERR_IOERR in case (3).
+ *   a new analyzer with no declared operations
+ */
+SNANALYZER *snanalyzer_alloc(void);
+
+/*
+ * Free a stack effect analyzer.
  * 
- * Do not use this function in the middle of parsing a Shastina file
- * with the source or undefined behavior occurs.
+ * This call is ignored if NULL is passed.
  * 
- * This function is intended for cases where nothing should follow the
- * |; EOF marker in the Shastina file.  Parsing stops at the semicolon
- * in the |; EOF marker without reading any further than that.  This
- * function can then make sure that nothing besides whitespace and blank
- * lines remains after the |; EOF marker.
+ * Parameters:
  * 
- * Note that after you use this function, snsource_bytes() will be
- * changed to include the number of additional bytes consumed by this
- * function.  You can therefore no longer use snsource_bytes() to count
- * the number of bytes up to the |; EOF marker after calling this
- * function.
+ *   pAn - the analyzer to free or NULL
+ */
+void snanalyzer_free(SNANALYZER *pAn);
+
+/*
+ * Declare the stack effect of an operation.
  * 
- * You may call this on a source that has already reached EOF, in which
- * case this function will just return greater than zero.
+ * pops is the number of values the operation pops, and pushes is the
+ * number of values it then pushes.  Either may be SNEFFECT_ANY if the
+ * count is only known at runtime.  Declaring an operation again
+ * replaces its effect.
  * 
  * Parameters:
  * 
- *   pSrc - the Shastina source object
+ *   pAn - the analyzer
  * 
- * Return:
+ *   pName - the nul-terminated operation name
  * 
- *   greater than zero if all remaining data has been read from the
- *   source and nothing besides whitespace and blank lines remained,
- *   SNERR_TRAILER if something besides whitespace and blank lines was
- *   encountered, SNERR_IOERR if there was an I/O error reading from the
- *   source object
+ *   pops - the number of values popped, or SNEFFECT_ANY
+ * 
+ *   pushes - the number of values pushed, or SNEFFECT_ANY
  */
-int snsource_consume(SNSOURCE *pSrc);
+void snanalyzer_effect(
+    SNANALYZER * pAn,
+    const char * pName,
+    int          pops,
+    int          pushes);
 
 /*
- * Determine whether a given Shastina source supports multipass
- * operation.
+ * Clear the results of an analyzer so that it can analyze another
+ * document.
  * 
- * Multipass sources can be rewound at any time to start reading again
- * from the beginning.  Single-pass sources can only be read through
- * once.
+ * Declared operation effects are kept.
  * 
  * Parameters:
  * 
- *   pSrc - the Shastina source object
- * 
- * Return:
- * 
- *   non-zero if source supports multipass, zero if not
+ *   pAn - the analyzer
  */
-int snsource_ismulti(SNSOURCE *pSrc);
+void snanalyzer_reset(SNANALYZER *pAn);
 
 /*
- * Rewind a Shastina source back to the beginning so it can be read
- * again.
+ * Pass an entity to an analyzer.
  * 
- * This is only supported by multipass sources.  A fault occurs if it is
- * called on a single-pass source.  Use snsource_ismulti() to check
- * whether a source supports this function.
+ * This allows a client to analyze a document while it reads the
+ * entities for some other purpose.  Entities must be passed in the
+ * order they are read, starting after snanalyzer_alloc() or
+ * snanalyzer_reset().  Error entities are ignored.
  * 
- * If you are rewinding, you will probably need to allocate a new parser
- * object to parse the file in the new pass.
+ * line and offset are recorded with any error the entity causes, and
+ * should be the values of snparser_count() and snsource_bytes() right
+ * after the entity was read.
  * 
  * Parameters:
  * 
- *   pSrc - the Shastina source object
+ *   pAn - the analyzer
  * 
- * Return:
+ *   pEntity - the entity
  * 
- *   non-zero if successful, zero if an I/O error prevented a successful
- *   rewind
+ *   line - the line number of the entity
+ * 
+ *   offset - the byte offset of the entity
  */
-int snsource_rewind(SNSOURCE *pSrc);
+void snanalyzer_entity(
+    SNANALYZER     * pAn,
+    const SNENTITY * pEntity,
+    long             line,
+    long             offset);
 
 /*
- * Allocate a new Shastina parser.
+ * Analyze a whole document.
  * 
- * The parser must eventually be freed with snparser_free().
+ * The analyzer is reset, and then entities are read from the source
+ * with the parser and passed to snanalyzer_entity() up to and including
+ * the EOF entity.
+ * 
+ * If the parser stops with an error, the error code is returned and the
+ * results only cover the entities read before it.  Otherwise, the
+ * number of stack effect errors is returned.
+ * 
+ * Parameters:
+ * 
+ *   pAn - the analyzer
+ * 
+ *   pParser - the parser to read with
+ * 
+ *   pIn - the source to read
  * 
  * Return:
  * 
- *   a new Shastina parser
+ *   the number of stack effect errors, or a negative SNERR_ code if
+ *   the document could not be parsed
  */
-SNPARSER *snparser_alloc(void);
+long snanalyzer_run(SNANALYZER *pAn, SNPARSER *pParser, SNSOURCE *pIn);
 
 /*
- * Free a Shastina parser.
- * 
- * This call is ignored if NULL is passed.
+ * Get the number of stack effect errors found by an analyzer.
  * 
- * The parser object must not be used again after freeing it.
+ * The error codes are SNERR_UNDERFLOW for an entity that pops values
+ * hidden by the group it is in, and SNERR_GROUPSIZE for the end of a
+ * group that does not leave exactly one value.  Underflow is not
+ * reported outside of groups, because the runtime may have values on
+ * its stack before the document begins.
  * 
  * Parameters:
  * 
- *   pParser - the parser object to free or NULL
+ *   pAn - the analyzer
+ * 
+ * Return:
+ * 
+ *   the number of errors
  */
-void snparser_free(SNPARSER *pParser);
+long snanalyzer_errcount(const SNANALYZER *pAn);
 
 /*
- * Parse an entity from a Shastina source file.
+ * Get a stack effect error found by an analyzer.
  * 
- * pParser is the parser object.
+ * i is the index of the error, from zero up to one less than
+ * snanalyzer_errcount().  Errors are in the order they were found.
  * 
- * pEntity is the entity structure that will be filled in.  Its state
- * upon entry to the function is irrelevant.  Upon return, it will hold
- * the results of the operation.  See the structure documentation for
- * further information.
+ * Parameters:
  * 
- * pIn is the input source to read from.
+ *   pAn - the analyzer
  * 
- * Once an error is encountered, the parser object will return that same
- * error each time this function is called without doing anything
- * further.
+ *   i - the index of the error
  * 
- * Once the End Of File (EOF) entity is returned, this function will
- * return the EOF entity on all subsequent calls without doing anything
- * further.
+ *   pInfo - the structure to receive the error
+ */
+void snanalyzer_errinfo(const SNANALYZER *pAn, long i, SNERRINFO *pInfo);
+
+/*
+ * Get the number of groups an analyzer has seen.
  * 
  * Parameters:
  * 
- *   pReader - the reader object
+ *   pAn - the analyzer
  * 
- *   pEntity - pointer to the entity to receive the results
+ * Return:
  * 
- *   pIn - the input source
+ *   the number of BEGIN_GROUP entities
  */
-void snparser_read(
-    SNPARSER * pParser,
-    SNENTITY * pEntity,
-    SNSOURCE * pIn);
+long snanalyzer_groups(const SNANALYZER *pAn);
 
 /*
- * Return the current line count.
+ * Get the marker of a group.
  * 
- * The line count is always at least one and at most LONG_MAX.  The
- * value of LONG_MAX is an overflow value, so any count of lines above
- * that will just remain at LONG_MAX.
+ * g is the number of the group, from zero up to one less than
+ * snanalyzer_groups().  Groups that have begun but not yet ended are
+ * SNGROUP_UNKNOWN.
  * 
  * Parameters:
  * 
- *   pParser - the parser object
+ *   pAn - the analyzer
+ * 
+ *   g - the group number
  * 
  * Return:
  * 
- *   the current line count
+ *   one of the SNGROUP_ constants
  */
-long snparser_count(SNPARSER *pParser);
+int snanalyzer_group(const SNANALYZER *pAn, long g);
 
 /*
  * Convert a Shastina SNERR_ error code into a string.
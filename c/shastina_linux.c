@@ -0,0 +1,865 @@
+/*
+ * shastina_linux.c
+ * 
+ * Optional Shastina sources that depend on Linux system interfaces.
+ * 
+ * See the header for specifications.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "shastina_linux.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/*
+ * The size in bytes of the read buffer of a follow source.
+ */
+#define SNFOLLOW_BUFSIZE (65536)
+
+/*
+ * The size in bytes of the buffer used to drain inotify events.
+ */
+#define SNFOLLOW_EVBUF (4096)
+
+/*
+ * The inotify events watched on the followed file.
+ */
+#define SNFOLLOW_FILE_EVENTS \
+  (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+
+/*
+ * The inotify events watched on the directory of the followed file, so
+ * that a replacement file created by rotation is noticed.
+ */
+#define SNFOLLOW_DIR_EVENTS \
+  (IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)
+
+/*
+ * Results of the snfollow_wait function.
+ */
+#define SNFOLLOW_WAIT_MORE  (1)  /* Something changed, so check again */
+#define SNFOLLOW_WAIT_STOP  (0)  /* Timed out or stopped */
+#define SNFOLLOW_WAIT_ERROR (-1) /* I/O error */
+
+/*
+ * The distance in bytes the read cursor of a mapped source moves
+ * between updates of its memory advice.
+ */
+#define SNMMAP_STEP (1048576L)
+
+/*
+ * The number of bytes behind the read cursor of a mapped source that
+ * are never released.
+ */
+#define SNMMAP_KEEP (1048576L)
+
+/*
+ * The number of bytes ahead of the read cursor of a mapped source that
+ * are requested in advance.
+ */
+#define SNMMAP_AHEAD (4194304L)
+
+/*
+ * Structure for storing the state of a follow source.
+ */
+typedef struct {
+  
+  /*
+   * The currently open file, or -1 if the path did not exist the last
+   * time the file was reopened.
+   */
+  int fd;
+  
+  /*
+   * The device and inode of the open file, which are used to detect
+   * when the path has been replaced by a new file.
+   */
+  dev_t dev;
+  ino_t ino;
+  
+  /*
+   * The number of bytes read from the open file so far.
+   */
+  off_t offset;
+  
+  /*
+   * The path of the followed file and of its directory, each
+   * dynamically allocated.
+   */
+  char *pPath;
+  char *pDir;
+  
+  /*
+   * The inotify instance and the watches on the file and directory.
+   * 
+   * wd_file is -1 if the file is not currently being watched.
+   */
+  int ifd;
+  int wd_file;
+  int wd_dir;
+  
+  /*
+   * The idle timeout in milliseconds, or -1, and the stop descriptor,
+   * or -1.
+   */
+  long idle_ms;
+  int stop_fd;
+  
+  /*
+   * Non-zero if the source is waiting at the end of the file, in which
+   * case idle_start has the time at which waiting began.
+   */
+  int idle;
+  struct timespec idle_start;
+  
+  /*
+   * Non-zero once End Of File has been reported.
+   */
+  int done;
+  
+  /*
+   * The read buffer.
+   * 
+   * buf_len is the number of bytes in the buffer and buf_pos is the
+   * number of those that have been returned.
+   */
+  long buf_len;
+  long buf_pos;
+  unsigned char buf[SNFOLLOW_BUFSIZE];
+  
+} SNFOLLOW;
+
+/*
+ * Structure for storing the state of a mapped source.
+ */
+typedef struct {
+  
+  /*
+   * The mapping, and the length of the file, which is also the length
+   * of the mapping.
+   * 
+   * If the file is empty, nothing is mapped and pBase points to an
+   * empty static string.
+   */
+  const unsigned char *pBase;
+  long len;
+  
+  /*
+   * The SNMMAP flags and the page size.
+   */
+  int flags;
+  long page;
+  
+  /*
+   * The number of bytes that have been read.
+   */
+  long pos;
+  
+  /*
+   * The read position at which the memory advice is next updated.
+   * 
+   * Keeping this as a single position means the reading callback only
+   * needs one extra comparison per byte.
+   */
+  long mark;
+  
+  /*
+   * The number of bytes at the start of the mapping that have been
+   * released.  This is always a multiple of the page size.
+   */
+  long released;
+  
+  /*
+   * The source that wraps this state, or NULL before it is allocated.
+   * 
+   * The line-start index of the source is extended over each range
+   * before the range is released.
+   */
+  SNSOURCE *pSrc;
+  
+} SNMMAP;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static long snfollow_elapsed(const struct timespec *pStart);
+static int snfollow_open(SNFOLLOW *pF);
+static int snfollow_check(SNFOLLOW *pF);
+static int snfollow_wait(SNFOLLOW *pF);
+
+static int snfollow_read(void *pCustom);
+static void snfollow_free(void *pCustom);
+
+static void snmmap_advise(SNMMAP *pM);
+static int snmmap_read(void *pCustom);
+static int snmmap_rewind(void *pCustom);
+static void snmmap_free(void *pCustom);
+
+/*
+ * Compute the number of milliseconds elapsed on the monotonic clock
+ * since a given time.
+ * 
+ * Parameters:
+ * 
+ *   pStart - the starting time
+ * 
+ * Return:
+ * 
+ *   the elapsed milliseconds
+ */
+static long snfollow_elapsed(const struct timespec *pStart) {
+  
+  struct timespec now;
+  long result = 0;
+  
+  if (pStart == NULL) {
+    abort();
+  }
+  
+  memset(&now, 0, sizeof(struct timespec));
+  if (clock_gettime(CLOCK_MONOTONIC, &now)) {
+    abort();
+  }
+  
+  result = ((long) (now.tv_sec - pStart->tv_sec)) * 1000L;
+  result += (long) ((now.tv_nsec - pStart->tv_nsec) / 1000000L);
+  if (result < 0) {
+    result = 0;
+  }
+  
+  return result;
+}
+
+/*
+ * Open the file at the path of a follow source, replacing any file
+ * that is already open, and watch it.
+ * 
+ * If the path does not exist, the source is left without an open file
+ * and the function succeeds, so that the source waits for the file to
+ * be created.
+ * 
+ * Parameters:
+ * 
+ *   pF - the follow source state
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if an I/O error occurred
+ */
+static int snfollow_open(SNFOLLOW *pF) {
+  
+  struct stat st;
+  int status = 1;
+  
+  if (pF == NULL) {
+    abort();
+  }
+  
+  memset(&st, 0, sizeof(struct stat));
+  
+  /* Close the current file and remove its watch, which may already
+   * have been removed by the kernel if the file was deleted */
+  if (pF->fd >= 0) {
+    close(pF->fd);
+    pF->fd = -1;
+  }
+  if (pF->wd_file >= 0) {
+    inotify_rm_watch(pF->ifd, pF->wd_file);
+    pF->wd_file = -1;
+  }
+  pF->offset = 0;
+  
+  /* Watch the path before opening it, so that nothing written in
+   * between is missed */
+  pF->wd_file = inotify_add_watch(pF->ifd, pF->pPath,
+                                  SNFOLLOW_FILE_EVENTS);
+  if ((pF->wd_file < 0) && (errno != ENOENT)) {
+    status = 0;
+  }
+  
+  /* Open the file and record its identity */
+  if (status && (pF->wd_file >= 0)) {
+    pF->fd = open(pF->pPath, O_RDONLY | O_CLOEXEC);
+    if (pF->fd >= 0) {
+      if (fstat(pF->fd, &st)) {
+        status = 0;
+      } else {
+        pF->dev = st.st_dev;
+        pF->ino = st.st_ino;
+      }
+    } else if (errno != ENOENT) {
+      status = 0;
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * Check a follow source at the end of its file for rotation and
+ * truncation.
+ * 
+ * Parameters:
+ * 
+ *   pF - the follow source state
+ * 
+ * Return:
+ * 
+ *   greater than zero if there may be more to read now, zero if the
+ *   source should wait, or less than zero if an I/O error occurred
+ */
+static int snfollow_check(SNFOLLOW *pF) {
+  
+  struct stat st;
+  int result = 0;
+  
+  if (pF == NULL) {
+    abort();
+  }
+  
+  memset(&st, 0, sizeof(struct stat));
+  
+  if (stat(pF->pPath, &st)) {
+    /* Path is gone, so wait for it unless there was another error */
+    if (errno != ENOENT) {
+      result = -1;
+    }
+    
+  } else if ((pF->fd < 0) ||
+              (st.st_dev != pF->dev) || (st.st_ino != pF->ino)) {
+    /* Path exists but is not the open file, so switch to it */
+    if (snfollow_open(pF)) {
+      result = 1;
+    } else {
+      result = -1;
+    }
+    
+  } else if (st.st_size < pF->offset) {
+    /* File has been truncated, so start again from the beginning */
+    if (lseek(pF->fd, 0, SEEK_SET) == (off_t) -1) {
+      result = -1;
+    } else {
+      pF->offset = 0;
+      result = 1;
+    }
+    
+  } else if (st.st_size > pF->offset) {
+    /* Data was appended since the last read */
+    result = 1;
+  }
+  
+  return result;
+}
+
+/*
+ * Wait until something changes in the followed file or its directory,
+ * the idle timeout passes, or the stop descriptor becomes readable.
+ * 
+ * Parameters:
+ * 
+ *   pF - the follow source state
+ * 
+ * Return:
+ * 
+ *   one of the SNFOLLOW_WAIT constants
+ */
+static int snfollow_wait(SNFOLLOW *pF) {
+  
+  struct pollfd pfd[2];
+  char evbuf[SNFOLLOW_EVBUF];
+  int result = SNFOLLOW_WAIT_MORE;
+  int timeout = -1;
+  int count = 1;
+  int rc = 0;
+  long left = 0;
+  
+  if (pF == NULL) {
+    abort();
+  }
+  
+  memset(pfd, 0, sizeof(pfd));
+  
+  /* Start the idle period if not already waiting, and work out how
+   * much of it is left */
+  if (!(pF->idle)) {
+    pF->idle = 1;
+    if (clock_gettime(CLOCK_MONOTONIC, &(pF->idle_start))) {
+      abort();
+    }
+  }
+  if (pF->idle_ms >= 0) {
+    left = pF->idle_ms - snfollow_elapsed(&(pF->idle_start));
+    if (left <= 0) {
+      result = SNFOLLOW_WAIT_STOP;
+    } else if (left > 0x7fffffffL) {
+      timeout = 0x7fffffff;
+    } else {
+      timeout = (int) left;
+    }
+  }
+  
+  /* Wait for inotify events or the stop descriptor */
+  if (result == SNFOLLOW_WAIT_MORE) {
+    pfd[0].fd = pF->ifd;
+    pfd[0].events = POLLIN;
+    if (pF->stop_fd >= 0) {
+      pfd[1].fd = pF->stop_fd;
+      pfd[1].events = POLLIN;
+      count = 2;
+    }
+    
+    rc = poll(pfd, (nfds_t) count, timeout);
+    if (rc < 0) {
+      if (errno != EINTR) {
+        result = SNFOLLOW_WAIT_ERROR;
+      }
+    } else if (rc == 0) {
+      result = SNFOLLOW_WAIT_STOP;
+    } else if ((count > 1) && (pfd[1].revents != 0)) {
+      result = SNFOLLOW_WAIT_STOP;
+    }
+  }
+  
+  /* Drain the inotify events; their contents do not matter, since the
+   * caller checks the file again in any case */
+  if ((result == SNFOLLOW_WAIT_MORE) && (pfd[0].revents & POLLIN)) {
+    if (read(pF->ifd, evbuf, sizeof(evbuf)) < 0) {
+      if ((errno != EAGAIN) && (errno != EINTR)) {
+        result = SNFOLLOW_WAIT_ERROR;
+      }
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Reading callback for a follow source.
+ * 
+ * The function prototype matches the read_func of snsource_custom().
+ * See the documentation of that function for further information.
+ */
+static int snfollow_read(void *pCustom) {
+  
+  SNFOLLOW *pF = NULL;
+  ssize_t rc = 0;
+  int c = SNERR_EOF;
+  int rv = 0;
+  int pending = 1;
+  
+  if (pCustom == NULL) {
+    abort();
+  }
+  pF = (SNFOLLOW *) pCustom;
+  
+  while (pending) {
+    if (pF->buf_pos < pF->buf_len) {
+      /* Return the next buffered byte */
+      c = (int) pF->buf[pF->buf_pos];
+      (pF->buf_pos)++;
+      pending = 0;
+      
+    } else if (pF->done) {
+      /* End Of File already reached */
+      c = SNERR_EOF;
+      pending = 0;
+      
+    } else {
+      /* Refill the buffer from whatever is available now */
+      rc = 0;
+      if (pF->fd >= 0) {
+        rc = read(pF->fd, pF->buf, SNFOLLOW_BUFSIZE);
+      }
+      
+      if (rc > 0) {
+        pF->buf_len = (long) rc;
+        pF->buf_pos = 0;
+        pF->offset += (off_t) rc;
+        pF->idle = 0;
+        
+      } else if ((rc < 0) && (errno != EINTR)) {
+        c = SNERR_IOERR;
+        pending = 0;
+        
+      } else if (rc == 0) {
+        /* At the end of the file, so check for rotation and wait if
+         * there is nothing more to read */
+        rv = snfollow_check(pF);
+        if (rv < 0) {
+          c = SNERR_IOERR;
+          pending = 0;
+          
+        } else if (rv == 0) {
+          rv = snfollow_wait(pF);
+          if (rv == SNFOLLOW_WAIT_STOP) {
+            pF->done = 1;
+          } else if (rv == SNFOLLOW_WAIT_ERROR) {
+            c = SNERR_IOERR;
+            pending = 0;
+          }
+        }
+      }
+    }
+  }
+  
+  return c;
+}
+
+/*
+ * Destructor callback for a follow source.
+ * 
+ * The function prototype matches the free_func of snsource_custom().
+ * See the documentation of that function for further information.
+ */
+static void snfollow_free(void *pCustom) {
+  
+  SNFOLLOW *pF = NULL;
+  
+  if (pCustom == NULL) {
+    abort();
+  }
+  pF = (SNFOLLOW *) pCustom;
+  
+  if (pF->fd >= 0) {
+    close(pF->fd);
+  }
+  if (pF->ifd >= 0) {
+    close(pF->ifd);
+  }
+  free(pF->pPath);
+  free(pF->pDir);
+  free(pF);
+}
+
+/*
+ * Update the memory advice of a mapped source for the current read
+ * position, and set the position of the next update.
+ * 
+ * Failures of madvise() are ignored, since the advice only affects
+ * performance.
+ * 
+ * Parameters:
+ * 
+ *   pM - the mapped source state
+ */
+static void snmmap_advise(SNMMAP *pM) {
+  
+  long start = 0;
+  long end = 0;
+  
+  if (pM == NULL) {
+    abort();
+  }
+  
+  /* Request the range ahead of the cursor, starting at the page that
+   * holds the cursor */
+  start = pM->pos - (pM->pos % pM->page);
+  end = pM->pos + SNMMAP_AHEAD;
+  if (end > pM->len) {
+    end = pM->len;
+  }
+  if (end > start) {
+    madvise((void *) (pM->pBase + start), (size_t) (end - start),
+            MADV_WILLNEED);
+  }
+  
+  /* Release whole pages behind the cursor, except for the most recent
+   * ones; the line-start index is extended over them first, so that
+   * line lookups do not fault them back in, and deactivating them lets
+   * the kernel reclaim them from the page cache early too */
+  if (pM->flags & SNMMAP_RELEASE) {
+    end = pM->pos - SNMMAP_KEEP;
+    end = end - (end % pM->page);
+    if (end > pM->released) {
+      if (pM->pSrc != NULL) {
+        snsource_scan(pM->pSrc, end);
+      }
+#ifdef MADV_COLD
+      madvise((void *) (pM->pBase + pM->released),
+              (size_t) (end - pM->released), MADV_COLD);
+#endif
+      madvise((void *) (pM->pBase + pM->released),
+              (size_t) (end - pM->released), MADV_DONTNEED);
+      pM->released = end;
+    }
+  }
+  
+  /* Schedule the next update */
+  if (pM->pos <= LONG_MAX - SNMMAP_STEP) {
+    pM->mark = pM->pos + SNMMAP_STEP;
+  } else {
+    pM->mark = LONG_MAX;
+  }
+}
+
+/*
+ * Reading callback for a mapped source.
+ * 
+ * The function prototype matches the read_func of snsource_custom().
+ * See the documentation of that function for further information.
+ */
+static int snmmap_read(void *pCustom) {
+  
+  SNMMAP *pM = NULL;
+  int c = SNERR_EOF;
+  
+  if (pCustom == NULL) {
+    abort();
+  }
+  pM = (SNMMAP *) pCustom;
+  
+  if (pM->pos < pM->len) {
+    c = (int) (pM->pBase)[pM->pos];
+    (pM->pos)++;
+    if (pM->pos >= pM->mark) {
+      snmmap_advise(pM);
+    }
+  }
+  
+  return c;
+}
+
+/*
+ * Rewinding callback for a mapped source.
+ * 
+ * The function prototype matches the rewind_func of snsource_custom().
+ * See the documentation of that function for further information.
+ */
+static int snmmap_rewind(void *pCustom) {
+  
+  SNMMAP *pM = NULL;
+  
+  if (pCustom == NULL) {
+    abort();
+  }
+  pM = (SNMMAP *) pCustom;
+  
+  /* Released pages are read back from the file as they are accessed
+   * again, so they simply count as not released any more; the line
+   * index already covers them and is kept */
+  pM->pos = 0;
+  pM->released = 0;
+  snmmap_advise(pM);
+  
+  return 1;
+}
+
+/*
+ * Destructor callback for a mapped source.
+ * 
+ * The function prototype matches the free_func of snsource_custom().
+ * See the documentation of that function for further information.
+ */
+static void snmmap_free(void *pCustom) {
+  
+  SNMMAP *pM = NULL;
+  
+  if (pCustom == NULL) {
+    abort();
+  }
+  pM = (SNMMAP *) pCustom;
+  
+  if (pM->len > 0) {
+    munmap((void *) pM->pBase, (size_t) pM->len);
+  }
+  free(pM);
+}
+
+/*
+ * Public functions
+ * ================
+ * 
+ * (see the header for specifications)
+ */
+
+/*
+ * snsource_follow function.
+ */
+SNSOURCE *snsource_follow(const char *pPath, long idle_ms, int stop_fd) {
+  
+  SNFOLLOW *pF = NULL;
+  SNSOURCE *pSrc = NULL;
+  const char *pSlash = NULL;
+  size_t plen = 0;
+  size_t dlen = 0;
+  int status = 1;
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (idle_ms < -1) || (stop_fd < -1)) {
+    abort();
+  }
+  
+  /* Allocate the state */
+  pF = (SNFOLLOW *) malloc(sizeof(SNFOLLOW));
+  if (pF == NULL) {
+    abort();
+  }
+  memset(pF, 0, sizeof(SNFOLLOW));
+  
+  pF->fd = -1;
+  pF->ifd = -1;
+  pF->wd_file = -1;
+  pF->wd_dir = -1;
+  pF->idle_ms = idle_ms;
+  pF->stop_fd = stop_fd;
+  
+  /* Copy the path, and the directory part of it, which is "." if the
+   * path has no slash and "/" for a file in the root directory */
+  plen = strlen(pPath);
+  pSlash = strrchr(pPath, '/');
+  if (pSlash == NULL) {
+    dlen = 1;
+  } else if (pSlash == pPath) {
+    dlen = 1;
+  } else {
+    dlen = (size_t) (pSlash - pPath);
+  }
+  
+  pF->pPath = (char *) malloc(plen + 1);
+  pF->pDir = (char *) malloc(dlen + 1);
+  if ((pF->pPath == NULL) || (pF->pDir == NULL)) {
+    abort();
+  }
+  memcpy(pF->pPath, pPath, plen + 1);
+  if (pSlash == NULL) {
+    strcpy(pF->pDir, ".");
+  } else {
+    memcpy(pF->pDir, pPath, dlen);
+    (pF->pDir)[dlen] = (char) 0;
+  }
+  
+  /* Set up inotify and watch the directory */
+  pF->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (pF->ifd < 0) {
+    status = 0;
+  }
+  if (status) {
+    pF->wd_dir = inotify_add_watch(pF->ifd, pF->pDir,
+                                    SNFOLLOW_DIR_EVENTS);
+    if (pF->wd_dir < 0) {
+      status = 0;
+    }
+  }
+  
+  /* Open and watch the file, which must exist at first */
+  if (status) {
+    if (!snfollow_open(pF)) {
+      status = 0;
+    } else if (pF->fd < 0) {
+      status = 0;
+    }
+  }
+  
+  /* Wrap the state in a source, or release it if setup failed */
+  if (status) {
+    pSrc = snsource_custom(
+            &snfollow_read,
+            &snfollow_free,
+            NULL,
+            (void *) pF);
+  } else {
+    snfollow_free((void *) pF);
+  }
+  pF = NULL;
+  
+  return pSrc;
+}
+
+/*
+ * snsource_mmap function.
+ */
+SNSOURCE *snsource_mmap(const char *pPath, int flags) {
+  
+  struct stat st;
+  SNMMAP *pM = NULL;
+  SNSOURCE *pSrc = NULL;
+  void *pMap = NULL;
+  int fd = -1;
+  int status = 1;
+  
+  /* Check parameters */
+  if (pPath == NULL) {
+    abort();
+  }
+  
+  memset(&st, 0, sizeof(struct stat));
+  
+  /* Allocate the state */
+  pM = (SNMMAP *) malloc(sizeof(SNMMAP));
+  if (pM == NULL) {
+    abort();
+  }
+  memset(pM, 0, sizeof(SNMMAP));
+  
+  pM->pBase = (const unsigned char *) "";
+  pM->len = 0;
+  pM->flags = flags;
+  pM->page = sysconf(_SC_PAGESIZE);
+  if (pM->page < 1) {
+    abort();
+  }
+  
+  /* Open the file and get its length */
+  fd = open(pPath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    status = 0;
+  }
+  if (status) {
+    if (fstat(fd, &st)) {
+      status = 0;
+    } else if ((!S_ISREG(st.st_mode)) || (st.st_size < 0) ||
+                (st.st_size > (off_t) LONG_MAX)) {
+      status = 0;
+    }
+  }
+  
+  /* Map the file unless it is empty, which mmap() does not allow; the
+   * mapping stays valid after the file is closed */
+  if (status && (st.st_size > 0)) {
+    pMap = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED,
+                fd, 0);
+    if (pMap == MAP_FAILED) {
+      status = 0;
+    } else {
+      pM->pBase = (const unsigned char *) pMap;
+      pM->len = (long) st.st_size;
+      
+      madvise(pMap, (size_t) pM->len, MADV_SEQUENTIAL);
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  
+  /* Wrap the state in a source with a memory view, which rewinds and
+   * requests the start of the file, or release it if setup failed */
+  if (status) {
+    pSrc = snsource_custom(
+            &snmmap_read,
+            &snmmap_free,
+            &snmmap_rewind,
+            (void *) pM);
+    snsource_view(pSrc, (const char *) pM->pBase);
+    pM->pSrc = pSrc;
+  } else {
+    free(pM);
+  }
+  pM = NULL;
+  
+  return pSrc;
+}
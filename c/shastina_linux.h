@@ -0,0 +1,126 @@
+#ifndef SHASTINA_LINUX_H_INCLUDED
+#define SHASTINA_LINUX_H_INCLUDED
+
+/*
+ * shastina_linux.h
+ * 
+ * Optional Shastina sources that depend on Linux system interfaces.
+ * 
+ * This module is built on the public interface of the core library,
+ * which remains ANSI C with no dependencies.  Only compile this module
+ * on Linux.
+ */
+
+#include "shastina.h"
+
+/*
+ * Flags for use with snsource_mmap().
+ * 
+ * SNMMAP_NORMAL has a value of zero, meaning no special flags set.  The
+ * other flags can be combined with bitwise OR.
+ * 
+ * If the RELEASE flag is set, pages of the mapping that the read cursor
+ * has moved well past are released as reading goes on, so the resident
+ * memory of the source stays about the same no matter how large the
+ * file is.
+ */
+#define SNMMAP_NORMAL   (0)
+#define SNMMAP_RELEASE  (1)
+
+/*
+ * Allocate a Shastina source that follows a growing file.
+ * 
+ * pPath is the path of the file to follow.  The file is opened and
+ * read from its beginning.  When the source reaches the end of the
+ * file, it does not report End Of File.  Instead, it waits without
+ * polling, through inotify, until more data is appended and then
+ * continues reading.  This is the equivalent of "tail -F" for a file
+ * that producers append Shastina documents to.
+ * 
+ * Rotation is handled at the end of the file.  If the path has been
+ * renamed away and a new file created in its place, the source
+ * continues reading from the beginning of the new file, after all the
+ * data of the old file has been read.  If the file has been truncated
+ * below the current read position, the source continues reading from
+ * the beginning of the file.  If the path does not exist at the end of
+ * the file, the source waits for it to be created.
+ * 
+ * The wait at the end of the file stops in two ways, in which case the
+ * source reports End Of File as usual:
+ * 
+ *   (1) If idle_ms is zero or greater, when idle_ms milliseconds have
+ *       passed without any new data.  Use -1 to wait indefinitely.
+ * 
+ *   (2) If stop_fd is not -1, when the file descriptor stop_fd becomes
+ *       readable.  This may be the read end of a pipe or an eventfd,
+ *       for example, which another thread writes to in order to stop a
+ *       follow source.  The source never reads from stop_fd.
+ * 
+ * The source is buffered internally.  It does not read ahead beyond
+ * what is available in the file, so a document is delivered as soon as
+ * its |; token has been appended.  After a parser reads the |; token,
+ * use snparser_next_document() to go on to the next document, which
+ * waits in the same way for the next document to begin.
+ * 
+ * Follow sources do not support multipass.  They should eventually be
+ * freed with snsource_free(), which closes the file.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path of the file to follow
+ * 
+ *   idle_ms - the idle timeout in milliseconds, or -1
+ * 
+ *   stop_fd - a file descriptor that stops waiting, or -1
+ * 
+ * Return:
+ * 
+ *   a new Shastina source following the file, or NULL if the file
+ *   could not be opened or watched
+ */
+SNSOURCE *snsource_follow(const char *pPath, long idle_ms, int stop_fd);
+
+/*
+ * Allocate a Shastina source that reads a file through a read-only
+ * memory mapping.
+ * 
+ * pPath is the path of the file to map.  The whole file is mapped, and
+ * the kernel is told that it will be read sequentially.  As the read
+ * cursor moves, the range ahead of it is requested in advance.
+ * 
+ * flags is a combination of SNMMAP flags, or SNMMAP_NORMAL (zero) if no
+ * flags are required.  Unrecognized flags are ignored.
+ * 
+ * With SNMMAP_RELEASE, the range behind the read cursor is released
+ * with madvise() in large steps, always keeping at least the most
+ * recent megabyte.  The file is not changed and the mapping remains
+ * valid, so released pages that are accessed again are just read back
+ * from the file, which happens when the source is rewound.  If a parser
+ * counting lines lazily (see SNMODE_LAZYLINES) reads the source, the
+ * line-start index is extended over each range with snsource_scan()
+ * before the range is released, so that line lookups never access
+ * released pages.  The index costs one long per line of the file.
+ * Without lazy line counting, snsource_locate() on a released offset
+ * reads the pages back from the file.
+ * 
+ * Mapped sources support multipass and have a memory view, so they
+ * support lazy line counting and snsource_locate().  The file must not
+ * be truncated while it is mapped, or reading it raises SIGBUS.
+ * 
+ * The returned source object should eventually be freed with
+ * snsource_free(), which unmaps the file.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path of the file to map
+ * 
+ *   flags - combination of SNMMAP flags
+ * 
+ * Return:
+ * 
+ *   a new Shastina source reading the mapped file, or NULL if the file
+ *   could not be opened or mapped
+ */
+SNSOURCE *snsource_mmap(const char *pPath, int flags);
+
+#endif
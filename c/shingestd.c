@@ -0,0 +1,1291 @@
+/*
+ * shingestd.c
+ * ===========
+ * 
+ * Reference ingest daemon for Shastina documents.
+ * 
+ * Syntax:
+ * 
+ *   shingestd [socket] [output] [workers]
+ * 
+ * The daemon listens on the Unix-domain socket at path [socket], which
+ * must not already exist.  Any number of local producers may connect
+ * and write a stream of Shastina documents, each ending with the |;
+ * token.  The daemon frames the documents as their bytes arrive,
+ * parses each complete document on a pool of [workers] threads (four
+ * if not given), and hands the entities of each document that parsed
+ * successfully to a sink.
+ * 
+ * Each connection is assigned to one worker in turn as it is accepted,
+ * and all its documents are parsed by that worker in the order they
+ * arrived.  The documents of each producer therefore reach the sink in
+ * the order they were sent, while the documents of different producers
+ * may be interleaved in any order.
+ * 
+ * The default sink appends compiled binary entity records to the file
+ * at [output] (see "Binary sink" below).  Other sinks can be plugged
+ * in by filling in an SHSINK structure.
+ * 
+ * Sending SIGUSR1 to the daemon prints its throughput and latency
+ * counters to standard error.  SIGINT or SIGTERM stops the daemon,
+ * which finishes any queued documents, prints the counters a final
+ * time, and removes the socket.
+ * 
+ * Producers never receive anything back.  A connection that sends a
+ * document larger than SHINGEST_MAXDOC bytes is closed.  Documents
+ * that fail to parse are counted and dropped.  Any partial document
+ * left when a producer closes its connection is counted as failed and
+ * dropped.
+ * 
+ * This program requires Linux (epoll and signalfd) and POSIX threads.
+ * Compile with libshastina and -pthread.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "shastina.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * The maximum size in bytes of a single document, including its |;
+ * terminator.
+ */
+#define SHINGEST_MAXDOC (1048576L)
+
+/*
+ * The number of bytes read from a connection at a time.
+ */
+#define SHINGEST_CHUNK (65536)
+
+/*
+ * The maximum number of framed documents waiting for each worker.
+ * 
+ * When the queue of a worker is full, the connection loop waits for
+ * the worker to take a document, which pushes back on producers
+ * through their socket buffers.
+ */
+#define SHINGEST_QUEUE (256)
+
+/*
+ * The default and maximum number of worker threads.
+ */
+#define SHINGEST_WORKERS_DEFAULT (4)
+#define SHINGEST_WORKERS_MAX (64)
+
+/*
+ * The maximum number of epoll events handled per wait.
+ */
+#define SHINGEST_EVENTS (64)
+
+/*
+ * The listen backlog of the socket.
+ */
+#define SHINGEST_BACKLOG (64)
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * A sink that receives the entities of parsed documents.
+ * 
+ * Each function is called with the pCustom pointer.  The sink is only
+ * ever called by one worker at a time, so it does not need its own
+ * locking.
+ * 
+ * pfBegin is called before the entities of a document.  pfEntity is
+ * called with each entity of the document in order, including the
+ * final EOF entity.  pfEnd is called after the last entity.
+ * 
+ * Each function returns non-zero if successful or zero if the sink
+ * failed, which stops the daemon.
+ */
+typedef struct {
+  
+  void *pCustom;
+  
+  int (*pfBegin)(void *pCustom);
+  int (*pfEntity)(void *pCustom, const SNENTITY *pEnt);
+  int (*pfEnd)(void *pCustom);
+  
+} SHSINK;
+
+/*
+ * A framed document waiting in the queue.
+ * 
+ * The document data is allocated directly after this structure and is
+ * nul-terminated.  framed is the time at which the framer found the
+ * end of the document, in nanoseconds.
+ */
+typedef struct {
+  
+  long len;
+  double framed;
+  
+} SHDOC;
+
+/*
+ * An entity parsed by a worker, with its strings copied to the local
+ * store of the worker.
+ * 
+ * key_off and value_off are the offsets of the key and value strings
+ * in the store, or -1 if the entity has no such string.
+ */
+typedef struct {
+  
+  SNENTITY ent;
+  long key_off;
+  long value_off;
+  
+} SHENT;
+
+/*
+ * The queue of framed documents waiting for one worker.
+ * 
+ * The queue is a ring buffer of SHINGEST_QUEUE document pointers.  A
+ * NULL document tells the worker to stop.
+ */
+typedef struct {
+  
+  SHDOC *ring[SHINGEST_QUEUE];
+  int head;
+  int count;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_cond_t space;
+  
+} SHQUEUE;
+
+/*
+ * The state of a producer connection.
+ */
+typedef struct {
+  
+  /*
+   * The socket of the connection.
+   */
+  int fd;
+  
+  /*
+   * The buffer holding the bytes of the document currently being
+   * framed.
+   * 
+   * cap is the allocated capacity, len is the number of bytes in the
+   * buffer, and scan is the number of those bytes that the framer has
+   * already examined.
+   */
+  char *pBuf;
+  long cap;
+  long len;
+  long scan;
+  
+  /*
+   * The state of the library scanner that finds the end of the
+   * document.
+   */
+  SNSCAN frame;
+  
+  /*
+   * The queue of the worker that parses all documents of the
+   * connection, which keeps them in order.
+   */
+  SHQUEUE *pQueue;
+  
+} SHCONN;
+
+/*
+ * The throughput and latency counters.
+ * 
+ * Latency is measured from the moment a document is framed to the
+ * moment its last entity has been given to the sink, so it includes
+ * time spent waiting in the queue.
+ */
+typedef struct {
+  
+  long conns;
+  long docs;
+  long failed;
+  long oversize;
+  double bytes;
+  double entities;
+  double lat_total;
+  double lat_max;
+  
+} SHSTATS;
+
+/*
+ * Static data
+ * ===========
+ */
+
+/*
+ * The queue of each worker.
+ */
+static SHQUEUE m_queues[SHINGEST_WORKERS_MAX];
+
+/*
+ * The sink, the counters, and the sink failure flag.
+ * 
+ * All of these are protected by m_sink_lock.
+ */
+static SHSINK m_sink;
+static SHSTATS m_stats;
+static int m_sink_failed = 0;
+static pthread_mutex_t m_sink_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The moment the daemon started, in nanoseconds.
+ */
+static double m_start = 0.0;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static double shingest_now(void);
+
+static int shbin_begin(void *pCustom);
+static int shbin_entity(void *pCustom, const SNENTITY *pEnt);
+static int shbin_end(void *pCustom);
+static void shbin_word(FILE *pOut, long v);
+
+static long shframe_scan(SHCONN *pConn);
+static int shframe_pending(SHCONN *pConn);
+
+static void shqueue_init(SHQUEUE *pQueue);
+static void shqueue_put(SHQUEUE *pQueue, SHDOC *pDoc);
+static SHDOC *shqueue_get(SHQUEUE *pQueue);
+
+static void *shworker_main(void *pArg);
+static void shworker_parse(SNPOOL *pPool, SHDOC *pDoc);
+
+static SHCONN *shconn_alloc(int fd, SHQUEUE *pQueue);
+static void shconn_free(SHCONN *pConn);
+static int shconn_read(SHCONN *pConn);
+static int shconn_emit(SHCONN *pConn, long doc_len);
+
+static void shstats_print(void);
+
+/*
+ * Return the current value of the monotonic clock in nanoseconds.
+ * 
+ * Return:
+ * 
+ *   the current time in nanoseconds
+ */
+static double shingest_now(void) {
+  
+  struct timespec ts;
+  
+  memset(&ts, 0, sizeof(struct timespec));
+  if (clock_gettime(CLOCK_MONOTONIC, &ts)) {
+    abort();
+  }
+  
+  return (((double) ts.tv_sec) * 1000000000.0) + ((double) ts.tv_nsec);
+}
+
+/*
+ * Binary sink
+ * ===========
+ * 
+ * The default sink writes each document as a sequence of records to a
+ * FILE handle passed as the pCustom pointer.
+ * 
+ * All integers are written as four-byte unsigned little-endian words.
+ * Each entity is written as:
+ * 
+ *   (1) The entity status (SNENTITY constant)
+ *   (2) The string type, or zero if not a string
+ *   (3) The array count, or zero if not an array
+ *   (4) The key length in bytes, followed by the key bytes
+ *   (5) The value length in bytes, followed by the value bytes
+ * 
+ * Entities without a key or value have a length of zero for that
+ * field.  No padding or terminators are written.  Since each document
+ * ends with an SNENTITY_EOF entity record, documents need no other
+ * framing in the output file.  The file is flushed after each
+ * document.
+ */
+
+/*
+ * Begin a document in the binary sink.
+ * 
+ * Parameters:
+ * 
+ *   pCustom - the output FILE handle
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the sink failed
+ */
+static int shbin_begin(void *pCustom) {
+  
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  return 1;
+}
+
+/*
+ * Write an entity to the binary sink.
+ * 
+ * Parameters:
+ * 
+ *   pCustom - the output FILE handle
+ * 
+ *   pEnt - the entity
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the sink failed
+ */
+static int shbin_entity(void *pCustom, const SNENTITY *pEnt) {
+  
+  FILE *pOut = NULL;
+  
+  if ((pCustom == NULL) || (pEnt == NULL)) {
+    abort();
+  }
+  pOut = (FILE *) pCustom;
+  
+  shbin_word(pOut, (long) pEnt->status);
+  shbin_word(pOut, (long) pEnt->str_type);
+  shbin_word(pOut, pEnt->count);
+  
+  shbin_word(pOut, pEnt->key_len);
+  if (pEnt->key_len > 0) {
+    fwrite(pEnt->pKey, 1, (size_t) pEnt->key_len, pOut);
+  }
+  
+  shbin_word(pOut, pEnt->value_len);
+  if (pEnt->value_len > 0) {
+    fwrite(pEnt->pValue, 1, (size_t) pEnt->value_len, pOut);
+  }
+  
+  return (ferror(pOut) ? 0 : 1);
+}
+
+/*
+ * Finish a document in the binary sink.
+ * 
+ * Parameters:
+ * 
+ *   pCustom - the output FILE handle
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the sink failed
+ */
+static int shbin_end(void *pCustom) {
+  
+  int result = 1;
+  
+  if (pCustom == NULL) {
+    abort();
+  }
+  
+  if (fflush((FILE *) pCustom)) {
+    result = 0;
+  }
+  
+  return result;
+}
+
+/*
+ * Write a four-byte little-endian word to the binary sink output.
+ * 
+ * v must be in range 0 to 0xffffffff.  Errors are detected later with
+ * ferror().
+ * 
+ * Parameters:
+ * 
+ *   pOut - the output file
+ * 
+ *   v - the value to write
+ */
+static void shbin_word(FILE *pOut, long v) {
+  
+  unsigned char buf[4];
+  
+  if ((pOut == NULL) || (v < 0) || (v > 0xffffffffL)) {
+    abort();
+  }
+  
+  buf[0] = (unsigned char) (v & 0xff);
+  buf[1] = (unsigned char) ((v >> 8) & 0xff);
+  buf[2] = (unsigned char) ((v >> 16) & 0xff);
+  buf[3] = (unsigned char) ((v >> 24) & 0xff);
+  
+  fwrite(buf, 1, 4, pOut);
+}
+
+/*
+ * Framer
+ * ======
+ * 
+ * The framer finds the end of each document in the bytes received on
+ * a connection without parsing it, using the document scanner of the
+ * library, which follows the same lexical rules as the parser.
+ * 
+ * The library parser pulls its input through a source callback, so it
+ * cannot be handed bytes as they arrive on a non-blocking socket.  The
+ * scanner therefore works alongside it: it resumes scanning where it
+ * left off each time more bytes arrive, and the complete document it
+ * finds is parsed in full by a worker.  Anything the scanner accepts
+ * that is not a valid document is reported by the parser.
+ */
+
+/*
+ * Scan the unexamined bytes of a connection buffer for the end of a
+ * document.
+ * 
+ * If a |; terminator is found, the return value is the length of the
+ * document including the terminator, and the scanner is left ready for
+ * the start of the next document.  Otherwise, all the bytes have been
+ * examined and zero is returned.
+ * 
+ * Parameters:
+ * 
+ *   pConn - the connection
+ * 
+ * Return:
+ * 
+ *   the length of a complete document, or zero if there is none yet
+ */
+static long shframe_scan(SHCONN *pConn) {
+  
+  long result = 0;
+  long n = 0;
+  
+  if (pConn == NULL) {
+    abort();
+  }
+  
+  n = snscan_feed(&(pConn->frame), pConn->pBuf + pConn->scan,
+                  pConn->len - pConn->scan);
+  if (n > 0) {
+    pConn->scan += n;
+    result = pConn->scan;
+  } else {
+    pConn->scan = pConn->len;
+  }
+  
+  return result;
+}
+
+/*
+ * Check whether a connection buffer holds the start of a document.
+ * 
+ * Whitespace left after the last terminator is not a document, so it
+ * does not count.
+ * 
+ * Parameters:
+ * 
+ *   pConn - the connection
+ * 
+ * Return:
+ * 
+ *   non-zero if the buffer holds anything besides whitespace, zero
+ *   otherwise
+ */
+static int shframe_pending(SHCONN *pConn) {
+  
+  int result = 0;
+  long i = 0;
+  char c = 0;
+  
+  if (pConn == NULL) {
+    abort();
+  }
+  
+  for(i = 0; (!result) && (i < pConn->len); i++) {
+    c = pConn->pBuf[i];
+    if ((c != ' ') && (c != '\t') && (c != '\r') && (c != '\n')) {
+      result = 1;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Document queue
+ * ==============
+ */
+
+/*
+ * Initialize an empty queue.
+ * 
+ * Parameters:
+ * 
+ *   pQueue - the queue
+ */
+static void shqueue_init(SHQUEUE *pQueue) {
+  
+  if (pQueue == NULL) {
+    abort();
+  }
+  
+  memset(pQueue, 0, sizeof(SHQUEUE));
+  pQueue->head = 0;
+  pQueue->count = 0;
+  if (pthread_mutex_init(&(pQueue->lock), NULL) ||
+      pthread_cond_init(&(pQueue->ready), NULL) ||
+      pthread_cond_init(&(pQueue->space), NULL)) {
+    abort();
+  }
+}
+
+/*
+ * Add a document to a queue, waiting for space if the queue is full.
+ * 
+ * pDoc may be NULL to tell the worker to stop.
+ * 
+ * Parameters:
+ * 
+ *   pQueue - the queue
+ * 
+ *   pDoc - the document to queue, or NULL
+ */
+static void shqueue_put(SHQUEUE *pQueue, SHDOC *pDoc) {
+  
+  if (pQueue == NULL) {
+    abort();
+  }
+  
+  pthread_mutex_lock(&(pQueue->lock));
+  while (pQueue->count >= SHINGEST_QUEUE) {
+    pthread_cond_wait(&(pQueue->space), &(pQueue->lock));
+  }
+  
+  (pQueue->ring)[(pQueue->head + pQueue->count) % SHINGEST_QUEUE] = pDoc;
+  (pQueue->count)++;
+  
+  pthread_cond_signal(&(pQueue->ready));
+  pthread_mutex_unlock(&(pQueue->lock));
+}
+
+/*
+ * Take a document from a queue, waiting for one if the queue is empty.
+ * 
+ * Parameters:
+ * 
+ *   pQueue - the queue
+ * 
+ * Return:
+ * 
+ *   the document, or NULL if the worker should stop
+ */
+static SHDOC *shqueue_get(SHQUEUE *pQueue) {
+  
+  SHDOC *pDoc = NULL;
+  
+  if (pQueue == NULL) {
+    abort();
+  }
+  
+  pthread_mutex_lock(&(pQueue->lock));
+  while (pQueue->count < 1) {
+    pthread_cond_wait(&(pQueue->ready), &(pQueue->lock));
+  }
+  
+  pDoc = (pQueue->ring)[pQueue->head];
+  (pQueue->ring)[pQueue->head] = NULL;
+  pQueue->head = (pQueue->head + 1) % SHINGEST_QUEUE;
+  (pQueue->count)--;
+  
+  pthread_cond_signal(&(pQueue->space));
+  pthread_mutex_unlock(&(pQueue->lock));
+  
+  return pDoc;
+}
+
+/*
+ * Workers
+ * =======
+ */
+
+/*
+ * Parse a document and give its entities to the sink.
+ * 
+ * The entities are read into a local array first, with their strings
+ * copied, so that the sink lock is only held while the sink runs and
+ * not while parsing.  Documents that fail to parse are counted but
+ * never reach the sink.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the object pool of the worker
+ * 
+ *   pDoc - the document
+ */
+static void shworker_parse(SNPOOL *pPool, SHDOC *pDoc) {
+  
+  SNPARSER *pParser = NULL;
+  SNSOURCE *pSrc = NULL;
+  SNENTITY ent;
+  SHENT *pEnts = NULL;
+  char *pStore = NULL;
+  long ent_count = 0;
+  long ent_cap = 0;
+  long store_len = 0;
+  long store_cap = 0;
+  long need = 0;
+  long i = 0;
+  int ok = 1;
+  double lat = 0.0;
+  
+  if ((pPool == NULL) || (pDoc == NULL)) {
+    abort();
+  }
+  
+  memset(&ent, 0, sizeof(SNENTITY));
+  
+  /* Parse the whole document, copying the key and value strings into
+   * a single store that may move as it grows, so they are recorded as
+   * offsets until the store is complete */
+  pParser = snpool_parser(pPool);
+  pSrc = snpool_string(pPool, ((const char *) pDoc) + sizeof(SHDOC));
+  
+  for(snparser_read(pParser, &ent, pSrc);
+      ent.status >= 0;
+      snparser_read(pParser, &ent, pSrc)) {
+    
+    /* Make room for the entity and its strings */
+    if (ent_count >= ent_cap) {
+      ent_cap = (ent_cap > 0) ? (ent_cap * 2) : 64;
+      pEnts = (SHENT *) realloc(pEnts,
+                  ((size_t) ent_cap) * sizeof(SHENT));
+      if (pEnts == NULL) {
+        abort();
+      }
+    }
+    
+    need = store_len + ent.key_len + ent.value_len + 2;
+    if (need > store_cap) {
+      store_cap = (store_cap > 0) ? store_cap : 1024;
+      while (store_cap < need) {
+        store_cap *= 2;
+      }
+      pStore = (char *) realloc(pStore, (size_t) store_cap);
+      if (pStore == NULL) {
+        abort();
+      }
+    }
+    
+    /* Copy the entity and its strings */
+    memcpy(&(pEnts[ent_count].ent), &ent, sizeof(SNENTITY));
+    
+    pEnts[ent_count].key_off = -1;
+    if (ent.pKey != NULL) {
+      memcpy(pStore + store_len, ent.pKey, (size_t) ent.key_len + 1);
+      pEnts[ent_count].key_off = store_len;
+      store_len += ent.key_len + 1;
+    }
+    
+    pEnts[ent_count].value_off = -1;
+    if (ent.pValue != NULL) {
+      memcpy(pStore + store_len, ent.pValue,
+              (size_t) ent.value_len + 1);
+      pEnts[ent_count].value_off = store_len;
+      store_len += ent.value_len + 1;
+    }
+    
+    ent_count++;
+    
+    if (ent.status == SNENTITY_EOF) {
+      break;
+    }
+  }
+  if (ent.status != SNENTITY_EOF) {
+    ok = 0;
+  }
+  
+  snpool_putsource(pPool, pSrc);
+  snpool_putparser(pPool, pParser);
+  pSrc = NULL;
+  pParser = NULL;
+  
+  /* Point the entities into the store now that it is final */
+  for(i = 0; i < ent_count; i++) {
+    pEnts[i].ent.pKey = NULL;
+    if (pEnts[i].key_off >= 0) {
+      pEnts[i].ent.pKey = pStore + pEnts[i].key_off;
+    }
+    pEnts[i].ent.pValue = NULL;
+    if (pEnts[i].value_off >= 0) {
+      pEnts[i].ent.pValue = pStore + pEnts[i].value_off;
+    }
+  }
+  
+  /* Hand the entities to the sink and update the counters */
+  pthread_mutex_lock(&m_sink_lock);
+  
+  if (ok && (!m_sink_failed)) {
+    if (!(*(m_sink.pfBegin))(m_sink.pCustom)) {
+      m_sink_failed = 1;
+    }
+    for(i = 0; (i < ent_count) && (!m_sink_failed); i++) {
+      if (!(*(m_sink.pfEntity))(m_sink.pCustom, &(pEnts[i].ent))) {
+        m_sink_failed = 1;
+      }
+    }
+    if (!m_sink_failed) {
+      if (!(*(m_sink.pfEnd))(m_sink.pCustom)) {
+        m_sink_failed = 1;
+      }
+    }
+  }
+  
+  if (ok) {
+    m_stats.docs++;
+    m_stats.entities += (double) ent_count;
+  } else {
+    m_stats.failed++;
+  }
+  m_stats.bytes += (double) pDoc->len;
+  
+  lat = shingest_now() - pDoc->framed;
+  m_stats.lat_total += lat;
+  if (lat > m_stats.lat_max) {
+    m_stats.lat_max = lat;
+  }
+  
+  pthread_mutex_unlock(&m_sink_lock);
+  
+  /* Release the local copies */
+  free(pEnts);
+  free(pStore);
+}
+
+/*
+ * Worker thread entrypoint.
+ * 
+ * Each worker has its own queue and object pool, so parsers and
+ * sources are reused without any locking.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SHQUEUE of the worker
+ * 
+ * Return:
+ * 
+ *   NULL
+ */
+static void *shworker_main(void *pArg) {
+  
+  SHQUEUE *pQueue = NULL;
+  SNPOOL *pPool = NULL;
+  SHDOC *pDoc = NULL;
+  
+  if (pArg == NULL) {
+    abort();
+  }
+  pQueue = (SHQUEUE *) pArg;
+  
+  pPool = snpool_alloc(1, 4);
+  
+  for(pDoc = shqueue_get(pQueue);
+      pDoc != NULL;
+      pDoc = shqueue_get(pQueue)) {
+    shworker_parse(pPool, pDoc);
+    free(pDoc);
+  }
+  
+  snpool_free(pPool);
+  return NULL;
+}
+
+/*
+ * Connections
+ * ===========
+ */
+
+/*
+ * Allocate the state of a new connection.
+ * 
+ * Parameters:
+ * 
+ *   fd - the connection socket
+ * 
+ *   pQueue - the queue of the worker for the connection
+ * 
+ * Return:
+ * 
+ *   the new connection
+ */
+static SHCONN *shconn_alloc(int fd, SHQUEUE *pQueue) {
+  
+  SHCONN *pConn = NULL;
+  
+  if (pQueue == NULL) {
+    abort();
+  }
+  
+  pConn = (SHCONN *) malloc(sizeof(SHCONN));
+  if (pConn == NULL) {
+    abort();
+  }
+  memset(pConn, 0, sizeof(SHCONN));
+  
+  pConn->fd = fd;
+  pConn->cap = SHINGEST_CHUNK;
+  pConn->pBuf = (char *) malloc((size_t) pConn->cap);
+  if (pConn->pBuf == NULL) {
+    abort();
+  }
+  pConn->len = 0;
+  pConn->scan = 0;
+  snscan_reset(&(pConn->frame));
+  pConn->pQueue = pQueue;
+  
+  return pConn;
+}
+
+/*
+ * Close a connection and free its state.
+ * 
+ * Parameters:
+ * 
+ *   pConn - the connection to free, or NULL
+ */
+static void shconn_free(SHCONN *pConn) {
+  
+  if (pConn != NULL) {
+    close(pConn->fd);
+    free(pConn->pBuf);
+    free(pConn);
+  }
+}
+
+/*
+ * Queue the first doc_len bytes of the connection buffer as a document
+ * and shift the remaining bytes to the start of the buffer.
+ * 
+ * Documents that contain a nul byte are counted as failed and dropped,
+ * since they can never be valid UTF-8 Shastina.
+ * 
+ * Parameters:
+ * 
+ *   pConn - the connection
+ * 
+ *   doc_len - the length of the document at the start of the buffer
+ * 
+ * Return:
+ * 
+ *   non-zero if the document was queued, zero if it was dropped
+ */
+static int shconn_emit(SHCONN *pConn, long doc_len) {
+  
+  SHDOC *pDoc = NULL;
+  char *pData = NULL;
+  int result = 1;
+  
+  if ((pConn == NULL) || (doc_len < 1) || (doc_len > pConn->len)) {
+    abort();
+  }
+  
+  if (memchr(pConn->pBuf, 0, (size_t) doc_len) != NULL) {
+    result = 0;
+  }
+  
+  if (result) {
+    pDoc = (SHDOC *) malloc(sizeof(SHDOC) + ((size_t) doc_len) + 1);
+    if (pDoc == NULL) {
+      abort();
+    }
+    pData = ((char *) pDoc) + sizeof(SHDOC);
+    memcpy(pData, pConn->pBuf, (size_t) doc_len);
+    pData[doc_len] = (char) 0;
+    pDoc->len = doc_len;
+    pDoc->framed = shingest_now();
+    shqueue_put(pConn->pQueue, pDoc);
+    
+  } else {
+    pthread_mutex_lock(&m_sink_lock);
+    m_stats.failed++;
+    pthread_mutex_unlock(&m_sink_lock);
+  }
+  
+  if (doc_len < pConn->len) {
+    memmove(pConn->pBuf, pConn->pBuf + doc_len,
+              (size_t) (pConn->len - doc_len));
+  }
+  pConn->len -= doc_len;
+  pConn->scan -= doc_len;
+  
+  return result;
+}
+
+/*
+ * Read available bytes from a connection and queue every document
+ * that is now complete.
+ * 
+ * Parameters:
+ * 
+ *   pConn - the connection
+ * 
+ * Return:
+ * 
+ *   non-zero if the connection is still open, zero if it should be
+ *   closed
+ */
+static int shconn_read(SHCONN *pConn) {
+  
+  int result = 1;
+  int reading = 1;
+  long doc_len = 0;
+  ssize_t rc = 0;
+  
+  if (pConn == NULL) {
+    abort();
+  }
+  
+  while (result && reading) {
+    /* Grow the buffer if it is full */
+    if (pConn->len >= pConn->cap) {
+      if (pConn->cap >= SHINGEST_MAXDOC) {
+        pthread_mutex_lock(&m_sink_lock);
+        m_stats.oversize++;
+        pthread_mutex_unlock(&m_sink_lock);
+        result = 0;
+      } else {
+        pConn->cap *= 2;
+        if (pConn->cap > SHINGEST_MAXDOC) {
+          pConn->cap = SHINGEST_MAXDOC;
+        }
+        pConn->pBuf = (char *) realloc(pConn->pBuf,
+                                        (size_t) pConn->cap);
+        if (pConn->pBuf == NULL) {
+          abort();
+        }
+      }
+    }
+    
+    /* Read what is available */
+    if (result) {
+      rc = read(pConn->fd, pConn->pBuf + pConn->len,
+                (size_t) (pConn->cap - pConn->len));
+      if (rc > 0) {
+        pConn->len += (long) rc;
+      } else if (rc == 0) {
+        /* Peer hung up, so a partial document can never complete */
+        if (shframe_pending(pConn)) {
+          pthread_mutex_lock(&m_sink_lock);
+          m_stats.failed++;
+          pthread_mutex_unlock(&m_sink_lock);
+        }
+        result = 0;
+      } else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        reading = 0;
+      } else if (errno != EINTR) {
+        result = 0;
+      }
+    }
+    
+    /* Frame and queue all the complete documents */
+    if (result && (rc > 0)) {
+      for(doc_len = shframe_scan(pConn);
+          doc_len > 0;
+          doc_len = shframe_scan(pConn)) {
+        shconn_emit(pConn, doc_len);
+      }
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Print the counters to standard error.
+ */
+static void shstats_print(void) {
+  
+  SHSTATS st;
+  double secs = 0.0;
+  double mean = 0.0;
+  long total = 0;
+  
+  pthread_mutex_lock(&m_sink_lock);
+  memcpy(&st, &m_stats, sizeof(SHSTATS));
+  pthread_mutex_unlock(&m_sink_lock);
+  
+  secs = (shingest_now() - m_start) / 1000000000.0;
+  if (secs <= 0.0) {
+    secs = 1.0;
+  }
+  
+  total = st.docs + st.failed;
+  if (total > 0) {
+    mean = st.lat_total / ((double) total);
+  }
+  
+  fprintf(stderr, "shingestd: %.1f s, %ld connections\n",
+          secs, st.conns);
+  fprintf(stderr,
+    "shingestd: %ld documents, %ld failed, %ld oversize\n",
+    st.docs, st.failed, st.oversize);
+  fprintf(stderr,
+    "shingestd: %.0f bytes, %.0f entities, %.1f docs/s, %.1f MB/s\n",
+    st.bytes, st.entities,
+    ((double) total) / secs, (st.bytes / 1000000.0) / secs);
+  fprintf(stderr,
+    "shingestd: latency mean %.1f us, max %.1f us\n",
+    mean / 1000.0, st.lat_max / 1000.0);
+}
+
+/*
+ * Program entrypoint
+ * ==================
+ */
+
+int main(int argc, char *argv[]) {
+  
+  struct sockaddr_un addr;
+  struct epoll_event ev;
+  struct epoll_event evs[SHINGEST_EVENTS];
+  struct signalfd_siginfo si;
+  pthread_t workers[SHINGEST_WORKERS_MAX];
+  sigset_t mask;
+  FILE *pOut = NULL;
+  SHCONN *pConn = NULL;
+  int worker_count = SHINGEST_WORKERS_DEFAULT;
+  int next_worker = 0;
+  int lfd = -1;
+  int sfd = -1;
+  int efd = -1;
+  int cfd = -1;
+  int running = 1;
+  int status = 1;
+  int n = 0;
+  int i = 0;
+  
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  memset(&ev, 0, sizeof(struct epoll_event));
+  memset(&si, 0, sizeof(struct signalfd_siginfo));
+  memset(&m_stats, 0, sizeof(SHSTATS));
+  
+  /* Check arguments */
+  if ((argc < 3) || (argc > 4)) {
+    fprintf(stderr, "Syntax: shingestd [socket] [output] [workers]\n");
+    status = 0;
+  }
+  if (status) {
+    if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+      fprintf(stderr, "shingestd: Socket path too long!\n");
+      status = 0;
+    }
+  }
+  if (status && (argc > 3)) {
+    worker_count = atoi(argv[3]);
+    if ((worker_count < 1) || (worker_count > SHINGEST_WORKERS_MAX)) {
+      fprintf(stderr, "shingestd: Invalid worker count!\n");
+      status = 0;
+    }
+  }
+  
+  /* Open the output file and set up the default sink */
+  if (status) {
+    pOut = fopen(argv[2], "ab");
+    if (pOut == NULL) {
+      fprintf(stderr, "shingestd: Can't open output file!\n");
+      status = 0;
+    }
+  }
+  if (status) {
+    m_sink.pCustom = (void *) pOut;
+    m_sink.pfBegin = &shbin_begin;
+    m_sink.pfEntity = &shbin_entity;
+    m_sink.pfEnd = &shbin_end;
+  }
+  
+  /* Route the signals we handle through a signalfd, and ignore
+   * SIGPIPE; the mask is set before any thread starts so that workers
+   * inherit it */
+  if (status) {
+    signal(SIGPIPE, SIG_IGN);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &mask, NULL)) {
+      abort();
+    }
+    sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd < 0) {
+      fprintf(stderr, "shingestd: Can't create signalfd!\n");
+      status = 0;
+    }
+  }
+  
+  /* Create the listening socket */
+  if (status) {
+    lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                  0);
+    if (lfd < 0) {
+      fprintf(stderr, "shingestd: Can't create socket!\n");
+      status = 0;
+    }
+  }
+  if (status) {
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, argv[1]);
+    if (bind(lfd, (struct sockaddr *) &addr,
+              sizeof(struct sockaddr_un))) {
+      fprintf(stderr, "shingestd: Can't bind socket!\n");
+      status = 0;
+    }
+  }
+  if (status) {
+    if (listen(lfd, SHINGEST_BACKLOG)) {
+      fprintf(stderr, "shingestd: Can't listen on socket!\n");
+      unlink(argv[1]);
+      status = 0;
+    }
+  }
+  
+  /* Create the epoll instance watching the signals and the listening
+   * socket, which are told apart from connections by a NULL pointer
+   * and by their file descriptor */
+  if (status) {
+    efd = epoll_create1(EPOLL_CLOEXEC);
+    if (efd < 0) {
+      abort();
+    }
+    
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(efd, EPOLL_CTL_ADD, sfd, &ev)) {
+      abort();
+    }
+    
+    ev.events = EPOLLIN;
+    ev.data.ptr = (void *) &lfd;
+    if (epoll_ctl(efd, EPOLL_CTL_ADD, lfd, &ev)) {
+      abort();
+    }
+  }
+  
+  /* Start the workers, each with its own queue */
+  if (status) {
+    m_start = shingest_now();
+    for(i = 0; i < worker_count; i++) {
+      shqueue_init(&(m_queues[i]));
+      if (pthread_create(&(workers[i]), NULL, &shworker_main,
+                          (void *) &(m_queues[i]))) {
+        abort();
+      }
+    }
+  }
+  
+  /* Event loop */
+  while (status && running) {
+    n = epoll_wait(efd, evs, SHINGEST_EVENTS, -1);
+    if ((n < 0) && (errno != EINTR)) {
+      abort();
+    }
+    
+    for(i = 0; i < n; i++) {
+      if (evs[i].data.ptr == NULL) {
+        /* Signals */
+        while (read(sfd, &si, sizeof(struct signalfd_siginfo)) ==
+                  (ssize_t) sizeof(struct signalfd_siginfo)) {
+          if (si.ssi_signo == SIGUSR1) {
+            shstats_print();
+          } else {
+            running = 0;
+          }
+        }
+        
+      } else if (evs[i].data.ptr == (void *) &lfd) {
+        /* New connections */
+        for(cfd = accept(lfd, NULL, NULL);
+            cfd >= 0;
+            cfd = accept(lfd, NULL, NULL)) {
+          if (fcntl(cfd, F_SETFL, O_NONBLOCK)) {
+            abort();
+          }
+          pConn = shconn_alloc(cfd, &(m_queues[next_worker]));
+          next_worker = (next_worker + 1) % worker_count;
+          ev.events = EPOLLIN | EPOLLRDHUP;
+          ev.data.ptr = (void *) pConn;
+          if (epoll_ctl(efd, EPOLL_CTL_ADD, cfd, &ev)) {
+            abort();
+          }
+          pConn = NULL;
+          pthread_mutex_lock(&m_sink_lock);
+          m_stats.conns++;
+          pthread_mutex_unlock(&m_sink_lock);
+        }
+        
+      } else {
+        /* Connection data */
+        pConn = (SHCONN *) evs[i].data.ptr;
+        if (!shconn_read(pConn)) {
+          epoll_ctl(efd, EPOLL_CTL_DEL, pConn->fd, NULL);
+          shconn_free(pConn);
+        }
+        pConn = NULL;
+      }
+    }
+    
+    /* Stop if the sink has failed */
+    pthread_mutex_lock(&m_sink_lock);
+    if (m_sink_failed) {
+      fprintf(stderr, "shingestd: Sink failed!\n");
+      running = 0;
+    }
+    pthread_mutex_unlock(&m_sink_lock);
+  }
+  
+  /* Stop the workers once they have drained their queues, report,
+   * and clean up; open connections are closed when the process exits */
+  if (status) {
+    for(i = 0; i < worker_count; i++) {
+      shqueue_put(&(m_queues[i]), NULL);
+    }
+    for(i = 0; i < worker_count; i++) {
+      pthread_join(workers[i], NULL);
+    }
+    shstats_print();
+    
+    close(efd);
+    close(lfd);
+    unlink(argv[1]);
+  }
+  if (sfd >= 0) {
+    close(sfd);
+  }
+  if (pOut != NULL) {
+    if (fclose(pOut)) {
+      status = 0;
+    }
+  }
+  
+  return (status ? 0 : 1);
+}
@@ -0,0 +1,5449 @@
+/*
+ * snvm.c
+ * 
+ * Optional Shastina runtime.
+ * 
+ * See the header for specifications.
+ */
+
+/* The JIT needs mmap() with anonymous mappings, and workers need POSIX
+ * threads */
+#if defined(SNVM_JIT) || defined(SNVM_THREADS)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "snvm.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The JIT is only compiled if requested, on x86-64 POSIX systems.
+ */
+#if defined(SNVM_JIT) && defined(__x86_64__) && \
+    (defined(__unix__) || defined(__APPLE__))
+#define SNVM_HAVE_JIT
+#include <sys/mman.h>
+#endif
+
+/*
+ * Workers for parallel arrays are only compiled if requested.
+ */
+#ifdef SNVM_THREADS
+#include <pthread.h>
+#endif
+
+/*
+ * The initial capacity of the value stack, and the most values it can
+ * hold.
+ */
+#define SNVM_STACK_INIT (256)
+#define SNVM_STACK_MAX  (1048576L)
+
+/*
+ * The initial capacities of the other arrays of runtimes and programs.
+ * 
+ * All arrays double as needed.
+ */
+#define SNVM_BASE_INIT  (16)
+#define SNVM_OPS_INIT   (16)
+#define SNVM_CODE_INIT  (256)
+#define SNVM_POOL_INIT  (64)
+#define SNVM_ARENA_INIT (1024)
+#define SNVM_PAR_INIT   (16)
+#define SNVM_NAMES_INIT (16)
+
+/*
+ * The size in bytes of the first chunk of a heap generation, and the
+ * size the nursery may grow to before the next dictionary entity
+ * collects it.
+ */
+#define SNVM_CHUNK_INIT   (65536L)
+#define SNVM_NURSERY_SIZE (1048576L)
+
+/*
+ * Object generations.
+ * 
+ * STATIC objects are vector literals inside programs, which the runtime
+ * never moves or frees.
+ */
+#define SNVM_GEN_NURSERY (0)
+#define SNVM_GEN_OLD     (1)
+#define SNVM_GEN_STATIC  (2)
+
+/*
+ * Operation codes of the numeric operations, passed as custom data.
+ */
+#define SNVMNUM_ADD (0)
+#define SNVMNUM_SUB (1)
+#define SNVMNUM_MUL (2)
+#define SNVMNUM_DIV (3)
+#define SNVMNUM_NEG (4)
+#define SNVMNUM_ABS (5)
+#define SNVMNUM_SUM (6)
+#define SNVMNUM_MIN (7)
+#define SNVMNUM_MAX (8)
+#define SNVMNUM_COUNT (9)
+
+/*
+ * Snapshot images.
+ * 
+ * The trailer of an image holds, in this order, the magic number, the
+ * format version, the stamp, the sizes of long, double, values, and
+ * object headers, the number of heap bytes and text bytes, and the
+ * number of stack values and global names.
+ */
+#define SNVM_IMAGE_MAGIC   (0x534e564dUL)
+#define SNVM_IMAGE_VERSION (1UL)
+#define SNVM_IMAGE_TRAILER (11)
+
+/*
+ * Instruction opcodes.
+ * 
+ * PUSH pushes the literal with index arg in the constant pool.  CALL
+ * calls the operation with index arg in the call table.  BEGIN and END
+ * perform the grouping check.  PARALLEL comes before the elements of
+ * the array with index arg in the parallel table, and skips them if they
+ * were evaluated in parallel.  VARIABLE, CONSTANT, and ASSIGN pop a
+ * value into the dictionary slot arg, and GET pushes the value in that
+ * slot.  NOP is only used while compiling, for
+ * group checks that turn out to be unnecessary, and is removed before
+ * the program is complete.
+ */
+#define SNVM_I_NOP      (0)
+#define SNVM_I_PUSH     (1)
+#define SNVM_I_CALL     (2)
+#define SNVM_I_BEGIN    (3)
+#define SNVM_I_END      (4)
+#define SNVM_I_PARALLEL (5)
+#define SNVM_I_VARIABLE (6)
+#define SNVM_I_CONSTANT (7)
+#define SNVM_I_ASSIGN   (8)
+#define SNVM_I_GET      (9)
+
+/*
+ * Arrays are only marked for parallel evaluation if they have at least
+ * SNVM_PARALLEL_MIN elements, made of at least SNVM_PARALLEL_WORK
+ * instructions in total.  Smaller arrays are not worth handing out to
+ * workers.
+ */
+#define SNVM_PARALLEL_MIN  (64)
+#define SNVM_PARALLEL_WORK (256)
+
+/*
+ * The most bytes of machine code the JIT generates for one instruction,
+ * and for the prologue and epilogue together.
+ */
+#define SNVM_JIT_INSMAX  (128)
+#define SNVM_JIT_FRAME   (64)
+
+/*
+ * A program instruction.
+ */
+typedef struct {
+  int op;
+  long arg;
+} SNVMINS;
+
+/*
+ * A resolved operation.
+ */
+typedef struct {
+  int (*pfOp)(SNVM *, void *);
+  void *pCustom;
+} SNVMCALL;
+
+/*
+ * An array marked for parallel evaluation.
+ * 
+ * The elements are the instructions between count + 1 boundaries in
+ * the boundary table of the program pProg, starting at index first.  The
+ * last boundary is where execution continues after the elements.
+ */
+typedef struct {
+  const SNVMPROG *pProg;
+  long first;
+  long count;
+} SNVMPAR;
+
+/*
+ * The unit of alignment of heap memory.
+ */
+typedef union {
+  long l;
+  double d;
+  void *p;
+} SNVMALIGN;
+
+/*
+ * A chunk of heap memory, which is allocated by bumping used up to cap
+ * bytes.
+ */
+typedef struct SNVMCHUNK_TAG {
+  struct SNVMCHUNK_TAG *pNext;
+  SNVMALIGN *pData;
+  size_t used;
+  size_t cap;
+} SNVMCHUNK;
+
+/*
+ * A heap generation, made of chunks with the most recent first, and the
+ * number of bytes used in all of them.
+ */
+typedef struct {
+  SNVMCHUNK *pChunk;
+  size_t used;
+} SNVMSPACE;
+
+/*
+ * Structure for a heap object.
+ * 
+ * The prototype of this structure (SNOBJ) is defined in the header.  The
+ * structure is followed in memory by count value slots and then bytes
+ * data bytes.
+ */
+struct SNOBJ_TAG {
+  
+  /*
+   * The new location of the object once it has been moved during a
+   * collection, or NULL.
+   */
+  SNOBJ *pForward;
+  
+  /*
+   * The number of slots and data bytes.
+   */
+  long count;
+  long bytes;
+  
+  /*
+   * The generation of the object, which is one of the SNVM_GEN_
+   * constants.
+   */
+  int gen;
+};
+
+/*
+ * The workers of a runtime.
+ * 
+ * The actual structure definition is given further on, if the module is
+ * compiled with SNVM_THREADS.
+ */
+struct SNVMPOOL_TAG;
+typedef struct SNVMPOOL_TAG SNVMPOOL;
+
+/*
+ * Structure for a runtime.
+ * 
+ * The prototype of this structure (SNVM) is defined in the header.
+ */
+struct SNVM_TAG {
+  
+  /*
+   * The value stack, with sp values in use and capacity cap.
+   * 
+   * The JIT accesses these fields directly.
+   */
+  SNVAL *pStack;
+  long sp;
+  long cap;
+  
+  /*
+   * The stack index below which values are hidden by the current
+   * group, or zero outside of groups.
+   */
+  long floor;
+  
+  /*
+   * The floors of the enclosing groups, with base_count in use and
+   * capacity base_cap.
+   */
+  long *pBase;
+  long base_count;
+  long base_cap;
+  
+  /*
+   * The index of the instruction being executed, used to find the line
+   * of an error.
+   * 
+   * The interpreter sets this on errors, and machine code sets it
+   * before every call.
+   */
+  long pc;
+  
+  /*
+   * The operation registry.
+   * 
+   * ppName holds copies of the names, pCalls the callbacks, pPops and
+   * pPushes the declared stack effects, and pPure the flags set by
+   * snvm_pure().  op_count is the number of operations and op_cap the
+   * capacity of the arrays.
+   */
+  char **ppName;
+  SNVMCALL *pCalls;
+  int *pPops;
+  int *pPushes;
+  int *pPure;
+  long op_count;
+  long op_cap;
+  
+  /*
+   * The workers for parallel arrays, or NULL if there are none.
+   */
+  SNVMPOOL *pPool;
+  
+  /*
+   * The dictionary of the current run, with a slot for each name that
+   * the program declares.
+   */
+  SNVAL *pDict;
+  long dict_count;
+  long dict_cap;
+  
+  /*
+   * The heap generations, and the moved objects whose slots have not
+   * yet been scanned during a collection.
+   */
+  SNVMSPACE nursery;
+  SNVMSPACE old;
+  SNOBJ **ppWork;
+  long work_count;
+  long work_cap;
+  
+  /*
+   * The global dictionary, which holds the names kept by snvm_define()
+   * and snvm_restore() so that later programs can import them.
+   * 
+   * ppGlobal holds copies of the names, pGlobalKind whether each is a
+   * variable or a constant, and pGlobal the values.
+   */
+  char **ppGlobal;
+  int *pGlobalKind;
+  SNVAL *pGlobal;
+  long global_count;
+  long global_cap;
+  
+  /*
+   * The text of restored images, and the bootstrap programs run by
+   * snvm_boot(), which are kept until the runtime is freed because
+   * string values may point into them.
+   */
+  SNVMSPACE text;
+  SNVMPROG **ppBoot;
+  long boot_count;
+  long boot_cap;
+};
+
+/*
+ * Structure for a compiled program.
+ * 
+ * The prototype of this structure (SNVMPROG) is defined in the header.
+ */
+struct SNVMPROG_TAG {
+  
+  /*
+   * The instructions, and the line number of the entity that produced
+   * each instruction.
+   */
+  SNVMINS *pCode;
+  long *pLines;
+  long code_count;
+  long code_cap;
+  
+  /*
+   * The constant pool.
+   */
+  SNVAL *pPool;
+  long pool_count;
+  long pool_cap;
+  
+  /*
+   * The call table, which is a copy of the registry of the runtime at
+   * the time of compilation.
+   */
+  SNVMCALL *pCalls;
+  long call_count;
+  
+  /*
+   * The string arena holding string literals.
+   * 
+   * While compiling, string literals in the pool hold arena offsets in
+   * v.i, and these are changed to pointers when the arena is complete.
+   */
+  char *pArena;
+  long arena_len;
+  long arena_cap;
+  
+  /*
+   * The names of the program, which are the slots of its dictionary.
+   * 
+   * ppName holds copies of the names and pKind whether each is a
+   * variable or a constant.  pImport holds the index of the global that
+   * each slot imports, or -1 if the program declares the name itself.
+   */
+  char **ppName;
+  int *pKind;
+  long *pImport;
+  long name_count;
+  
+  /*
+   * The parallel table, and the boundary table that holds the element
+   * boundaries of its arrays as instruction indices.
+   */
+  SNVMPAR *pPar;
+  long par_count;
+  long par_cap;
+  long *pBounds;
+  long bound_count;
+  long bound_cap;
+  
+  /*
+   * The machine code of the program, or NULL if it has not been
+   * translated.
+   * 
+   * pNativeMem is the mapping that holds the code and native_size is
+   * its size in bytes.
+   */
+  int (*pfNative)(SNVM *);
+  void *pNativeMem;
+  size_t native_size;
+};
+
+/*
+ * A group that is open while compiling.
+ * 
+ * begin is the index of its BEGIN instruction, and sib is the number of
+ * completed groups in SNVMCOMP when it began.  pure is cleared if the
+ * group calls an operation that is not pure.
+ */
+typedef struct {
+  long begin;
+  long sib;
+  int pure;
+} SNVMOPEN;
+
+/*
+ * A completed group, which may turn out to be an array element.
+ * 
+ * The group is made of the instructions from start up to but excluding
+ * end.
+ */
+typedef struct {
+  long start;
+  long end;
+  int pure;
+} SNVMSIB;
+
+/*
+ * The group structure of a program that is being compiled.
+ * 
+ * pOpen is the stack of open groups.  pSib holds, for the innermost
+ * open group and each enclosing group, the groups completed directly
+ * within it since the last instruction that was not part of a group.
+ * These are the candidate elements of an array.
+ * 
+ * ppName holds copies of the names declared or imported so far, pKind
+ * whether each is a SNENTITY_VARIABLE or a SNENTITY_CONSTANT, and
+ * pImport the index of the global each imports, or -1.  The index of a
+ * name is its dictionary slot.pHash is a hash table with hash_cap
+ * entries, which are zero if unused or else a name index plus one.
+ * 
+ * lit_start is the index of the first instruction of the last array if
+ * all of its elements are numeric literals, or else -1.  lit_end is the
+ * index after the instruction that pushed the count of that array.
+ */
+typedef struct {
+  SNVMOPEN *pOpen;
+  long open_count;
+  long open_cap;
+  SNVMSIB *pSib;
+  long sib_count;
+  long sib_cap;
+  char **ppName;
+  int *pKind;
+  long *pImport;
+  long name_count;
+  long name_cap;
+  long *pHash;
+  long hash_cap;
+  long lit_start;
+  long lit_end;
+} SNVMCOMP;
+
+/*
+ * State of writing a snapshot image.
+ * 
+ * pText holds the text of the image.  ppStatic holds the static objects
+ * the image refers to, which are written after the old generation, and
+ * pStaticOff their heap offsets.  static_len is the number of heap
+ * bytes they take.
+ */
+typedef struct {
+  SNVM *pVM;
+  char *pText;
+  long text_len;
+  long text_cap;
+  SNOBJ **ppStatic;
+  long *pStaticOff;
+  long static_count;
+  long static_cap;
+  long static_len;
+} SNVMIMAGE;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+static void *snvm_grow(void *pArray, long cap, size_t elsize);
+
+static int snvm_stack(SNVM *pVM);
+static int snvm_begin(SNVM *pVM);
+static int snvm_end(SNVM *pVM);
+
+static size_t snvm_objsize(long count, long bytes);
+static void *snvmspace_alloc(SNVMSPACE *pSpace, size_t size);
+static void snvmspace_release(SNVMSPACE *pSpace, int keep);
+static void snvm_move(SNVM *pVM, SNVAL *pVal, SNVMSPACE *pTo, int all);
+static void snvm_scan(SNVM *pVM, SNVMSPACE *pTo, int all);
+static void snvm_collect(SNVM *pVM, int full);
+static int snvm_dict(SNVM *pVM, const SNVMINS *pi);
+
+static long snvm_find(const SNVM *pVM, const char *pName);
+static long snvm_global(const SNVM *pVM, const char *pName);
+static void snvm_publish(
+    SNVM        * pVM,
+    const char  * pName,
+    int           kind,
+    const SNVAL * pVal);
+static int snvm_number(const char *pStr, SNVAL *pVal);
+
+static long snvmprog_emit(SNVMPROG *pProg, int op, long arg, long line);
+static long snvmprog_literal(SNVMPROG *pProg, const SNVAL *pVal);
+static long snvmprog_reserve(SNVMPROG *pProg, long len, long align);
+static long snvmprog_string(SNVMPROG *pProg, const char *pStr, long len);
+static void snvmprog_vector(SNVMPROG *pProg, long start, long line);
+static void snvmprog_parallel(
+    SNVMPROG      * pProg,
+    const SNVMSIB * pSib,
+    long            count);
+static void snvmprog_finish(SNVMPROG *pProg);
+
+static void snvmcomp_begin(SNVMCOMP *pComp, long begin);
+static void snvmcomp_end(SNVMCOMP *pComp, long end);
+static void snvmcomp_array(SNVMCOMP *pComp, SNVMPROG *pProg, long count);
+static void snvmcomp_impure(SNVMCOMP *pComp);
+static unsigned long snvmcomp_hash(const char *pName);
+static long snvmcomp_lookup(const SNVMCOMP *pComp, const char *pName);
+static long snvmcomp_declare(SNVMCOMP *pComp, const char *pName, int kind);
+static void snvmcomp_free(SNVMCOMP *pComp);
+
+static int snvm_interpret(
+    SNVM           * pVM,
+    const SNVMPROG * pProg,
+    long             start,
+    long             end);
+static int snvm_execute(
+    SNVM           * pVM,
+    const SNVMPROG * pProg,
+    long           * pLine,
+    int              define);
+static int snvm_parallel(SNVM *pVM, const SNVMPAR *pPar);
+
+/*
+ * Resize an array, aborting if memory can not be allocated.
+ * 
+ * Parameters:
+ * 
+ *   pArray - the array to resize, or NULL to allocate a new array
+ * 
+ *   cap - the new capacity in elements, greater than zero
+ * 
+ *   elsize - the size of each element in bytes
+ * 
+ * Return:
+ * 
+ *   the resized array
+ */
+static void *snvm_grow(void *pArray, long cap, size_t elsize) {
+  
+  void *pResult = NULL;
+  
+  /* Check parameters */
+  if ((cap < 1) || (elsize < 1)) {
+    abort();
+  }
+  if (((size_t) cap) > ((size_t) -1) / elsize) {
+    abort();
+  }
+  
+  /* Resize */
+  pResult = realloc(pArray, ((size_t) cap) * elsize);
+  if (pResult == NULL) {
+    abort();
+  }
+  
+  /* Return resized array */
+  return pResult;
+}
+
+/*
+ * Make room for at least one more value on the value stack.
+ * 
+ * This is also called by machine code.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNVM_ERR_OVERFLOW
+ */
+static int snvm_stack(SNVM *pVM) {
+  
+  long newcap = 0;
+  int err_code = 0;
+  
+  /* Check parameter */
+  if (pVM == NULL) {
+    abort();
+  }
+  
+  /* Grow the stack if it is full */
+  if (pVM->sp >= pVM->cap) {
+    if (pVM->cap < SNVM_STACK_MAX) {
+      newcap = pVM->cap * 2;
+      if (newcap < SNVM_STACK_INIT) {
+        newcap = SNVM_STACK_INIT;
+      }
+      if (newcap > SNVM_STACK_MAX) {
+        newcap = SNVM_STACK_MAX;
+      }
+      pVM->pStack = (SNVAL *) snvm_grow(
+                      pVM->pStack, newcap, sizeof(SNVAL));
+      pVM->cap = newcap;
+      
+    } else {
+      err_code = SNVM_ERR_OVERFLOW;
+    }
+  }
+  
+  /* Return status */
+  return err_code;
+}
+
+/*
+ * Begin a group, hiding everything currently on the stack.
+ * 
+ * This is also called by machine code.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ * Return:
+ * 
+ *   zero
+ */
+static int snvm_begin(SNVM *pVM) {
+  
+  long newcap = 0;
+  
+  /* Check parameter */
+  if (pVM == NULL) {
+    abort();
+  }
+  
+  /* Save the current floor */
+  if (pVM->base_count >= pVM->base_cap) {
+    newcap = pVM->base_cap * 2;
+    if (newcap < SNVM_BASE_INIT) {
+      newcap = SNVM_BASE_INIT;
+    }
+    pVM->pBase = (long *) snvm_grow(pVM->pBase, newcap, sizeof(long));
+    pVM->base_cap = newcap;
+  }
+  (pVM->pBase)[pVM->base_count] = pVM->floor;
+  (pVM->base_count)++;
+  
+  /* Raise the floor */
+  pVM->floor = pVM->sp;
+  
+  return 0;
+}
+
+/*
+ * End a group, checking that it left exactly one value.
+ * 
+ * This is also called by machine code.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNVM_ERR_GROUP
+ */
+static int snvm_end(SNVM *pVM) {
+  
+  int err_code = 0;
+  
+  /* Check parameter and state */
+  if (pVM == NULL) {
+    abort();
+  }
+  if (pVM->base_count < 1) {
+    abort();
+  }
+  
+  /* Check the group, then restore the enclosing floor */
+  if (pVM->sp - pVM->floor == 1) {
+    (pVM->base_count)--;
+    pVM->floor = (pVM->pBase)[pVM->base_count];
+    
+  } else {
+    err_code = SNVM_ERR_GROUP;
+  }
+  
+  /* Return status */
+  return err_code;
+}
+
+/*
+ * Compute the number of heap bytes an object takes.
+ * 
+ * Parameters:
+ * 
+ *   count - the number of value slots
+ * 
+ *   bytes - the number of data bytes
+ * 
+ * Return:
+ * 
+ *   the size of the object, including its header and padding
+ */
+static size_t snvm_objsize(long count, long bytes) {
+  
+  size_t size = 0;
+  
+  /* Check parameters */
+  if ((count < 0) || (bytes < 0) ||
+      (((size_t) count) > ((size_t) LONG_MAX) / sizeof(SNVAL)) ||
+      (((size_t) bytes) > ((size_t) LONG_MAX) / 4)) {
+    abort();
+  }
+  
+  /* Add up the parts and round up to the alignment */
+  size = sizeof(SNOBJ) + ((size_t) count) * sizeof(SNVAL) + (size_t) bytes;
+  size = ((size + sizeof(SNVMALIGN) - 1) / sizeof(SNVMALIGN)) *
+            sizeof(SNVMALIGN);
+  
+  return size;
+}
+
+/*
+ * Allocate memory in a heap generation by bumping a pointer.
+ * 
+ * A new chunk, twice as large as the current one, is added when the
+ * current one is full.
+ * 
+ * Parameters:
+ * 
+ *   pSpace - the generation
+ * 
+ *   size - the number of bytes, a multiple of the alignment
+ * 
+ * Return:
+ * 
+ *   the uninitialized memory
+ */
+static void *snvmspace_alloc(SNVMSPACE *pSpace, size_t size) {
+  
+  SNVMCHUNK *pChunk = NULL;
+  unsigned char *pResult = NULL;
+  size_t cap = 0;
+  
+  /* Check parameters */
+  if ((pSpace == NULL) || (size < 1) || (size % sizeof(SNVMALIGN) != 0)) {
+    abort();
+  }
+  
+  /* Add a chunk if the current one is full */
+  pChunk = pSpace->pChunk;
+  if ((pChunk == NULL) || (size > pChunk->cap - pChunk->used)) {
+    cap = SNVM_CHUNK_INIT;
+    if (pChunk != NULL) {
+      cap = pChunk->cap * 2;
+    }
+    while (cap < size) {
+      cap = cap * 2;
+    }
+    
+    pChunk = (SNVMCHUNK *) malloc(sizeof(SNVMCHUNK));
+    if (pChunk == NULL) {
+      abort();
+    }
+    pChunk->pData = (SNVMALIGN *) snvm_grow(
+                      NULL, (long) (cap / sizeof(SNVMALIGN)),
+                      sizeof(SNVMALIGN));
+    pChunk->used = 0;
+    pChunk->cap = cap;
+    pChunk->pNext = pSpace->pChunk;
+    pSpace->pChunk = pChunk;
+  }
+  
+  /* Bump the pointer */
+  pResult = ((unsigned char *) pChunk->pData) + pChunk->used;
+  pChunk->used += size;
+  pSpace->used += size;
+  
+  return pResult;
+}
+
+/*
+ * Free everything in a heap generation in bulk.
+ * 
+ * Parameters:
+ * 
+ *   pSpace - the generation
+ * 
+ *   keep - non-zero to keep the most recent chunk, which is the largest,
+ *   for further allocations
+ */
+static void snvmspace_release(SNVMSPACE *pSpace, int keep) {
+  
+  SNVMCHUNK *pChunk = NULL;
+  SNVMCHUNK *pNext = NULL;
+  
+  /* Check parameter */
+  if (pSpace == NULL) {
+    abort();
+  }
+  
+  /* Free the chunks, except maybe the first */
+  pChunk = pSpace->pChunk;
+  if (keep && (pChunk != NULL)) {
+    pChunk->used = 0;
+    pNext = pChunk->pNext;
+    pChunk->pNext = NULL;
+    pChunk = pNext;
+  } else {
+    pSpace->pChunk = NULL;
+  }
+  while (pChunk != NULL) {
+    pNext = pChunk->pNext;
+    free(pChunk->pData);
+    free(pChunk);
+    pChunk = pNext;
+  }
+  pSpace->used = 0;
+}
+
+/*
+ * Move the object a value refers to during a collection.
+ * 
+ * Nothing happens if the value is not an object or vector, if the
+ * object is static, or if all is zero and the object is already in the
+ * old generation.  If the object has
+ * already been moved, the value is updated to the new location.
+ * Otherwise, the object is copied to pTo and added to the objects whose
+ * slots must be scanned.  Copies are in the old generation unless pTo is
+ * the nursery of the runtime.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pVal - the value
+ * 
+ *   pTo - the generation to copy to
+ * 
+ *   all - non-zero to also move objects in the old generation
+ */
+static void snvm_move(SNVM *pVM, SNVAL *pVal, SNVMSPACE *pTo, int all) {
+  
+  SNOBJ *pObj = NULL;
+  SNOBJ *pCopy = NULL;
+  size_t size = 0;
+  long newcap = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pVal == NULL) || (pTo == NULL)) {
+    abort();
+  }
+  
+  if (((pVal->type == SNVAL_OBJECT) || (pVal->type == SNVAL_VECTOR)) &&
+      (pVal->v.pObj->gen != SNVM_GEN_STATIC)) {
+    pObj = pVal->v.pObj;
+    if (pObj->pForward != NULL) {
+      pVal->v.pObj = pObj->pForward;
+      
+    } else if (all || (pObj->gen == SNVM_GEN_NURSERY)) {
+      /* Copy the object and leave its new location behind */
+      size = snvm_objsize(pObj->count, pObj->bytes);
+      pCopy = (SNOBJ *) snvmspace_alloc(pTo, size);
+      memcpy(pCopy, pObj, size);
+      pCopy->gen = (pTo == &(pVM->nursery)) ?
+                      SNVM_GEN_NURSERY : SNVM_GEN_OLD;
+      pObj->pForward = pCopy;
+      pVal->v.pObj = pCopy;
+      
+      /* Remember to scan the slots of the copy */
+      if (pVM->work_count >= pVM->work_cap) {
+        newcap = pVM->work_cap * 2;
+        if (newcap < SNVM_BASE_INIT) {
+          newcap = SNVM_BASE_INIT;
+        }
+        pVM->ppWork = (SNOBJ **) snvm_grow(
+                        pVM->ppWork, newcap, sizeof(SNOBJ *));
+        pVM->work_cap = newcap;
+      }
+      (pVM->ppWork)[pVM->work_count] = pCopy;
+      (pVM->work_count)++;
+    }
+  }
+}
+
+/*
+ * Move everything the moved objects refer to during a collection.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pTo - the generation to copy to
+ * 
+ *   all - non-zero to also move objects in the old generation
+ */
+static void snvm_scan(SNVM *pVM, SNVMSPACE *pTo, int all) {
+  
+  SNOBJ *pObj = NULL;
+  SNVAL *pSlots = NULL;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pTo == NULL)) {
+    abort();
+  }
+  
+  /* Scan until no moved objects are left */
+  while (pVM->work_count > 0) {
+    (pVM->work_count)--;
+    pObj = (pVM->ppWork)[pVM->work_count];
+    pSlots = snobj_slots(pObj);
+    for(i = 0; i < pObj->count; i++) {
+      snvm_move(pVM, &(pSlots[i]), pTo, all);
+    }
+  }
+}
+
+/*
+ * Collect the heap of a runtime.
+ * 
+ * The roots are the stack, the dictionary, and the global dictionary.
+ * A minor collection moves
+ * the objects in the nursery that can be reached from the roots to the
+ * old generation and frees the rest of the nursery.  Since objects in
+ * the old generation only refer to objects created before them, they
+ * never refer to the nursery and need not be scanned.  A full collection
+ * moves everything that can be reached into a new old generation and
+ * frees both old generations.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   full - non-zero for a full collection
+ */
+static void snvm_collect(SNVM *pVM, int full) {
+  
+  SNVMSPACE to;
+  SNVMSPACE *pTo = NULL;
+  long i = 0;
+  
+  /* Initialize structures */
+  memset(&to, 0, sizeof(SNVMSPACE));
+  
+  /* Check parameter */
+  if (pVM == NULL) {
+    abort();
+  }
+  
+  /* Move everything that can be reached from the roots */
+  pTo = full ? &to : &(pVM->old);
+  for(i = 0; i < pVM->sp; i++) {
+    snvm_move(pVM, &((pVM->pStack)[i]), pTo, full);
+  }
+  for(i = 0; i < pVM->dict_count; i++) {
+    snvm_move(pVM, &((pVM->pDict)[i]), pTo, full);
+  }
+  for(i = 0; i < pVM->global_count; i++) {
+    snvm_move(pVM, &((pVM->pGlobal)[i]), pTo, full);
+  }
+  snvm_scan(pVM, pTo, full);
+  
+  /* Free what is left behind */
+  snvmspace_release(&(pVM->nursery), 1);
+  if (full) {
+    snvmspace_release(&(pVM->old), 0);
+    memcpy(&(pVM->old), &to, sizeof(SNVMSPACE));
+  }
+}
+
+/*
+ * Perform a dictionary instruction.
+ * 
+ * This is also called by machine code.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pi - the VARIABLE, CONSTANT, ASSIGN, or GET instruction
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+static int snvm_dict(SNVM *pVM, const SNVMINS *pi) {
+  
+  int err_code = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pi == NULL)) {
+    abort();
+  }
+  if ((pi->arg < 0) || (pi->arg >= pVM->dict_count)) {
+    abort();
+  }
+  
+  /* Get a value, or store one and collect the nursery if it is large,
+   * now that the value is a root */
+  if (pi->op == SNVM_I_GET) {
+    err_code = snvm_push(pVM, &((pVM->pDict)[pi->arg]));
+    
+  } else {
+    err_code = snvm_pop(pVM, &((pVM->pDict)[pi->arg]));
+    if ((!err_code) && (pVM->nursery.used >= SNVM_NURSERY_SIZE)) {
+      snvm_collect(pVM, 0);
+    }
+  }
+  
+  /* Return status */
+  return err_code;
+}
+
+/*
+ * Find a registered operation.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pName - the name of the operation
+ * 
+ * Return:
+ * 
+ *   the index of the operation in the registry, or -1 if it is not
+ *   registered
+ */
+static long snvm_find(const SNVM *pVM, const char *pName) {
+  
+  long result = -1;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pName == NULL)) {
+    abort();
+  }
+  
+  /* Search the registry */
+  for(i = 0; i < pVM->op_count; i++) {
+    if (strcmp((pVM->ppName)[i], pName) == 0) {
+      result = i;
+      break;
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Find a name in the global dictionary.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pName - the name
+ * 
+ * Return:
+ * 
+ *   the index of the name in the global dictionary, or -1 if it is not
+ *   there
+ */
+static long snvm_global(const SNVM *pVM, const char *pName) {
+  
+  long result = -1;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pName == NULL)) {
+    abort();
+  }
+  
+  /* Search the global dictionary */
+  for(i = 0; i < pVM->global_count; i++) {
+    if (strcmp((pVM->ppGlobal)[i], pName) == 0) {
+      result = i;
+      break;
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Add a name to the global dictionary, or replace it if it is already
+ * there.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pName - the name
+ * 
+ *   kind - SNENTITY_VARIABLE or SNENTITY_CONSTANT
+ * 
+ *   pVal - the value
+ */
+static void snvm_publish(
+    SNVM        * pVM,
+    const char  * pName,
+    int           kind,
+    const SNVAL * pVal) {
+  
+  long i = 0;
+  long newcap = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pName == NULL) || (pVal == NULL)) {
+    abort();
+  }
+  
+  /* Add the name if it is new */
+  i = snvm_global(pVM, pName);
+  if (i < 0) {
+    if (pVM->global_count >= pVM->global_cap) {
+      newcap = pVM->global_cap * 2;
+      if (newcap < SNVM_NAMES_INIT) {
+        newcap = SNVM_NAMES_INIT;
+      }
+      pVM->ppGlobal = (char **) snvm_grow(
+                        pVM->ppGlobal, newcap, sizeof(char *));
+      pVM->pGlobalKind = (int *) snvm_grow(
+                          pVM->pGlobalKind, newcap, sizeof(int));
+      pVM->pGlobal = (SNVAL *) snvm_grow(
+                      pVM->pGlobal, newcap, sizeof(SNVAL));
+      pVM->global_cap = newcap;
+    }
+    
+    i = pVM->global_count;
+    (pVM->ppGlobal)[i] = (char *) malloc(strlen(pName) + 1);
+    if ((pVM->ppGlobal)[i] == NULL) {
+      abort();
+    }
+    strcpy((pVM->ppGlobal)[i], pName);
+    (pVM->global_count)++;
+  }
+  
+  /* Set the kind and the value */
+  (pVM->pGlobalKind)[i] = kind;
+  memcpy(&((pVM->pGlobal)[i]), pVal, sizeof(SNVAL));
+}
+
+/*
+ * Convert a numeric literal into a value.
+ * 
+ * Parameters:
+ * 
+ *   pStr - the numeric literal
+ * 
+ *   pVal - receives the value
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNVM_ERR_BADNUM
+ */
+static int snvm_number(const char *pStr, SNVAL *pVal) {
+  
+  const char *pc = NULL;
+  const char *pDigits = NULL;
+  char *pEnd = NULL;
+  int err_code = 0;
+  int neg = 0;
+  int hex = 0;
+  int digits = 1;
+  
+  /* Check parameters */
+  if ((pStr == NULL) || (pVal == NULL)) {
+    abort();
+  }
+  memset(pVal, 0, sizeof(SNVAL));
+  
+  /* Skip the sign and any hexadecimal mark, then see whether only
+   * digits remain */
+  pc = pStr;
+  if ((*pc == '+') || (*pc == '-')) {
+    neg = (*pc == '-');
+    pc++;
+  }
+  if ((pc[0] == '0') && ((pc[1] == 'x') || (pc[1] == 'X'))) {
+    hex = 1;
+    pc += 2;
+  }
+  pDigits = pc;
+  if (*pc == 0) {
+    digits = 0;
+  }
+  for( ; *pc != 0; pc++) {
+    if (!(((*pc >= '0') && (*pc <= '9')) ||
+          (hex && (((*pc >= 'a') && (*pc <= 'f')) ||
+                    ((*pc >= 'A') && (*pc <= 'F')))))) {
+      digits = 0;
+      break;
+    }
+  }
+  
+  /* Convert integers with strtol() and everything else with strtod() */
+  errno = 0;
+  if (hex && digits) {
+    pVal->type = SNVAL_INT;
+    pVal->v.i = strtol(pDigits, &pEnd, 16);
+    if (neg) {
+      pVal->v.i = -(pVal->v.i);
+    }
+    
+  } else if (digits) {
+    pVal->type = SNVAL_INT;
+    pVal->v.i = strtol(pStr, &pEnd, 10);
+    
+    /* Decimal integers that do not fit in a long become floating-point
+     * numbers instead */
+    if (errno == ERANGE) {
+      errno = 0;
+      pVal->type = SNVAL_FLOAT;
+      pVal->v.f = strtod(pStr, &pEnd);
+    }
+    
+  } else if (hex) {
+    err_code = SNVM_ERR_BADNUM;
+    
+  } else {
+    pVal->type = SNVAL_FLOAT;
+    pVal->v.f = strtod(pStr, &pEnd);
+  }
+  
+  /* Check that the whole literal was converted and in range */
+  if (!err_code) {
+    if ((errno == ERANGE) || (pEnd == NULL) || (*pEnd != 0)) {
+      err_code = SNVM_ERR_BADNUM;
+    }
+  }
+  
+  /* Return status */
+  return err_code;
+}
+
+/*
+ * Append an instruction to a program.
+ * 
+ * Parameters:
+ * 
+ *   pProg - the program
+ * 
+ *   op - the opcode
+ * 
+ *   arg - the argument
+ * 
+ *   line - the line number of the entity
+ * 
+ * Return:
+ * 
+ *   the index of the instruction
+ */
+static long snvmprog_emit(SNVMPROG *pProg, int op, long arg, long line) {
+  
+  long newcap = 0;
+  
+  /* Check parameter */
+  if (pProg == NULL) {
+    abort();
+  }
+  if (pProg->code_count >= LONG_MAX / 2) {
+    abort();
+  }
+  
+  /* Grow the code if necessary */
+  if (pProg->code_count >= pProg->code_cap) {
+    newcap = pProg->code_cap * 2;
+    if (newcap < SNVM_CODE_INIT) {
+      newcap = SNVM_CODE_INIT;
+    }
+    pProg->pCode = (SNVMINS *) snvm_grow(
+                      pProg->pCode, newcap, sizeof(SNVMINS));
+    pProg->pLines = (long *) snvm_grow(
+                      pProg->pLines, newcap, sizeof(long));
+    pProg->code_cap = newcap;
+  }
+  
+  /* Append the instruction */
+  (pProg->pCode)[pProg->code_count].op = op;
+  (pProg->pCode)[pProg->code_count].arg = arg;
+  (pProg->pLines)[pProg->code_count] = line;
+  (pProg->code_count)++;
+  
+  return pProg->code_count - 1;
+}
+
+/*
+ * Add a literal to the constant pool of a program.
+ * 
+ * Parameters:
+ * 
+ *   pProg - the program
+ * 
+ *   pVal - the literal
+ * 
+ * Return:
+ * 
+ *   the index of the literal in the pool
+ */
+static long snvmprog_literal(SNVMPROG *pProg, const SNVAL *pVal) {
+  
+  long newcap = 0;
+  
+  /* Check parameters */
+  if ((pProg == NULL) || (pVal == NULL)) {
+    abort();
+  }
+  if (pProg->pool_count >= LONG_MAX / 2) {
+    abort();
+  }
+  
+  /* Grow the pool if necessary */
+  if (pProg->pool_count >= pProg->pool_cap) {
+    newcap = pProg->pool_cap * 2;
+    if (newcap < SNVM_POOL_INIT) {
+      newcap = SNVM_POOL_INIT;
+    }
+    pProg->pPool = (SNVAL *) snvm_grow(
+                      pProg->pPool, newcap, sizeof(SNVAL));
+    pProg->pool_cap = newcap;
+  }
+  
+  /* Append the literal */
+  memcpy(&((pProg->pPool)[pProg->pool_count]), pVal, sizeof(SNVAL));
+  (pProg->pool_count)++;
+  
+  return pProg->pool_count - 1;
+}
+
+/*
+ * Reserve space in the arena of a program.
+ * 
+ * Parameters:
+ * 
+ *   pProg - the program
+ * 
+ *   len - the number of bytes
+ * 
+ *   align - the alignment of the space, which is one or the size of
+ *   SNVMALIGN
+ * 
+ * Return:
+ * 
+ *   the offset of the space in the arena
+ */
+static long snvmprog_reserve(SNVMPROG *pProg, long len, long align) {
+  
+  long result = 0;
+  long newcap = 0;
+  
+  /* Check parameters */
+  if ((pProg == NULL) || (len < 0) || (align < 1)) {
+    abort();
+  }
+  if (len >= LONG_MAX / 2 - pProg->arena_len - align) {
+    abort();
+  }
+  
+  /* Pad up to the alignment */
+  result = ((pProg->arena_len + align - 1) / align) * align;
+  
+  /* Grow the arena if necessary */
+  if (result + len > pProg->arena_cap) {
+    newcap = pProg->arena_cap;
+    if (newcap < SNVM_ARENA_INIT) {
+      newcap = SNVM_ARENA_INIT;
+    }
+    while (result + len > newcap) {
+      newcap = newcap * 2;
+    }
+    pProg->pArena = (char *) snvm_grow(pProg->pArena, newcap, 1);
+    pProg->arena_cap = newcap;
+  }
+  
+  pProg->arena_len = result + len;
+  return result;
+}
+
+/*
+ * Copy a string literal into the arena of a program.
+ * 
+ * Parameters:
+ * 
+ *   pProg - the program
+ * 
+ *   pStr - the string
+ * 
+ *   len - the length of the string
+ * 
+ * Return:
+ * 
+ *   the offset of the nul-terminated copy in the arena
+ */
+static long snvmprog_string(SNVMPROG *pProg, const char *pStr, long len) {
+  
+  long result = 0;
+  
+  /* Check parameters */
+  if ((pProg == NULL) || (pStr == NULL) || (len < 0)) {
+    abort();
+  }
+  
+  /* Copy the string */
+  result = snvmprog_reserve(pProg, len + 1, 1);
+  memcpy(pProg->pArena + result, pStr, (size_t) len);
+  (pProg->pArena)[result + len] = (char) 0;
+  
+  return result;
+}
+
+/*
+ * Replace a literal array by a vector literal.
+ * 
+ * The array consists of the instructions from start up to the end of
+ * the program, which are the PUSH instructions of its numeric elements,
+ * any NOP instructions of their groups, and the PUSH of the element
+ * count.  These are removed, and a PUSH of a vector literal holding the
+ * elements is emitted instead.  The vector is a static object in the
+ * arena, which the pool refers to by offset until the program is
+ * complete.
+ * 
+ * Parameters:
+ * 
+ *   pProg - the program
+ * 
+ *   start - the index of the first instruction of the array
+ * 
+ *   line - the line number for the new instruction
+ */
+static void snvmprog_vector(SNVMPROG *pProg, long start, long line) {
+  
+  const SNVAL *pLit = NULL;
+  SNOBJ obj;
+  SNVAL val;
+  double d = 0.0;
+  long count = 0;
+  long off = 0;
+  long i = 0;
+  long j = 0;
+  
+  /* Initialize structures */
+  memset(&obj, 0, sizeof(SNOBJ));
+  memset(&val, 0, sizeof(SNVAL));
+  
+  /* Check parameters */
+  if ((pProg == NULL) || (start < 0) || (start >= pProg->code_count)) {
+    abort();
+  }
+  
+  /* Count the elements, leaving out the element count */
+  for(i = start; i < pProg->code_count - 1; i++) {
+    if ((pProg->pCode)[i].op == SNVM_I_PUSH) {
+      count++;
+    }
+  }
+  
+  /* Reserve the object and write its header */
+  obj.pForward = NULL;
+  obj.count = 0;
+  obj.bytes = count * ((long) sizeof(double));
+  obj.gen = SNVM_GEN_STATIC;
+  off = snvmprog_reserve(pProg,
+          (long) snvm_objsize(0, obj.bytes), (long) sizeof(SNVMALIGN));
+  memset(pProg->pArena + off, 0, snvm_objsize(0, obj.bytes));
+  memcpy(pProg->pArena + off, &obj, sizeof(SNOBJ));
+  
+  /* Copy the elements */
+  for(i = start; i < pProg->code_count - 1; i++) {
+    if ((pProg->pCode)[i].op == SNVM_I_PUSH) {
+      pLit = &((pProg->pPool)[(pProg->pCode)[i].arg]);
+      if (pLit->type == SNVAL_INT) {
+        d = (double) pLit->v.i;
+      } else {
+        d = pLit->v.f;
+      }
+      memcpy(pProg->pArena + off + sizeof(SNOBJ) + j * sizeof(double),
+              &d, sizeof(double));
+      j++;
+    }
+  }
+  
+  /* Replace the array */
+  pProg->code_count = start;
+  val.type = SNVAL_VECTOR;
+  val.v.i = off;
+  snvmprog_emit(pProg, SNVM_I_PUSH, snvmprog_literal(pProg, &val), line);
+}
+
+/*
+ * Mark an array of a program for parallel evaluation.
+ * 
+ * The boundaries of the elements are added to the boundary table, and
+ * the array to the parallel table.  The PARALLEL instruction is only
+ * inserted when the program is complete.
+ * 
+ * Parameters:
+ * 
+ *   pProg - the program
+ * 
+ *   pSib - the groups that are the elements, in order
+ * 
+ *   count - the number of elements, greater than zero
+ */
+static void snvmprog_parallel(
+    SNVMPROG      * pProg,
+    const SNVMSIB * pSib,
+    long            count) {
+  
+  SNVMPAR *pPar = NULL;
+  long newcap = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pProg == NULL) || (pSib == NULL) || (count < 1)) {
+    abort();
+  }
+  if (count >= LONG_MAX / 2 - pProg->bound_count) {
+    abort();
+  }
+  
+  /* Grow the tables if necessary */
+  if (pProg->par_count >= pProg->par_cap) {
+    newcap = pProg->par_cap * 2;
+    if (newcap < SNVM_PAR_INIT) {
+      newcap = SNVM_PAR_INIT;
+    }
+    pProg->pPar = (SNVMPAR *) snvm_grow(
+                    pProg->pPar, newcap, sizeof(SNVMPAR));
+    pProg->par_cap = newcap;
+  }
+  if (count + 1 > pProg->bound_cap - pProg->bound_count) {
+    newcap = pProg->bound_cap;
+    if (newcap < SNVM_CODE_INIT) {
+      newcap = SNVM_CODE_INIT;
+    }
+    while (count + 1 > newcap - pProg->bound_count) {
+      newcap = newcap * 2;
+    }
+    pProg->pBounds = (long *) snvm_grow(
+                        pProg->pBounds, newcap, sizeof(long));
+    pProg->bound_cap = newcap;
+  }
+  
+  /* Record the element boundaries and the array */
+  pPar = &((pProg->pPar)[pProg->par_count]);
+  pPar->pProg = pProg;
+  pPar->first = pProg->bound_count;
+  pPar->count = count;
+  for(i = 0; i < count; i++) {
+    (pProg->pBounds)[pProg->bound_count + i] = pSib[i].start;
+  }
+  (pProg->pBounds)[pProg->bound_count + count] = pSib[count - 1].end;
+  pProg->bound_count += (count + 1);
+  (pProg->par_count)++;
+}
+
+/*
+ * Complete a program after the last instruction has been emitted.
+ * 
+ * NOP instructions are removed, a PARALLEL instruction is inserted
+ * before the elements of each array in the parallel table, the element
+ * boundaries are moved to match, and string and vector literals in the
+ * pool are changed from arena offsets to pointers.
+ * 
+ * Parameters:
+ * 
+ *   pProg - the program
+ */
+static void snvmprog_finish(SNVMPROG *pProg) {
+  
+  SNVMINS *pCode = NULL;
+  long *pLines = NULL;
+  long *pAt = NULL;
+  long *pMap = NULL;
+  long cap = 0;
+  long i = 0;
+  long j = 0;
+  
+  /* Check parameter */
+  if (pProg == NULL) {
+    abort();
+  }
+  
+  /* Find the instruction where each parallel array begins */
+  pAt = (long *) snvm_grow(NULL, pProg->code_count + 1, sizeof(long));
+  pMap = (long *) snvm_grow(NULL, pProg->code_count + 1, sizeof(long));
+  for(i = 0; i < pProg->code_count; i++) {
+    pAt[i] = -1;
+  }
+  for(i = 0; i < pProg->par_count; i++) {
+    pAt[(pProg->pBounds)[(pProg->pPar)[i].first]] = i;
+  }
+  
+  /* Rebuild the code without NOP instructions and with PARALLEL
+   * instructions, mapping each old index to its new index */
+  cap = pProg->code_count + pProg->par_count + 1;
+  pCode = (SNVMINS *) snvm_grow(NULL, cap, sizeof(SNVMINS));
+  pLines = (long *) snvm_grow(NULL, cap, sizeof(long));
+  for(i = 0; i < pProg->code_count; i++) {
+    if (pAt[i] >= 0) {
+      pCode[j].op = SNVM_I_PARALLEL;
+      pCode[j].arg = pAt[i];
+      pLines[j] = (pProg->pLines)[i];
+      j++;
+    }
+    pMap[i] = j;
+    if ((pProg->pCode)[i].op != SNVM_I_NOP) {
+      pCode[j] = (pProg->pCode)[i];
+      pLines[j] = (pProg->pLines)[i];
+      j++;
+    }
+  }
+  pMap[pProg->code_count] = j;
+  
+  free(pProg->pCode);
+  free(pProg->pLines);
+  pProg->pCode = pCode;
+  pProg->pLines = pLines;
+  pProg->code_count = j;
+  pProg->code_cap = cap;
+  
+  /* Move the element boundaries */
+  for(i = 0; i < pProg->bound_count; i++) {
+    (pProg->pBounds)[i] = pMap[(pProg->pBounds)[i]];
+  }
+  free(pAt);
+  free(pMap);
+  
+  /* Resolve string and vector literals */
+  for(i = 0; i < pProg->pool_count; i++) {
+    if ((pProg->pPool)[i].type == SNVAL_STRING) {
+      (pProg->pPool)[i].v.pStr = pProg->pArena + (pProg->pPool)[i].v.i;
+      
+    } else if ((pProg->pPool)[i].type == SNVAL_VECTOR) {
+      (pProg->pPool)[i].v.pObj =
+        (SNOBJ *) (pProg->pArena + (pProg->pPool)[i].v.i);
+    }
+  }
+}
+
+/*
+ * Record the BEGIN instruction of a group while compiling.
+ * 
+ * Parameters:
+ * 
+ *   pComp - the group structure
+ * 
+ *   begin - the index of the BEGIN instruction
+ */
+static void snvmcomp_begin(SNVMCOMP *pComp, long begin) {
+  
+  SNVMOPEN *pOpen = NULL;
+  long newcap = 0;
+  
+  /* Check parameters */
+  if ((pComp == NULL) || (begin < 0)) {
+    abort();
+  }
+  
+  /* Grow the stack of open groups if necessary */
+  if (pComp->open_count >= pComp->open_cap) {
+    newcap = pComp->open_cap * 2;
+    if (newcap < SNVM_BASE_INIT) {
+      newcap = SNVM_BASE_INIT;
+    }
+    pComp->pOpen = (SNVMOPEN *) snvm_grow(
+                      pComp->pOpen, newcap, sizeof(SNVMOPEN));
+    pComp->open_cap = newcap;
+  }
+  
+  /* Open the group */
+  pOpen = &((pComp->pOpen)[pComp->open_count]);
+  pOpen->begin = begin;
+  pOpen->sib = pComp->sib_count;
+  pOpen->pure = 1;
+  (pComp->open_count)++;
+}
+
+/*
+ * Record the end of the innermost open group while compiling.
+ * 
+ * The group becomes a completed group of the enclosing group.  It
+ * follows the completed groups already recorded there if it begins
+ * where the last of them ends, and replaces them otherwise.
+ * 
+ * Parameters:
+ * 
+ *   pComp - the group structure
+ * 
+ *   end - the index after the last instruction of the group
+ */
+static void snvmcomp_end(SNVMCOMP *pComp, long end) {
+  
+  const SNVMOPEN *pInner = NULL;
+  SNVMSIB *pSib = NULL;
+  long base = 0;
+  long newcap = 0;
+  
+  /* Check parameters */
+  if (pComp == NULL) {
+    abort();
+  }
+  if (pComp->open_count < 1) {
+    abort();
+  }
+  
+  /* Close the group, dropping the groups completed within it */
+  (pComp->open_count)--;
+  pInner = &((pComp->pOpen)[pComp->open_count]);
+  pComp->sib_count = pInner->sib;
+  
+  /* Pass impurity to the enclosing group */
+  if (pComp->open_count > 0) {
+    base = (pComp->pOpen)[pComp->open_count - 1].sib;
+    if (!(pInner->pure)) {
+      (pComp->pOpen)[pComp->open_count - 1].pure = 0;
+    }
+  }
+  
+  /* Start over if something came between this group and the last */
+  if (pComp->sib_count > base) {
+    if ((pComp->pSib)[pComp->sib_count - 1].end != pInner->begin) {
+      pComp->sib_count = base;
+    }
+  }
+  
+  /* Add the completed group */
+  if (pComp->sib_count >= pComp->sib_cap) {
+    newcap = pComp->sib_cap * 2;
+    if (newcap < SNVM_BASE_INIT) {
+      newcap = SNVM_BASE_INIT;
+    }
+    pComp->pSib = (SNVMSIB *) snvm_grow(
+                      pComp->pSib, newcap, sizeof(SNVMSIB));
+    pComp->sib_cap = newcap;
+  }
+  pSib = &((pComp->pSib)[pComp->sib_count]);
+  pSib->start = pInner->begin;
+  pSib->end = end;
+  pSib->pure = pInner->pure;
+  (pComp->sib_count)++;
+}
+
+/*
+ * Handle an ARRAY entity while compiling.
+ * 
+ * This must be called before the instruction that pushes the element
+ * count is emitted.  The elements are the last count completed groups.
+ * If each of them is a single numeric literal, lit_start is set so that
+ * the array can become a vector literal.  Otherwise, if there are enough
+ * of them, they are pure, and they hold enough work, the array is marked
+ * for parallel evaluation.
+ * 
+ * Parameters:
+ * 
+ *   pComp - the group structure
+ * 
+ *   pProg - the program
+ * 
+ *   count - the number of elements
+ */
+static void snvmcomp_array(SNVMCOMP *pComp, SNVMPROG *pProg, long count) {
+  
+  const SNVMSIB *pFirst = NULL;
+  const SNVMSIB *pLast = NULL;
+  const SNVMINS *pi = NULL;
+  long base = 0;
+  long pushes = 0;
+  long i = 0;
+  long j = 0;
+  int pure = 1;
+  
+  /* Check parameters */
+  if ((pComp == NULL) || (pProg == NULL) || (count < 0)) {
+    abort();
+  }
+  
+  /* Get the completed groups of the current group */
+  if (pComp->open_count > 0) {
+    base = (pComp->pOpen)[pComp->open_count - 1].sib;
+  }
+  
+  /* Check whether each element is a single numeric literal */
+  pComp->lit_start = -1;
+  if (count < 1) {
+    pComp->lit_start = pProg->code_count;
+    
+  } else if (pComp->sib_count - base >= count) {
+    pFirst = &((pComp->pSib)[pComp->sib_count - count]);
+    pLast = &((pComp->pSib)[pComp->sib_count - 1]);
+    if (pLast->end == pProg->code_count) {
+      pComp->lit_start = pFirst->start;
+      for(i = 0; i < count; i++) {
+        pushes = 0;
+        for(j = pFirst[i].start; j < pFirst[i].end; j++) {
+          pi = &((pProg->pCode)[j]);
+          if ((pi->op == SNVM_I_PUSH) &&
+              (((pProg->pPool)[pi->arg].type == SNVAL_INT) ||
+                ((pProg->pPool)[pi->arg].type == SNVAL_FLOAT))) {
+            pushes++;
+          } else if (pi->op != SNVM_I_NOP) {
+            pushes = -1;
+            break;
+          }
+        }
+        if (pushes != 1) {
+          pComp->lit_start = -1;
+          break;
+        }
+      }
+    }
+  }
+  
+  /* Otherwise, mark the array if it qualifies */
+  if ((pComp->lit_start < 0) && (count >= SNVM_PARALLEL_MIN) &&
+      (pComp->sib_count - base >= count)) {
+    pFirst = &((pComp->pSib)[pComp->sib_count - count]);
+    pLast = &((pComp->pSib)[pComp->sib_count - 1]);
+    if ((pLast->end == pProg->code_count) &&
+        (pLast->end - pFirst->start >= SNVM_PARALLEL_WORK)) {
+      for(i = 0; i < count; i++) {
+        if (!(pFirst[i].pure)) {
+          pure = 0;
+          break;
+        }
+      }
+      if (pure) {
+        snvmprog_parallel(pProg, pFirst, count);
+      }
+    }
+  }
+  
+  /* The element count comes between these groups and any later ones */
+  pComp->sib_count = base;
+}
+
+/*
+ * Record that the innermost open group, if any, is not pure.
+ * 
+ * Parameters:
+ * 
+ *   pComp - the group structure
+ */
+static void snvmcomp_impure(SNVMCOMP *pComp) {
+  
+  /* Check parameter */
+  if (pComp == NULL) {
+    abort();
+  }
+  
+  if (pComp->open_count > 0) {
+    (pComp->pOpen)[pComp->open_count - 1].pure = 0;
+  }
+}
+
+/*
+ * Compute the FNV-1a hash of a name.
+ * 
+ * Parameters:
+ * 
+ *   pName - the nul-terminated name
+ * 
+ * Return:
+ * 
+ *   the hash
+ */
+static unsigned long snvmcomp_hash(const char *pName) {
+  
+  unsigned long h = 2166136261UL;
+  
+  /* Check parameter */
+  if (pName == NULL) {
+    abort();
+  }
+  
+  for( ; *pName != 0; pName++) {
+    h = ((h ^ ((unsigned char) *pName)) * 16777619UL) & 0xffffffffUL;
+  }
+  
+  return h;
+}
+
+/*
+ * Find a declared name while compiling.
+ * 
+ * Parameters:
+ * 
+ *   pComp - the compilation state
+ * 
+ *   pName - the nul-terminated name
+ * 
+ * Return:
+ * 
+ *   the index of the name, or -1 if it has not been declared
+ */
+static long snvmcomp_lookup(const SNVMCOMP *pComp, const char *pName) {
+  
+  long result = -1;
+  long slot = 0;
+  
+  /* Check parameters */
+  if ((pComp == NULL) || (pName == NULL)) {
+    abort();
+  }
+  
+  /* Probe the hash table until the name or an unused entry */
+  if (pComp->hash_cap > 0) {
+    slot = (long) (snvmcomp_hash(pName) % ((unsigned long) pComp->hash_cap));
+    while ((pComp->pHash)[slot] > 0) {
+      if (strcmp((pComp->ppName)[(pComp->pHash)[slot] - 1], pName) == 0) {
+        result = (pComp->pHash)[slot] - 1;
+        break;
+      }
+      slot = (slot + 1) % pComp->hash_cap;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Declare a name while compiling.
+ * 
+ * The caller must check that the name has not been declared yet.  The
+ * name does not import a global, unless the caller changes that.
+ * 
+ * Parameters:
+ * 
+ *   pComp - the compilation state
+ * 
+ *   pName - the nul-terminated name
+ * 
+ *   kind - SNENTITY_VARIABLE or SNENTITY_CONSTANT
+ * 
+ * Return:
+ * 
+ *   the index of the name, which is its dictionary slot
+ */
+static long snvmcomp_declare(SNVMCOMP *pComp, const char *pName, int kind) {
+  
+  long newcap = 0;
+  long slot = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pComp == NULL) || (pName == NULL)) {
+    abort();
+  }
+  if (pComp->name_count >= LONG_MAX / 4) {
+    abort();
+  }
+  
+  /* Grow the name arrays if necessary */
+  if (pComp->name_count >= pComp->name_cap) {
+    newcap = pComp->name_cap * 2;
+    if (newcap < SNVM_NAMES_INIT) {
+      newcap = SNVM_NAMES_INIT;
+    }
+    pComp->ppName = (char **) snvm_grow(
+                      pComp->ppName, newcap, sizeof(char *));
+    pComp->pKind = (int *) snvm_grow(pComp->pKind, newcap, sizeof(int));
+    pComp->pImport = (long *) snvm_grow(
+                      pComp->pImport, newcap, sizeof(long));
+    pComp->name_cap = newcap;
+  }
+  
+  /* Store a copy of the name */
+  (pComp->ppName)[pComp->name_count] = (char *) malloc(strlen(pName) + 1);
+  if ((pComp->ppName)[pComp->name_count] == NULL) {
+    abort();
+  }
+  strcpy((pComp->ppName)[pComp->name_count], pName);
+  (pComp->pKind)[pComp->name_count] = kind;
+  (pComp->pImport)[pComp->name_count] = -1;
+  (pComp->name_count)++;
+  
+  /* Rebuild the hash table when it would be more than half full, else
+   * add the new name */
+  if (pComp->name_count * 2 > pComp->hash_cap) {
+    newcap = pComp->name_cap * 4;
+    if (pComp->pHash != NULL) {
+      free(pComp->pHash);
+    }
+    pComp->pHash = (long *) calloc((size_t) newcap, sizeof(long));
+    if (pComp->pHash == NULL) {
+      abort();
+    }
+    pComp->hash_cap = newcap;
+    i = 0;
+  } else {
+    i = pComp->name_count - 1;
+  }
+  for( ; i < pComp->name_count; i++) {
+    slot = (long) (snvmcomp_hash((pComp->ppName)[i]) %
+                    ((unsigned long) pComp->hash_cap));
+    while ((pComp->pHash)[slot] > 0) {
+      slot = (slot + 1) % pComp->hash_cap;
+    }
+    (pComp->pHash)[slot] = i + 1;
+  }
+  
+  return pComp->name_count - 1;
+}
+
+/*
+ * Release the compilation state.
+ * 
+ * Parameters:
+ * 
+ *   pComp - the compilation state
+ */
+static void snvmcomp_free(SNVMCOMP *pComp) {
+  
+  long i = 0;
+  
+  /* Check parameter */
+  if (pComp == NULL) {
+    abort();
+  }
+  
+  if (pComp->pOpen != NULL) {
+    free(pComp->pOpen);
+  }
+  if (pComp->pSib != NULL) {
+    free(pComp->pSib);
+  }
+  for(i = 0; i < pComp->name_count; i++) {
+    free((pComp->ppName)[i]);
+  }
+  if (pComp->ppName != NULL) {
+    free(pComp->ppName);
+    free(pComp->pKind);
+    free(pComp->pImport);
+  }
+  if (pComp->pHash != NULL) {
+    free(pComp->pHash);
+  }
+  memset(pComp, 0, sizeof(SNVMCOMP));
+}
+
+/*
+ * Run a range of instructions of a program with the interpreter.
+ * 
+ * If there is an error, pc of the runtime is set to the index of the
+ * instruction that failed.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pProg - the program
+ * 
+ *   start - the index of the first instruction
+ * 
+ *   end - the index after the last instruction
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+static int snvm_interpret(
+    SNVM           * pVM,
+    const SNVMPROG * pProg,
+    long             start,
+    long             end) {
+  
+  const SNVMINS *pi = NULL;
+  const SNVMCALL *pCall = NULL;
+  const SNVMPAR *pPar = NULL;
+  int err_code = 0;
+  long pc = 0;
+  long next = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pProg == NULL) ||
+      (start < 0) || (end < start) || (end > pProg->code_count)) {
+    abort();
+  }
+  
+  /* Execute each instruction until the end or an error */
+  pc = start;
+  while ((!err_code) && (pc < end)) {
+    pi = &((pProg->pCode)[pc]);
+    next = pc + 1;
+    switch (pi->op) {
+      
+      case SNVM_I_PUSH:
+        if (pVM->sp >= pVM->cap) {
+          err_code = snvm_stack(pVM);
+        }
+        if (!err_code) {
+          (pVM->pStack)[pVM->sp] = (pProg->pPool)[pi->arg];
+          (pVM->sp)++;
+        }
+        break;
+      
+      case SNVM_I_CALL:
+        pCall = &((pProg->pCalls)[pi->arg]);
+        err_code = pCall->pfOp(pVM, pCall->pCustom);
+        break;
+      
+      case SNVM_I_BEGIN:
+        err_code = snvm_begin(pVM);
+        break;
+      
+      case SNVM_I_END:
+        err_code = snvm_end(pVM);
+        break;
+      
+      case SNVM_I_VARIABLE:
+      case SNVM_I_CONSTANT:
+      case SNVM_I_ASSIGN:
+      case SNVM_I_GET:
+        err_code = snvm_dict(pVM, pi);
+        break;
+      
+      case SNVM_I_PARALLEL:
+        /* Skip the elements unless they must be evaluated in order;
+         * snvm_parallel() sets pc of the runtime itself */
+        pPar = &((pProg->pPar)[pi->arg]);
+        pVM->pc = pc;
+        err_code = snvm_parallel(pVM, pPar);
+        if (err_code == 0) {
+          next = (pProg->pBounds)[pPar->first + pPar->count];
+        } else if (err_code > 0) {
+          err_code = 0;
+        }
+        break;
+      
+      default:
+        abort();
+    }
+    
+    if (!err_code) {
+      pc = next;
+    } else if (pi->op != SNVM_I_PARALLEL) {
+      pVM->pc = pc;
+    }
+  }
+  
+  /* Return status */
+  return err_code;
+}
+
+/*
+ * Run a program on a runtime.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pProg - the program
+ * 
+ *   pLine - pointer to receive the error line, or NULL
+ * 
+ *   define - non-zero to add the names the program declares to the
+ *   global dictionary if the run is successful
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+static int snvm_execute(
+    SNVM           * pVM,
+    const SNVMPROG * pProg,
+    long           * pLine,
+    int              define) {
+  
+  long floor = 0;
+  long base_count = 0;
+  long i = 0;
+  long j = 0;
+  int err_code = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pProg == NULL)) {
+    abort();
+  }
+  
+  /* Save the group state, so that groups left open by an error can be
+   * closed */
+  floor = pVM->floor;
+  base_count = pVM->base_count;
+  
+  /* Start with an empty dictionary, apart from imported globals that the
+   * runtime has */
+  if (pProg->name_count > pVM->dict_cap) {
+    pVM->pDict = (SNVAL *) snvm_grow(
+                    pVM->pDict, pProg->name_count, sizeof(SNVAL));
+    pVM->dict_cap = pProg->name_count;
+  }
+  if (pProg->name_count > 0) {
+    memset(pVM->pDict, 0, ((size_t) pProg->name_count) * sizeof(SNVAL));
+  }
+  pVM->dict_count = pProg->name_count;
+  for(i = 0; i < pProg->name_count; i++) {
+    j = (pProg->pImport)[i];
+    if ((j >= 0) && (j < pVM->global_count) &&
+        (strcmp((pVM->ppGlobal)[j], (pProg->ppName)[i]) == 0)) {
+      (pVM->pDict)[i] = (pVM->pGlobal)[j];
+    }
+  }
+  
+  /* Run machine code if there is any, else interpret */
+  if (pProg->pfNative != NULL) {
+    err_code = pProg->pfNative(pVM);
+  } else {
+    err_code = snvm_interpret(pVM, pProg, 0, pProg->code_count);
+  }
+  
+  /* Close any open groups on error and report the line */
+  if (err_code) {
+    pVM->floor = floor;
+    pVM->base_count = base_count;
+  }
+  
+  /* Store imported variables back, and keep the names the program
+   * declared if requested */
+  for(i = 0; i < pProg->name_count; i++) {
+    j = (pProg->pImport)[i];
+    if ((j >= 0) && (j < pVM->global_count) &&
+        ((pProg->pKind)[i] == SNENTITY_VARIABLE) &&
+        (strcmp((pVM->ppGlobal)[j], (pProg->ppName)[i]) == 0)) {
+      (pVM->pGlobal)[j] = (pVM->pDict)[i];
+      
+    } else if ((j < 0) && define && (!err_code)) {
+      snvm_publish(pVM, (pProg->ppName)[i], (pProg->pKind)[i],
+        &((pVM->pDict)[i]));
+    }
+  }
+  
+  /* Discard the dictionary and free everything the stack and the global
+   * dictionary do not refer to */
+  pVM->dict_count = 0;
+  if ((pVM->nursery.used > 0) || (pVM->old.used > 0)) {
+    snvm_collect(pVM, 1);
+  }
+  
+  if (pLine != NULL) {
+    *pLine = err_code ? (pProg->pLines)[pVM->pc] : 0;
+  }
+  
+  return err_code;
+}
+
+/*
+ * Parallel evaluation
+ * ===================
+ * 
+ * A runtime with workers has a pool with one worker runtime and one
+ * range of element indices for each participant, which are the worker
+ * threads and, last, the calling thread.  When an array is evaluated,
+ * its elements are split evenly over the ranges.  Each participant takes
+ * elements from the start of its own range, and when that is empty,
+ * steals the second half of another range.  Results and errors are
+ * stored by element index, so they can be reported in order.
+ */
+#ifdef SNVM_THREADS
+
+/*
+ * A range of elements that a participant has yet to run.
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  long lo;
+  long hi;
+} SNVMRANGE;
+
+/*
+ * A worker thread.
+ */
+typedef struct {
+  SNVMPOOL *pPool;
+  int index;
+  pthread_t thread;
+} SNVMWORKER;
+
+/*
+ * Structure for the workers of a runtime.
+ * 
+ * The prototype of this structure (SNVMPOOL) is defined further up.
+ */
+struct SNVMPOOL_TAG {
+  
+  /*
+   * The worker threads, of which started are running.  count is also
+   * the participant index of the calling thread.
+   */
+  SNVMWORKER *pWorkers;
+  int count;
+  int started;
+  
+  /*
+   * The runtime and range of each participant.
+   */
+  SNVM **ppVM;
+  SNVMRANGE *pRange;
+  
+  /*
+   * Signals between the calling thread and the workers.
+   * 
+   * The calling thread increments generation to start a job, and
+   * workers decrement busy when they have run out of elements.  quit
+   * stops the workers.
+   */
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned long generation;
+  int busy;
+  int quit;
+  
+  /*
+   * The current job, with the result and error code of each element,
+   * and the capacity of those arrays.
+   */
+  const SNVMPAR *pJob;
+  SNVAL *pResults;
+  int *pErrs;
+  long job_cap;
+};
+
+/*
+ * Take the next element to run.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the workers
+ * 
+ *   me - the participant index
+ * 
+ * Return:
+ * 
+ *   the element index, or -1 if there are no elements left
+ */
+static long snvmpool_take(SNVMPOOL *pPool, int me) {
+  
+  SNVMRANGE *pOwn = NULL;
+  SNVMRANGE *pVictim = NULL;
+  long e = -1;
+  long lo = 0;
+  long hi = 0;
+  long mid = 0;
+  int k = 0;
+  
+  /* Take from the start of the own range */
+  pOwn = &((pPool->pRange)[me]);
+  pthread_mutex_lock(&(pOwn->lock));
+  if (pOwn->lo < pOwn->hi) {
+    e = pOwn->lo;
+    (pOwn->lo)++;
+  }
+  pthread_mutex_unlock(&(pOwn->lock));
+  
+  /* Otherwise, steal the second half of another range */
+  for(k = 1; (e < 0) && (k <= pPool->count); k++) {
+    pVictim = &((pPool->pRange)[(me + k) % (pPool->count + 1)]);
+    pthread_mutex_lock(&(pVictim->lock));
+    lo = pVictim->lo;
+    hi = pVictim->hi;
+    if (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      pVictim->hi = mid;
+    }
+    pthread_mutex_unlock(&(pVictim->lock));
+    
+    if (lo < hi) {
+      e = mid;
+      pthread_mutex_lock(&(pOwn->lock));
+      pOwn->lo = mid + 1;
+      pOwn->hi = hi;
+      pthread_mutex_unlock(&(pOwn->lock));
+    }
+  }
+  
+  return e;
+}
+
+/*
+ * Run elements of the current job until there are none left.
+ * 
+ * Each element runs on the runtime of the participant, starting with an
+ * empty stack.  When an element fails, later elements are removed from
+ * all ranges, since only the first error is reported.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the workers
+ * 
+ *   me - the participant index
+ */
+static void snvmpool_work(SNVMPOOL *pPool, int me) {
+  
+  const SNVMPAR *pPar = NULL;
+  const long *pBounds = NULL;
+  SNVMRANGE *pRange = NULL;
+  SNVM *pVM = NULL;
+  int err_code = 0;
+  long e = 0;
+  int k = 0;
+  
+  pPar = pPool->pJob;
+  pBounds = &((pPar->pProg->pBounds)[pPar->first]);
+  pVM = (pPool->ppVM)[me];
+  
+  for(e = snvmpool_take(pPool, me); e >= 0; e = snvmpool_take(pPool, me)) {
+    pVM->sp = 0;
+    pVM->floor = 0;
+    pVM->base_count = 0;
+    
+    err_code = snvm_interpret(pVM, pPar->pProg, pBounds[e], pBounds[e + 1]);
+    if ((!err_code) && (pVM->sp != 1)) {
+      err_code = SNVM_ERR_GROUP;
+    }
+    
+    (pPool->pErrs)[e] = err_code;
+    if (!err_code) {
+      (pPool->pResults)[e] = (pVM->pStack)[0];
+      
+    } else {
+      for(k = 0; k <= pPool->count; k++) {
+        pRange = &((pPool->pRange)[k]);
+        pthread_mutex_lock(&(pRange->lock));
+        if (pRange->hi > e) {
+          pRange->hi = (pRange->lo > e) ? pRange->lo : e;
+        }
+        pthread_mutex_unlock(&(pRange->lock));
+      }
+    }
+  }
+}
+
+/*
+ * The main function of a worker thread.
+ * 
+ * Parameters:
+ * 
+ *   pArg - the SNVMWORKER
+ * 
+ * Return:
+ * 
+ *   NULL
+ */
+static void *snvmpool_main(void *pArg) {
+  
+  SNVMWORKER *pWorker = NULL;
+  SNVMPOOL *pPool = NULL;
+  unsigned long seen = 0;
+  
+  pWorker = (SNVMWORKER *) pArg;
+  pPool = pWorker->pPool;
+  
+  /* Take part in each new job until told to quit */
+  pthread_mutex_lock(&(pPool->lock));
+  while (!(pPool->quit)) {
+    if (pPool->generation != seen) {
+      seen = pPool->generation;
+      pthread_mutex_unlock(&(pPool->lock));
+      snvmpool_work(pPool, pWorker->index);
+      pthread_mutex_lock(&(pPool->lock));
+      
+      (pPool->busy)--;
+      if (pPool->busy < 1) {
+        pthread_cond_signal(&(pPool->done));
+      }
+      
+    } else {
+      pthread_cond_wait(&(pPool->start), &(pPool->lock));
+    }
+  }
+  pthread_mutex_unlock(&(pPool->lock));
+  
+  return NULL;
+}
+
+/*
+ * Stop the workers and free them.
+ * 
+ * This call is ignored if NULL is passed.
+ * 
+ * Parameters:
+ * 
+ *   pPool - the workers, or NULL
+ */
+static void snvmpool_free(SNVMPOOL *pPool) {
+  
+  int i = 0;
+  
+  if (pPool != NULL) {
+    pthread_mutex_lock(&(pPool->lock));
+    pPool->quit = 1;
+    pthread_cond_broadcast(&(pPool->start));
+    pthread_mutex_unlock(&(pPool->lock));
+    for(i = 0; i < pPool->started; i++) {
+      pthread_join((pPool->pWorkers)[i].thread, NULL);
+    }
+    
+    for(i = 0; i <= pPool->count; i++) {
+      snvm_free((pPool->ppVM)[i]);
+      pthread_mutex_destroy(&((pPool->pRange)[i].lock));
+    }
+    pthread_mutex_destroy(&(pPool->lock));
+    pthread_cond_destroy(&(pPool->start));
+    pthread_cond_destroy(&(pPool->done));
+    
+    free(pPool->pWorkers);
+    free(pPool->ppVM);
+    free(pPool->pRange);
+    if (pPool->pResults != NULL) {
+      free(pPool->pResults);
+      free(pPool->pErrs);
+    }
+    free(pPool);
+  }
+}
+
+/*
+ * Start workers.
+ * 
+ * Parameters:
+ * 
+ *   count - the number of worker threads, greater than zero
+ * 
+ * Return:
+ * 
+ *   the workers, or NULL if the threads could not be started
+ */
+static SNVMPOOL *snvmpool_alloc(int count) {
+  
+  SNVMPOOL *pPool = NULL;
+  int i = 0;
+  
+  /* Check parameter */
+  if (count < 1) {
+    abort();
+  }
+  
+  /* Allocate the pool with a runtime and range per participant */
+  pPool = (SNVMPOOL *) calloc(1, sizeof(SNVMPOOL));
+  if (pPool == NULL) {
+    abort();
+  }
+  pPool->count = count;
+  pPool->pWorkers = (SNVMWORKER *) snvm_grow(
+                      NULL, count, sizeof(SNVMWORKER));
+  pPool->ppVM = (SNVM **) snvm_grow(NULL, count + 1, sizeof(SNVM *));
+  pPool->pRange = (SNVMRANGE *) snvm_grow(
+                      NULL, count + 1, sizeof(SNVMRANGE));
+  for(i = 0; i <= count; i++) {
+    (pPool->ppVM)[i] = snvm_alloc();
+    pthread_mutex_init(&((pPool->pRange)[i].lock), NULL);
+    (pPool->pRange)[i].lo = 0;
+    (pPool->pRange)[i].hi = 0;
+  }
+  pthread_mutex_init(&(pPool->lock), NULL);
+  pthread_cond_init(&(pPool->start), NULL);
+  pthread_cond_init(&(pPool->done), NULL);
+  
+  /* Start the threads */
+  for(i = 0; i < count; i++) {
+    (pPool->pWorkers)[i].pPool = pPool;
+    (pPool->pWorkers)[i].index = i;
+    if (pthread_create(&((pPool->pWorkers)[i].thread), NULL,
+          snvmpool_main, &((pPool->pWorkers)[i])) != 0) {
+      break;
+    }
+    (pPool->started)++;
+  }
+  
+  /* Give up unless all threads started */
+  if (pPool->started < count) {
+    snvmpool_free(pPool);
+    pPool = NULL;
+  }
+  
+  return pPool;
+}
+
+#endif
+
+/*
+ * Evaluate the elements of an array in parallel.
+ * 
+ * If the runtime has workers, the elements are run on them and their
+ * results are pushed in element order.  If an element fails, only the
+ * results before it are pushed, and that element and the ones after it
+ * are evaluated again in order by the runtime itself.  This is safe
+ * because the elements are pure, and leaves the stack, the error, and
+ * pc of the runtime exactly as in sequential evaluation.
+ * 
+ * This is also called by machine code.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pPar - the array
+ * 
+ * Return:
+ * 
+ *   zero if successful, one if the runtime has no workers so the
+ *   elements must be evaluated in order, or a negative error code
+ */
+static int snvm_parallel(SNVM *pVM, const SNVMPAR *pPar) {
+  
+  int result = 1;
+#ifdef SNVM_THREADS
+  SNVMPOOL *pPool = NULL;
+  const long *pBounds = NULL;
+  long parts = 0;
+  long n = 0;
+  long bad = 0;
+  long e = 0;
+  long k = 0;
+#endif
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pPar == NULL)) {
+    abort();
+  }
+
+#ifdef SNVM_THREADS
+  pPool = pVM->pPool;
+  if (pPool != NULL) {
+    result = 0;
+    n = pPar->count;
+    parts = pPool->count + 1;
+    
+    /* Make room for the results */
+    if (n > pPool->job_cap) {
+      pPool->pResults = (SNVAL *) snvm_grow(
+                          pPool->pResults, n, sizeof(SNVAL));
+      pPool->pErrs = (int *) snvm_grow(pPool->pErrs, n, sizeof(int));
+      pPool->job_cap = n;
+    }
+    
+    /* Split the elements evenly and start the workers */
+    pthread_mutex_lock(&(pPool->lock));
+    pPool->pJob = pPar;
+    for(k = 0; k < parts; k++) {
+      (pPool->pRange)[k].lo = e;
+      e += (n / parts) + ((k < n % parts) ? 1 : 0);
+      (pPool->pRange)[k].hi = e;
+    }
+    pPool->busy = pPool->count;
+    (pPool->generation)++;
+    pthread_cond_broadcast(&(pPool->start));
+    pthread_mutex_unlock(&(pPool->lock));
+    
+    /* Take part, then wait for the workers to finish */
+    snvmpool_work(pPool, pPool->count);
+    pthread_mutex_lock(&(pPool->lock));
+    while (pPool->busy > 0) {
+      pthread_cond_wait(&(pPool->done), &(pPool->lock));
+    }
+    pthread_mutex_unlock(&(pPool->lock));
+    
+    /* Find the first failing element, and push the results of the
+     * elements before it in order */
+    for(bad = 0; bad < n; bad++) {
+      if ((pPool->pErrs)[bad]) {
+        break;
+      }
+    }
+    for(e = 0; (!result) && (e < bad); e++) {
+      snvm_move(pVM, &((pPool->pResults)[e]), &(pVM->nursery), 1);
+      result = snvm_push(pVM, &((pPool->pResults)[e]));
+    }
+    
+    /* Take over the objects in the results, so that the heaps of the
+     * workers can be freed */
+    snvm_scan(pVM, &(pVM->nursery), 1);
+    for(k = 0; k < parts; k++) {
+      snvmspace_release(&(((pPool->ppVM)[k])->nursery), 1);
+    }
+    
+    /* Evaluate the failing element and the rest in order */
+    if ((!result) && (bad < n)) {
+      pBounds = &((pPar->pProg->pBounds)[pPar->first]);
+      result = snvm_interpret(pVM, pPar->pProg, pBounds[bad], pBounds[n]);
+    }
+  }
+#endif
+  
+  return result;
+}
+
+/*
+ * Machine code generation
+ * =======================
+ * 
+ * Generated functions take the runtime as their only argument and
+ * return zero or an error code.  The runtime is kept in rbx, which is
+ * callee-saved.  Each instruction is translated with a fixed template:
+ * 
+ *   PUSH loads sp, calls snvm_stack() if the stack is full, and stores
+ *   the two words of the literal directly into the stack
+ * 
+ *   CALL stores pc and calls the operation with its custom data
+ * 
+ *   BEGIN and END store pc and call snvm_begin() and snvm_end()
+ * 
+ *   PARALLEL stores pc and calls snvm_parallel(), then jumps past the
+ *   elements if it returns zero
+ * 
+ *   VARIABLE, CONSTANT, ASSIGN, and GET store pc and call snvm_dict()
+ *   with the instruction
+ * 
+ * After every other call, a non-zero result jumps to the shared exit,
+ * which returns the result.  After snvm_parallel(), only negative
+ * results do.
+ */
+#ifdef SNVM_HAVE_JIT
+
+/*
+ * State of the machine code being generated.
+ */
+typedef struct {
+  
+  /*
+   * The code buffer, with len bytes written of cap.
+   */
+  unsigned char *pCode;
+  size_t len;
+  size_t cap;
+  
+  /*
+   * Offsets of the rel32 fields of jumps to the failure exit.
+   */
+  size_t *pFix;
+  long fix_count;
+  
+  /*
+   * The code offset of each instruction, and the offsets of the rel32
+   * fields of jumps to instructions with their target indices.
+   */
+  size_t *pOff;
+  size_t *pJump;
+  long *pJumpTo;
+  long jump_count;
+  
+} SNVMJIT;
+
+/*
+ * Write bytes of machine code.
+ * 
+ * Parameters:
+ * 
+ *   pj - the code being generated
+ * 
+ *   pData - the bytes to write
+ * 
+ *   len - the number of bytes
+ */
+static void snvmjit_bytes(SNVMJIT *pj, const void *pData, size_t len) {
+  
+  /* Check parameters */
+  if ((pj == NULL) || (pData == NULL) || (len > pj->cap - pj->len)) {
+    abort();
+  }
+  
+  /* Append the bytes */
+  memcpy(pj->pCode + pj->len, pData, len);
+  pj->len += len;
+}
+
+/*
+ * Fill in the rel32 field of a jump that has already been written.
+ * 
+ * Parameters:
+ * 
+ *   pj - the code being generated
+ * 
+ *   at - the offset of the rel32 field
+ * 
+ *   target - the offset the jump goes to
+ */
+static void snvmjit_patch(SNVMJIT *pj, size_t at, size_t target) {
+  
+  long rel = 0;
+  
+  /* Check parameters */
+  if ((pj == NULL) || (at + 4 > pj->len) || (target > pj->len)) {
+    abort();
+  }
+  
+  /* Write the displacement from the end of the field */
+  rel = (long) target - (long) (at + 4);
+  (pj->pCode)[at] = (unsigned char) (rel & 0xff);
+  (pj->pCode)[at + 1] = (unsigned char) ((rel >> 8) & 0xff);
+  (pj->pCode)[at + 2] = (unsigned char) ((rel >> 16) & 0xff);
+  (pj->pCode)[at + 3] = (unsigned char) ((rel >> 24) & 0xff);
+}
+
+/*
+ * Write an instruction that takes a 32-bit displacement from rbx.
+ * 
+ * pOp is the opcode bytes, which include the ModRM byte, and disp is
+ * the displacement.
+ * 
+ * Parameters:
+ * 
+ *   pj - the code being generated
+ * 
+ *   pOp - the opcode bytes
+ * 
+ *   op_len - the number of opcode bytes
+ * 
+ *   disp - the displacement
+ */
+static void snvmjit_disp(
+    SNVMJIT             * pj,
+    const unsigned char * pOp,
+    size_t                op_len,
+    size_t                disp) {
+  
+  unsigned char buf[4];
+  
+  snvmjit_bytes(pj, pOp, op_len);
+  buf[0] = (unsigned char) (disp & 0xff);
+  buf[1] = (unsigned char) ((disp >> 8) & 0xff);
+  buf[2] = (unsigned char) ((disp >> 16) & 0xff);
+  buf[3] = (unsigned char) ((disp >> 24) & 0xff);
+  snvmjit_bytes(pj, buf, 4);
+}
+
+/*
+ * Write "mov qword [rbx + pc], index" so that errors can be located.
+ * 
+ * Parameters:
+ * 
+ *   pj - the code being generated
+ * 
+ *   index - the instruction index
+ */
+static void snvmjit_pc(SNVMJIT *pj, long index) {
+  
+  static const unsigned char op[3] = { 0x48, 0xc7, 0x83 };
+  unsigned char buf[4];
+  
+  snvmjit_disp(pj, op, 3, offsetof(SNVM, pc));
+  buf[0] = (unsigned char) (index & 0xff);
+  buf[1] = (unsigned char) ((index >> 8) & 0xff);
+  buf[2] = (unsigned char) ((index >> 16) & 0xff);
+  buf[3] = (unsigned char) ((index >> 24) & 0xff);
+  snvmjit_bytes(pj, buf, 4);
+}
+
+/*
+ * Write a call that passes the runtime and optionally custom data, then
+ * leaves on a non-zero result.
+ * 
+ * The function pointer and custom data are embedded as 64-bit
+ * immediates.
+ * 
+ * Parameters:
+ * 
+ *   pj - the code being generated
+ * 
+ *   pFunc - the bytes of the function pointer
+ * 
+ *   pCustom - the bytes of the custom data pointer, or NULL to pass
+ *   only the runtime
+ */
+static void snvmjit_call(
+    SNVMJIT    * pj,
+    const void * pFunc,
+    const void * pCustom) {
+  
+  static const unsigned char mov_rdi_rbx[3] = { 0x48, 0x89, 0xdf };
+  static const unsigned char mov_rsi[2] = { 0x48, 0xbe };
+  static const unsigned char mov_rax[2] = { 0x48, 0xb8 };
+  static const unsigned char call_test_jnz[6] = {
+    0xff, 0xd0,               /* call rax */
+    0x85, 0xc0,               /* test eax, eax */
+    0x0f, 0x85                /* jnz rel32 */
+  };
+  static const unsigned char rel[4] = { 0, 0, 0, 0 };
+  
+  snvmjit_bytes(pj, mov_rdi_rbx, 3);
+  if (pCustom != NULL) {
+    snvmjit_bytes(pj, mov_rsi, 2);
+    snvmjit_bytes(pj, pCustom, 8);
+  }
+  snvmjit_bytes(pj, mov_rax, 2);
+  snvmjit_bytes(pj, pFunc, 8);
+  snvmjit_bytes(pj, call_test_jnz, 6);
+  
+  (pj->pFix)[pj->fix_count] = pj->len;
+  (pj->fix_count)++;
+  snvmjit_bytes(pj, rel, 4);
+}
+
+/*
+ * Write the template of a PUSH instruction.
+ * 
+ * Parameters:
+ * 
+ *   pj - the code being generated
+ * 
+ *   index - the instruction index
+ * 
+ *   pVal - the literal to push
+ */
+static void snvmjit_push(SNVMJIT *pj, long index, const SNVAL *pVal) {
+  
+  static const unsigned char mov_rax_sp[3] = { 0x48, 0x8b, 0x83 };
+  static const unsigned char cmp_rax_cap[3] = { 0x48, 0x3b, 0x83 };
+  static const unsigned char jb[1] = { 0x72 };
+  static const unsigned char shl_rax_4[4] = { 0x48, 0xc1, 0xe0, 0x04 };
+  static const unsigned char add_rax_stack[3] = { 0x48, 0x03, 0x83 };
+  static const unsigned char mov_rcx[2] = { 0x48, 0xb9 };
+  static const unsigned char st_lo[3] = { 0x48, 0x89, 0x08 };
+  static const unsigned char st_hi[4] = { 0x48, 0x89, 0x48, 0x08 };
+  static const unsigned char inc_sp[3] = { 0x48, 0xff, 0x83 };
+  int (*pfStack)(SNVM *) = snvm_stack;
+  unsigned char raw[16];
+  unsigned char skip = 0;
+  size_t jb_at = 0;
+  
+  /* rax = sp; if full, grow the stack and reload sp */
+  snvmjit_disp(pj, mov_rax_sp, 3, offsetof(SNVM, sp));
+  snvmjit_disp(pj, cmp_rax_cap, 3, offsetof(SNVM, cap));
+  snvmjit_bytes(pj, jb, 1);
+  jb_at = pj->len;
+  snvmjit_bytes(pj, &skip, 1);
+  
+  snvmjit_pc(pj, index);
+  snvmjit_call(pj, &pfStack, NULL);
+  snvmjit_disp(pj, mov_rax_sp, 3, offsetof(SNVM, sp));
+  (pj->pCode)[jb_at] = (unsigned char) (pj->len - (jb_at + 1));
+  
+  /* rax = &pStack[sp]; store the literal and increment sp */
+  memcpy(raw, pVal, 16);
+  snvmjit_bytes(pj, shl_rax_4, 4);
+  snvmjit_disp(pj, add_rax_stack, 3, offsetof(SNVM, pStack));
+  snvmjit_bytes(pj, mov_rcx, 2);
+  snvmjit_bytes(pj, raw, 8);
+  snvmjit_bytes(pj, st_lo, 3);
+  snvmjit_bytes(pj, mov_rcx, 2);
+  snvmjit_bytes(pj, raw + 8, 8);
+  snvmjit_bytes(pj, st_hi, 4);
+  snvmjit_disp(pj, inc_sp, 3, offsetof(SNVM, sp));
+}
+
+/*
+ * Write the template of a PARALLEL instruction.
+ * 
+ * Parameters:
+ * 
+ *   pj - the code being generated
+ * 
+ *   index - the instruction index
+ * 
+ *   pPar - the array
+ * 
+ *   target - the index of the instruction after the elements
+ */
+static void snvmjit_parallel(
+    SNVMJIT       * pj,
+    long            index,
+    const SNVMPAR * pPar,
+    long            target) {
+  
+  static const unsigned char mov_rdi_rbx[3] = { 0x48, 0x89, 0xdf };
+  static const unsigned char mov_rsi[2] = { 0x48, 0xbe };
+  static const unsigned char mov_rax[2] = { 0x48, 0xb8 };
+  static const unsigned char call_test_js[6] = {
+    0xff, 0xd0,               /* call rax */
+    0x85, 0xc0,               /* test eax, eax */
+    0x0f, 0x88                /* js rel32 */
+  };
+  static const unsigned char jz[2] = { 0x0f, 0x84 };
+  static const unsigned char rel[4] = { 0, 0, 0, 0 };
+  int (*pfParallel)(SNVM *, const SNVMPAR *) = snvm_parallel;
+  
+  /* Call snvm_parallel() and leave on error */
+  snvmjit_pc(pj, index);
+  snvmjit_bytes(pj, mov_rdi_rbx, 3);
+  snvmjit_bytes(pj, mov_rsi, 2);
+  snvmjit_bytes(pj, &pPar, 8);
+  snvmjit_bytes(pj, mov_rax, 2);
+  snvmjit_bytes(pj, &pfParallel, 8);
+  snvmjit_bytes(pj, call_test_js, 6);
+  (pj->pFix)[pj->fix_count] = pj->len;
+  (pj->fix_count)++;
+  snvmjit_bytes(pj, rel, 4);
+  
+  /* Skip the elements if they were evaluated */
+  snvmjit_bytes(pj, jz, 2);
+  (pj->pJump)[pj->jump_count] = pj->len;
+  (pj->pJumpTo)[pj->jump_count] = target;
+  (pj->jump_count)++;
+  snvmjit_bytes(pj, rel, 4);
+}
+
+#endif
+
+/*
+ * Numeric operations
+ * ==================
+ * 
+ * These are the operations registered by snvm_numeric().  The kernels
+ * are simple loops over contiguous arrays, with separate loops for each
+ * combination of vector and number so that compilers can vectorize them.
+ * Sums use four independent accumulators, so that they do not depend on
+ * the latency of each addition.
+ */
+
+/*
+ * The operation codes that are passed to the operations as custom data.
+ */
+static int snvmnum_codes[SNVMNUM_COUNT] = {
+  SNVMNUM_ADD, SNVMNUM_SUB, SNVMNUM_MUL, SNVMNUM_DIV,
+  SNVMNUM_NEG, SNVMNUM_ABS,
+  SNVMNUM_SUM, SNVMNUM_MIN, SNVMNUM_MAX
+};
+
+/*
+ * Get the elements of a vector value.
+ * 
+ * Parameters:
+ * 
+ *   pVal - the value
+ * 
+ *   pCount - receives the number of elements
+ * 
+ * Return:
+ * 
+ *   the elements, or NULL if the value is not a vector
+ */
+static const double *snvmnum_elements(const SNVAL *pVal, long *pCount) {
+  
+  const double *pResult = NULL;
+  
+  *pCount = 0;
+  if (pVal->type == SNVAL_VECTOR) {
+    pResult = (const double *) snobj_data(pVal->v.pObj);
+    *pCount = snobj_bytes(pVal->v.pObj) / ((long) sizeof(double));
+  }
+  
+  return pResult;
+}
+
+/*
+ * Get the value of a number as a double.
+ * 
+ * Parameters:
+ * 
+ *   pVal - the value
+ * 
+ *   pd - receives the number
+ * 
+ * Return:
+ * 
+ *   non-zero if the value is a number, zero otherwise
+ */
+static int snvmnum_number(const SNVAL *pVal, double *pd) {
+  
+  int result = 1;
+  
+  if (pVal->type == SNVAL_INT) {
+    *pd = (double) pVal->v.i;
+  } else if (pVal->type == SNVAL_FLOAT) {
+    *pd = pVal->v.f;
+  } else {
+    result = 0;
+  }
+  
+  return result;
+}
+
+/*
+ * Allocate a vector and push it.
+ * 
+ * The vector is pushed before its elements are computed, which is
+ * safe because nothing can collect the heap during an operation.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   count - the number of elements
+ * 
+ *   ppData - receives the uninitialized elements
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNVM_ERR_OVERFLOW
+ */
+static int snvmnum_push(SNVM *pVM, long count, double **ppData) {
+  
+  SNVAL val;
+  
+  memset(&val, 0, sizeof(SNVAL));
+  val.type = SNVAL_VECTOR;
+  val.v.pObj = snvm_new(pVM, 0, count * ((long) sizeof(double)));
+  *ppData = (double *) snobj_data(val.v.pObj);
+  
+  return snvm_push(pVM, &val);
+}
+
+/*
+ * Apply a binary arithmetic operation element by element.
+ * 
+ * pA or pB is NULL if that side is the number a or b instead of a
+ * vector.
+ * 
+ * Parameters:
+ * 
+ *   code - the SNVMNUM_ operation code
+ * 
+ *   pOut - receives the results
+ * 
+ *   pA - the left vector, or NULL
+ * 
+ *   a - the left number
+ * 
+ *   pB - the right vector, or NULL
+ * 
+ *   b - the right number
+ * 
+ *   n - the number of elements
+ */
+static void snvmnum_map(
+    int            code,
+    double       * pOut,
+    const double * pA,
+    double         a,
+    const double * pB,
+    double         b,
+    long           n) {
+  
+  long i = 0;
+  
+  switch (code) {
+    
+    case SNVMNUM_ADD:
+      if ((pA != NULL) && (pB != NULL)) {
+        for(i = 0; i < n; i++) {
+          pOut[i] = pA[i] + pB[i];
+        }
+      } else if (pA != NULL) {
+        for(i = 0; i < n; i++) {
+          pOut[i] = pA[i] + b;
+        }
+      } else {
+        for(i = 0; i < n; i++) {
+          pOut[i] = a + pB[i];
+        }
+      }
+      break;
+    
+    case SNVMNUM_SUB:
+      if ((pA != NULL) && (pB != NULL)) {
+        for(i = 0; i < n; i++) {
+          pOut[i] = pA[i] - pB[i];
+        }
+      } else if (pA != NULL) {
+        for(i = 0; i < n; i++) {
+          pOut[i] = pA[i] - b;
+        }
+      } else {
+        for(i = 0; i < n; i++) {
+          pOut[i] = a - pB[i];
+        }
+      }
+      break;
+    
+    case SNVMNUM_MUL:
+      if ((pA != NULL) && (pB != NULL)) {
+        for(i = 0; i < n; i++) {
+          pOut[i] = pA[i] * pB[i];
+        }
+      } else if (pA != NULL) {
+        for(i = 0; i < n; i++) {
+          pOut[i] = pA[i] * b;
+        }
+      } else {
+        for(i = 0; i < n; i++) {
+          pOut[i] = a * pB[i];
+        }
+      }
+      break;
+    
+    case SNVMNUM_DIV:
+      if ((pA != NULL) && (pB != NULL)) {
+        for(i = 0; i < n; i++) {
+          pOut[i] = pA[i] / pB[i];
+        }
+      } else if (pA != NULL) {
+        for(i = 0; i < n; i++) {
+          pOut[i] = pA[i] / b;
+        }
+      } else {
+        for(i = 0; i < n; i++) {
+          pOut[i] = a / pB[i];
+        }
+      }
+      break;
+    
+    default:
+      abort();
+  }
+}
+
+/*
+ * Compute the sum of the products of two arrays, or the plain sum if
+ * the second array is NULL.
+ * 
+ * Parameters:
+ * 
+ *   pA - the first array
+ * 
+ *   pB - the second array, or NULL
+ * 
+ *   n - the number of elements
+ * 
+ * Return:
+ * 
+ *   the sum
+ */
+static double snvmnum_sum(const double *pA, const double *pB, long n) {
+  
+  double s0 = 0.0;
+  double s1 = 0.0;
+  double s2 = 0.0;
+  double s3 = 0.0;
+  long i = 0;
+  
+  if (pB != NULL) {
+    for(i = 0; i + 4 <= n; i += 4) {
+      s0 += pA[i] * pB[i];
+      s1 += pA[i + 1] * pB[i + 1];
+      s2 += pA[i + 2] * pB[i + 2];
+      s3 += pA[i + 3] * pB[i + 3];
+    }
+    for( ; i < n; i++) {
+      s0 += pA[i] * pB[i];
+    }
+    
+  } else {
+    for(i = 0; i + 4 <= n; i += 4) {
+      s0 += pA[i];
+      s1 += pA[i + 1];
+      s2 += pA[i + 2];
+      s3 += pA[i + 3];
+    }
+    for( ; i < n; i++) {
+      s0 += pA[i];
+    }
+  }
+  
+  return (s0 + s1) + (s2 + s3);
+}
+
+/*
+ * The vector operation, which converts an array into a vector.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pCustom - ignored
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+static int snvmnum_vector(SNVM *pVM, void *pCustom) {
+  
+  SNVAL val;
+  SNVAL vec;
+  double *pData = NULL;
+  long count = 0;
+  long i = 0;
+  int err_code = 0;
+  
+  (void) pCustom;
+  
+  memset(&val, 0, sizeof(SNVAL));
+  memset(&vec, 0, sizeof(SNVAL));
+  
+  /* Get the element count */
+  err_code = snvm_pop(pVM, &val);
+  if ((!err_code) && ((val.type != SNVAL_INT) || (val.v.i < 0) ||
+        (val.v.i > snvm_depth(pVM)))) {
+    err_code = (val.type != SNVAL_INT) ? SNVM_ERR_TYPE : SNVM_ERR_UNDERFLOW;
+  }
+  
+  /* Pop the elements into a new vector, last one first */
+  if (!err_code) {
+    count = val.v.i;
+    vec.type = SNVAL_VECTOR;
+    vec.v.pObj = snvm_new(pVM, 0, count * ((long) sizeof(double)));
+    pData = (double *) snobj_data(vec.v.pObj);
+    for(i = count - 1; i >= 0; i--) {
+      snvm_pop(pVM, &val);
+      if (!snvmnum_number(&val, &(pData[i]))) {
+        err_code = SNVM_ERR_TYPE;
+        break;
+      }
+    }
+  }
+  if (!err_code) {
+    err_code = snvm_push(pVM, &vec);
+  }
+  
+  return err_code;
+}
+
+/*
+ * The elements operation, which converts a vector into an array.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pCustom - ignored
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+static int snvmnum_array(SNVM *pVM, void *pCustom) {
+  
+  const double *pData = NULL;
+  SNVAL val;
+  long count = 0;
+  long i = 0;
+  int err_code = 0;
+  
+  (void) pCustom;
+  
+  memset(&val, 0, sizeof(SNVAL));
+  
+  err_code = snvm_pop(pVM, &val);
+  if (!err_code) {
+    pData = snvmnum_elements(&val, &count);
+    if (pData == NULL) {
+      err_code = SNVM_ERR_TYPE;
+    }
+  }
+  
+  /* The vector stays valid while its elements are pushed, since nothing
+   * can collect the heap during an operation */
+  for(i = 0; (!err_code) && (i < count); i++) {
+    val.type = SNVAL_FLOAT;
+    val.v.f = pData[i];
+    err_code = snvm_push(pVM, &val);
+  }
+  if (!err_code) {
+    val.type = SNVAL_INT;
+    val.v.i = count;
+    err_code = snvm_push(pVM, &val);
+  }
+  
+  return err_code;
+}
+
+/*
+ * The length operation.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pCustom - ignored
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+static int snvmnum_length(SNVM *pVM, void *pCustom) {
+  
+  SNVAL val;
+  long count = 0;
+  int err_code = 0;
+  
+  (void) pCustom;
+  
+  memset(&val, 0, sizeof(SNVAL));
+  
+  err_code = snvm_pop(pVM, &val);
+  if ((!err_code) && (snvmnum_elements(&val, &count) == NULL)) {
+    err_code = SNVM_ERR_TYPE;
+  }
+  if (!err_code) {
+    val.type = SNVAL_INT;
+    val.v.i = count;
+    err_code = snvm_push(pVM, &val);
+  }
+  
+  return err_code;
+}
+
+/*
+ * The binary arithmetic operations add, sub, mul, scale, and div.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pCustom - points to the SNVMNUM_ operation code
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+static int snvmnum_binary(SNVM *pVM, void *pCustom) {
+  
+  const double *pA = NULL;
+  const double *pB = NULL;
+  double *pOut = NULL;
+  SNVAL va;
+  SNVAL vb;
+  double a = 0.0;
+  double b = 0.0;
+  long na = 0;
+  long nb = 0;
+  int code = 0;
+  int err_code = 0;
+  
+  memset(&va, 0, sizeof(SNVAL));
+  memset(&vb, 0, sizeof(SNVAL));
+  code = *((int *) pCustom);
+  
+  /* Get the operands, each of which is a vector or a number */
+  err_code = snvm_pop(pVM, &vb);
+  if (!err_code) {
+    err_code = snvm_pop(pVM, &va);
+  }
+  if (!err_code) {
+    pA = snvmnum_elements(&va, &na);
+    pB = snvmnum_elements(&vb, &nb);
+    if (((pA == NULL) && (!snvmnum_number(&va, &a))) ||
+        ((pB == NULL) && (!snvmnum_number(&vb, &b)))) {
+      err_code = SNVM_ERR_TYPE;
+    } else if ((pA != NULL) && (pB != NULL) && (na != nb)) {
+      err_code = SNVM_ERR_LENGTH;
+    }
+  }
+  
+  if (err_code) {
+    /* Nothing more to do */
+    
+  } else if ((pA == NULL) && (pB == NULL) && (code != SNVMNUM_DIV) &&
+              (va.type == SNVAL_INT) && (vb.type == SNVAL_INT)) {
+    /* Integers, which wrap around like unsigned numbers */
+    if (code == SNVMNUM_ADD) {
+      va.v.i = (long) (((unsigned long) va.v.i) + ((unsigned long) vb.v.i));
+    } else if (code == SNVMNUM_SUB) {
+      va.v.i = (long) (((unsigned long) va.v.i) - ((unsigned long) vb.v.i));
+    } else {
+      va.v.i = (long) (((unsigned long) va.v.i) * ((unsigned long) vb.v.i));
+    }
+    err_code = snvm_push(pVM, &va);
+    
+  } else if ((pA == NULL) && (pB == NULL)) {
+    /* Floating-point numbers */
+    snvmnum_map(code, &(va.v.f), &a, 0.0, &b, 0.0, 1);
+    va.type = SNVAL_FLOAT;
+    err_code = snvm_push(pVM, &va);
+    
+  } else {
+    /* At least one vector */
+    err_code = snvmnum_push(pVM, (pA != NULL) ? na : nb, &pOut);
+    if (!err_code) {
+      snvmnum_map(code, pOut, pA, a, pB, b, (pA != NULL) ? na : nb);
+    }
+  }
+  
+  return err_code;
+}
+
+/*
+ * The unary operations neg and abs.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pCustom - points to the SNVMNUM_ operation code
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+static int snvmnum_unary(SNVM *pVM, void *pCustom) {
+  
+  const double *pA = NULL;
+  double *pOut = NULL;
+  SNVAL val;
+  long n = 0;
+  long i = 0;
+  int code = 0;
+  int err_code = 0;
+  
+  memset(&val, 0, sizeof(SNVAL));
+  code = *((int *) pCustom);
+  
+  err_code = snvm_pop(pVM, &val);
+  if (!err_code) {
+    pA = snvmnum_elements(&val, &n);
+  }
+  
+  if (err_code) {
+    /* Nothing more to do */
+    
+  } else if (pA != NULL) {
+    err_code = snvmnum_push(pVM, n, &pOut);
+    if ((!err_code) && (code == SNVMNUM_NEG)) {
+      for(i = 0; i < n; i++) {
+        pOut[i] = -(pA[i]);
+      }
+    } else if (!err_code) {
+      for(i = 0; i < n; i++) {
+        pOut[i] = (pA[i] < 0.0) ? -(pA[i]) : pA[i];
+      }
+    }
+    
+  } else if (val.type == SNVAL_INT) {
+    if ((code == SNVMNUM_NEG) || (val.v.i < 0)) {
+      val.v.i = (long) (0UL - ((unsigned long) val.v.i));
+    }
+    err_code = snvm_push(pVM, &val);
+    
+  } else if (val.type == SNVAL_FLOAT) {
+    if ((code == SNVMNUM_NEG) || (val.v.f < 0.0)) {
+      val.v.f = -(val.v.f);
+    }
+    err_code = snvm_push(pVM, &val);
+    
+  } else {
+    err_code = SNVM_ERR_TYPE;
+  }
+  
+  return err_code;
+}
+
+/*
+ * The reductions sum, min, and max.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pCustom - points to the SNVMNUM_ operation code
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+static int snvmnum_reduce(SNVM *pVM, void *pCustom) {
+  
+  const double *pA = NULL;
+  SNVAL val;
+  double x = 0.0;
+  long n = 0;
+  long i = 0;
+  int code = 0;
+  int err_code = 0;
+  
+  memset(&val, 0, sizeof(SNVAL));
+  code = *((int *) pCustom);
+  
+  err_code = snvm_pop(pVM, &val);
+  if (!err_code) {
+    pA = snvmnum_elements(&val, &n);
+    if (pA == NULL) {
+      err_code = SNVM_ERR_TYPE;
+    } else if ((n < 1) && (code != SNVMNUM_SUM)) {
+      err_code = SNVM_ERR_LENGTH;
+    }
+  }
+  
+  if (!err_code) {
+    if (code == SNVMNUM_SUM) {
+      x = snvmnum_sum(pA, NULL, n);
+    } else if (code == SNVMNUM_MIN) {
+      x = pA[0];
+      for(i = 1; i < n; i++) {
+        x = (pA[i] < x) ? pA[i] : x;
+      }
+    } else {
+      x = pA[0];
+      for(i = 1; i < n; i++) {
+        x = (pA[i] > x) ? pA[i] : x;
+      }
+    }
+    
+    val.type = SNVAL_FLOAT;
+    val.v.f = x;
+    err_code = snvm_push(pVM, &val);
+  }
+  
+  return err_code;
+}
+
+/*
+ * The dot operation.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pCustom - ignored
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+static int snvmnum_dot(SNVM *pVM, void *pCustom) {
+  
+  const double *pA = NULL;
+  const double *pB = NULL;
+  SNVAL va;
+  SNVAL vb;
+  long na = 0;
+  long nb = 0;
+  int err_code = 0;
+  
+  (void) pCustom;
+  
+  memset(&va, 0, sizeof(SNVAL));
+  memset(&vb, 0, sizeof(SNVAL));
+  
+  err_code = snvm_pop(pVM, &vb);
+  if (!err_code) {
+    err_code = snvm_pop(pVM, &va);
+  }
+  if (!err_code) {
+    pA = snvmnum_elements(&va, &na);
+    pB = snvmnum_elements(&vb, &nb);
+    if ((pA == NULL) || (pB == NULL)) {
+      err_code = SNVM_ERR_TYPE;
+    } else if (na != nb) {
+      err_code = SNVM_ERR_LENGTH;
+    }
+  }
+  
+  if (!err_code) {
+    va.type = SNVAL_FLOAT;
+    va.v.f = snvmnum_sum(pA, pB, na);
+    err_code = snvm_push(pVM, &va);
+  }
+  
+  return err_code;
+}
+
+/*
+ * Snapshot images
+ * ===============
+ * 
+ * An image consists of these sections, followed by the trailer:
+ * 
+ *   (1) The heap, which is a copy of the old generation right after a
+ *       full collection, followed by copies of the static objects that
+ *       are referred to.  Objects are written as they are in memory,
+ *       except that references in their slots are heap offsets.
+ * 
+ *   (2) The text, which holds nul-terminated strings.  String values
+ *       are text offsets.
+ * 
+ *   (3) The stack, as an array of values.
+ * 
+ *   (4) The global dictionary, as an array of values, followed by an
+ *       array of kinds and an array of text offsets of the names, both
+ *       of unsigned long.
+ * 
+ * Everything is in the byte order and layout of the platform, which the
+ * trailer records so that images of other platforms are rejected.
+ * Since the heap section has the layout of a heap chunk, restoring only
+ * has to turn offsets back into pointers before adopting it.
+ */
+
+/*
+ * Add a string to the text of an image.
+ * 
+ * Parameters:
+ * 
+ *   pImg - the image state
+ * 
+ *   pStr - the nul-terminated string
+ * 
+ * Return:
+ * 
+ *   the text offset of the string
+ */
+static long snvmimage_text(SNVMIMAGE *pImg, const char *pStr) {
+  
+  long result = 0;
+  long len = 0;
+  long newcap = 0;
+  
+  /* Check parameters */
+  if ((pImg == NULL) || (pStr == NULL)) {
+    abort();
+  }
+  len = (long) strlen(pStr);
+  if (len >= LONG_MAX / 2 - pImg->text_len) {
+    abort();
+  }
+  
+  /* Grow the text if necessary */
+  if (len + 1 > pImg->text_cap - pImg->text_len) {
+    newcap = pImg->text_cap;
+    if (newcap < SNVM_ARENA_INIT) {
+      newcap = SNVM_ARENA_INIT;
+    }
+    while (len + 1 > newcap - pImg->text_len) {
+      newcap = newcap * 2;
+    }
+    pImg->pText = (char *) snvm_grow(pImg->pText, newcap, 1);
+    pImg->text_cap = newcap;
+  }
+  
+  /* Copy the string */
+  result = pImg->text_len;
+  memcpy(pImg->pText + result, pStr, (size_t) (len + 1));
+  pImg->text_len += (len + 1);
+  
+  return result;
+}
+
+/*
+ * Get the heap offset of an object in an image.
+ * 
+ * Static objects are added after the old generation the first time
+ * they are referred to.
+ * 
+ * Parameters:
+ * 
+ *   pImg - the image state
+ * 
+ *   pObj - the object, which is static or in the old generation
+ * 
+ * Return:
+ * 
+ *   the heap offset of the object
+ */
+static long snvmimage_offset(SNVMIMAGE *pImg, SNOBJ *pObj) {
+  
+  const SNVMCHUNK *pChunk = NULL;
+  const unsigned char *pAddr = NULL;
+  const unsigned char *pData = NULL;
+  long result = -1;
+  long base = 0;
+  long newcap = 0;
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pImg == NULL) || (pObj == NULL)) {
+    abort();
+  }
+  
+  if (pObj->gen == SNVM_GEN_STATIC) {
+    /* Look for the static object, and add it if it is new */
+    for(i = 0; i < pImg->static_count; i++) {
+      if ((pImg->ppStatic)[i] == pObj) {
+        result = (pImg->pStaticOff)[i];
+        break;
+      }
+    }
+    if (result < 0) {
+      if (pImg->static_count >= pImg->static_cap) {
+        newcap = pImg->static_cap * 2;
+        if (newcap < SNVM_POOL_INIT) {
+          newcap = SNVM_POOL_INIT;
+        }
+        pImg->ppStatic = (SNOBJ **) snvm_grow(
+                            pImg->ppStatic, newcap, sizeof(SNOBJ *));
+        pImg->pStaticOff = (long *) snvm_grow(
+                              pImg->pStaticOff, newcap, sizeof(long));
+        pImg->static_cap = newcap;
+      }
+      result = ((long) pImg->pVM->old.used) + pImg->static_len;
+      (pImg->ppStatic)[pImg->static_count] = pObj;
+      (pImg->pStaticOff)[pImg->static_count] = result;
+      (pImg->static_count)++;
+      pImg->static_len += (long) snvm_objsize(pObj->count, pObj->bytes);
+    }
+    
+  } else {
+    /* Find the chunk of the old generation, which are written in list
+     * order */
+    pAddr = (const unsigned char *) pObj;
+    for(pChunk = pImg->pVM->old.pChunk;
+        pChunk != NULL;
+        pChunk = pChunk->pNext) {
+      pData = (const unsigned char *) pChunk->pData;
+      if ((pAddr >= pData) && (pAddr < pData + pChunk->used)) {
+        result = base + (long) (pAddr - pData);
+        break;
+      }
+      base += (long) pChunk->used;
+    }
+    if (result < 0) {
+      abort();
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Convert a value for an image.
+ * 
+ * Parameters:
+ * 
+ *   pImg - the image state
+ * 
+ *   pIn - the value
+ * 
+ *   pOut - receives the converted value
+ */
+static void snvmimage_value(
+    SNVMIMAGE   * pImg,
+    const SNVAL * pIn,
+    SNVAL       * pOut) {
+  
+  /* Check parameters */
+  if ((pImg == NULL) || (pIn == NULL) || (pOut == NULL)) {
+    abort();
+  }
+  
+  /* Start from zero, so that no stray bytes end up in the image */
+  memset(pOut, 0, sizeof(SNVAL));
+  pOut->type = pIn->type;
+  
+  if ((pIn->type == SNVAL_OBJECT) || (pIn->type == SNVAL_VECTOR)) {
+    pOut->v.i = snvmimage_offset(pImg, pIn->v.pObj);
+    
+  } else if (pIn->type == SNVAL_STRING) {
+    pOut->v.i = snvmimage_text(pImg, pIn->v.pStr);
+    
+  } else if (pIn->type == SNVAL_INT) {
+    pOut->v.i = pIn->v.i;
+    
+  } else if (pIn->type == SNVAL_FLOAT) {
+    pOut->v.f = pIn->v.f;
+  }
+}
+
+/*
+ * Write bytes to an image.
+ * 
+ * Parameters:
+ * 
+ *   pOut - the file
+ * 
+ *   pData - the bytes, which may be NULL if size is zero
+ * 
+ *   size - the number of bytes
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if there was an I/O error
+ */
+static int snvmimage_write(FILE *pOut, const void *pData, size_t size) {
+  
+  int result = 1;
+  
+  if (size > 0) {
+    if (fwrite(pData, 1, size, pOut) != size) {
+      result = 0;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Write an object to an image.
+ * 
+ * Parameters:
+ * 
+ *   pImg - the image state
+ * 
+ *   pOut - the file
+ * 
+ *   pObj - the object
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if there was an I/O error
+ */
+static int snvmimage_object(SNVMIMAGE *pImg, FILE *pOut, SNOBJ *pObj) {
+  
+  SNOBJ head;
+  SNVAL val;
+  SNVAL *pSlots = NULL;
+  size_t rest = 0;
+  long i = 0;
+  int ok = 1;
+  
+  /* Initialize structures */
+  memset(&head, 0, sizeof(SNOBJ));
+  memset(&val, 0, sizeof(SNVAL));
+  
+  /* Check parameters */
+  if ((pImg == NULL) || (pOut == NULL) || (pObj == NULL)) {
+    abort();
+  }
+  
+  /* Write the header, as an object of the old generation */
+  head.pForward = NULL;
+  head.count = pObj->count;
+  head.bytes = pObj->bytes;
+  head.gen = SNVM_GEN_OLD;
+  ok = snvmimage_write(pOut, &head, sizeof(SNOBJ));
+  
+  /* Write the converted slots, then the data and padding as they are */
+  pSlots = snobj_slots(pObj);
+  for(i = 0; ok && (i < pObj->count); i++) {
+    snvmimage_value(pImg, &(pSlots[i]), &val);
+    ok = snvmimage_write(pOut, &val, sizeof(SNVAL));
+  }
+  if (ok) {
+    rest = snvm_objsize(pObj->count, pObj->bytes) - sizeof(SNOBJ) -
+            ((size_t) pObj->count) * sizeof(SNVAL);
+    ok = snvmimage_write(pOut, pSlots + pObj->count, rest);
+  }
+  
+  return ok;
+}
+
+/*
+ * Turn an offset in a restored value back into a pointer.
+ * 
+ * Object and vector values must refer to the start of an object in the
+ * heap, and vector values must refer to an object that has no slots and
+ * holds a whole number of doubles.
+ * 
+ * Parameters:
+ * 
+ *   pVal - the value
+ * 
+ *   pHeap - the heap of the image, or NULL if it is empty
+ * 
+ *   heap - the number of heap bytes
+ * 
+ *   pStarts - one flag for each unit of SNVMALIGN in the heap, which is
+ *   non-zero where an object starts, or NULL if the heap is empty
+ * 
+ *   pText - the text of the image
+ * 
+ *   text - the number of text bytes
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the value is not valid
+ */
+static int snvmimage_relocate(
+    SNVAL               * pVal,
+    unsigned char       * pHeap,
+    size_t                heap,
+    const unsigned char * pStarts,
+    const char          * pText,
+    size_t                text) {
+  
+  SNOBJ *pObj = NULL;
+  int result = 1;
+  
+  /* Check parameters */
+  if ((pVal == NULL) || (pText == NULL)) {
+    abort();
+  }
+  
+  if ((pVal->type == SNVAL_OBJECT) || (pVal->type == SNVAL_VECTOR)) {
+    if ((pVal->v.i < 0) || (((unsigned long) pVal->v.i) >= heap) ||
+        (((unsigned long) pVal->v.i) % sizeof(SNVMALIGN) != 0)) {
+      result = 0;
+    } else if (!pStarts[((unsigned long) pVal->v.i) / sizeof(SNVMALIGN)]) {
+      result = 0;
+    } else {
+      pObj = (SNOBJ *) (pHeap + pVal->v.i);
+      if ((pVal->type == SNVAL_VECTOR) && ((pObj->count != 0) ||
+            (((unsigned long) pObj->bytes) % sizeof(double) != 0))) {
+        result = 0;
+      } else {
+        pVal->v.pObj = pObj;
+      }
+    }
+    
+  } else if (pVal->type == SNVAL_STRING) {
+    if ((pVal->v.i < 0) || (((unsigned long) pVal->v.i) >= text)) {
+      result = 0;
+    } else {
+      pVal->v.pStr = pText + pVal->v.i;
+    }
+    
+  } else if ((pVal->type != SNVAL_NULL) && (pVal->type != SNVAL_INT) &&
+              (pVal->type != SNVAL_FLOAT)) {
+    result = 0;
+  }
+  
+  return result;
+}
+
+/*
+ * Compute the stamp of a bootstrap document.
+ * 
+ * This is the 32-bit FNV-1a hash of its bytes.
+ * 
+ * Parameters:
+ * 
+ *   pData - the document
+ * 
+ *   len - the number of bytes
+ * 
+ * Return:
+ * 
+ *   the stamp
+ */
+static unsigned long snvmimage_stamp(const char *pData, long len) {
+  
+  unsigned long h = 2166136261UL;
+  long i = 0;
+  
+  for(i = 0; i < len; i++) {
+    h = h ^ ((unsigned long) ((unsigned char) pData[i]));
+    h = (h * 16777619UL) & 0xffffffffUL;
+  }
+  
+  return h;
+}
+
+/*
+ * Public functions
+ * ================
+ * 
+ * (see the header for specifications)
+ */
+
+/*
+ * snvm_alloc function.
+ */
+SNVM *snvm_alloc(void) {
+  
+  SNVM *pVM = NULL;
+  
+  pVM = (SNVM *) calloc(1, sizeof(SNVM));
+  if (pVM == NULL) {
+    abort();
+  }
+  
+  return pVM;
+}
+
+/*
+ * snvm_free function.
+ */
+void snvm_free(SNVM *pVM) {
+  
+  long i = 0;
+  
+  if (pVM != NULL) {
+    snvm_threads(pVM, 0);
+    for(i = 0; i < pVM->op_count; i++) {
+      free((pVM->ppName)[i]);
+    }
+    if (pVM->ppName != NULL) {
+      free(pVM->ppName);
+      free(pVM->pCalls);
+      free(pVM->pPops);
+      free(pVM->pPushes);
+      free(pVM->pPure);
+    }
+    if (pVM->pStack != NULL) {
+      free(pVM->pStack);
+    }
+    if (pVM->pBase != NULL) {
+      free(pVM->pBase);
+    }
+    if (pVM->pDict != NULL) {
+      free(pVM->pDict);
+    }
+    if (pVM->ppWork != NULL) {
+      free(pVM->ppWork);
+    }
+    for(i = 0; i < pVM->global_count; i++) {
+      free((pVM->ppGlobal)[i]);
+    }
+    if (pVM->ppGlobal != NULL) {
+      free(pVM->ppGlobal);
+      free(pVM->pGlobalKind);
+      free(pVM->pGlobal);
+    }
+    for(i = 0; i < pVM->boot_count; i++) {
+      snvmprog_free((pVM->ppBoot)[i]);
+    }
+    if (pVM->ppBoot != NULL) {
+      free(pVM->ppBoot);
+    }
+    snvmspace_release(&(pVM->nursery), 0);
+    snvmspace_release(&(pVM->old), 0);
+    snvmspace_release(&(pVM->text), 0);
+    free(pVM);
+  }
+}
+
+/*
+ * snvm_op function.
+ */
+void snvm_op(
+    SNVM       * pVM,
+    const char * pName,
+    int (*pfOp)(SNVM *, void *),
+    void       * pCustom,
+    int          pops,
+    int          pushes) {
+  
+  long i = 0;
+  long newcap = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pName == NULL) || (pfOp == NULL) ||
+      ((pops < 0) && (pops != SNEFFECT_ANY)) ||
+      ((pushes < 0) && (pushes != SNEFFECT_ANY))) {
+    abort();
+  }
+  
+  /* Find the operation, adding it if it is new */
+  i = snvm_find(pVM, pName);
+  if (i < 0) {
+    if (pVM->op_count >= pVM->op_cap) {
+      newcap = pVM->op_cap * 2;
+      if (newcap < SNVM_OPS_INIT) {
+        newcap = SNVM_OPS_INIT;
+      }
+      pVM->ppName = (char **) snvm_grow(
+                      pVM->ppName, newcap, sizeof(char *));
+      pVM->pCalls = (SNVMCALL *) snvm_grow(
+                      pVM->pCalls, newcap, sizeof(SNVMCALL));
+      pVM->pPops = (int *) snvm_grow(pVM->pPops, newcap, sizeof(int));
+      pVM->pPushes = (int *) snvm_grow(pVM->pPushes, newcap, sizeof(int));
+      pVM->pPure = (int *) snvm_grow(pVM->pPure, newcap, sizeof(int));
+      pVM->op_cap = newcap;
+    }
+    
+    i = pVM->op_count;
+    (pVM->ppName)[i] = (char *) malloc(strlen(pName) + 1);
+    if ((pVM->ppName)[i] == NULL) {
+      abort();
+    }
+    strcpy((pVM->ppName)[i], pName);
+    (pVM->op_count)++;
+  }
+  
+  /* Store the operation */
+  (pVM->pCalls)[i].pfOp = pfOp;
+  (pVM->pCalls)[i].pCustom = pCustom;
+  (pVM->pPops)[i] = pops;
+  (pVM->pPushes)[i] = pushes;
+  (pVM->pPure)[i] = 0;
+}
+
+/*
+ * snvm_pure function.
+ */
+void snvm_pure(SNVM *pVM, const char *pName) {
+  
+  long i = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pName == NULL)) {
+    abort();
+  }
+  
+  /* Flag the operation, which must be registered */
+  i = snvm_find(pVM, pName);
+  if (i < 0) {
+    abort();
+  }
+  (pVM->pPure)[i] = 1;
+}
+
+/*
+ * snvm_threads function.
+ */
+int snvm_threads(SNVM *pVM, int count) {
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (count < 0)) {
+    abort();
+  }
+  
+  /* Replace any workers */
+#ifdef SNVM_THREADS
+  snvmpool_free(pVM->pPool);
+  pVM->pPool = NULL;
+  if (count > 0) {
+    pVM->pPool = snvmpool_alloc(count);
+  }
+#endif
+  
+  return (pVM->pPool != NULL);
+}
+
+/*
+ * snvm_numeric function.
+ */
+void snvm_numeric(SNVM *pVM) {
+  
+  static const char *pBinary[5] = { "add", "sub", "mul", "scale", "div" };
+  static const int binary_code[5] = {
+    SNVMNUM_ADD, SNVMNUM_SUB, SNVMNUM_MUL, SNVMNUM_MUL, SNVMNUM_DIV
+  };
+  static const char *pUnary[2] = { "neg", "abs" };
+  static const char *pReduce[3] = { "sum", "min", "max" };
+  int i = 0;
+  
+  /* Check parameter */
+  if (pVM == NULL) {
+    abort();
+  }
+  
+  /* Register the operations */
+  snvm_op(pVM, "vector", snvmnum_vector, NULL, SNEFFECT_ANY, 1);
+  snvm_op(pVM, "elements", snvmnum_array, NULL, 1, SNEFFECT_ANY);
+  snvm_op(pVM, "length", snvmnum_length, NULL, 1, 1);
+  snvm_op(pVM, "dot", snvmnum_dot, NULL, 2, 1);
+  for(i = 0; i < 5; i++) {
+    snvm_op(pVM, pBinary[i], snvmnum_binary,
+      &(snvmnum_codes[binary_code[i]]), 2, 1);
+  }
+  for(i = 0; i < 2; i++) {
+    snvm_op(pVM, pUnary[i], snvmnum_unary,
+      &(snvmnum_codes[SNVMNUM_NEG + i]), 1, 1);
+  }
+  for(i = 0; i < 3; i++) {
+    snvm_op(pVM, pReduce[i], snvmnum_reduce,
+      &(snvmnum_codes[SNVMNUM_SUM + i]), 1, 1);
+  }
+  
+  /* Declare them all pure */
+  snvm_pure(pVM, "vector");
+  snvm_pure(pVM, "elements");
+  snvm_pure(pVM, "length");
+  snvm_pure(pVM, "dot");
+  for(i = 0; i < 5; i++) {
+    snvm_pure(pVM, pBinary[i]);
+  }
+  for(i = 0; i < 2; i++) {
+    snvm_pure(pVM, pUnary[i]);
+  }
+  for(i = 0; i < 3; i++) {
+    snvm_pure(pVM, pReduce[i]);
+  }
+}
+
+/*
+ * snvm_compile function.
+ */
+SNVMPROG *snvm_compile(
+    const SNVM * pVM,
+    SNSOURCE   * pIn,
+    int        * pErr,
+    long       * pLine) {
+  
+  SNVMPROG *pProg = NULL;
+  SNPARSER *pParser = NULL;
+  SNANALYZER *pAn = NULL;
+  SNERRINFO info;
+  SNENTITY ent;
+  SNVAL val;
+  SNVMCOMP comp;
+  int err_code = 0;
+  long line = 0;
+  long i = 0;
+  long j = 0;
+  
+  /* Initialize structures */
+  memset(&info, 0, sizeof(SNERRINFO));
+  memset(&ent, 0, sizeof(SNENTITY));
+  memset(&val, 0, sizeof(SNVAL));
+  memset(&comp, 0, sizeof(SNVMCOMP));
+  comp.lit_start = -1;
+  comp.lit_end = -1;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pIn == NULL)) {
+    abort();
+  }
+  
+  /* Allocate the program, with a copy of the registry as call table */
+  pProg = (SNVMPROG *) calloc(1, sizeof(SNVMPROG));
+  if (pProg == NULL) {
+    abort();
+  }
+  if (pVM->op_count > 0) {
+    pProg->pCalls = (SNVMCALL *) snvm_grow(
+                      NULL, pVM->op_count, sizeof(SNVMCALL));
+    memcpy(pProg->pCalls, pVM->pCalls,
+            ((size_t) pVM->op_count) * sizeof(SNVMCALL));
+  }
+  pProg->call_count = pVM->op_count;
+  
+  /* Allocate a parser, and an analyzer with the declared effects */
+  pParser = snparser_alloc();
+  pAn = snanalyzer_alloc();
+  for(i = 0; i < pVM->op_count; i++) {
+    snanalyzer_effect(pAn, (pVM->ppName)[i],
+      (pVM->pPops)[i], (pVM->pPushes)[i]);
+  }
+  
+  /* Translate each entity up to EOF or error */
+  for(snparser_read(pParser, &ent, pIn);
+      ent.status > 0;
+      snparser_read(pParser, &ent, pIn)) {
+    
+    line = snparser_count(pParser);
+    snanalyzer_entity(pAn, &ent, line, snsource_bytes(pIn));
+    if (snanalyzer_errcount(pAn) > 0) {
+      snanalyzer_errinfo(pAn, 0, &info);
+      err_code = info.code;
+      break;
+    }
+    
+    switch (ent.status) {
+      
+      case SNENTITY_STRING:
+        if (ent.key_len > 0) {
+          err_code = SNVM_ERR_PREFIX;
+        } else {
+          val.type = SNVAL_STRING;
+          val.v.i = snvmprog_string(pProg, ent.pValue, ent.value_len);
+          snvmprog_emit(pProg, SNVM_I_PUSH,
+            snvmprog_literal(pProg, &val), line);
+        }
+        break;
+      
+      case SNENTITY_NUMERIC:
+        err_code = snvm_number(ent.pKey, &val);
+        if (!err_code) {
+          snvmprog_emit(pProg, SNVM_I_PUSH,
+            snvmprog_literal(pProg, &val), line);
+        }
+        break;
+      
+      case SNENTITY_ARRAY:
+        snvmcomp_array(&comp, pProg, ent.count);
+        val.type = SNVAL_INT;
+        val.v.i = ent.count;
+        snvmprog_emit(pProg, SNVM_I_PUSH,
+          snvmprog_literal(pProg, &val), line);
+        comp.lit_end = pProg->code_count;
+        break;
+      
+      case SNENTITY_OPERATION:
+        /* Turn a literal array right before the built-in vector
+         * operation into a vector literal */
+        i = snvm_find(pVM, ent.pKey);
+        if ((i >= 0) && (comp.lit_start >= 0) &&
+            (comp.lit_end == pProg->code_count) &&
+            ((pVM->pCalls)[i].pfOp == snvmnum_vector)) {
+          snvmprog_vector(pProg, comp.lit_start, line);
+          
+        } else if (i >= 0) {
+          snvmprog_emit(pProg, SNVM_I_CALL, i, line);
+          if (!(pVM->pPure)[i]) {
+            snvmcomp_impure(&comp);
+          }
+        } else {
+          err_code = SNVM_ERR_UNKNOWNOP;
+        }
+        break;
+      
+      case SNENTITY_VARIABLE:
+      case SNENTITY_CONSTANT:
+        if (snvmcomp_lookup(&comp, ent.pKey) < 0) {
+          snvmprog_emit(pProg,
+            (ent.status == SNENTITY_VARIABLE) ?
+              SNVM_I_VARIABLE : SNVM_I_CONSTANT,
+            snvmcomp_declare(&comp, ent.pKey, ent.status), line);
+          snvmcomp_impure(&comp);
+        } else {
+          err_code = SNVM_ERR_REDEFINE;
+        }
+        break;
+      
+      case SNENTITY_ASSIGN:
+      case SNENTITY_GET:
+        /* Names the program does not declare are imported from the
+         * global dictionary */
+        i = snvmcomp_lookup(&comp, ent.pKey);
+        if (i < 0) {
+          j = snvm_global(pVM, ent.pKey);
+          if (j >= 0) {
+            i = snvmcomp_declare(&comp, ent.pKey, (pVM->pGlobalKind)[j]);
+            (comp.pImport)[i] = j;
+          }
+        }
+        if (i < 0) {
+          err_code = SNVM_ERR_UNDEFINED;
+        } else if ((ent.status == SNENTITY_ASSIGN) &&
+                    ((comp.pKind)[i] == SNENTITY_CONSTANT)) {
+          err_code = SNVM_ERR_CONSTANT;
+        } else {
+          snvmprog_emit(pProg,
+            (ent.status == SNENTITY_ASSIGN) ? SNVM_I_ASSIGN : SNVM_I_GET,
+            i, line);
+          snvmcomp_impure(&comp);
+        }
+        break;
+      
+      case SNENTITY_BEGIN_GROUP:
+        /* Remember where the group began, which is also the group
+         * number in the analyzer */
+        snvmcomp_begin(&comp, snvmprog_emit(pProg, SNVM_I_BEGIN,
+                                snanalyzer_groups(pAn) - 1, line));
+        break;
+      
+      case SNENTITY_END_GROUP:
+        /* Drop the check of proven groups */
+        i = (comp.pOpen)[comp.open_count - 1].begin;
+        if (snanalyzer_group(pAn, (pProg->pCode)[i].arg) ==
+              SNGROUP_PROVEN) {
+          (pProg->pCode)[i].op = SNVM_I_NOP;
+        } else {
+          snvmprog_emit(pProg, SNVM_I_END, 0, line);
+        }
+        snvmcomp_end(&comp, pProg->code_count);
+        break;
+      
+      case SNENTITY_BEGIN_META:
+      case SNENTITY_END_META:
+      case SNENTITY_META_TOKEN:
+      case SNENTITY_META_STRING:
+        break;
+      
+      default:
+        err_code = SNVM_ERR_ENTITY;
+    }
+    
+    if (err_code) {
+      break;
+    }
+  }
+  
+  /* Get any parsing error */
+  if ((!err_code) && (ent.status < 0)) {
+    err_code = ent.status;
+    line = snparser_count(pParser);
+  }
+  
+  /* Hand the names over to the program and release compilation state */
+  pProg->ppName = comp.ppName;
+  pProg->pKind = comp.pKind;
+  pProg->pImport = comp.pImport;
+  pProg->name_count = comp.name_count;
+  comp.ppName = NULL;
+  comp.pKind = NULL;
+  comp.pImport = NULL;
+  comp.name_count = 0;
+  snvmcomp_free(&comp);
+  snanalyzer_free(pAn);
+  snparser_free(pParser);
+  
+  /* Complete the program, or free it on error */
+  if (!err_code) {
+    snvmprog_finish(pProg);
+    line = 0;
+  } else {
+    snvmprog_free(pProg);
+    pProg = NULL;
+  }
+  
+  /* Report the error and line */
+  if (pErr != NULL) {
+    *pErr = err_code;
+  }
+  if (pLine != NULL) {
+    *pLine = line;
+  }
+  
+  return pProg;
+}
+
+/*
+ * snvmprog_free function.
+ */
+void snvmprog_free(SNVMPROG *pProg) {
+  
+  long i = 0;
+  
+  if (pProg != NULL) {
+#ifdef SNVM_HAVE_JIT
+    if (pProg->pNativeMem != NULL) {
+      munmap(pProg->pNativeMem, pProg->native_size);
+    }
+#endif
+    if (pProg->pCode != NULL) {
+      free(pProg->pCode);
+      free(pProg->pLines);
+    }
+    if (pProg->pPool != NULL) {
+      free(pProg->pPool);
+    }
+    if (pProg->pCalls != NULL) {
+      free(pProg->pCalls);
+    }
+    if (pProg->pArena != NULL) {
+      free(pProg->pArena);
+    }
+    if (pProg->pPar != NULL) {
+      free(pProg->pPar);
+    }
+    if (pProg->pBounds != NULL) {
+      free(pProg->pBounds);
+    }
+    for(i = 0; i < pProg->name_count; i++) {
+      free((pProg->ppName)[i]);
+    }
+    if (pProg->ppName != NULL) {
+      free(pProg->ppName);
+      free(pProg->pKind);
+      free(pProg->pImport);
+    }
+    free(pProg);
+  }
+}
+
+/*
+ * snvmprog_jit function.
+ */
+int snvmprog_jit(SNVMPROG *pProg) {
+
+#ifdef SNVM_HAVE_JIT
+  static const unsigned char prologue[4] = {
+    0x53,                     /* push rbx */
+    0x48, 0x89, 0xfb          /* mov rbx, rdi */
+  };
+  static const unsigned char success[4] = {
+    0x31, 0xc0,               /* xor eax, eax */
+    0x5b,                     /* pop rbx */
+    0xc3                      /* ret */
+  };
+  static const unsigned char failure[2] = {
+    0x5b,                     /* pop rbx */
+    0xc3                      /* ret */
+  };
+  int (*pfBegin)(SNVM *) = snvm_begin;
+  int (*pfEnd)(SNVM *) = snvm_end;
+  int (*pfDict)(SNVM *, const SNVMINS *) = snvm_dict;
+  const SNVMINS *pi = NULL;
+  const SNVMCALL *pCall = NULL;
+  const SNVMPAR *pPar = NULL;
+  SNVMJIT jit;
+  void *pMem = NULL;
+  size_t size = 0;
+  long i = 0;
+  int ok = 1;
+  
+  /* Initialize structures */
+  memset(&jit, 0, sizeof(SNVMJIT));
+  
+  /* Check parameter */
+  if (pProg == NULL) {
+    abort();
+  }
+  
+  /* Templates assume 16-byte values with the payload at offset 8, and
+   * instruction indices that fit in 32 bits */
+  if ((sizeof(SNVAL) != 16) || (offsetof(SNVAL, v) != 8) ||
+      (sizeof(pfBegin) != 8) || (pProg->code_count > 0x7fffffffL) ||
+      (pProg->pfNative != NULL)) {
+    ok = 0;
+  }
+  
+  /* Map a writable buffer large enough for every template */
+  if (ok) {
+    size = ((size_t) pProg->code_count) * SNVM_JIT_INSMAX +
+              SNVM_JIT_FRAME;
+    pMem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pMem == MAP_FAILED) {
+      pMem = NULL;
+      ok = 0;
+    }
+  }
+  if (ok) {
+    jit.pCode = (unsigned char *) pMem;
+    jit.cap = size;
+    jit.pFix = (size_t *) snvm_grow(
+                  NULL, pProg->code_count * 2 + 1, sizeof(size_t));
+    jit.pOff = (size_t *) snvm_grow(
+                  NULL, pProg->code_count + 1, sizeof(size_t));
+    jit.pJump = (size_t *) snvm_grow(
+                  NULL, pProg->par_count + 1, sizeof(size_t));
+    jit.pJumpTo = (long *) snvm_grow(
+                  NULL, pProg->par_count + 1, sizeof(long));
+  }
+  
+  /* Translate each instruction */
+  if (ok) {
+    snvmjit_bytes(&jit, prologue, 4);
+    for(i = 0; i < pProg->code_count; i++) {
+      pi = &((pProg->pCode)[i]);
+      (jit.pOff)[i] = jit.len;
+      switch (pi->op) {
+        
+        case SNVM_I_PUSH:
+          snvmjit_push(&jit, i, &((pProg->pPool)[pi->arg]));
+          break;
+        
+        case SNVM_I_CALL:
+          pCall = &((pProg->pCalls)[pi->arg]);
+          snvmjit_pc(&jit, i);
+          snvmjit_call(&jit, &(pCall->pfOp), &(pCall->pCustom));
+          break;
+        
+        case SNVM_I_BEGIN:
+          snvmjit_pc(&jit, i);
+          snvmjit_call(&jit, &pfBegin, NULL);
+          break;
+        
+        case SNVM_I_END:
+          snvmjit_pc(&jit, i);
+          snvmjit_call(&jit, &pfEnd, NULL);
+          break;
+        
+        case SNVM_I_VARIABLE:
+        case SNVM_I_CONSTANT:
+        case SNVM_I_ASSIGN:
+        case SNVM_I_GET:
+          snvmjit_pc(&jit, i);
+          snvmjit_call(&jit, &pfDict, &pi);
+          break;
+        
+        case SNVM_I_PARALLEL:
+          pPar = &((pProg->pPar)[pi->arg]);
+          snvmjit_parallel(&jit, i, pPar,
+            (pProg->pBounds)[pPar->first + pPar->count]);
+          break;
+        
+        default:
+          abort();
+      }
+    }
+    (jit.pOff)[pProg->code_count] = jit.len;
+    snvmjit_bytes(&jit, success, 4);
+    
+    /* Point every jump past parallel elements at its instruction, and
+     * every failure jump at the shared failure exit */
+    for(i = 0; i < jit.jump_count; i++) {
+      snvmjit_patch(&jit, (jit.pJump)[i], (jit.pOff)[(jit.pJumpTo)[i]]);
+    }
+    for(i = 0; i < jit.fix_count; i++) {
+      snvmjit_patch(&jit, (jit.pFix)[i], jit.len);
+    }
+    snvmjit_bytes(&jit, failure, 2);
+    free(jit.pFix);
+    free(jit.pOff);
+    free(jit.pJump);
+    free(jit.pJumpTo);
+    
+    /* Make the code executable */
+    if (mprotect(pMem, size, PROT_READ | PROT_EXEC) != 0) {
+      ok = 0;
+    }
+  }
+  
+  /* Install the code, or release the mapping on failure */
+  if (ok) {
+    memcpy(&(pProg->pfNative), &pMem, sizeof(pMem));
+    pProg->pNativeMem = pMem;
+    pProg->native_size = size;
+  } else if (pMem != NULL) {
+    munmap(pMem, size);
+  }
+  
+  return (pProg->pfNative != NULL);
+
+#else
+  /* Check parameter */
+  if (pProg == NULL) {
+    abort();
+  }
+  
+  /* No JIT in this build */
+  return 0;
+#endif
+}
+
+/*
+ * snvm_run function.
+ */
+int snvm_run(SNVM *pVM, const SNVMPROG *pProg, long *pLine) {
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pProg == NULL)) {
+    abort();
+  }
+  
+  return snvm_execute(pVM, pProg, pLine, 0);
+}
+
+/*
+ * snvm_define function.
+ */
+int snvm_define(SNVM *pVM, const SNVMPROG *pProg, long *pLine) {
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pProg == NULL)) {
+    abort();
+  }
+  
+  return snvm_execute(pVM, pProg, pLine, 1);
+}
+
+/*
+ * snvm_save function.
+ */
+int snvm_save(SNVM *pVM, FILE *pOut, unsigned long stamp) {
+  
+  unsigned long trailer[SNVM_IMAGE_TRAILER];
+  SNVMIMAGE img;
+  const SNVMCHUNK *pChunk = NULL;
+  SNOBJ *pObj = NULL;
+  SNVAL *pVals = NULL;
+  unsigned long *pMeta = NULL;
+  size_t pos = 0;
+  long vals = 0;
+  long i = 0;
+  int ok = 1;
+  
+  /* Initialize structures */
+  memset(trailer, 0, sizeof(trailer));
+  memset(&img, 0, sizeof(SNVMIMAGE));
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pOut == NULL)) {
+    abort();
+  }
+  img.pVM = pVM;
+  
+  /* Collect the heap, so that the old generation holds exactly the
+   * objects that can be reached, back to back */
+  snvm_collect(pVM, 1);
+  
+  /* Convert the stack and the global dictionary */
+  vals = pVM->sp + pVM->global_count;
+  if (vals > 0) {
+    pVals = (SNVAL *) snvm_grow(NULL, vals, sizeof(SNVAL));
+  }
+  if (pVM->global_count > 0) {
+    pMeta = (unsigned long *) snvm_grow(
+              NULL, pVM->global_count * 2, sizeof(unsigned long));
+  }
+  for(i = 0; i < pVM->sp; i++) {
+    snvmimage_value(&img, &((pVM->pStack)[i]), &(pVals[i]));
+  }
+  for(i = 0; i < pVM->global_count; i++) {
+    snvmimage_value(&img, &((pVM->pGlobal)[i]), &(pVals[pVM->sp + i]));
+    pMeta[i] = (unsigned long) (pVM->pGlobalKind)[i];
+    pMeta[pVM->global_count + i] =
+      (unsigned long) snvmimage_text(&img, (pVM->ppGlobal)[i]);
+  }
+  
+  /* Write the old generation object by object, then the static objects,
+   * whose number may grow while writing */
+  for(pChunk = pVM->old.pChunk;
+      ok && (pChunk != NULL);
+      pChunk = pChunk->pNext) {
+    pos = 0;
+    while (ok && (pos < pChunk->used)) {
+      pObj = (SNOBJ *) (((unsigned char *) pChunk->pData) + pos);
+      ok = snvmimage_object(&img, pOut, pObj);
+      pos += snvm_objsize(pObj->count, pObj->bytes);
+    }
+  }
+  for(i = 0; ok && (i < img.static_count); i++) {
+    ok = snvmimage_object(&img, pOut, (img.ppStatic)[i]);
+  }
+  
+  /* Write the other sections and the trailer */
+  if (ok) {
+    ok = snvmimage_write(pOut, img.pText, (size_t) img.text_len);
+  }
+  if (ok) {
+    ok = snvmimage_write(pOut, pVals, ((size_t) vals) * sizeof(SNVAL));
+  }
+  if (ok) {
+    ok = snvmimage_write(pOut, pMeta,
+          ((size_t) pVM->global_count) * 2 * sizeof(unsigned long));
+  }
+  if (ok) {
+    trailer[0] = SNVM_IMAGE_MAGIC;
+    trailer[1] = SNVM_IMAGE_VERSION;
+    trailer[2] = stamp;
+    trailer[3] = (unsigned long) sizeof(long);
+    trailer[4] = (unsigned long) sizeof(double);
+    trailer[5] = (unsigned long) sizeof(SNVAL);
+    trailer[6] = (unsigned long) sizeof(SNOBJ);
+    trailer[7] = ((unsigned long) pVM->old.used) +
+                    ((unsigned long) img.static_len);
+    trailer[8] = (unsigned long) img.text_len;
+    trailer[9] = (unsigned long) pVM->sp;
+    trailer[10] = (unsigned long) pVM->global_count;
+    ok = snvmimage_write(pOut, trailer, sizeof(trailer));
+  }
+  if (ok && (fflush(pOut) != 0)) {
+    ok = 0;
+  }
+  
+  /* Release the image state */
+  if (pVals != NULL) {
+    free(pVals);
+  }
+  if (pMeta != NULL) {
+    free(pMeta);
+  }
+  if (img.pText != NULL) {
+    free(img.pText);
+  }
+  if (img.ppStatic != NULL) {
+    free(img.ppStatic);
+    free(img.pStaticOff);
+  }
+  
+  return ok;
+}
+
+/*
+ * snvm_restore function.
+ */
+int snvm_restore(SNVM *pVM, FILE *pIn, unsigned long stamp) {
+  
+  unsigned long trailer[SNVM_IMAGE_TRAILER];
+  SNVMALIGN *pBuf = NULL;
+  unsigned char *pBytes = NULL;
+  SNVMCHUNK *pHeap = NULL;
+  SNVMCHUNK *pText = NULL;
+  unsigned char *pHeapData = NULL;
+  unsigned char *pStarts = NULL;
+  const char *pTextData = NULL;
+  SNOBJ *pObj = NULL;
+  SNVAL *pSlots = NULL;
+  SNVAL *pVals = NULL;
+  unsigned long *pMeta = NULL;
+  size_t len = 0;
+  size_t cap = 0;
+  size_t got = 0;
+  size_t avail = 0;
+  size_t heap = 0;
+  size_t text = 0;
+  size_t stack = 0;
+  size_t globals = 0;
+  size_t pos = 0;
+  size_t size = 0;
+  long i = 0;
+  int ok = 1;
+  
+  /* Initialize structures */
+  memset(trailer, 0, sizeof(trailer));
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pIn == NULL)) {
+    abort();
+  }
+  
+  /* Read the whole image */
+  cap = SNVM_CHUNK_INIT;
+  pBuf = (SNVMALIGN *) snvm_grow(
+            NULL, (long) (cap / sizeof(SNVMALIGN)), sizeof(SNVMALIGN));
+  got = 1;
+  while (got > 0) {
+    if (len >= cap) {
+      cap = cap * 2;
+      pBuf = (SNVMALIGN *) snvm_grow(
+                pBuf, (long) (cap / sizeof(SNVMALIGN)), sizeof(SNVMALIGN));
+    }
+    got = fread(((unsigned char *) pBuf) + len, 1, cap - len, pIn);
+    len += got;
+  }
+  if (ferror(pIn)) {
+    ok = 0;
+  }
+  pBytes = (unsigned char *) pBuf;
+  
+  /* Check the trailer */
+  if (ok && (len >= sizeof(trailer))) {
+    memcpy(trailer, pBytes + (len - sizeof(trailer)), sizeof(trailer));
+    if ((trailer[0] != SNVM_IMAGE_MAGIC) ||
+        (trailer[1] != SNVM_IMAGE_VERSION) ||
+        (trailer[2] != stamp) ||
+        (trailer[3] != (unsigned long) sizeof(long)) ||
+        (trailer[4] != (unsigned long) sizeof(double)) ||
+        (trailer[5] != (unsigned long) sizeof(SNVAL)) ||
+        (trailer[6] != (unsigned long) sizeof(SNOBJ))) {
+      ok = 0;
+    }
+  } else {
+    ok = 0;
+  }
+  
+  /* Check that the sections exactly fill the image, one at a time so
+   * that nothing can overflow */
+  if (ok) {
+    avail = len - sizeof(trailer);
+    heap = (size_t) trailer[7];
+    text = (size_t) trailer[8];
+    stack = (size_t) trailer[9];
+    globals = (size_t) trailer[10];
+    if ((heap > avail) || (heap % sizeof(SNVMALIGN) != 0)) {
+      ok = 0;
+    } else {
+      avail -= heap;
+    }
+  }
+  if (ok) {
+    if ((text > avail) || ((text > 0) && (pBytes[heap + text - 1] != 0))) {
+      ok = 0;
+    } else {
+      avail -= text;
+    }
+  }
+  if (ok) {
+    if ((stack > avail / sizeof(SNVAL)) || (stack > SNVM_STACK_MAX)) {
+      ok = 0;
+    } else {
+      avail -= stack * sizeof(SNVAL);
+    }
+  }
+  if (ok) {
+    if ((globals != avail / (sizeof(SNVAL) + 2 * sizeof(unsigned long))) ||
+        (avail % (sizeof(SNVAL) + 2 * sizeof(unsigned long)) != 0)) {
+      ok = 0;
+    }
+  }
+  
+  /* Copy out the text, the values, and the names, and then shrink the
+   * buffer to the heap, which becomes a chunk of its own */
+  if (ok) {
+    pText = (SNVMCHUNK *) malloc(sizeof(SNVMCHUNK));
+    if (pText == NULL) {
+      abort();
+    }
+    pText->pNext = NULL;
+    pText->cap = ((text / sizeof(SNVMALIGN)) + 1) * sizeof(SNVMALIGN);
+    pText->used = pText->cap;
+    pText->pData = (SNVMALIGN *) snvm_grow(
+                      NULL, (long) (pText->cap / sizeof(SNVMALIGN)),
+                      sizeof(SNVMALIGN));
+    memcpy(pText->pData, pBytes + heap, text);
+    pTextData = (const char *) pText->pData;
+    
+    pos = heap + text;
+    if (stack + globals > 0) {
+      pVals = (SNVAL *) snvm_grow(
+                NULL, (long) (stack + globals), sizeof(SNVAL));
+      memcpy(pVals, pBytes + pos, (stack + globals) * sizeof(SNVAL));
+      pos += (stack + globals) * sizeof(SNVAL);
+    }
+    if (globals > 0) {
+      pMeta = (unsigned long *) snvm_grow(
+                NULL, (long) (globals * 2), sizeof(unsigned long));
+      memcpy(pMeta, pBytes + pos, globals * 2 * sizeof(unsigned long));
+    }
+    
+    if (heap > 0) {
+      pHeap = (SNVMCHUNK *) malloc(sizeof(SNVMCHUNK));
+      if (pHeap == NULL) {
+        abort();
+      }
+      pHeap->pNext = NULL;
+      pHeap->pData = (SNVMALIGN *) snvm_grow(
+                        pBuf, (long) (heap / sizeof(SNVMALIGN)),
+                        sizeof(SNVMALIGN));
+      pHeap->used = heap;
+      pHeap->cap = heap;
+      pHeapData = (unsigned char *) pHeap->pData;
+      pBuf = NULL;
+    }
+  }
+  
+  /* Walk the objects, checking that each header is one the image
+   * writer could have produced and that the object fits in the heap,
+   * and mark where each one starts */
+  if (ok && (heap > 0)) {
+    pStarts = (unsigned char *) snvm_grow(
+                NULL, (long) (heap / sizeof(SNVMALIGN)), 1);
+    memset(pStarts, 0, heap / sizeof(SNVMALIGN));
+  }
+  pos = 0;
+  while (ok && (pos < heap)) {
+    pObj = (SNOBJ *) (pHeapData + pos);
+    if ((sizeof(SNOBJ) > heap - pos) || (pObj->pForward != NULL) ||
+        (pObj->gen != SNVM_GEN_OLD) || (pObj->count < 0) ||
+        (pObj->bytes < 0) ||
+        (((size_t) pObj->count) > (heap - pos) / sizeof(SNVAL)) ||
+        (((size_t) pObj->bytes) > heap - pos)) {
+      ok = 0;
+    } else {
+      size = snvm_objsize(pObj->count, pObj->bytes);
+      if (size > heap - pos) {
+        ok = 0;
+      }
+    }
+    
+    if (ok) {
+      pStarts[pos / sizeof(SNVMALIGN)] = 1;
+      pos += size;
+    }
+  }
+  
+  /* Relocate the objects in place, now that every reference can be
+   * checked against the object starts */
+  pos = 0;
+  while (ok && (pos < heap)) {
+    pObj = (SNOBJ *) (pHeapData + pos);
+    pSlots = snobj_slots(pObj);
+    for(i = 0; ok && (i < pObj->count); i++) {
+      ok = snvmimage_relocate(
+              &(pSlots[i]), pHeapData, heap, pStarts, pTextData, text);
+    }
+    pos += snvm_objsize(pObj->count, pObj->bytes);
+  }
+  
+  /* Relocate the stack and the global dictionary */
+  for(i = 0; ok && (i < (long) (stack + globals)); i++) {
+    ok = snvmimage_relocate(
+            &(pVals[i]), pHeapData, heap, pStarts, pTextData, text);
+  }
+  for(i = 0; ok && (i < (long) globals); i++) {
+    if (((pMeta[i] != (unsigned long) SNENTITY_VARIABLE) &&
+          (pMeta[i] != (unsigned long) SNENTITY_CONSTANT)) ||
+        (pMeta[globals + i] >= text)) {
+      ok = 0;
+    }
+  }
+  
+  /* Adopt the image, keeping the current chunk of the old generation
+   * first so that allocation continues there */
+  if (ok) {
+    if (pHeap != NULL) {
+      if (pVM->old.pChunk != NULL) {
+        pHeap->pNext = pVM->old.pChunk->pNext;
+        pVM->old.pChunk->pNext = pHeap;
+      } else {
+        pVM->old.pChunk = pHeap;
+      }
+      pVM->old.used += heap;
+      pHeap = NULL;
+    }
+    pText->pNext = pVM->text.pChunk;
+    pVM->text.pChunk = pText;
+    pVM->text.used += pText->cap;
+    pText = NULL;
+    
+    pVM->sp = pVM->floor;
+    for(i = 0; i < (long) stack; i++) {
+      snvm_push(pVM, &(pVals[i]));
+    }
+    for(i = 0; i < (long) globals; i++) {
+      snvm_publish(pVM, pTextData + pMeta[globals + i], (int) pMeta[i],
+        &(pVals[stack + i]));
+    }
+  }
+  
+  /* Release what was not adopted */
+  if (pBuf != NULL) {
+    free(pBuf);
+  }
+  if (pStarts != NULL) {
+    free(pStarts);
+  }
+  if (pHeap != NULL) {
+    free(pHeap->pData);
+    free(pHeap);
+  }
+  if (pText != NULL) {
+    free(pText->pData);
+    free(pText);
+  }
+  if (pVals != NULL) {
+    free(pVals);
+  }
+  if (pMeta != NULL) {
+    free(pMeta);
+  }
+  
+  return ok;
+}
+
+/*
+ * snvm_boot function.
+ */
+int snvm_boot(
+    SNVM       * pVM,
+    const char * pSource,
+    const char * pImage,
+    long       * pLine) {
+  
+  FILE *pFile = NULL;
+  SNSOURCE *pSrc = NULL;
+  SNVMPROG *pProg = NULL;
+  char *pData = NULL;
+  unsigned long stamp = 0;
+  long len = 0;
+  long cap = 0;
+  long newcap = 0;
+  long line = 0;
+  size_t got = 1;
+  int err_code = 0;
+  int ok = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pSource == NULL) || (pImage == NULL)) {
+    abort();
+  }
+  
+  /* Read the bootstrap document and compute its stamp */
+  pFile = fopen(pSource, "rb");
+  if (pFile == NULL) {
+    err_code = SNERR_IOERR;
+  }
+  while ((!err_code) && (got > 0)) {
+    if (len >= cap) {
+      if (cap >= LONG_MAX / 2) {
+        abort();
+      }
+      newcap = (cap > 0) ? (cap * 2) : SNVM_CHUNK_INIT;
+      pData = (char *) snvm_grow(pData, newcap, 1);
+      cap = newcap;
+    }
+    got = fread(pData + len, 1, (size_t) (cap - len), pFile);
+    len += (long) got;
+  }
+  if (pFile != NULL) {
+    if (ferror(pFile)) {
+      err_code = SNERR_IOERR;
+    }
+    fclose(pFile);
+    pFile = NULL;
+  }
+  if (!err_code) {
+    stamp = snvmimage_stamp(pData, len);
+  }
+  
+  /* Restore the image if it is current */
+  if (!err_code) {
+    pFile = fopen(pImage, "rb");
+    if (pFile != NULL) {
+      ok = snvm_restore(pVM, pFile, stamp);
+      fclose(pFile);
+      pFile = NULL;
+    }
+  }
+  
+  /* Otherwise, run the document and keep the program */
+  if ((!err_code) && (!ok)) {
+    pSrc = snsource_memory(pData, len);
+    pProg = snvm_compile(pVM, pSrc, &err_code, &line);
+    snsource_free(pSrc);
+    if (pProg != NULL) {
+      err_code = snvm_define(pVM, pProg, &line);
+      
+      if (pVM->boot_count >= pVM->boot_cap) {
+        newcap = pVM->boot_cap * 2;
+        if (newcap < SNVM_BASE_INIT) {
+          newcap = SNVM_BASE_INIT;
+        }
+        pVM->ppBoot = (SNVMPROG **) snvm_grow(
+                        pVM->ppBoot, newcap, sizeof(SNVMPROG *));
+        pVM->boot_cap = newcap;
+      }
+      (pVM->ppBoot)[pVM->boot_count] = pProg;
+      (pVM->boot_count)++;
+    }
+    
+    /* Write a new image, removing it if that fails */
+    if (!err_code) {
+      pFile = fopen(pImage, "wb");
+      if (pFile != NULL) {
+        ok = snvm_save(pVM, pFile, stamp);
+        if (fclose(pFile) != 0) {
+          ok = 0;
+        }
+        pFile = NULL;
+        if (!ok) {
+          remove(pImage);
+        }
+      }
+      if (!ok) {
+        err_code = SNVM_ERR_IMAGE;
+      }
+    }
+  }
+  
+  /* Release the document */
+  if (pData != NULL) {
+    free(pData);
+  }
+  
+  if (pLine != NULL) {
+    *pLine = line;
+  }
+  
+  return err_code;
+}
+
+/*
+ * snvm_new function.
+ */
+SNOBJ *snvm_new(SNVM *pVM, long count, long bytes) {
+  
+  SNOBJ *pObj = NULL;
+  size_t size = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (count < 0) || (bytes < 0)) {
+    abort();
+  }
+  
+  /* Allocate in the nursery, with null slots and zero data */
+  size = snvm_objsize(count, bytes);
+  pObj = (SNOBJ *) snvmspace_alloc(&(pVM->nursery), size);
+  memset(pObj, 0, size);
+  pObj->pForward = NULL;
+  pObj->count = count;
+  pObj->bytes = bytes;
+  pObj->gen = SNVM_GEN_NURSERY;
+  
+  return pObj;
+}
+
+/*
+ * snobj_slots function.
+ */
+SNVAL *snobj_slots(SNOBJ *pObj) {
+  
+  /* Check parameter */
+  if (pObj == NULL) {
+    abort();
+  }
+  
+  return (SNVAL *) (pObj + 1);
+}
+
+/*
+ * snobj_count function.
+ */
+long snobj_count(const SNOBJ *pObj) {
+  
+  /* Check parameter */
+  if (pObj == NULL) {
+    abort();
+  }
+  
+  return pObj->count;
+}
+
+/*
+ * snobj_data function.
+ */
+unsigned char *snobj_data(SNOBJ *pObj) {
+  
+  /* Check parameter */
+  if (pObj == NULL) {
+    abort();
+  }
+  
+  return (unsigned char *) (snobj_slots(pObj) + pObj->count);
+}
+
+/*
+ * snobj_bytes function.
+ */
+long snobj_bytes(const SNOBJ *pObj) {
+  
+  /* Check parameter */
+  if (pObj == NULL) {
+    abort();
+  }
+  
+  return pObj->bytes;
+}
+
+/*
+ * snvm_push function.
+ */
+int snvm_push(SNVM *pVM, const SNVAL *pVal) {
+  
+  int err_code = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pVal == NULL)) {
+    abort();
+  }
+  
+  /* Make room and push */
+  if (pVM->sp >= pVM->cap) {
+    err_code = snvm_stack(pVM);
+  }
+  if (!err_code) {
+    memcpy(&((pVM->pStack)[pVM->sp]), pVal, sizeof(SNVAL));
+    (pVM->sp)++;
+  }
+  
+  return err_code;
+}
+
+/*
+ * snvm_pop function.
+ */
+int snvm_pop(SNVM *pVM, SNVAL *pVal) {
+  
+  int err_code = 0;
+  
+  /* Check parameters */
+  if ((pVM == NULL) || (pVal == NULL)) {
+    abort();
+  }
+  
+  /* Pop if there is a visible value */
+  if (pVM->sp > pVM->floor) {
+    (pVM->sp)--;
+    memcpy(pVal, &((pVM->pStack)[pVM->sp]), sizeof(SNVAL));
+  } else {
+    err_code = SNVM_ERR_UNDERFLOW;
+  }
+  
+  return err_code;
+}
+
+/*
+ * snvm_depth function.
+ */
+long snvm_depth(const SNVM *pVM) {
+  
+  /* Check parameter */
+  if (pVM == NULL) {
+    abort();
+  }
+  
+  return pVM->sp - pVM->floor;
+}
+
+/*
+ * snvm_clear function.
+ */
+void snvm_clear(SNVM *pVM) {
+  
+  /* Check parameter */
+  if (pVM == NULL) {
+    abort();
+  }
+  
+  pVM->sp = pVM->floor;
+}
+
+/*
+ * snvm_errstr function.
+ */
+const char *snvm_errstr(int code) {
+  
+  const char *pResult = NULL;
+  
+  switch (code) {
+    
+    case SNVM_ERR_ENTITY:
+      pResult = "Entity not supported by runtime";
+      break;
+    
+    case SNVM_ERR_UNKNOWNOP:
+      pResult = "Operation is not registered";
+      break;
+    
+    case SNVM_ERR_BADNUM:
+      pResult = "Numeric literal invalid or too big";
+      break;
+    
+    case SNVM_ERR_PREFIX:
+      pResult = "String prefix not supported";
+      break;
+    
+    case SNVM_ERR_UNDERFLOW:
+      pResult = "Stack underflow";
+      break;
+    
+    case SNVM_ERR_OVERFLOW:
+      pResult = "Stack overflow";
+      break;
+    
+    case SNVM_ERR_GROUP:
+      pResult = "Group did not leave one value";
+      break;
+    
+    case SNVM_ERR_TYPE:
+      pResult = "Wrong value type for operation";
+      break;
+    
+    case SNVM_ERR_REDEFINE:
+      pResult = "Name already declared";
+      break;
+    
+    case SNVM_ERR_UNDEFINED:
+      pResult = "Name not declared";
+      break;
+    
+    case SNVM_ERR_CONSTANT:
+      pResult = "Constant can not be assigned";
+      break;
+    
+    case SNVM_ERR_LENGTH:
+      pResult = "Vector length does not match";
+      break;
+    
+    case SNVM_ERR_IMAGE:
+      pResult = "Image could not be written";
+      break;
+    
+    default:
+      pResult = snerror_str(code);
+  }
+  
+  return pResult;
+}
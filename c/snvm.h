@@ -0,0 +1,722 @@
+#ifndef SNVM_H_INCLUDED
+#define SNVM_H_INCLUDED
+
+/*
+ * snvm.h
+ * 
+ * Optional Shastina runtime.
+ * 
+ * This module compiles Shastina documents into programs for a stack
+ * machine that follows the client architecture recommended by the
+ * Shastina specification, and then runs those programs as many times as
+ * needed.  It is built on the public interface of the core library,
+ * which does not depend on it.
+ * 
+ * The module is ANSI C with no further dependencies.  If the SNVM_JIT
+ * macro is defined when compiling it for x86-64 on a POSIX system, it
+ * also includes a template JIT that translates programs to machine
+ * code.  See snvmprog_jit() for further information.  If the
+ * SNVM_THREADS macro is defined, it uses POSIX threads to evaluate
+ * large arrays in parallel.  See snvm_threads() for further
+ * information.
+ */
+
+#include "shastina.h"
+
+/*
+ * Error constants of the runtime.
+ * 
+ * These are all negative and distinct from the SNERR_ constants of the
+ * core library, so that both kinds of error can be returned through the
+ * same channel.  Use snvm_errstr() to convert either kind to a string.
+ */
+#define SNVM_ERR_ENTITY    (-101) /* Entity not supported by runtime */
+#define SNVM_ERR_UNKNOWNOP (-102) /* Operation is not registered */
+#define SNVM_ERR_BADNUM    (-103) /* Numeric literal invalid or too big */
+#define SNVM_ERR_PREFIX    (-104) /* String prefix not supported */
+#define SNVM_ERR_UNDERFLOW (-105) /* Stack underflow */
+#define SNVM_ERR_OVERFLOW  (-106) /* Stack overflow */
+#define SNVM_ERR_GROUP     (-107) /* Group did not leave one value */
+#define SNVM_ERR_TYPE      (-108) /* Wrong value type for operation */
+#define SNVM_ERR_REDEFINE  (-109) /* Name already declared */
+#define SNVM_ERR_UNDEFINED (-110) /* Name not declared */
+#define SNVM_ERR_CONSTANT  (-111) /* Constant can not be assigned */
+#define SNVM_ERR_LENGTH    (-112) /* Vector length does not match */
+#define SNVM_ERR_IMAGE     (-113) /* Image could not be written */
+
+/*
+ * Value types.
+ */
+#define SNVAL_NULL   (0)  /* No value */
+#define SNVAL_INT    (1)  /* Integer, in v.i */
+#define SNVAL_FLOAT  (2)  /* Floating-point number, in v.f */
+#define SNVAL_STRING (3)  /* Nul-terminated string, in v.pStr */
+#define SNVAL_OBJECT (4)  /* Heap object, in v.pObj */
+#define SNVAL_VECTOR (5)  /* Vector of doubles, in v.pObj */
+
+/*
+ * The SNOBJ structure prototype.
+ * 
+ * The actual structure definition is given in the implementation file.
+ */
+struct SNOBJ_TAG;
+typedef struct SNOBJ_TAG SNOBJ;
+
+/*
+ * A value on the runtime stack.
+ */
+typedef struct {
+  
+  /*
+   * The type of value, which is one of the SNVAL_ constants.
+   */
+  int type;
+  
+  /*
+   * The value itself, in the field selected by the type.
+   * 
+   * String literals of a program point into the program, so they remain
+   * valid until the program is freed.  Objects are in the heap of the
+   * runtime, see snvm_new().
+   * 
+   * A vector is an object without slots whose data holds the elements
+   * as an array of double, so the length is snobj_bytes() divided by
+   * sizeof(double).  Vectors are never changed once they are on the
+   * stack.  Vector literals point into the program, like strings.
+   */
+  union {
+    long i;
+    double f;
+    const char *pStr;
+    SNOBJ *pObj;
+  } v;
+  
+} SNVAL;
+
+/*
+ * The SNVM structure prototype.
+ * 
+ * The actual structure definition is given in the implementation file.
+ */
+struct SNVM_TAG;
+typedef struct SNVM_TAG SNVM;
+
+/*
+ * The SNVMPROG structure prototype.
+ * 
+ * The actual structure definition is given in the implementation file.
+ */
+struct SNVMPROG_TAG;
+typedef struct SNVMPROG_TAG SNVMPROG;
+
+/*
+ * Allocate a runtime.
+ * 
+ * A runtime holds a registry of operations and a value stack.  The
+ * stack is empty and no operations are registered at first.
+ * 
+ * The runtime should eventually be freed with snvm_free().
+ * 
+ * Return:
+ * 
+ *   a new runtime
+ */
+SNVM *snvm_alloc(void);
+
+/*
+ * Free a runtime.
+ * 
+ * This call is ignored if NULL is passed.  Programs compiled against the
+ * runtime remain valid and may be run on other runtimes.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime to free, or NULL
+ */
+void snvm_free(SNVM *pVM);
+
+/*
+ * Register a native operation with a runtime.
+ * 
+ * pName is the name of the operation.  When a program runs the
+ * operation, pfOp is called with the runtime and pCustom.  It uses
+ * snvm_pop() and snvm_push() to work with the stack, and returns zero
+ * if successful or a negative error code, which stops the program.
+ * Operations may use the SNVM_ERR_ constants or their own codes, which
+ * must be less than -1000.
+ * 
+ * pops and pushes declare the stack effect of the operation, as for
+ * snanalyzer_effect().  Either may be SNEFFECT_ANY.  Groups that are
+ * proven by the stack effect analyzer are compiled without a runtime
+ * depth check, so the declared effect must be accurate.
+ * 
+ * Registering a name again replaces the operation.  Programs that have
+ * already been compiled are not affected.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pName - the nul-terminated operation name
+ * 
+ *   pfOp - the native callback
+ * 
+ *   pCustom - passed through to the callback
+ * 
+ *   pops - the number of values popped, or SNEFFECT_ANY
+ * 
+ *   pushes - the number of values pushed, or SNEFFECT_ANY
+ */
+void snvm_op(
+    SNVM       * pVM,
+    const char * pName,
+    int (*pfOp)(SNVM *, void *),
+    void       * pCustom,
+    int          pops,
+    int          pushes);
+
+/*
+ * Declare that a registered operation is pure.
+ * 
+ * A pure operation only works with the stack, always has the same
+ * result for the same values, and can safely be called by several
+ * threads at once on different runtimes.  Array elements that only use
+ * literals and pure operations can be evaluated in parallel.  See
+ * snvm_threads() for further information.
+ * 
+ * The operation must already be registered, or a fault occurs.  As for
+ * snvm_op(), programs that have already been compiled are not affected.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pName - the nul-terminated operation name
+ */
+void snvm_pure(SNVM *pVM, const char *pName);
+
+/*
+ * Set the number of worker threads a runtime uses to evaluate arrays in
+ * parallel.
+ * 
+ * This is only available if the module was compiled with SNVM_THREADS
+ * defined.  Otherwise, zero is returned and arrays are always evaluated
+ * in order.
+ * 
+ * When a program runs an array that was marked for parallel evaluation
+ * and the runtime has workers, the elements are spread over the workers
+ * and the calling thread, each of which runs elements on a runtime of
+ * its own.  Threads that run out of elements steal half of the remaining
+ * elements of another thread.  Each element is a group, so it starts
+ * with an empty stack and must leave exactly one value.  The results are
+ * then pushed in element order, followed by the element count, so the
+ * stack ends up exactly as if the array had been evaluated in order.
+ * Objects the elements created are moved into the heap of the runtime.
+ * If an element fails, the results of the elements before it are
+ * pushed, and the runtime evaluates that element and the ones after it
+ * again in order.  The stack and the error that snvm_run() reports are
+ * therefore also the same as if the array had been evaluated in order.
+ * 
+ * Arrays within parallel elements are evaluated in order by the thread
+ * that runs the element.
+ * 
+ * count is the number of worker threads in addition to the calling
+ * thread, or zero to stop any workers.  Calling this again replaces the
+ * workers.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   count - the number of worker threads, or zero
+ * 
+ * Return:
+ * 
+ *   non-zero if the runtime now has workers, zero otherwise
+ */
+int snvm_threads(SNVM *pVM, int count);
+
+/*
+ * Register the built-in numeric operations with a runtime.
+ * 
+ * The operations work on numbers, which are SNVAL_INT or SNVAL_FLOAT,
+ * and on vectors, which are SNVAL_VECTOR.  They are all pure, and are
+ * registered with these names and stack effects:
+ * 
+ *   vector (n values, count -- vector) converts an array into a vector
+ * 
+ *   elements (vector -- n values, count) converts a vector back into an
+ *   array of floating-point numbers
+ * 
+ *   length (vector -- count) gets the number of elements
+ * 
+ *   add, sub, mul, div (a b -- c) work element by element.  Either side
+ *   may be a number, which is applied to every element of the other
+ *   side.  Vectors on both sides must have the same length.  Numbers on
+ *   both sides give an integer if both are integers, except for div.
+ * 
+ *   scale (a b -- c) is the same as mul
+ * 
+ *   neg, abs (a -- b) work element by element
+ * 
+ *   dot (a b -- x) is the dot product of two vectors of the same length
+ * 
+ *   sum, min, max (a -- x) reduce a vector to a floating-point number.
+ *   min and max of an empty vector are SNVM_ERR_LENGTH.
+ * 
+ * Wrong value types are SNVM_ERR_TYPE.  Vector results are allocated in
+ * the heap of the runtime.  The kernels are plain loops over contiguous
+ * arrays of double, which compilers can vectorize.
+ * 
+ * Operations registered earlier with the same names are replaced, so
+ * clients should register their own operations afterwards.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ */
+void snvm_numeric(SNVM *pVM);
+
+/*
+ * Compile a Shastina document into a program.
+ * 
+ * The document is read from pIn up to and including the |; token.  Each
+ * entity is translated as follows:
+ * 
+ *   STRING entities push a string.  Only strings without a prefix are
+ *   supported, and the string data is used as is.
+ * 
+ *   NUMERIC entities push an integer if they are decimal or hexadecimal
+ *   ("0x") integers that fit in a long, or else a floating-point number
+ *   if the whole literal can be read by strtod().  Decimal integers that
+ *   are too large for a long are therefore pushed as floating-point
+ *   numbers, while hexadecimal integers that are too large are invalid.
+ * 
+ *   OPERATION entities call the operation registered with that name at
+ *   the time of compilation.  The callback is resolved now, so programs
+ *   do not look up names while running.
+ * 
+ *   BEGIN_GROUP and END_GROUP entities perform the grouping check of the
+ *   specification, unless the stack effect analyzer proves the group.
+ *   If it proves that a group is wrong, compilation fails with the error
+ *   code of the analyzer.
+ * 
+ *   ARRAY entities push the element count as an integer.  Arrays with
+ *   many elements that only use literals and pure operations (see
+ *   snvm_pure()) are marked for parallel evaluation.
+ * 
+ *   An array whose elements are all single numeric literals, followed
+ *   by the "vector" operation of snvm_numeric(), is compiled into a
+ *   single vector literal.  The elements go straight into typed storage
+ *   in the program, and are never pushed one by one.
+ * 
+ *   VARIABLE and CONSTANT entities pop a value and declare a name with
+ *   it, ASSIGN entities pop a value into a declared variable, and GET
+ *   entities push the value of a declared variable or constant.  Since
+ *   programs run straight through, names are resolved now.  Declaring a
+ *   name twice is SNVM_ERR_REDEFINE, using a name before it is declared
+ *   is SNVM_ERR_UNDEFINED, and assigning a constant is SNVM_ERR_CONSTANT.
+ *   The dictionary belongs to a single run of the program.
+ * 
+ *   Names that the program uses without declaring them are looked up
+ *   in the global dictionary of the runtime, which holds the names
+ *   kept by snvm_define().  Such names are imported, so the program
+ *   gets their values when it starts, and the global variables get
+ *   the values the program leaves in them when it ends.
+ * 
+ *   Metacommands are ignored.  Other entities are not supported.
+ * 
+ * Literals are stored in a constant pool inside the program.
+ * 
+ * If compilation fails, NULL is returned.  If pErr is not NULL, it
+ * receives the error code, which may be an SNERR_ or an SNVM_ERR_ code.
+ * If pLine is not NULL, it receives the line number of the error.  Both
+ * are set to zero on success.
+ * 
+ * The returned program should eventually be freed with snvmprog_free().
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime whose registered operations are used
+ * 
+ *   pIn - the source to compile
+ * 
+ *   pErr - pointer to receive the error code, or NULL
+ * 
+ *   pLine - pointer to receive the error line, or NULL
+ * 
+ * Return:
+ * 
+ *   the compiled program, or NULL if there was an error
+ */
+SNVMPROG *snvm_compile(
+    const SNVM * pVM,
+    SNSOURCE   * pIn,
+    int        * pErr,
+    long       * pLine);
+
+/*
+ * Free a program.
+ * 
+ * This call is ignored if NULL is passed.
+ * 
+ * Parameters:
+ * 
+ *   pProg - the program to free, or NULL
+ */
+void snvmprog_free(SNVMPROG *pProg);
+
+/*
+ * Translate a program into machine code.
+ * 
+ * This is only available if the module was compiled with SNVM_JIT
+ * defined, for x86-64 on a POSIX system.  Otherwise, and if the
+ * translation is not possible, zero is returned and the program is
+ * still run by the interpreter.  Calling this more than once has no
+ * further effect.
+ * 
+ * The translation uses one machine code template per instruction.
+ * Literal pushes are inlined into the code, and operations, group
+ * checks, and stack growth are direct calls.  There is no dispatch
+ * between instructions.  Results and errors are exactly the same as
+ * with the interpreter.
+ * 
+ * Parameters:
+ * 
+ *   pProg - the program
+ * 
+ * Return:
+ * 
+ *   non-zero if the program now runs as machine code, zero otherwise
+ */
+int snvmprog_jit(SNVMPROG *pProg);
+
+/*
+ * Run a program on a runtime.
+ * 
+ * The program starts with whatever is on the stack of the runtime, so
+ * clients can push input values first and pop results afterwards.  The
+ * stack is not cleared between runs.  A program may be run on any
+ * runtime, any number of times, and by several threads at once on
+ * different runtimes.
+ * 
+ * If the program stops with an error, the stack is left as it was at
+ * the point of the error, except that any groups the program opened are
+ * closed.  If pLine is not NULL, it receives the line number in the
+ * compiled document of the entity that failed, or zero on success.
+ * 
+ * When the run ends, successfully or not, imported global variables
+ * are updated, the dictionary is discarded, and the heap is reclaimed,
+ * keeping only objects that can be reached from the stack and the
+ * global dictionary.  See snvm_new() for further information.
+ * Imported names that the global dictionary of the runtime lacks start
+ * out null and are not stored anywhere.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pProg - the program
+ * 
+ *   pLine - pointer to receive the error line, or NULL
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+int snvm_run(SNVM *pVM, const SNVMPROG *pProg, long *pLine);
+
+/*
+ * Run a program on a runtime and keep its dictionary.
+ * 
+ * This is the same as snvm_run(), except that if the run is successful,
+ * each name that the program declared is added to the global dictionary
+ * of the runtime with its final value, so that programs compiled later
+ * can use it.  Names that are already in the global dictionary are
+ * replaced.  This is how bootstrap documents set up the dictionary of a
+ * long-running interpreter.
+ * 
+ * String values point into the program, so the program must not be
+ * freed while they are in use, as for the stack.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pProg - the program
+ * 
+ *   pLine - pointer to receive the error line, or NULL
+ * 
+ * Return:
+ * 
+ *   zero if successful, or a negative error code
+ */
+int snvm_define(SNVM *pVM, const SNVMPROG *pProg, long *pLine);
+
+/*
+ * Write a snapshot image of a runtime.
+ * 
+ * The image holds the whole stack, the global dictionary, everything in
+ * the heap they refer to, and the strings they use.  Pointers are
+ * written as offsets, so the image can be loaded anywhere.  The heap is
+ * collected first, so only reachable objects are written, and they are
+ * laid out exactly as they will be in the heap of the runtime that
+ * restores them.
+ * 
+ * The stamp is stored in the image and must match when restoring, so
+ * that stale images are rejected.  It would typically be a hash of the
+ * bootstrap documents, see snvm_boot().  The registered operations are
+ * not part of the image.
+ * 
+ * This must not be called while a program is running on the runtime.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pOut - the binary file to write the image to
+ * 
+ *   stamp - the stamp of the image
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if there was an I/O error
+ */
+int snvm_save(SNVM *pVM, FILE *pOut, unsigned long stamp);
+
+/*
+ * Restore a snapshot image written by snvm_save().
+ * 
+ * The image is read in full.  Its heap is relocated in place and then
+ * adopted as part of the old generation, without copying any objects.
+ * The stack of the runtime is replaced by the stack of the image, and
+ * the names of the image are added to the global dictionary, replacing
+ * names that are already there.  Strings of the image are kept until
+ * the runtime is freed.
+ * 
+ * The image is rejected if it was not written by this module on the
+ * same kind of platform, if it is damaged, or if its stamp does not
+ * match.  The runtime is not changed in that case.  An image counts as
+ * damaged if any object header is invalid or does not fit in the heap,
+ * or if any reference does not point at the start of an object of the
+ * right kind.
+ * 
+ * This must not be called while a program is running on the runtime.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pIn - the binary file to read the image from
+ * 
+ *   stamp - the stamp the image must have
+ * 
+ * Return:
+ * 
+ *   non-zero if the image was restored, zero if it was rejected
+ */
+int snvm_restore(SNVM *pVM, FILE *pIn, unsigned long stamp);
+
+/*
+ * Start a runtime from a bootstrap document, using a snapshot image to
+ * skip running it when possible.
+ * 
+ * The bootstrap document is read from the file at pSource, and its
+ * stamp is computed by hashing its contents.  If the file at pImage is
+ * an image with that stamp, it is restored with snvm_restore().
+ * Otherwise, the document is compiled and run with snvm_define(), and
+ * a new image is written to pImage with snvm_save().
+ * 
+ * When the document is run, the program is kept until the runtime is
+ * freed, since string values may point into it.  If the document fails,
+ * the error is returned and no image is written.  If only writing the
+ * image fails, SNVM_ERR_IMAGE is returned but the runtime is ready all
+ * the same, and any partial image is removed.
+ * 
+ * If pLine is not NULL, it receives the line number of a compilation or
+ * run error, or zero otherwise.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime, with its operations registered
+ * 
+ *   pSource - the path to the bootstrap document
+ * 
+ *   pImage - the path to the image
+ * 
+ *   pLine - pointer to receive the error line, or NULL
+ * 
+ * Return:
+ * 
+ *   zero if successful, SNERR_IOERR if the document can not be read, or
+ *   another negative error code
+ */
+int snvm_boot(
+    SNVM       * pVM,
+    const char * pSource,
+    const char * pImage,
+    long       * pLine);
+
+/*
+ * Allocate an object in the heap of a runtime.
+ * 
+ * Operations use objects to build complex values out of simpler ones.
+ * An object has count value slots, which start out as SNVAL_NULL, and
+ * bytes bytes of data, which start out as zero.  Use snobj_slots() and
+ * snobj_data() to fill them in.  Objects are referred to by values of
+ * type SNVAL_OBJECT.
+ * 
+ * The heap has two generations.  New objects are allocated in the
+ * nursery by bumping a pointer.  When the nursery has grown large, the
+ * next VARIABLE, CONSTANT, or ASSIGN entity collects it: objects that
+ * can be reached from the stack, the variables, or the constants are
+ * moved to the old generation, and the rest of the nursery is freed in
+ * bulk.  When the run of the document ends, everything that can not be
+ * reached from the stack is freed in bulk.  Temporary objects are
+ * therefore never freed one by one.
+ * 
+ * Since objects move, a pointer to an object is only valid until the
+ * next collection.  Operations must not keep object pointers anywhere
+ * but on the stack, and objects that are on the stack or in the
+ * dictionary should not be changed, except to fill in slots with values
+ * created before the object.  Clients that pop objects after a run must
+ * copy what they need before running again.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   count - the number of value slots
+ * 
+ *   bytes - the number of data bytes
+ * 
+ * Return:
+ * 
+ *   the new object
+ */
+SNOBJ *snvm_new(SNVM *pVM, long count, long bytes);
+
+/*
+ * Get the value slots of an object.
+ * 
+ * Parameters:
+ * 
+ *   pObj - the object
+ * 
+ * Return:
+ * 
+ *   the array of slots, which has snobj_count() elements
+ */
+SNVAL *snobj_slots(SNOBJ *pObj);
+
+/*
+ * Get the number of value slots of an object.
+ * 
+ * Parameters:
+ * 
+ *   pObj - the object
+ * 
+ * Return:
+ * 
+ *   the number of slots
+ */
+long snobj_count(const SNOBJ *pObj);
+
+/*
+ * Get the data bytes of an object.
+ * 
+ * Parameters:
+ * 
+ *   pObj - the object
+ * 
+ * Return:
+ * 
+ *   the data, which has snobj_bytes() bytes
+ */
+unsigned char *snobj_data(SNOBJ *pObj);
+
+/*
+ * Get the number of data bytes of an object.
+ * 
+ * Parameters:
+ * 
+ *   pObj - the object
+ * 
+ * Return:
+ * 
+ *   the number of bytes
+ */
+long snobj_bytes(const SNOBJ *pObj);
+
+/*
+ * Push a value on the stack of a runtime.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pVal - the value to push
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNVM_ERR_OVERFLOW if the stack is full
+ */
+int snvm_push(SNVM *pVM, const SNVAL *pVal);
+
+/*
+ * Pop a value from the stack of a runtime.
+ * 
+ * Within a group, values that were on the stack when the group began
+ * are hidden and can not be popped.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ *   pVal - receives the value
+ * 
+ * Return:
+ * 
+ *   zero if successful, or SNVM_ERR_UNDERFLOW if there is no visible
+ *   value to pop
+ */
+int snvm_pop(SNVM *pVM, SNVAL *pVal);
+
+/*
+ * Get the number of visible values on the stack of a runtime.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ * 
+ * Return:
+ * 
+ *   the number of values that can be popped
+ */
+long snvm_depth(const SNVM *pVM);
+
+/*
+ * Remove all visible values from the stack of a runtime.
+ * 
+ * Parameters:
+ * 
+ *   pVM - the runtime
+ */
+void snvm_clear(SNVM *pVM);
+
+/*
+ * Convert an error code into a string.
+ * 
+ * Both SNVM_ERR_ and SNERR_ codes are supported.
+ * 
+ * Parameters:
+ * 
+ *   code - the error code
+ * 
+ * Return:
+ * 
+ *   an error message
+ */
+const char *snvm_errstr(int code);
+
+#endif